@@ -10,15 +10,25 @@ const AllCSources = [_][]const u8{
     "src/opt/pipeline.c",        "src/opt/sccp.c",          "src/opt/dce.c",
     "src/opt/value_numbering.c", "src/opt/licm.c",          "src/opt/copy_prop.c",
     "src/opt/cse.c",             "src/opt/peephole.c",      "src/opt/inline.c",
-    "src/opt/loop_opt.c",        "src/codegen/c_emit.c",    "src/codegen/context.c",
-    "src/codegen/expr.c",        "src/codegen/stmt.c",      "src/codegen/codegen.c",
-    "src/codegen/backend.c",     "src/codegen/module.c",
+    "src/opt/loop_opt.c",        "src/opt/vrp.c",           "src/codegen/c_emit.c",
+    "src/codegen/context.c",     "src/codegen/expr.c",      "src/codegen/stmt.c",
+    "src/codegen/codegen.c",     "src/codegen/backend.c",   "src/codegen/module.c",
+    "src/codegen/bounds.c",      "src/opt/interprocedural.c", "src/codegen/reach.c",
+    "src/codegen/memo.c",        "src/opt/profile.c",       "src/codegen/profile.c",
+    "src/codegen/hints.c",       "src/codegen/switch.c",    "src/codegen/consteval.c",
+    "src/codegen/strlit.c",      "src/codegen/owner.c",     "src/codegen/escape.c",
+    "src/codegen/coro.c",
 };
 
 /// Baseline runtime sources always compiled
 const BaseRuntimeSources = [_][]const u8{
     "src/runtime/memory/memory.c", "src/runtime/io/console.c",   "src/runtime/extensions/custom.c",
-    "src/runtime/system/task.c",   "src/runtime/exceptions/exception.c",
+    "src/runtime/system/task.c",   "src/runtime/system/scheduler.c",
+    "src/runtime/system/eventloop.c",
+    "src/runtime/exceptions/exception.c",
+    "src/runtime/memory/memo.c",   "src/runtime/system/profile.c",
+    "src/runtime/memory/drstring.c", "src/runtime/memory/slab.c",
+    "src/runtime/memory/region.c", "src/runtime/memory/allocprof.c",
 };
 
 const CFLAGS = [_][]const u8{
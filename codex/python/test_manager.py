@@ -286,10 +286,12 @@ class TestManager:
         # Runtime sources moved into subdirectories; use new paths
         runtime_files = [
             "src/runtime/memory/memory.c",
+            "src/runtime/memory/memo.c",
             "src/runtime/io/console.c",
             "src/runtime/extensions/custom.c",
             "src/runtime/exceptions/exception.c",
             "src/runtime/system/task.c",
+            "src/runtime/system/profile.c",
         ]
         
         cc_cmd = [
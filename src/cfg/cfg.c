@@ -196,8 +196,11 @@ void cfg_compute_dominators(CFG *cfg) {
   struct UF *uf = calloc(n + 1, sizeof(struct UF));
 
   int idx = 0;
-  for (size_t i = 0; i < n; i++)
+  for (size_t i = 0; i < n; i++) {
     cfg->blocks[i]->dfnum = 0;
+    cfg->blocks[i]->idom = NULL;
+    cfg->blocks[i]->ndf = 0;
+  }
   dfs(cfg->entry, vertex, parent, semi, &idx);
   for (int i = 1; i <= idx; i++)
     uf[i].label = i;
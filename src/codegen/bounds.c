@@ -0,0 +1,794 @@
+#include "bounds.h"
+#include "../opt/vrp.h"
+#include "codegen.h"
+#include "expr.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* A variable written inside a statement, with the direction of the writes. */
+typedef struct {
+  const char *start;
+  size_t len;
+  int dir; /* 1 only increments, -1 only decrements, 0 anything else */
+} Write;
+
+typedef struct {
+  Write *items;
+  size_t len;
+  size_t cap;
+} WriteList;
+
+/* Range assigned by the simple statement being emitted, applied at its end. */
+static struct {
+  int active;
+  const char *start;
+  size_t len;
+  ValueRange range;
+} g_pending;
+
+static int enabled(void) { return cg_options.bounds_check; }
+
+static int slice_eq(const char *a, size_t alen, const char *b, size_t blen) {
+  return alen == blen && strncmp(a, b, alen) == 0;
+}
+
+static int is_int_var(CGCtx *ctx, const char *s, size_t n) {
+  return cgctx_lookup(ctx, s, n) == TK_KW_INT &&
+         cgctx_lookup_array_len(ctx, s, n) == 0;
+}
+
+/* ---- fact table ---------------------------------------------------------- */
+
+static CGRangeFact *find_fact(CGCtx *ctx, const char *s, size_t n) {
+  for (size_t i = ctx->nfacts; i-- > 0;) {
+    CGRangeFact *f = &ctx->facts[i];
+    if (!f->dead && slice_eq(f->start, f->len, s, n))
+      return f;
+  }
+  return NULL;
+}
+
+static ValueRange var_range(CGCtx *ctx, const char *s, size_t n) {
+  CGRangeFact *f = find_fact(ctx, s, n);
+  if (!f)
+    return range_full();
+  return (ValueRange){.lo = f->lo, .hi = f->hi, .empty = false};
+}
+
+static void add_fact(CGCtx *ctx, const char *s, size_t n, ValueRange r) {
+  if (!is_int_var(ctx, s, n))
+    return;
+  r = range_meet(r, var_range(ctx, s, n));
+  if (r.empty || (r.lo <= INT_MIN && r.hi >= INT_MAX))
+    return;
+  if (ctx->nfacts + 1 > ctx->facts_cap) {
+    ctx->facts_cap = ctx->facts_cap ? ctx->facts_cap * 2 : 16;
+    ctx->facts = realloc(ctx->facts, ctx->facts_cap * sizeof(CGRangeFact));
+  }
+  ctx->facts[ctx->nfacts++] = (CGRangeFact){s, n, r.lo, r.hi, 0};
+}
+
+static void kill_var(CGCtx *ctx, const char *s, size_t n) {
+  for (size_t i = 0; i < ctx->nfacts; i++) {
+    if (slice_eq(ctx->facts[i].start, ctx->facts[i].len, s, n))
+      ctx->facts[i].dead = 1;
+  }
+}
+
+size_t cg_bounds_mark(CGCtx *ctx) { return ctx->nfacts; }
+
+void cg_bounds_restore(CGCtx *ctx, size_t mark) {
+  if (mark < ctx->nfacts)
+    ctx->nfacts = mark;
+}
+
+/* ---- AST helpers --------------------------------------------------------- */
+
+static int int_literal(Node *n, long long *out) {
+  if (!n || n->kind != ND_INT || n->as.lit.len >= 32)
+    return 0;
+  char buf[32];
+  memcpy(buf, n->as.lit.start, n->as.lit.len);
+  buf[n->as.lit.len] = '\0';
+  *out = strtoll(buf, NULL, 0);
+  return 1;
+}
+
+static IROp arith_op(TokenKind tk) {
+  switch (tk) {
+  case TK_PLUS: return IR_ADD;
+  case TK_MINUS: return IR_SUB;
+  case TK_STAR: return IR_MUL;
+  case TK_SLASH: return IR_DIV;
+  case TK_PERCENT: return IR_MOD;
+  case TK_AND: return IR_AND;
+  case TK_OR: return IR_OR;
+  case TK_CARET: return IR_XOR;
+  case TK_LSHIFT: return IR_SHL;
+  case TK_RSHIFT: return IR_SHR;
+  case TK_LT: return IR_LT;
+  case TK_LTEQ: return IR_LE;
+  case TK_GT: return IR_GT;
+  case TK_GTEQ: return IR_GE;
+  case TK_EQEQ: return IR_EQ;
+  case TK_NEQ: return IR_NE;
+  default: return IR_NOP;
+  }
+}
+
+static ValueRange eval_range(CGCtx *ctx, Node *n) {
+  long long v;
+  if (int_literal(n, &v))
+    return range_const(v);
+  if (!n)
+    return range_full();
+  switch (n->kind) {
+  case ND_IDENT:
+    if (!is_int_var(ctx, n->as.ident.start, n->as.ident.len))
+      return range_full();
+    return var_range(ctx, n->as.ident.start, n->as.ident.len);
+  case ND_UNARY:
+    if (n->as.unary.op == TK_MINUS)
+      return range_binop(IR_SUB, range_const(0), eval_range(ctx, n->as.unary.expr));
+    return range_full();
+  case ND_BINOP: {
+    IROp op = arith_op(n->as.bin.op);
+    if (op == IR_NOP)
+      return range_full();
+    return range_binop(op, eval_range(ctx, n->as.bin.lhs),
+                       eval_range(ctx, n->as.bin.rhs));
+  }
+  default:
+    return range_full();
+  }
+}
+
+static void visit_children(Node *n, void (*fn)(Node *, void *), void *ud) {
+  switch (n->kind) {
+  case ND_UNARY:
+  case ND_POST_UNARY:
+    fn(n->as.unary.expr, ud);
+    break;
+  case ND_BINOP:
+    fn(n->as.bin.lhs, ud);
+    fn(n->as.bin.rhs, ud);
+    break;
+  case ND_COND:
+    fn(n->as.cond.cond, ud);
+    fn(n->as.cond.then_expr, ud);
+    fn(n->as.cond.else_expr, ud);
+    break;
+  case ND_INDEX:
+    fn(n->as.index.array, ud);
+    fn(n->as.index.index, ud);
+    break;
+  case ND_FIELD:
+    fn(n->as.field.object, ud);
+    break;
+  case ND_VAR_DECL:
+    fn(n->as.var_decl.init, ud);
+    break;
+  case ND_IF:
+    fn(n->as.if_stmt.cond, ud);
+    fn(n->as.if_stmt.then_br, ud);
+    fn(n->as.if_stmt.else_br, ud);
+    break;
+  case ND_WHILE:
+    fn(n->as.while_stmt.cond, ud);
+    fn(n->as.while_stmt.body, ud);
+    break;
+  case ND_DO_WHILE:
+    fn(n->as.do_while_stmt.body, ud);
+    fn(n->as.do_while_stmt.cond, ud);
+    break;
+  case ND_FOR:
+    fn(n->as.for_stmt.init, ud);
+    fn(n->as.for_stmt.cond, ud);
+    fn(n->as.for_stmt.update, ud);
+    fn(n->as.for_stmt.body, ud);
+    break;
+  case ND_BLOCK:
+    for (size_t i = 0; i < n->as.block.len; i++)
+      fn(n->as.block.items[i], ud);
+    break;
+  case ND_EXPR_STMT:
+    fn(n->as.expr_stmt.expr, ud);
+    break;
+  case ND_RETURN:
+    fn(n->as.ret.expr, ud);
+    break;
+  case ND_SWITCH:
+    fn(n->as.switch_stmt.expr, ud);
+    for (size_t i = 0; i < n->as.switch_stmt.len; i++) {
+      fn(n->as.switch_stmt.cases[i].value, ud);
+      fn(n->as.switch_stmt.cases[i].body, ud);
+    }
+    break;
+  case ND_CONSOLE_CALL:
+    fn(n->as.console.arg, ud);
+    break;
+  case ND_CALL:
+    fn(n->as.call.callee, ud);
+    for (size_t i = 0; i < n->as.call.len; i++)
+      fn(n->as.call.args[i], ud);
+    break;
+  case ND_NEW:
+    for (size_t i = 0; i < n->as.new_expr.arg_len; i++)
+      fn(n->as.new_expr.args[i], ud);
+    break;
+  case ND_TRY:
+    fn(n->as.try_stmt.body, ud);
+    fn(n->as.try_stmt.catch_body, ud);
+    fn(n->as.try_stmt.finally_body, ud);
+    break;
+  case ND_THROW:
+    fn(n->as.throw_stmt.expr, ud);
+    break;
+  case ND_AWAIT:
+    fn(n->as.await_expr.expr, ud);
+    break;
+  case ND_REGION:
+    fn(n->as.region.body, ud);
+    break;
+  default:
+    break;
+  }
+}
+
+/* ---- write collection ---------------------------------------------------- */
+
+static void add_write(WriteList *w, const char *s, size_t n, int dir) {
+  for (size_t i = 0; i < w->len; i++) {
+    if (slice_eq(w->items[i].start, w->items[i].len, s, n)) {
+      if (w->items[i].dir != dir)
+        w->items[i].dir = 0;
+      return;
+    }
+  }
+  if (w->len + 1 > w->cap) {
+    w->cap = w->cap ? w->cap * 2 : 8;
+    w->items = realloc(w->items, w->cap * sizeof(Write));
+  }
+  w->items[w->len++] = (Write){s, n, dir};
+}
+
+static int is_written(const WriteList *w, const char *s, size_t n) {
+  for (size_t i = 0; i < w->len; i++) {
+    if (slice_eq(w->items[i].start, w->items[i].len, s, n))
+      return 1;
+  }
+  return 0;
+}
+
+/* Classifies "x op= rhs" as an increment (1), decrement (-1) or other (0). */
+static int write_dir(Node *n) {
+  long long c;
+  Node *lhs = n->as.bin.lhs, *rhs = n->as.bin.rhs;
+  if (n->as.bin.op == TK_PLUSEQ && int_literal(rhs, &c))
+    return c > 0 ? 1 : (c < 0 ? -1 : 0);
+  if (n->as.bin.op == TK_MINUSEQ && int_literal(rhs, &c))
+    return c > 0 ? -1 : (c < 0 ? 1 : 0);
+  if (n->as.bin.op == TK_EQ && rhs->kind == ND_BINOP &&
+      rhs->as.bin.lhs->kind == ND_IDENT &&
+      slice_eq(rhs->as.bin.lhs->as.ident.start, rhs->as.bin.lhs->as.ident.len,
+               lhs->as.ident.start, lhs->as.ident.len) &&
+      int_literal(rhs->as.bin.rhs, &c) && c > 0) {
+    if (rhs->as.bin.op == TK_PLUS)
+      return 1;
+    if (rhs->as.bin.op == TK_MINUS)
+      return -1;
+  }
+  return 0;
+}
+
+static int is_assign_op(TokenKind op) {
+  switch (op) {
+  case TK_EQ:
+  case TK_PLUSEQ:
+  case TK_MINUSEQ:
+  case TK_STAREQ:
+  case TK_SLASHEQ:
+  case TK_PERCENTEQ:
+  case TK_ANDEQ:
+  case TK_OREQ:
+  case TK_XOREQ:
+  case TK_LSHIFTEQ:
+  case TK_RSHIFTEQ:
+  case TK_QMARKQMARKEQ:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+static void collect_writes(Node *n, void *ud) {
+  WriteList *w = ud;
+  if (!n || n->kind == ND_FUNC)
+    return;
+  if ((n->kind == ND_UNARY || n->kind == ND_POST_UNARY) &&
+      (n->as.unary.op == TK_PLUSPLUS || n->as.unary.op == TK_MINUSMINUS) &&
+      n->as.unary.expr->kind == ND_IDENT) {
+    add_write(w, n->as.unary.expr->as.ident.start, n->as.unary.expr->as.ident.len,
+              n->as.unary.op == TK_PLUSPLUS ? 1 : -1);
+  } else if (n->kind == ND_BINOP && is_assign_op(n->as.bin.op) &&
+             n->as.bin.lhs->kind == ND_IDENT) {
+    add_write(w, n->as.bin.lhs->as.ident.start, n->as.bin.lhs->as.ident.len,
+              write_dir(n));
+  } else if (n->kind == ND_VAR_DECL) {
+    add_write(w, n->as.var_decl.name.start, n->as.var_decl.name.len, 0);
+  }
+  visit_children(n, collect_writes, ud);
+}
+
+static void kill_writes(CGCtx *ctx, const WriteList *w) {
+  for (size_t i = 0; i < w->len; i++)
+    kill_var(ctx, w->items[i].start, w->items[i].len);
+}
+
+/* ---- facts from executed accesses ---------------------------------------- */
+
+typedef struct {
+  CGCtx *ctx;
+  const WriteList *written;
+} NoteState;
+
+/*
+ * Every access reached unconditionally by an evaluated expression has either
+ * been proven or checked, so its index lies in [0, length) afterwards.
+ */
+static void note_access(Node *n, void *ud) {
+  NoteState *st = ud;
+  if (!n || n->kind == ND_FUNC)
+    return;
+  if (n->kind == ND_BINOP &&
+      (n->as.bin.op == TK_ANDAND || n->as.bin.op == TK_OROR ||
+       n->as.bin.op == TK_QMARKQMARK)) {
+    note_access(n->as.bin.lhs, ud);
+    return;
+  }
+  if (n->kind == ND_COND) {
+    note_access(n->as.cond.cond, ud);
+    return;
+  }
+  visit_children(n, note_access, ud);
+  if (n->kind != ND_INDEX || n->as.index.array->kind != ND_IDENT)
+    return;
+  Node *arr = n->as.index.array;
+  size_t len = cgctx_lookup_array_len(st->ctx, arr->as.ident.start,
+                                      arr->as.ident.len);
+  if (!len)
+    return;
+  Node *idx = n->as.index.index;
+  long long k = 0;
+  if (idx->kind == ND_BINOP && idx->as.bin.lhs->kind == ND_IDENT &&
+      int_literal(idx->as.bin.rhs, &k) &&
+      (idx->as.bin.op == TK_PLUS || idx->as.bin.op == TK_MINUS)) {
+    if (idx->as.bin.op == TK_MINUS)
+      k = -k;
+    idx = idx->as.bin.lhs;
+  }
+  if (idx->kind != ND_IDENT ||
+      is_written(st->written, idx->as.ident.start, idx->as.ident.len))
+    return;
+  add_fact(st->ctx, idx->as.ident.start, idx->as.ident.len,
+           (ValueRange){.lo = -k, .hi = (long long)len - 1 - k, .empty = false});
+}
+
+void cg_bounds_note_expr(CGCtx *ctx, Node *expr) {
+  if (!enabled() || !expr)
+    return;
+  WriteList w = {0};
+  collect_writes(expr, &w);
+  kill_writes(ctx, &w);
+  NoteState st = {ctx, &w};
+  note_access(expr, &st);
+  free(w.items);
+}
+
+/* ---- conditions ---------------------------------------------------------- */
+
+static IROp negate_cmp(IROp op) {
+  switch (op) {
+  case IR_LT: return IR_GE;
+  case IR_LE: return IR_GT;
+  case IR_GT: return IR_LE;
+  case IR_GE: return IR_LT;
+  case IR_EQ: return IR_NE;
+  case IR_NE: return IR_EQ;
+  default: return op;
+  }
+}
+
+static IROp swap_cmp(IROp op) {
+  switch (op) {
+  case IR_LT: return IR_GT;
+  case IR_LE: return IR_GE;
+  case IR_GT: return IR_LT;
+  case IR_GE: return IR_LE;
+  default: return op;
+  }
+}
+
+/* Records that "x op y" holds. */
+static void refine(CGCtx *ctx, Node *x, IROp op, Node *y) {
+  if (x->kind != ND_IDENT)
+    return;
+  ValueRange yr = eval_range(ctx, y);
+  ValueRange bound = range_full();
+  switch (op) {
+  case IR_LT: bound.hi = yr.hi - 1; break;
+  case IR_LE: bound.hi = yr.hi; break;
+  case IR_GT: bound.lo = yr.lo + 1; break;
+  case IR_GE: bound.lo = yr.lo; break;
+  case IR_EQ: bound = yr; break;
+  default: return;
+  }
+  add_fact(ctx, x->as.ident.start, x->as.ident.len, bound);
+}
+
+void cg_bounds_assume(CGCtx *ctx, Node *cond, int truth) {
+  if (!enabled() || !cond)
+    return;
+  if (cond->kind == ND_UNARY && cond->as.unary.op == TK_BANG) {
+    cg_bounds_assume(ctx, cond->as.unary.expr, !truth);
+    return;
+  }
+  if (cond->kind != ND_BINOP)
+    return;
+  if ((cond->as.bin.op == TK_ANDAND && truth) ||
+      (cond->as.bin.op == TK_OROR && !truth)) {
+    cg_bounds_assume(ctx, cond->as.bin.lhs, truth);
+    cg_bounds_assume(ctx, cond->as.bin.rhs, truth);
+    return;
+  }
+  IROp op = arith_op(cond->as.bin.op);
+  if (op < IR_LT || op > IR_NE)
+    return;
+  if (!truth)
+    op = negate_cmp(op);
+  refine(ctx, cond->as.bin.lhs, op, cond->as.bin.rhs);
+  refine(ctx, cond->as.bin.rhs, swap_cmp(op), cond->as.bin.lhs);
+}
+
+/* ---- statements ---------------------------------------------------------- */
+
+static int is_simple_stmt(Node *n) {
+  switch (n->kind) {
+  case ND_VAR_DECL:
+  case ND_EXPR_STMT:
+  case ND_RETURN:
+  case ND_CONSOLE_CALL:
+  case ND_THROW:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+/* Computes the range stored by "x = e", "x op= c", "x++" style statements. */
+static void capture_assignment(CGCtx *ctx, Node *n) {
+  g_pending.active = 0;
+  Node *target = NULL;
+  ValueRange r = range_full();
+  if (n->kind == ND_VAR_DECL && n->as.var_decl.init &&
+      n->as.var_decl.type == TK_KW_INT && n->as.var_decl.array_len == 0) {
+    g_pending.active = 1;
+    g_pending.start = n->as.var_decl.name.start;
+    g_pending.len = n->as.var_decl.name.len;
+    g_pending.range = eval_range(ctx, n->as.var_decl.init);
+    return;
+  }
+  if (n->kind != ND_EXPR_STMT)
+    return;
+  Node *e = n->as.expr_stmt.expr;
+  if ((e->kind == ND_UNARY || e->kind == ND_POST_UNARY) &&
+      (e->as.unary.op == TK_PLUSPLUS || e->as.unary.op == TK_MINUSMINUS) &&
+      e->as.unary.expr->kind == ND_IDENT) {
+    target = e->as.unary.expr;
+    r = range_binop(e->as.unary.op == TK_PLUSPLUS ? IR_ADD : IR_SUB,
+                    eval_range(ctx, target), range_const(1));
+  } else if (e->kind == ND_BINOP && e->as.bin.lhs->kind == ND_IDENT) {
+    target = e->as.bin.lhs;
+    if (e->as.bin.op == TK_EQ)
+      r = eval_range(ctx, e->as.bin.rhs);
+    else if (e->as.bin.op == TK_PLUSEQ)
+      r = range_binop(IR_ADD, eval_range(ctx, target), eval_range(ctx, e->as.bin.rhs));
+    else if (e->as.bin.op == TK_MINUSEQ)
+      r = range_binop(IR_SUB, eval_range(ctx, target), eval_range(ctx, e->as.bin.rhs));
+    else
+      return;
+  } else {
+    return;
+  }
+  g_pending.active = 1;
+  g_pending.start = target->as.ident.start;
+  g_pending.len = target->as.ident.len;
+  g_pending.range = r;
+}
+
+size_t cg_bounds_stmt_begin(CGCtx *ctx, Node *stmt) {
+  if (!enabled())
+    return 0;
+  size_t mark = ctx->nfacts;
+  if (is_simple_stmt(stmt)) {
+    capture_assignment(ctx, stmt);
+    WriteList w = {0};
+    collect_writes(stmt, &w);
+    kill_writes(ctx, &w);
+    free(w.items);
+  } else if (stmt->kind == ND_IF || stmt->kind == ND_SWITCH) {
+    /* Writes in the header invalidate facts before the branches run. */
+    WriteList w = {0};
+    collect_writes(stmt->kind == ND_IF ? stmt->as.if_stmt.cond
+                                       : stmt->as.switch_stmt.expr,
+                   &w);
+    kill_writes(ctx, &w);
+    free(w.items);
+  }
+  return mark;
+}
+
+void cg_bounds_stmt_end(CGCtx *ctx, Node *stmt, size_t mark) {
+  if (!enabled())
+    return;
+  WriteList w = {0};
+  collect_writes(stmt, &w);
+  if (!is_simple_stmt(stmt)) {
+    cg_bounds_restore(ctx, mark);
+    kill_writes(ctx, &w);
+    free(w.items);
+    return;
+  }
+  NoteState st = {ctx, &w};
+  note_access(stmt, &st);
+  if (g_pending.active) {
+    g_pending.active = 0;
+    add_fact(ctx, g_pending.start, g_pending.len, g_pending.range);
+  }
+  free(w.items);
+}
+
+/* ---- loops --------------------------------------------------------------- */
+
+static Node *loop_cond(Node *loop) {
+  switch (loop->kind) {
+  case ND_WHILE: return loop->as.while_stmt.cond;
+  case ND_DO_WHILE: return loop->as.do_while_stmt.cond;
+  case ND_FOR: return loop->as.for_stmt.cond;
+  default: return NULL;
+  }
+}
+
+static Node *loop_body(Node *loop) {
+  switch (loop->kind) {
+  case ND_WHILE: return loop->as.while_stmt.body;
+  case ND_DO_WHILE: return loop->as.do_while_stmt.body;
+  case ND_FOR: return loop->as.for_stmt.body;
+  default: return NULL;
+  }
+}
+
+/* Identifies the variable and value set up by a for-loop initialiser. */
+static Node *init_target(Node *loop, Node **value, Slice *name) {
+  Node *init = loop->kind == ND_FOR ? loop->as.for_stmt.init : NULL;
+  if (!init)
+    return NULL;
+  if (init->kind == ND_VAR_DECL && init->as.var_decl.init &&
+      init->as.var_decl.type == TK_KW_INT) {
+    *value = init->as.var_decl.init;
+    *name = init->as.var_decl.name;
+    return init;
+  }
+  if (init->kind == ND_EXPR_STMT)
+    init = init->as.expr_stmt.expr;
+  if (init->kind == ND_BINOP && init->as.bin.op == TK_EQ &&
+      init->as.bin.lhs->kind == ND_IDENT) {
+    *value = init->as.bin.rhs;
+    *name = (Slice){init->as.bin.lhs->as.ident.start, init->as.bin.lhs->as.ident.len};
+    return init;
+  }
+  return NULL;
+}
+
+static int expr_equal(Node *a, Node *b) {
+  if (a->kind != b->kind)
+    return 0;
+  switch (a->kind) {
+  case ND_INT:
+    return slice_eq(a->as.lit.start, a->as.lit.len, b->as.lit.start, b->as.lit.len);
+  case ND_IDENT:
+    return slice_eq(a->as.ident.start, a->as.ident.len, b->as.ident.start,
+                    b->as.ident.len);
+  case ND_UNARY:
+    return a->as.unary.op == b->as.unary.op &&
+           expr_equal(a->as.unary.expr, b->as.unary.expr);
+  case ND_BINOP:
+    return a->as.bin.op == b->as.bin.op && expr_equal(a->as.bin.lhs, b->as.bin.lhs) &&
+           expr_equal(a->as.bin.rhs, b->as.bin.rhs);
+  default:
+    return 0;
+  }
+}
+
+/* True for side-effect free int expressions over variables the loop keeps. */
+static int is_invariant(CGCtx *ctx, Node *n, const WriteList *w) {
+  switch (n->kind) {
+  case ND_INT:
+    return 1;
+  case ND_IDENT:
+    return is_int_var(ctx, n->as.ident.start, n->as.ident.len) &&
+           !is_written(w, n->as.ident.start, n->as.ident.len);
+  case ND_UNARY:
+    return n->as.unary.op == TK_MINUS && is_invariant(ctx, n->as.unary.expr, w);
+  case ND_BINOP: {
+    /* Division could trap in a preheader the loop never reaches. */
+    IROp op = arith_op(n->as.bin.op);
+    return op != IR_NOP && op != IR_DIV && op != IR_MOD &&
+           is_invariant(ctx, n->as.bin.lhs, w) && is_invariant(ctx, n->as.bin.rhs, w);
+  }
+  default:
+    return 0;
+  }
+}
+
+typedef struct {
+  CGCtx *ctx;
+  COut *b;
+  const WriteList *written;
+  CGBoundsLoop *st;
+} HoistState;
+
+static void hoist_checks(Node *n, void *ud) {
+  HoistState *hs = ud;
+  CGCtx *ctx = hs->ctx;
+  if (!n || n->kind == ND_FUNC)
+    return;
+  visit_children(n, hoist_checks, ud);
+  if (n->kind != ND_INDEX || n->as.index.array->kind != ND_IDENT)
+    return;
+  Node *arr = n->as.index.array;
+  Node *idx = n->as.index.index;
+  size_t len = cgctx_lookup_array_len(ctx, arr->as.ident.start, arr->as.ident.len);
+  if (!len || is_written(hs->written, arr->as.ident.start, arr->as.ident.len) ||
+      !is_invariant(ctx, idx, hs->written))
+    return;
+  ValueRange r = eval_range(ctx, idx);
+  if (!r.empty && r.lo >= 0 && r.hi < (long long)len)
+    return;
+  for (size_t i = 0; i < ctx->nhoisted; i++) {
+    CGHoistedCheck *h = &ctx->hoisted[i];
+    if (slice_eq(h->array.start, h->array.len, arr->as.ident.start,
+                 arr->as.ident.len) &&
+        expr_equal(h->index, idx))
+      return;
+  }
+  if (!hs->st->opened) {
+    c_out_write(hs->b, "{");
+    c_out_newline(hs->b);
+    c_out_indent(hs->b);
+    hs->st->opened = 1;
+  }
+  int flag = ctx->next_check_flag++;
+  c_out_write(hs->b, "const int dr_bc_ok%d = (unsigned)(", flag);
+  cg_emit_expr(ctx, hs->b, idx);
+  c_out_write(hs->b, ") < %zuu;", len);
+  c_out_newline(hs->b);
+  if (ctx->nhoisted + 1 > ctx->hoisted_cap) {
+    ctx->hoisted_cap = ctx->hoisted_cap ? ctx->hoisted_cap * 2 : 8;
+    ctx->hoisted = realloc(ctx->hoisted, ctx->hoisted_cap * sizeof(CGHoistedCheck));
+  }
+  ctx->hoisted[ctx->nhoisted++] =
+      (CGHoistedCheck){{arr->as.ident.start, arr->as.ident.len}, idx, flag};
+}
+
+CGBoundsLoop cg_bounds_loop_begin(CGCtx *ctx, COut *b, Node *loop) {
+  CGBoundsLoop st = {0};
+  st.hoist_mark = ctx->nhoisted;
+  if (!enabled())
+    return st;
+
+  WriteList w = {0};
+  collect_writes(loop_cond(loop), &w);
+  collect_writes(loop_body(loop), &w);
+  if (loop->kind == ND_FOR)
+    collect_writes(loop->as.for_stmt.update, &w);
+
+  Node *value = NULL;
+  Slice name = {NULL, 0};
+  if (init_target(loop, &value, &name)) {
+    ValueRange r = eval_range(ctx, value);
+    st.has_init = !r.empty;
+    st.init_lo = r.lo;
+    st.init_hi = r.hi;
+    st.init_dir = 0;
+    for (size_t i = 0; i < w.len; i++) {
+      if (slice_eq(w.items[i].start, w.items[i].len, name.start, name.len))
+        st.init_dir = w.items[i].dir;
+    }
+    kill_var(ctx, name.start, name.len);
+  }
+
+  /* Monotonic variables keep one bound across iterations; the other one
+   * is lost. */
+  for (size_t i = 0; i < w.len; i++) {
+    Write *wr = &w.items[i];
+    ValueRange entry = var_range(ctx, wr->start, wr->len);
+    kill_var(ctx, wr->start, wr->len);
+    if (wr->dir > 0)
+      add_fact(ctx, wr->start, wr->len, (ValueRange){entry.lo, INT_MAX, false});
+    else if (wr->dir < 0)
+      add_fact(ctx, wr->start, wr->len, (ValueRange){INT_MIN, entry.hi, false});
+  }
+
+  if (init_target(loop, &value, &name))
+    add_write(&w, name.start, name.len, 0);
+  /* A coroutine resuming inside the loop would skip the preheader. */
+  HoistState hs = {ctx, b, &w, &st};
+  if (!ctx->coro) {
+    hoist_checks(loop_cond(loop), &hs);
+    hoist_checks(loop_body(loop), &hs);
+    if (loop->kind == ND_FOR)
+      hoist_checks(loop->as.for_stmt.update, &hs);
+  }
+  free(w.items);
+  return st;
+}
+
+size_t cg_bounds_loop_body(CGCtx *ctx, Node *loop, const CGBoundsLoop *st) {
+  size_t mark = ctx->nfacts;
+  if (!enabled())
+    return mark;
+  Node *value = NULL;
+  Slice name = {NULL, 0};
+  if (st->has_init && init_target(loop, &value, &name)) {
+    if (st->init_dir > 0)
+      add_fact(ctx, name.start, name.len,
+               (ValueRange){.lo = st->init_lo, .hi = INT_MAX, .empty = false});
+    else if (st->init_dir < 0)
+      add_fact(ctx, name.start, name.len,
+               (ValueRange){.lo = INT_MIN, .hi = st->init_hi, .empty = false});
+  }
+  if (loop->kind != ND_DO_WHILE) {
+    cg_bounds_note_expr(ctx, loop_cond(loop));
+    cg_bounds_assume(ctx, loop_cond(loop), 1);
+  }
+  return mark;
+}
+
+void cg_bounds_loop_end(CGCtx *ctx, COut *b, const CGBoundsLoop *st) {
+  ctx->nhoisted = st->hoist_mark;
+  if (st->opened) {
+    c_out_dedent(b);
+    c_out_write(b, "}");
+    c_out_newline(b);
+  }
+}
+
+/* ---- accesses ------------------------------------------------------------ */
+
+CGBoundsCheck cg_bounds_classify(CGCtx *ctx, Node *n) {
+  CGBoundsCheck chk = {CG_BOUNDS_NONE, 0, 0};
+  if (!enabled() || n->as.index.array->kind != ND_IDENT)
+    return chk;
+  Node *arr = n->as.index.array;
+  size_t len = cgctx_lookup_array_len(ctx, arr->as.ident.start, arr->as.ident.len);
+  if (!len)
+    return chk;
+  ValueRange r = eval_range(ctx, n->as.index.index);
+  if (!r.empty && r.lo >= 0 && r.hi < (long long)len)
+    return chk;
+  chk.length = len;
+  for (size_t i = ctx->nhoisted; i-- > 0;) {
+    CGHoistedCheck *h = &ctx->hoisted[i];
+    if (slice_eq(h->array.start, h->array.len, arr->as.ident.start,
+                 arr->as.ident.len) &&
+        expr_equal(h->index, n->as.index.index)) {
+      chk.kind = CG_BOUNDS_HOISTED;
+      chk.flag = h->flag;
+      return chk;
+    }
+  }
+  chk.kind = CG_BOUNDS_CHECK;
+  return chk;
+}
@@ -0,0 +1,63 @@
+#ifndef CG_BOUNDS_H
+#define CG_BOUNDS_H
+
+#include "../parser/ast.h"
+#include "c_emit.h"
+#include "context.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Array bounds checking for --bounds-check.
+ *
+ * While statements are emitted, the value ranges of int locals are tracked
+ * from constant initialisers, assignments, loop induction variables and
+ * branch conditions. A successful check also proves its index in range for
+ * the statements it dominates. Accesses whose index is proven in range are
+ * emitted without a check; loop-invariant checks have their comparison
+ * hoisted into the loop preheader.
+ */
+
+typedef enum {
+  CG_BOUNDS_NONE,    /* emit the raw subscript */
+  CG_BOUNDS_CHECK,   /* wrap the index in dream_check_index() */
+  CG_BOUNDS_HOISTED  /* test the flag computed in the loop preheader */
+} CGBoundsKind;
+
+typedef struct {
+  CGBoundsKind kind;
+  size_t length;
+  int flag;
+} CGBoundsCheck;
+
+typedef struct {
+  size_t hoist_mark;
+  int opened;
+  int has_init;
+  long long init_lo;
+  long long init_hi;
+  int init_dir; /* 1 increasing, -1 decreasing, 0 otherwise */
+} CGBoundsLoop;
+
+CGBoundsCheck cg_bounds_classify(CGCtx *ctx, Node *index_expr);
+
+size_t cg_bounds_mark(CGCtx *ctx);
+void cg_bounds_restore(CGCtx *ctx, size_t mark);
+
+size_t cg_bounds_stmt_begin(CGCtx *ctx, Node *stmt);
+void cg_bounds_stmt_end(CGCtx *ctx, Node *stmt, size_t mark);
+
+void cg_bounds_assume(CGCtx *ctx, Node *cond, int truth);
+void cg_bounds_note_expr(CGCtx *ctx, Node *expr);
+
+CGBoundsLoop cg_bounds_loop_begin(CGCtx *ctx, COut *b, Node *loop);
+size_t cg_bounds_loop_body(CGCtx *ctx, Node *loop, const CGBoundsLoop *st);
+void cg_bounds_loop_end(CGCtx *ctx, COut *b, const CGBoundsLoop *st);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CG_BOUNDS_H
@@ -124,6 +124,25 @@ void c_out_write(COut *out, const char *fmt, ...) {
     out->data[out->len] = '\0';
 }
 
+/**
+ * @brief Appends the contents of another output buffer.
+ *
+ * Copies the text of src without re-indenting it and takes over its
+ * line-start state, so src should have been written at the indentation
+ * of out.
+ *
+ * @param out Pointer to the output buffer structure to append to.
+ * @param src Pointer to the output buffer structure to copy from.
+ */
+void c_out_append(COut *out, const COut *src) {
+    if (!src->len) return;
+    grow(out, src->len + 1);
+    memcpy(out->data + out->len, src->data, src->len);
+    out->len += src->len;
+    out->data[out->len] = '\0';
+    out->at_line_start = src->at_line_start;
+}
+
 /**
  * @brief Writes the contents of the output buffer to a file.
  *
@@ -57,6 +57,13 @@ void c_out_write(COut *out, const char *fmt, ...);
  */
 void c_out_newline(COut *out);
 
+/**
+ * @brief Appends the content of another builder verbatim.
+ * @param out Pointer to the COut structure to append to.
+ * @param src Builder whose text was written at out's indentation.
+ */
+void c_out_append(COut *out, const COut *src);
+
 /**
  * @brief Dumps the content of a COut string builder to a file.
  * @param f Pointer to the output file.
@@ -1,9 +1,15 @@
 #include "codegen.h"
 #include "../util/platform.h"
 #include "c_emit.h"
+#include "consteval.h"
 #include "context.h"
+#include "reach.h"
 #include "expr.h"
+#include "hints.h"
+#include "memo.h"
+#include "profile.h"
 #include "stmt.h"
+#include "strlit.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,6 +19,8 @@
 #include <io.h>
 #endif
 
+CGOptions cg_options = {0};
+
 // Check if the AST contains any async functions
 static bool has_async_functions(Node *n) {
   if (!n) return false;
@@ -67,14 +75,23 @@ void codegen_emit_c(Node *root, FILE *out, const char *src_file) {
   c_out_write(&builder, "#include \"../libs/console.h\"\n");
   c_out_write(&builder, "#include \"../libs/custom.h\"\n");
   c_out_write(&builder, "#include \"../libs/memory.h\"\n");
+  c_out_write(&builder, "#include \"../libs/drstring.h\"\n");
+  c_out_write(&builder, "#include \"../libs/region.h\"\n");
   c_out_write(&builder, "#include \"../libs/exception.h\"\n");
-  
-  // Only include task.h when async functions are used
-  if (has_async_functions(root)) {
+
+  cg_reach_compute(root);
+  // Only include the task headers when tasks are used
+  if (has_async_functions(root) || cg_reach_uses_tasks()) {
     c_out_write(&builder, "#include \"../libs/task.h\"\n");
+    c_out_write(&builder, "#include \"../libs/eventloop.h\"\n");
   }
   c_out_newline(&builder);
 
+  if (cg_memo_any(root))
+    c_out_write(&builder, "#include \"../libs/memo.h\"\n\n");
+  cg_hint_emit_macros(&builder);
+  cg_prof_emit_preamble(&builder);
+
   // Initialize exception handling system
   c_out_write(&builder, "static void dream_init_runtime(void) {\n");
   c_out_write(&builder, "    dream_exception_init();\n");
@@ -85,9 +102,10 @@ void codegen_emit_c(Node *root, FILE *out, const char *src_file) {
   c_out_write(&builder, "    if(!fgets(buf,sizeof buf,stdin)) return NULL;\n");
   c_out_write(&builder, "    size_t len=strlen(buf);\n");
   c_out_write(&builder, "    if(len && buf[len-1]=='\\n') len--;\n");
-  c_out_write(&builder, "    char *r=dr_alloc(len+1);\n");
-  c_out_write(&builder, "    memcpy(r,buf,len);\n");
-  c_out_write(&builder, "    r[len]=0;\n    return r;\n}\n\n");
+  c_out_write(&builder, "    return (char *)dr_str_from(buf,len);\n}\n\n");
+
+  /* Literal definitions go here once the code has named them all. */
+  size_t literals_at = builder.len;
 
   CGTypeInfo *tinfo = NULL;
   size_t tlen = 0, tcap = 0;
@@ -106,11 +124,31 @@ void codegen_emit_c(Node *root, FILE *out, const char *src_file) {
           has_init = 1;
       }
       tinfo[tlen++] = (CGTypeInfo){it->as.type_decl.name,
-                                   it->kind == ND_CLASS_DECL, has_init};
+                                   it->kind == ND_CLASS_DECL, has_init, it};
     }
   }
   cg_register_types(tinfo, tlen);
 
+  // Functions calling each other need declarations ahead of their bodies;
+  // tail calls around such a cycle are forced where the compiler can
+  int mutual = 0;
+  for (size_t i = 0; i < root->as.block.len; i++) {
+    Node *it = root->as.block.items[i];
+    if (it->kind == ND_FUNC && !it->as.func.is_async &&
+        cg_reach_mutually_recursive(it)) {
+      if (!mutual)
+        c_out_write(&builder, "#if defined(__has_attribute)\n"
+                              "#if __has_attribute(musttail)\n"
+                              "#define DR_MUSTTAIL __attribute__((musttail))\n"
+                              "#endif\n#endif\n"
+                              "#ifndef DR_MUSTTAIL\n#define DR_MUSTTAIL\n#endif\n");
+      emit_func_prototype(&builder, it);
+      mutual = 1;
+    }
+  }
+  if (mutual)
+    c_out_newline(&builder);
+
   char src_buf[512];
   size_t i = 0;
   for (; src_file[i] && i < sizeof(src_buf) - 1; i++) {
@@ -122,6 +160,8 @@ void codegen_emit_c(Node *root, FILE *out, const char *src_file) {
 
   for (size_t i = 0; i < root->as.block.len; i++) {
     Node *it = root->as.block.items[i];
+    if (!cg_reach_is_live(it))
+      continue;
     if (it->kind == ND_STRUCT_DECL || it->kind == ND_CLASS_DECL)
       emit_type_decl(&builder, it, src_norm);
     else if (it->kind == ND_ENUM_DECL)
@@ -129,7 +169,7 @@ void codegen_emit_c(Node *root, FILE *out, const char *src_file) {
   }
   for (size_t i = 0; i < root->as.block.len; i++) {
     Node *it = root->as.block.items[i];
-    if (it->kind == ND_FUNC)
+    if (it->kind == ND_FUNC && cg_reach_is_live(it))
       emit_func(&builder, it, src_norm);
   }
 
@@ -165,25 +205,40 @@ void codegen_emit_c(Node *root, FILE *out, const char *src_file) {
     } else {
       CGCtx ctx = {0};
       ctx.ret_type = TK_KW_INT;
+      cg_prof_func_begin(&ctx, (Slice){NULL, 0}, (Slice){"main", 4});
       cgctx_scope_enter(&ctx);
-      for (size_t i = 0; i < root->as.block.len; i++) {
-        Node *it = root->as.block.items[i];
-        if (it->kind != ND_FUNC)
-          cg_emit_stmt(&ctx, &builder, it, src_norm);
+      int counted = cg_prof_emit_entry(&ctx, &builder);
+      for (size_t i = 0; i < root->as.block.len;) {
+        if (root->as.block.items[i]->kind == ND_FUNC)
+          i++;
+        else
+          i += cg_emit_block_item(&ctx, &builder, root->as.block.items,
+                                  root->as.block.len, i, src_norm);
       }
+      cg_prof_emit_exit(&builder, counted);
       cgctx_scope_leave(&ctx);
-      free(ctx.vars);
+      cgctx_free(&ctx);
       c_out_write(&builder, "dr_release_all();\nreturn 0;\n");
     }
     c_out_dedent(&builder);
     c_out_write(&builder, "}\n");
   }
+  cg_prof_emit_trailer(&builder, src_norm);
   c_out_write(&builder, "#endif /* DREAM_GENERATED */\n");
 
-  c_out_dump(out, &builder);
+  COut literals;
+  c_out_init(&literals);
+  cg_strlit_emit_table(&literals);
+  fwrite(builder.data, 1, literals_at, out);
+  c_out_dump(out, &literals);
+  fwrite(builder.data + literals_at, 1, builder.len - literals_at, out);
+  c_out_free(&literals);
   c_out_free(&builder);
   free(tinfo);
   cg_register_types(NULL, 0);
+  cg_reach_reset();
+  cg_eval_reset();
+  cg_strlit_reset();
 }
 
 void codegen_emit_obj(Node *root, const char *path, const char *src_file) {
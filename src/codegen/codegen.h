@@ -1,9 +1,45 @@
 #ifndef CODEGEN_H
 #define CODEGEN_H
 
+#include "../opt/profile.h"
 #include "../parser/ast.h"
 #include <stdio.h>
 
+/**
+ * @brief A call the optimizer proved to return a constant: to the function
+ * name, with argument i equal to args[i] wherever bound[i] is set.
+ */
+typedef struct {
+  const char *name;      /**< Function called. */
+  int *args;             /**< Constant arguments. */
+  unsigned char *bound;  /**< Nonzero for the arguments args fixes. */
+  size_t nargs;          /**< Number of parameters of the function. */
+  int result;            /**< What the call returns. */
+  int has_effects;       /**< The callee makes calls, so the call stays. */
+} CGConstCall;
+
+/**
+ * @brief Options controlling the generated C code.
+ */
+typedef struct {
+  int opt_level;    /**< Optimization level (0-3). */
+  int bounds_check; /**< Emit array bounds checks (--bounds-check). */
+  const char **memo_candidates; /**< Pure recursive functions to memoize at -O3. */
+  size_t nmemo_candidates;      /**< Number of entries in memo_candidates. */
+  const CGConstCall *const_calls; /**< Constant calls found from -O2 on. */
+  size_t nconst_calls;          /**< Number of entries in const_calls. */
+  int profile_generate;         /**< Emit profiling counters (--profile-generate). */
+  const char *profile_path;     /**< File the instrumented program writes. */
+  const Profile *profile;       /**< Profile applied by --profile-use, or NULL. */
+  int profile_alloc;            /**< Tag allocation sites (--profile-alloc). */
+  const char *profile_alloc_path; /**< Report the profiled program writes. */
+} CGOptions;
+
+/**
+ * @brief Global code generation options, set by the driver before emission.
+ */
+extern CGOptions cg_options;
+
 /**
  * @brief Emits C code for the given AST root node to the specified output file.
  *
@@ -0,0 +1,972 @@
+#include "consteval.h"
+#include "codegen.h"
+#include "reach.h"
+#include "strlit.h"
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Limits of one evaluation: AST nodes visited, bytes held, call depth. */
+#define EVAL_MAX_STEPS 2000000L
+#define EVAL_MAX_BYTES (1u << 20)
+#define EVAL_MAX_DEPTH 128
+
+/* Largest lookup table worth emitting as an initializer. */
+#define EVAL_MAX_TABLE 65536
+
+typedef struct {
+  const char *name;
+  size_t len;
+  TokenKind type;
+  int set;
+  CValue v;
+  CValue *cells; /* elements of an array variable, else NULL */
+  size_t ncells;
+  int scope;
+} EvalVar;
+
+typedef struct {
+  CGCtx *ctx;
+  EvalVar *vars;
+  size_t len, cap;
+  size_t frame; /* first variable of the innermost call */
+  int scope;
+  int depth;
+  long steps;
+  size_t bytes;
+  void **allocs;
+  size_t nallocs, allocs_cap;
+  CValue ret;
+  int has_ret;
+} Eval;
+
+typedef enum { EX_NEXT, EX_BREAK, EX_CONTINUE, EX_RETURN, EX_FAIL } ExecResult;
+
+/* Results handed out to codegen, freed by cg_eval_reset. */
+static void **pool;
+static size_t npool, pool_cap;
+
+static void *pool_keep(void *p) {
+  if (npool == pool_cap) {
+    pool_cap = pool_cap ? pool_cap * 2 : 32;
+    pool = realloc(pool, pool_cap * sizeof(void *));
+  }
+  pool[npool++] = p;
+  return p;
+}
+
+void cg_eval_reset(void) {
+  for (size_t i = 0; i < npool; i++)
+    free(pool[i]);
+  free(pool);
+  pool = NULL;
+  npool = pool_cap = 0;
+}
+
+/* Memory of one evaluation, within EVAL_MAX_BYTES. */
+static void *eval_alloc(Eval *e, size_t size) {
+  if (size > EVAL_MAX_BYTES || e->bytes + size > EVAL_MAX_BYTES)
+    return NULL;
+  e->bytes += size;
+  if (e->nallocs == e->allocs_cap) {
+    e->allocs_cap = e->allocs_cap ? e->allocs_cap * 2 : 16;
+    e->allocs = realloc(e->allocs, e->allocs_cap * sizeof(void *));
+  }
+  void *p = calloc(1, size ? size : 1);
+  e->allocs[e->nallocs++] = p;
+  return p;
+}
+
+static void eval_free(Eval *e) {
+  for (size_t i = 0; i < e->nallocs; i++)
+    free(e->allocs[i]);
+  free(e->allocs);
+  free(e->vars);
+}
+
+static int step(Eval *e) { return ++e->steps <= EVAL_MAX_STEPS; }
+
+static long long wrap_int(long long v) { return (long long)(int)(unsigned)v; }
+
+static long long wrap_char(long long v) {
+  return (long long)(signed char)(unsigned char)v;
+}
+
+static CValue int_value(long long v) {
+  return (CValue){CV_INT, wrap_int(v), 0, NULL, 0};
+}
+
+/* An int operation's exact result; overflow is undefined, so a result out
+ * of range is left to runtime. */
+static int int_result(long long v, CValue *out) {
+  if (v < INT_MIN || v > INT_MAX)
+    return 0;
+  *out = int_value(v);
+  return 1;
+}
+
+static int is_num(const CValue *v) { return v->kind != CV_STRING; }
+
+static int is_real(const CValue *v) {
+  return v->kind == CV_FLOAT || v->kind == CV_DOUBLE;
+}
+
+static double as_double(const CValue *v) {
+  return is_real(v) ? v->f : (double)v->i;
+}
+
+/* The value assigned to a variable of the given type, as C converts it. */
+static int convert(TokenKind type, const CValue *in, CValue *out) {
+  switch (type) {
+  case TK_KW_INT:
+  case TK_KW_BOOL:
+  case TK_KW_CHAR: {
+    long long v;
+    if (in->kind == CV_STRING)
+      return 0;
+    if (is_real(in)) {
+      /* Out-of-range conversions are undefined; leave them to runtime. */
+      if (!(in->f > -2147483649.0 && in->f < 2147483648.0))
+        return 0;
+      v = (long long)in->f;
+    } else {
+      v = in->i;
+    }
+    if (type == TK_KW_CHAR)
+      *out = (CValue){CV_CHAR, wrap_char(v), 0, NULL, 0};
+    else
+      *out = int_value(v);
+    return 1;
+  }
+  case TK_KW_FLOAT:
+    if (in->kind == CV_STRING)
+      return 0;
+    *out = (CValue){CV_FLOAT, 0, (float)as_double(in), NULL, 0};
+    return isfinite(out->f);
+  case TK_KW_STRING:
+    if (in->kind != CV_STRING)
+      return 0;
+    *out = *in;
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+static int is_value_type(TokenKind type) {
+  return type == TK_KW_INT || type == TK_KW_BOOL || type == TK_KW_CHAR ||
+         type == TK_KW_FLOAT || type == TK_KW_STRING;
+}
+
+char *cg_eval_decode_string(Node *lit, size_t *len) {
+  const char *s = lit->as.lit.start;
+  char *out = malloc(lit->as.lit.len + 1);
+  size_t k = 0;
+  for (size_t i = 0; i < lit->as.lit.len; i++) {
+    if (s[i] != '\\') {
+      out[k++] = s[i];
+      continue;
+    }
+    if (++i == lit->as.lit.len) {
+      free(out);
+      return NULL;
+    }
+    switch (s[i]) {
+    case 'n': out[k++] = '\n'; break;
+    case 't': out[k++] = '\t'; break;
+    case 'r': out[k++] = '\r'; break;
+    case '\\': case '"': case '\'': out[k++] = s[i]; break;
+    default:
+      free(out);
+      return NULL;
+    }
+  }
+  out[k] = 0;
+  *len = k;
+  return out;
+}
+
+/* A char literal, with or without its quotes. */
+static int char_literal(Node *n, long long *out) {
+  const char *s = n->as.lit.start;
+  size_t len = n->as.lit.len;
+  if (len >= 2 && s[0] == '\'' && s[len - 1] == '\'') {
+    s++;
+    len -= 2;
+  }
+  if (len == 1 && s[0] != '\\') {
+    *out = wrap_char((unsigned char)s[0]);
+    return 1;
+  }
+  if (len != 2 || s[0] != '\\')
+    return 0;
+  switch (s[1]) {
+  case 'n': *out = '\n'; return 1;
+  case 't': *out = '\t'; return 1;
+  case 'r': *out = '\r'; return 1;
+  case '0': *out = 0; return 1;
+  case '\\': case '\'': case '"': *out = s[1]; return 1;
+  default: return 0;
+  }
+}
+
+static EvalVar *find_var(Eval *e, Slice name) {
+  for (size_t i = e->len; i-- > e->frame;) {
+    EvalVar *v = &e->vars[i];
+    if (v->len == name.len && strncmp(v->name, name.start, name.len) == 0)
+      return v;
+  }
+  return NULL;
+}
+
+static EvalVar *declare(Eval *e, Slice name, TokenKind type) {
+  if (e->len == e->cap) {
+    e->cap = e->cap ? e->cap * 2 : 16;
+    e->vars = realloc(e->vars, e->cap * sizeof(EvalVar));
+  }
+  EvalVar *v = &e->vars[e->len++];
+  *v = (EvalVar){name.start, name.len, type, 0, {0}, NULL, 0, e->scope};
+  return v;
+}
+
+static void scope_leave(Eval *e) {
+  while (e->len > e->frame && e->vars[e->len - 1].scope >= e->scope)
+    e->len--;
+  e->scope--;
+}
+
+static int eval(Eval *e, Node *n, CValue *out);
+static ExecResult exec(Eval *e, Node *n);
+
+/* A variable outside the evaluation: only consts of the code being emitted. */
+static int outer_const(Eval *e, Slice name, CValue *out) {
+  if (e->frame || !e->ctx)
+    return 0;
+  const CValue *v = cgctx_lookup_value(e->ctx, name.start, name.len);
+  if (!v)
+    return 0;
+  *out = *v;
+  return 1;
+}
+
+/* The storage an assignment writes, and the type it converts to. */
+static CValue *lvalue(Eval *e, Node *n, TokenKind *type) {
+  if (n->kind == ND_IDENT) {
+    EvalVar *v = find_var(e, n->as.ident);
+    if (!v || v->cells)
+      return NULL;
+    *type = v->type;
+    return &v->v;
+  }
+  if (n->kind == ND_INDEX && n->as.index.array->kind == ND_IDENT) {
+    /* The index may call functions, which grow the variable stack. */
+    CValue idx;
+    if (!eval(e, n->as.index.index, &idx))
+      return NULL;
+    EvalVar *v = find_var(e, n->as.index.array->as.ident);
+    if (!v || !v->cells ||
+        idx.kind == CV_STRING || is_real(&idx) || idx.i < 0 ||
+        (unsigned long long)idx.i >= v->ncells)
+      return NULL;
+    *type = v->type;
+    return &v->cells[idx.i];
+  }
+  return NULL;
+}
+
+static int mark_set(Eval *e, Node *n) {
+  if (n->kind == ND_IDENT) {
+    EvalVar *v = find_var(e, n->as.ident);
+    if (!v)
+      return 0;
+    v->set = 1;
+  }
+  return 1;
+}
+
+static int is_set(Eval *e, Node *n) {
+  if (n->kind != ND_IDENT)
+    return 1;
+  EvalVar *v = find_var(e, n->as.ident);
+  return v && v->set;
+}
+
+static int concat(Eval *e, const CValue *a, const CValue *b, CValue *out) {
+  char *s = eval_alloc(e, a->len + b->len + 1);
+  if (!s)
+    return 0;
+  memcpy(s, a->s, a->len);
+  memcpy(s + a->len, b->s, b->len);
+  s[a->len + b->len] = 0;
+  *out = (CValue){CV_STRING, 0, 0, s, a->len + b->len};
+  return 1;
+}
+
+/* Operands the generated C concatenates rather than adds as pointers. */
+static int concat_operand(Node *n) {
+  return n->kind == ND_STRING || n->kind == ND_IDENT ||
+         (n->kind == ND_BINOP && n->as.bin.op == TK_PLUS);
+}
+
+static int arith(TokenKind op, const CValue *a, const CValue *b, CValue *out) {
+  if (!is_num(a) || !is_num(b))
+    return 0;
+  if (is_real(a) || is_real(b)) {
+    /* float op float stays float; a double literal makes it double. */
+    int dbl = a->kind == CV_DOUBLE || b->kind == CV_DOUBLE;
+    double x = as_double(a), y = as_double(b);
+    double r;
+    if (!dbl) {
+      x = (float)x;
+      y = (float)y;
+    }
+    switch (op) {
+    case TK_PLUS: r = x + y; break;
+    case TK_MINUS: r = x - y; break;
+    case TK_STAR: r = x * y; break;
+    case TK_SLASH:
+      if (y == 0)
+        return 0;
+      r = x / y;
+      break;
+    case TK_LT: *out = int_value(x < y); return 1;
+    case TK_GT: *out = int_value(x > y); return 1;
+    case TK_LTEQ: *out = int_value(x <= y); return 1;
+    case TK_GTEQ: *out = int_value(x >= y); return 1;
+    case TK_EQEQ: *out = int_value(x == y); return 1;
+    case TK_NEQ: *out = int_value(x != y); return 1;
+    default: return 0;
+    }
+    *out = (CValue){dbl ? CV_DOUBLE : CV_FLOAT, 0, dbl ? r : (float)r, NULL, 0};
+    return isfinite(out->f);
+  }
+  long long x = a->i, y = b->i;
+  switch (op) {
+  /* The operands are ints, so these cannot overflow a long long. */
+  case TK_PLUS: return int_result(x + y, out);
+  case TK_MINUS: return int_result(x - y, out);
+  case TK_STAR: return int_result(x * y, out);
+  case TK_SLASH:
+  case TK_PERCENT:
+    if (y == 0 || (x == -2147483648LL && y == -1))
+      return 0;
+    *out = int_value(op == TK_SLASH ? x / y : x % y);
+    return 1;
+  case TK_AND: *out = int_value(x & y); return 1;
+  case TK_OR: *out = int_value(x | y); return 1;
+  case TK_CARET: *out = int_value(x ^ y); return 1;
+  case TK_LSHIFT:
+  case TK_RSHIFT:
+    if (y < 0 || y >= 32)
+      return 0;
+    if (op == TK_LSHIFT)
+      return x >= 0 && int_result(x << y, out);
+    *out = int_value(x >> y);
+    return 1;
+  case TK_LT: *out = int_value(x < y); return 1;
+  case TK_GT: *out = int_value(x > y); return 1;
+  case TK_LTEQ: *out = int_value(x <= y); return 1;
+  case TK_GTEQ: *out = int_value(x >= y); return 1;
+  case TK_EQEQ: *out = int_value(x == y); return 1;
+  case TK_NEQ: *out = int_value(x != y); return 1;
+  default: return 0;
+  }
+}
+
+/* The operator a compound assignment applies, or 0. */
+static TokenKind compound_op(TokenKind op) {
+  switch (op) {
+  case TK_PLUSEQ: return TK_PLUS;
+  case TK_MINUSEQ: return TK_MINUS;
+  case TK_STAREQ: return TK_STAR;
+  case TK_SLASHEQ: return TK_SLASH;
+  case TK_PERCENTEQ: return TK_PERCENT;
+  case TK_ANDEQ: return TK_AND;
+  case TK_OREQ: return TK_OR;
+  case TK_XOREQ: return TK_CARET;
+  case TK_LSHIFTEQ: return TK_LSHIFT;
+  case TK_RSHIFTEQ: return TK_RSHIFT;
+  default: return (TokenKind)0;
+  }
+}
+
+static int truth(const CValue *v, int *out) {
+  if (v->kind == CV_STRING)
+    return 0;
+  *out = is_real(v) ? v->f != 0 : v->i != 0;
+  return 1;
+}
+
+static int assign(Eval *e, Node *n, CValue *out) {
+  TokenKind op = n->as.bin.op;
+  Node *target = n->as.bin.lhs;
+  CValue rhs;
+  if (!eval(e, n->as.bin.rhs, &rhs))
+    return 0;
+  TokenKind type;
+  CValue *slot = lvalue(e, target, &type);
+  if (!slot)
+    return 0;
+  CValue v = rhs;
+  if (op != TK_EQ) {
+    if (!is_set(e, target))
+      return 0;
+    if (!arith(compound_op(op), slot, &rhs, &v))
+      return 0;
+  }
+  if (!convert(type, &v, slot))
+    return 0;
+  *out = *slot;
+  return mark_set(e, target);
+}
+
+static int incdec(Eval *e, Node *n, int post, CValue *out) {
+  TokenKind type;
+  Node *target = n->as.unary.expr;
+  CValue *slot = lvalue(e, target, &type);
+  if (!slot || !is_set(e, target))
+    return 0;
+  CValue old = *slot, one = int_value(1), v;
+  if (!arith(n->as.unary.op == TK_PLUSPLUS ? TK_PLUS : TK_MINUS, slot, &one,
+             &v) ||
+      !convert(type, &v, slot))
+    return 0;
+  *out = post ? old : *slot;
+  return 1;
+}
+
+static int call(Eval *e, Node *n, CValue *out) {
+  Node *callee = n->as.call.callee;
+  if (callee->kind != ND_IDENT || e->depth >= EVAL_MAX_DEPTH)
+    return 0;
+  Node *fn = cg_reach_function(callee->as.ident);
+  if (!fn || fn->as.func.is_async || fn->as.func.param_len != n->as.call.len)
+    return 0;
+  size_t nargs = n->as.call.len;
+  CValue *args = nargs ? eval_alloc(e, nargs * sizeof(CValue)) : NULL;
+  if (nargs && !args)
+    return 0;
+  for (size_t i = 0; i < nargs; i++) {
+    Node *p = fn->as.func.params[i];
+    CValue a;
+    if (p->as.var_decl.array_len || !eval(e, n->as.call.args[i], &a) ||
+        !convert(p->as.var_decl.type, &a, &args[i]))
+      return 0;
+  }
+  size_t saved_frame = e->frame, saved_len = e->len;
+  int saved_scope = e->scope;
+  e->frame = e->len;
+  e->scope++;
+  e->depth++;
+  for (size_t i = 0; i < nargs; i++) {
+    Node *p = fn->as.func.params[i];
+    EvalVar *v = declare(e, p->as.var_decl.name, p->as.var_decl.type);
+    v->v = args[i];
+    v->set = 1;
+  }
+  e->has_ret = 0;
+  ExecResult r = exec(e, fn->as.func.body);
+  e->depth--;
+  e->len = saved_len;
+  e->frame = saved_frame;
+  e->scope = saved_scope;
+  if (r == EX_FAIL || r == EX_BREAK || r == EX_CONTINUE)
+    return 0;
+  if (fn->as.func.ret_type == TK_KW_VOID) {
+    /* Only usable as a statement. */
+    *out = int_value(0);
+    return 1;
+  }
+  if (!e->has_ret)
+    return 0;
+  return convert(fn->as.func.ret_type, &e->ret, out);
+}
+
+static int eval(Eval *e, Node *n, CValue *out) {
+  if (!n || !step(e))
+    return 0;
+  switch (n->kind) {
+  case ND_INT: {
+    long long v = 0;
+    for (size_t i = 0; i < n->as.lit.len; i++) {
+      v = v * 10 + (n->as.lit.start[i] - '0');
+      if (v > 2147483648LL)
+        return 0;
+    }
+    /* 2147483648 only fits negated, which C types as long. */
+    if (v > 2147483647LL)
+      return 0;
+    *out = int_value(v);
+    return 1;
+  }
+  case ND_FLOAT: {
+    char buf[64];
+    if (n->as.lit.len >= sizeof buf)
+      return 0;
+    memcpy(buf, n->as.lit.start, n->as.lit.len);
+    buf[n->as.lit.len] = 0;
+    /* The generated C writes the literal as a double. */
+    *out = (CValue){CV_DOUBLE, 0, strtod(buf, NULL), NULL, 0};
+    return 1;
+  }
+  case ND_CHAR: {
+    long long v;
+    if (!char_literal(n, &v))
+      return 0;
+    *out = (CValue){CV_CHAR, v, 0, NULL, 0};
+    return 1;
+  }
+  case ND_BOOL:
+    *out = int_value(n->as.lit.len == 4);
+    return 1;
+  case ND_STRING: {
+    size_t len;
+    char *s = cg_eval_decode_string(n, &len);
+    if (!s)
+      return 0;
+    char *copy = eval_alloc(e, len + 1);
+    if (copy)
+      memcpy(copy, s, len + 1);
+    free(s);
+    if (!copy)
+      return 0;
+    *out = (CValue){CV_STRING, 0, 0, copy, len};
+    return 1;
+  }
+  case ND_IDENT: {
+    EvalVar *v = find_var(e, n->as.ident);
+    if (!v)
+      return outer_const(e, n->as.ident, out);
+    if (v->cells || !v->set)
+      return 0;
+    *out = v->v;
+    return 1;
+  }
+  case ND_INDEX: {
+    TokenKind type;
+    CValue *slot = lvalue(e, n, &type);
+    if (!slot)
+      return 0;
+    *out = *slot;
+    return 1;
+  }
+  case ND_UNARY: {
+    TokenKind op = n->as.unary.op;
+    if (op == TK_PLUSPLUS || op == TK_MINUSMINUS)
+      return incdec(e, n, 0, out);
+    CValue v;
+    if (!eval(e, n->as.unary.expr, &v) || v.kind == CV_STRING)
+      return 0;
+    switch (op) {
+    case TK_MINUS:
+      if (is_real(&v)) {
+        *out = (CValue){v.kind, 0, -v.f, NULL, 0};
+        return 1;
+      }
+      return int_result(-v.i, out);
+    case TK_PLUS:
+      *out = is_real(&v) ? v : int_value(v.i);
+      return 1;
+    case TK_BANG: {
+      int t;
+      truth(&v, &t);
+      *out = int_value(!t);
+      return 1;
+    }
+    case TK_TILDE:
+      if (is_real(&v))
+        return 0;
+      *out = int_value(~v.i);
+      return 1;
+    default:
+      return 0;
+    }
+  }
+  case ND_POST_UNARY:
+    return incdec(e, n, 1, out);
+  case ND_BINOP: {
+    TokenKind op = n->as.bin.op;
+    if (op == TK_EQ || compound_op(op))
+      return assign(e, n, out);
+    CValue a, b;
+    int t;
+    if (op == TK_ANDAND || op == TK_OROR) {
+      if (!eval(e, n->as.bin.lhs, &a) || !truth(&a, &t))
+        return 0;
+      if (t == (op == TK_OROR)) {
+        *out = int_value(t);
+        return 1;
+      }
+      if (!eval(e, n->as.bin.rhs, &b) || !truth(&b, &t))
+        return 0;
+      *out = int_value(t);
+      return 1;
+    }
+    if (!eval(e, n->as.bin.lhs, &a) || !eval(e, n->as.bin.rhs, &b))
+      return 0;
+    if (a.kind == CV_STRING || b.kind == CV_STRING) {
+      if (op != TK_PLUS || a.kind != b.kind ||
+          !concat_operand(n->as.bin.lhs) || !concat_operand(n->as.bin.rhs))
+        return 0;
+      return concat(e, &a, &b, out);
+    }
+    return arith(op, &a, &b, out);
+  }
+  case ND_COND: {
+    CValue c;
+    int t;
+    if (!eval(e, n->as.cond.cond, &c) || !truth(&c, &t))
+      return 0;
+    return eval(e, t ? n->as.cond.then_expr : n->as.cond.else_expr, out);
+  }
+  case ND_CALL:
+    return call(e, n, out);
+  default:
+    return 0;
+  }
+}
+
+static ExecResult exec_decl(Eval *e, Node *n) {
+  TokenKind type = n->as.var_decl.type;
+  if (!is_value_type(type) || n->as.var_decl.is_pointer)
+    return EX_FAIL;
+  CValue init;
+  if (n->as.var_decl.init && !eval(e, n->as.var_decl.init, &init))
+    return EX_FAIL;
+  EvalVar *v = declare(e, n->as.var_decl.name, type);
+  if (n->as.var_decl.array_len) {
+    /* Initialized arrays and string arrays are left to runtime. */
+    if (n->as.var_decl.init || type == TK_KW_STRING)
+      return EX_FAIL;
+    v->ncells = n->as.var_decl.array_len;
+    v->cells = eval_alloc(e, v->ncells * sizeof(CValue));
+    if (!v->cells)
+      return EX_FAIL;
+    CValue zero = int_value(0);
+    for (size_t i = 0; i < v->ncells; i++)
+      convert(type, &zero, &v->cells[i]);
+    return EX_NEXT;
+  }
+  if (n->as.var_decl.init) {
+    if (!convert(type, &init, &v->v))
+      return EX_FAIL;
+    v->set = 1;
+  }
+  return EX_NEXT;
+}
+
+/* Runs a loop body; 1 to go on looping, 0 to stop, -1 when r must propagate. */
+static int loop_body(Eval *e, Node *body, ExecResult *r) {
+  *r = exec(e, body);
+  if (*r == EX_BREAK) {
+    *r = EX_NEXT;
+    return 0;
+  }
+  if (*r == EX_FAIL || *r == EX_RETURN)
+    return -1;
+  *r = EX_NEXT;
+  return 1;
+}
+
+static int cond_true(Eval *e, Node *cond, int *t) {
+  CValue c;
+  if (!cond) {
+    *t = 1;
+    return 1;
+  }
+  return eval(e, cond, &c) && truth(&c, t);
+}
+
+static ExecResult exec_switch(Eval *e, Node *n) {
+  CValue v;
+  if (!eval(e, n->as.switch_stmt.expr, &v) || v.kind == CV_STRING ||
+      is_real(&v))
+    return EX_FAIL;
+  size_t start = n->as.switch_stmt.len;
+  for (size_t i = 0; i < n->as.switch_stmt.len && start == n->as.switch_stmt.len; i++) {
+    SwitchCase *sc = &n->as.switch_stmt.cases[i];
+    CValue c;
+    if (sc->is_default)
+      continue;
+    if (!eval(e, sc->value, &c) || c.kind == CV_STRING || is_real(&c))
+      return EX_FAIL;
+    if (c.i == v.i)
+      start = i;
+  }
+  for (size_t i = 0; i < n->as.switch_stmt.len && start == n->as.switch_stmt.len; i++) {
+    if (n->as.switch_stmt.cases[i].is_default)
+      start = i;
+  }
+  for (size_t i = start; i < n->as.switch_stmt.len; i++) {
+    ExecResult r = exec(e, n->as.switch_stmt.cases[i].body);
+    if (r == EX_BREAK)
+      return EX_NEXT;
+    if (r != EX_NEXT)
+      return r;
+  }
+  return EX_NEXT;
+}
+
+static ExecResult exec(Eval *e, Node *n) {
+  if (!n || !step(e))
+    return EX_FAIL;
+  ExecResult r = EX_NEXT;
+  int t, go;
+  switch (n->kind) {
+  case ND_VAR_DECL:
+    return exec_decl(e, n);
+  case ND_EXPR_STMT: {
+    CValue v;
+    return eval(e, n->as.expr_stmt.expr, &v) ? EX_NEXT : EX_FAIL;
+  }
+  case ND_BLOCK:
+    e->scope++;
+    for (size_t i = 0; i < n->as.block.len && r == EX_NEXT; i++)
+      r = exec(e, n->as.block.items[i]);
+    scope_leave(e);
+    return r;
+  case ND_IF:
+    if (!cond_true(e, n->as.if_stmt.cond, &t))
+      return EX_FAIL;
+    if (t)
+      return exec(e, n->as.if_stmt.then_br);
+    return n->as.if_stmt.else_br ? exec(e, n->as.if_stmt.else_br) : EX_NEXT;
+  case ND_WHILE:
+    for (;;) {
+      if (!cond_true(e, n->as.while_stmt.cond, &t))
+        return EX_FAIL;
+      if (!t || (go = loop_body(e, n->as.while_stmt.body, &r)) == 0)
+        return EX_NEXT;
+      if (go < 0)
+        return r;
+    }
+  case ND_DO_WHILE:
+    for (;;) {
+      if ((go = loop_body(e, n->as.do_while_stmt.body, &r)) == 0)
+        return EX_NEXT;
+      if (go < 0)
+        return r;
+      if (!cond_true(e, n->as.do_while_stmt.cond, &t))
+        return EX_FAIL;
+      if (!t)
+        return EX_NEXT;
+    }
+  case ND_FOR: {
+    CValue v;
+    e->scope++;
+    if (n->as.for_stmt.init) {
+      Node *init = n->as.for_stmt.init;
+      if (init->kind == ND_VAR_DECL ? exec_decl(e, init) != EX_NEXT
+                                    : !eval(e, init, &v))
+        r = EX_FAIL;
+    }
+    while (r == EX_NEXT) {
+      if (!cond_true(e, n->as.for_stmt.cond, &t)) {
+        r = EX_FAIL;
+        break;
+      }
+      if (!t || (go = loop_body(e, n->as.for_stmt.body, &r)) == 0)
+        break;
+      if (go < 0)
+        break;
+      if (n->as.for_stmt.update && !eval(e, n->as.for_stmt.update, &v))
+        r = EX_FAIL;
+    }
+    scope_leave(e);
+    return r;
+  }
+  case ND_SWITCH:
+    return exec_switch(e, n);
+  case ND_BREAK:
+    return EX_BREAK;
+  case ND_CONTINUE:
+    return EX_CONTINUE;
+  case ND_RETURN:
+    e->has_ret = 0;
+    if (n->as.ret.expr) {
+      CValue v;
+      if (!eval(e, n->as.ret.expr, &v))
+        return EX_FAIL;
+      e->ret = v;
+      e->has_ret = 1;
+    }
+    return EX_RETURN;
+  default:
+    return EX_FAIL;
+  }
+}
+
+/* Copies v out of the evaluation into the result pool. */
+static const CValue *keep(const CValue *v) {
+  CValue *out = pool_keep(malloc(sizeof(CValue)));
+  *out = *v;
+  if (v->kind == CV_STRING) {
+    char *s = pool_keep(malloc(v->len + 1));
+    memcpy(s, v->s, v->len + 1);
+    out->s = s;
+  }
+  return out;
+}
+
+const CValue *cg_eval_expr(CGCtx *ctx, Node *expr, TokenKind type) {
+  Eval e = {0};
+  e.ctx = ctx;
+  CValue v, conv;
+  const CValue *result = NULL;
+  if (eval(&e, expr, &v)) {
+    if (!type)
+      result = keep(&v);
+    else if (convert(type, &v, &conv))
+      result = keep(&conv);
+  }
+  eval_free(&e);
+  return result;
+}
+
+const CValue *cg_eval_pure_call(CGCtx *ctx, Node *call) {
+  Node *callee = call->as.call.callee;
+  if (cg_options.opt_level < 1 || !callee || callee->kind != ND_IDENT)
+    return NULL;
+  Node *fn = cg_reach_function(callee->as.ident);
+  if (!fn || !(fn->as.func.attrs & FUNC_ATTR_PURE) ||
+      fn->as.func.ret_type == TK_KW_VOID)
+    return NULL;
+  return cg_eval_expr(ctx, call, 0);
+}
+
+/* Types the optimizer's integer constants stand for exactly. */
+static int is_int_type(TokenKind type) {
+  return type == TK_KW_INT || type == TK_KW_BOOL || type == TK_KW_CHAR;
+}
+
+/* Nonzero if evaluating n cannot have an effect. */
+static int no_effect(Node *n) {
+  switch (n->kind) {
+  case ND_INT:
+  case ND_FLOAT:
+  case ND_CHAR:
+  case ND_STRING:
+  case ND_BOOL:
+  case ND_NULL:
+  case ND_IDENT:
+    return 1;
+  case ND_UNARY:
+    return n->as.unary.op != TK_PLUSPLUS && n->as.unary.op != TK_MINUSMINUS &&
+           no_effect(n->as.unary.expr);
+  case ND_BINOP:
+    return n->as.bin.op != TK_EQ && n->as.bin.op != TK_QMARKQMARKEQ &&
+           !compound_op(n->as.bin.op) && n->as.bin.op != TK_SLASH &&
+           n->as.bin.op != TK_PERCENT && no_effect(n->as.bin.lhs) &&
+           no_effect(n->as.bin.rhs);
+  default:
+    return 0;
+  }
+}
+
+/* Nonzero if the arguments of call give every constant c binds. */
+static int binds(CGCtx *ctx, Node *fn, Node *call, const CGConstCall *c) {
+  for (size_t i = 0; i < c->nargs; i++) {
+    if (!c->bound[i])
+      continue;
+    if (!is_int_type(fn->as.func.params[i]->as.var_decl.type) ||
+        fn->as.func.params[i]->as.var_decl.is_pointer)
+      return 0;
+    const CValue *v = cg_eval_expr(ctx, call->as.call.args[i], 0);
+    if (!v || (v->kind != CV_INT && v->kind != CV_CHAR) || v->i != c->args[i])
+      return 0;
+  }
+  return 1;
+}
+
+const CValue *cg_eval_known_call(CGCtx *ctx, Node *call, int *runs) {
+  Node *callee = call->as.call.callee;
+  if (cg_options.opt_level < 2 || !callee || callee->kind != ND_IDENT)
+    return NULL;
+  Node *fn = cg_reach_function(callee->as.ident);
+  if (!fn || fn->as.func.is_async || !is_int_type(fn->as.func.ret_type) ||
+      fn->as.func.param_len != call->as.call.len)
+    return NULL;
+  for (size_t i = 0; i < cg_options.nconst_calls; i++) {
+    const CGConstCall *c = &cg_options.const_calls[i];
+    if (c->nargs != fn->as.func.param_len ||
+        strlen(c->name) != callee->as.ident.len ||
+        strncmp(c->name, callee->as.ident.start, callee->as.ident.len) != 0 ||
+        !binds(ctx, fn, call, c))
+      continue;
+    *runs = c->has_effects;
+    for (size_t k = 0; k < c->nargs; k++)
+      *runs |= !c->bound[k] && !no_effect(call->as.call.args[k]);
+    CValue v = int_value(c->result);
+    if (fn->as.func.ret_type == TK_KW_CHAR)
+      v.kind = CV_CHAR;
+    return keep(&v);
+  }
+  return NULL;
+}
+
+const CValue *cg_eval_table(CGCtx *ctx, Node *decl, Node *loop) {
+  if (cg_options.opt_level < 1 || !decl || !loop || decl->kind != ND_VAR_DECL ||
+      (loop->kind != ND_FOR && loop->kind != ND_WHILE &&
+       loop->kind != ND_DO_WHILE))
+    return NULL;
+  size_t n = decl->as.var_decl.array_len;
+  TokenKind type = decl->as.var_decl.type;
+  if (!n || n > EVAL_MAX_TABLE || decl->as.var_decl.init ||
+      decl->as.var_decl.is_pointer || type == TK_KW_STRING ||
+      !is_value_type(type))
+    return NULL;
+  Eval e = {0};
+  e.ctx = ctx;
+  const CValue *result = NULL;
+  if (exec_decl(&e, decl) == EX_NEXT && exec(&e, loop) == EX_NEXT) {
+    EvalVar *v = &e.vars[0];
+    CValue *cells = pool_keep(malloc(n * sizeof(CValue)));
+    memcpy(cells, v->cells, n * sizeof(CValue));
+    result = cells;
+  }
+  eval_free(&e);
+  return result;
+}
+
+void cg_eval_emit(COut *b, const CValue *v) {
+  switch (v->kind) {
+  case CV_INT:
+    if (v->i == -2147483648LL)
+      c_out_write(b, "(-2147483647 - 1)");
+    else
+      c_out_write(b, "%lld", v->i);
+    break;
+  case CV_CHAR:
+    if (v->i >= 32 && v->i < 127 && v->i != '\'' && v->i != '\\')
+      c_out_write(b, "'%c'", (int)v->i);
+    else
+      c_out_write(b, "%lld", v->i);
+    break;
+  case CV_FLOAT:
+  case CV_DOUBLE: {
+    char buf[40];
+    snprintf(buf, sizeof buf, v->kind == CV_FLOAT ? "%.9g" : "%.17g", v->f);
+    c_out_write(b, "%s%s%s", buf, strpbrk(buf, ".e") ? "" : ".0",
+                v->kind == CV_FLOAT ? "f" : "");
+    break;
+  }
+  case CV_STRING: {
+    COut text;
+    c_out_init(&text);
+    for (size_t i = 0; i < v->len; i++) {
+      unsigned char ch = (unsigned char)v->s[i];
+      if (ch == '"' || ch == '\\')
+        c_out_write(&text, "\\%c", ch);
+      else if (ch < 32 || ch >= 127)
+        c_out_write(&text, "\\%03o", ch);
+      else
+        c_out_write(&text, "%c", ch);
+    }
+    cg_strlit_emit(b, text.data ? text.data : "", text.len);
+    c_out_free(&text);
+    break;
+  }
+  }
+}
@@ -0,0 +1,78 @@
+#ifndef CG_CONSTEVAL_H
+#define CG_CONSTEVAL_H
+
+#include "../parser/ast.h"
+#include "c_emit.h"
+#include "context.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Compile-time evaluation.
+ *
+ * A small interpreter over the AST runs const initializers, calls to
+ * functions marked [pure] whose arguments are known, and from -O1 on the
+ * loop that fills an array declared right before it. What it computes is
+ * emitted as literals, or as an initializer list for such a lookup table.
+ *
+ * The interpreter models int, bool, char, float and string values with the
+ * semantics of the generated C, signed overflow wrapping. It gives up, and
+ * the code runs as before, on anything with an effect (console I/O,
+ * objects, globals that are not const), on operations C leaves undefined
+ * such as division by zero or out-of-range indexing, and once it exceeds
+ * its step, memory or call depth limits.
+ */
+
+typedef enum { CV_INT, CV_CHAR, CV_FLOAT, CV_DOUBLE, CV_STRING } CValueKind;
+
+/*
+ * A value known at compile time; bools are ints, as in the generated C, and
+ * CV_DOUBLE is what a float literal is before it meets a float.
+ */
+typedef struct CValue {
+  CValueKind kind;
+  long long i;
+  double f;
+  const char *s; /* NUL-terminated */
+  size_t len;
+} CValue;
+
+/*
+ * Evaluates expr, converted to type unless that is 0; NULL if it has to
+ * run at runtime. Results live until cg_eval_reset.
+ */
+const CValue *cg_eval_expr(CGCtx *ctx, Node *expr, TokenKind type);
+
+/* The value of a call to a [pure] function, if it can be computed. */
+const CValue *cg_eval_pure_call(CGCtx *ctx, Node *call);
+
+/*
+ * The value of a call the optimizer proved constant, from -O2 on, if the
+ * arguments it binds are known here; *runs is set when the call has to run
+ * anyway, for the callee's effects or to evaluate the other arguments.
+ */
+const CValue *cg_eval_known_call(CGCtx *ctx, Node *call, int *runs);
+
+/*
+ * Runs loop against the array declared by decl, which must come right
+ * before it; returns the decl->as.var_decl.array_len elements it leaves
+ * behind, or NULL.
+ */
+const CValue *cg_eval_table(CGCtx *ctx, Node *decl, Node *loop);
+
+/* Emits v as a C literal. */
+void cg_eval_emit(COut *b, const CValue *v);
+
+/* The bytes of a string literal, malloc'd; NULL for unknown escapes. */
+char *cg_eval_decode_string(Node *lit, size_t *len);
+
+/* Releases every result. */
+void cg_eval_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CG_CONSTEVAL_H
@@ -9,7 +9,7 @@ void cgctx_push(CGCtx *ctx, const char *start, size_t len, TokenKind ty,
     ctx->vars = realloc(ctx->vars, ctx->cap * sizeof(VarBinding));
   }
   ctx->vars[ctx->len++] =
-      (VarBinding){start, len, ty, type_name, ctx->depth};
+      (VarBinding){start, len, ty, type_name, ctx->depth, 0, NULL, 0, 0};
 }
 
 void cgctx_scope_enter(CGCtx *ctx) { ctx->depth++; }
@@ -47,3 +47,69 @@ int cgctx_has_var(CGCtx *ctx, const char *start, size_t len) {
   }
   return 0;
 }
+
+/* Records the array length of the most recently pushed binding. */
+void cgctx_set_array_len(CGCtx *ctx, size_t array_len) {
+  if (ctx->len)
+    ctx->vars[ctx->len - 1].array_len = array_len;
+}
+
+size_t cgctx_lookup_array_len(CGCtx *ctx, const char *start, size_t len) {
+  for (size_t i = ctx->len; i-- > 0;) {
+    VarBinding *v = &ctx->vars[i];
+    if (v->len == len && strncmp(v->start, start, len) == 0)
+      return v->array_len;
+  }
+  return 0;
+}
+
+/* Records the compile-time value of the most recently pushed binding. */
+void cgctx_set_value(CGCtx *ctx, const struct CValue *value) {
+  if (ctx->len)
+    ctx->vars[ctx->len - 1].value = value;
+}
+
+const struct CValue *cgctx_lookup_value(CGCtx *ctx, const char *start,
+                                        size_t len) {
+  for (size_t i = ctx->len; i-- > 0;) {
+    VarBinding *v = &ctx->vars[i];
+    if (v->len == len && strncmp(v->start, start, len) == 0)
+      return v->value;
+  }
+  return NULL;
+}
+
+VarBinding *cgctx_find(CGCtx *ctx, const char *start, size_t len) {
+  for (size_t i = ctx->len; i-- > 0;) {
+    VarBinding *v = &ctx->vars[i];
+    if (v->len == len && strncmp(v->start, start, len) == 0)
+      return v;
+  }
+  return NULL;
+}
+
+void cgctx_set_owned(CGCtx *ctx) {
+  if (ctx->len)
+    ctx->vars[ctx->len - 1].owned = 1;
+}
+
+int cgctx_lookup_owned(CGCtx *ctx, const char *start, size_t len) {
+  for (size_t i = ctx->len; i-- > 0;) {
+    VarBinding *v = &ctx->vars[i];
+    if (v->len == len && strncmp(v->start, start, len) == 0)
+      return v->owned;
+  }
+  return 0;
+}
+
+void cgctx_free(CGCtx *ctx) {
+  free(ctx->vars);
+  free(ctx->facts);
+  free(ctx->hoisted);
+  ctx->vars = NULL;
+  ctx->facts = NULL;
+  ctx->hoisted = NULL;
+  ctx->len = ctx->cap = 0;
+  ctx->nfacts = ctx->facts_cap = 0;
+  ctx->nhoisted = ctx->hoisted_cap = 0;
+}
@@ -14,8 +14,28 @@ typedef struct VarBinding {
   TokenKind type;
   Slice type_name;
   int depth;
+  size_t array_len; /* element count for fixed-size arrays, 0 otherwise */
+  const struct CValue *value; /* const evaluated at compile time, or NULL */
+  int owned; /* holds a reference of its own (see owner.h) */
+  int lent;  /* a borrowed local points at its value */
 } VarBinding;
 
+/* Known value range of an int variable, used for bounds-check elimination. */
+typedef struct CGRangeFact {
+  const char *start;
+  size_t len;
+  long long lo;
+  long long hi;
+  int dead;
+} CGRangeFact;
+
+/* Loop-invariant bounds check whose comparison was hoisted to a preheader. */
+typedef struct CGHoistedCheck {
+  Slice array;
+  Node *index;
+  int flag;
+} CGHoistedCheck;
+
 typedef struct CGCtx {
   VarBinding *vars;
   size_t len;
@@ -23,7 +43,29 @@ typedef struct CGCtx {
   int depth;
   TokenKind ret_type;
   int is_async_worker;
-  Slice async_func_name;
+  CGRangeFact *facts;
+  size_t nfacts;
+  size_t facts_cap;
+  CGHoistedCheck *hoisted;
+  size_t nhoisted;
+  size_t hoisted_cap;
+  int next_check_flag;
+  Node *func;       /* function whose body is emitted, for tail calls */
+  Slice func_prefix; /* owning type of a static method */
+  int try_depth;
+  int tail_loop;    /* body starts with the dr_tail_entry label */
+  const char *prof_func; /* "name" or "Type.name" while profiling, else NULL */
+  size_t site_line;      /* line of the statement being emitted */
+  int site_ordinal;      /* calls emitted so far on site_line */
+  struct CGOwn *own;     /* full expression collecting temporaries, or NULL */
+  int own_suppress;      /* values emitted now outlive their full expression */
+  Node *stack_new;       /* class `new` built in a stack slot (see escape.h) */
+  int stack_slot;        /* number of that slot */
+  int region_depth;      /* scope depth of the innermost region body, or 0 */
+  Node *own_stmt;        /* block item being emitted */
+  Node **own_rest;       /* the items of its block after it */
+  size_t own_rest_len;
+  struct CGCoro *coro;   /* async function emitted as a coroutine (coro.h) */
 } CGCtx;
 
 void cgctx_push(CGCtx *ctx, const char *start, size_t len, TokenKind ty,
@@ -33,6 +75,15 @@ void cgctx_scope_leave(CGCtx *ctx);
 TokenKind cgctx_lookup(CGCtx *ctx, const char *start, size_t len);
 Slice cgctx_lookup_name(CGCtx *ctx, const char *start, size_t len);
 int cgctx_has_var(CGCtx *ctx, const char *start, size_t len);
+void cgctx_set_array_len(CGCtx *ctx, size_t array_len);
+size_t cgctx_lookup_array_len(CGCtx *ctx, const char *start, size_t len);
+void cgctx_set_value(CGCtx *ctx, const struct CValue *value);
+const struct CValue *cgctx_lookup_value(CGCtx *ctx, const char *start,
+                                        size_t len);
+VarBinding *cgctx_find(CGCtx *ctx, const char *start, size_t len);
+void cgctx_set_owned(CGCtx *ctx);
+int cgctx_lookup_owned(CGCtx *ctx, const char *start, size_t len);
+void cgctx_free(CGCtx *ctx);
 
 #ifdef __cplusplus
 }
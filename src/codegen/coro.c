@@ -0,0 +1,391 @@
+#include "coro.h"
+#include "expr.h"
+#include "owner.h"
+#include "profile.h"
+#include "stmt.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* ---- locals -------------------------------------------------------------- */
+
+static void add_local(CGCoro *co, Node *decl) {
+  if (co->nlocals == co->locals_cap) {
+    co->locals_cap = co->locals_cap ? co->locals_cap * 2 : 16;
+    co->locals = realloc(co->locals, co->locals_cap * sizeof(Node *));
+    co->saved = realloc(co->saved, co->locals_cap);
+  }
+  co->saved[co->nlocals] = 0;
+  co->locals[co->nlocals++] = decl;
+}
+
+static void collect_locals(CGCoro *co, Node *n) {
+  if (!n)
+    return;
+  switch (n->kind) {
+  case ND_VAR_DECL:
+    add_local(co, n);
+    break;
+  case ND_BLOCK:
+    for (size_t i = 0; i < n->as.block.len; i++)
+      collect_locals(co, n->as.block.items[i]);
+    break;
+  case ND_IF:
+    collect_locals(co, n->as.if_stmt.then_br);
+    collect_locals(co, n->as.if_stmt.else_br);
+    break;
+  case ND_WHILE:
+    collect_locals(co, n->as.while_stmt.body);
+    break;
+  case ND_DO_WHILE:
+    collect_locals(co, n->as.do_while_stmt.body);
+    break;
+  case ND_FOR:
+    collect_locals(co, n->as.for_stmt.init);
+    collect_locals(co, n->as.for_stmt.body);
+    break;
+  case ND_SWITCH:
+    for (size_t i = 0; i < n->as.switch_stmt.len; i++)
+      collect_locals(co, n->as.switch_stmt.cases[i].body);
+    break;
+  case ND_TRY:
+    collect_locals(co, n->as.try_stmt.body);
+    collect_locals(co, n->as.try_stmt.catch_body);
+    collect_locals(co, n->as.try_stmt.finally_body);
+    break;
+  case ND_REGION:
+    collect_locals(co, n->as.region.body);
+    break;
+  default:
+    break;
+  }
+}
+
+/* The local a binding was pushed for: its name points into the source. */
+static long local_of(CGCoro *co, const VarBinding *v) {
+  for (size_t i = 0; i < co->nlocals; i++) {
+    if (co->locals[i]->as.var_decl.name.start == v->start)
+      return (long)i;
+  }
+  return -1;
+}
+
+/* Nonzero if the bindings in scope name distinct locals only. */
+static int locals_distinct(CGCtx *ctx) {
+  for (size_t i = 0; i < ctx->len; i++) {
+    if (local_of(ctx->coro, &ctx->vars[i]) < 0)
+      continue;
+    for (size_t j = i + 1; j < ctx->len; j++) {
+      if (ctx->vars[j].len == ctx->vars[i].len &&
+          strncmp(ctx->vars[j].start, ctx->vars[i].start, ctx->vars[i].len) ==
+              0)
+        return 0;
+    }
+  }
+  return 1;
+}
+
+static void emit_field_name(COut *b, CGCoro *co, size_t k) {
+  Slice name = co->locals[k]->as.var_decl.name;
+  c_out_write(b, "v%zu_%.*s", k, (int)name.len, name.start);
+}
+
+/* Saves the locals in scope to the frame, or restores them from it. */
+static void emit_locals_copy(CGCtx *ctx, COut *b, int save) {
+  CGCoro *co = ctx->coro;
+  for (size_t i = 0; i < ctx->len; i++) {
+    long k = local_of(co, &ctx->vars[i]);
+    if (k < 0)
+      continue;
+    Node *decl = co->locals[k];
+    Slice name = decl->as.var_decl.name;
+    co->saved[k] = 1;
+    if (decl->as.var_decl.array_len) {
+      c_out_write(b, "memcpy(");
+      if (save) {
+        c_out_write(b, "dr_f->");
+        emit_field_name(b, co, (size_t)k);
+        c_out_write(b, ", %.*s", (int)name.len, name.start);
+      } else {
+        c_out_write(b, "%.*s, dr_f->", (int)name.len, name.start);
+        emit_field_name(b, co, (size_t)k);
+      }
+      c_out_write(b, ", sizeof(%.*s));\n", (int)name.len, name.start);
+    } else if (save) {
+      c_out_write(b, "dr_f->");
+      emit_field_name(b, co, (size_t)k);
+      c_out_write(b, " = %.*s;\n", (int)name.len, name.start);
+    } else {
+      c_out_write(b, "%.*s = dr_f->", (int)name.len, name.start);
+      emit_field_name(b, co, (size_t)k);
+      c_out_write(b, ";\n");
+    }
+  }
+}
+
+/* ---- suspension points --------------------------------------------------- */
+
+/* Awaits e evaluates unconditionally, innermost first. */
+static void collect_awaits(CGCoro *co, Node *e) {
+  if (!e)
+    return;
+  switch (e->kind) {
+  case ND_UNARY:
+  case ND_POST_UNARY:
+    collect_awaits(co, e->as.unary.expr);
+    break;
+  case ND_BINOP:
+    collect_awaits(co, e->as.bin.lhs);
+    if (e->as.bin.op != TK_ANDAND && e->as.bin.op != TK_OROR &&
+        e->as.bin.op != TK_QMARKQMARK && e->as.bin.op != TK_QMARKQMARKEQ)
+      collect_awaits(co, e->as.bin.rhs);
+    break;
+  case ND_COND:
+    collect_awaits(co, e->as.cond.cond);
+    break;
+  case ND_INDEX:
+    collect_awaits(co, e->as.index.array);
+    collect_awaits(co, e->as.index.index);
+    break;
+  case ND_FIELD:
+    collect_awaits(co, e->as.field.object);
+    break;
+  case ND_CALL:
+    collect_awaits(co, e->as.call.callee);
+    for (size_t i = 0; i < e->as.call.len; i++)
+      collect_awaits(co, e->as.call.args[i]);
+    break;
+  case ND_NEW:
+    for (size_t i = 0; i < e->as.new_expr.arg_len; i++)
+      collect_awaits(co, e->as.new_expr.args[i]);
+    break;
+  case ND_CONSOLE_CALL:
+    collect_awaits(co, e->as.console.arg);
+    break;
+  case ND_AWAIT:
+    collect_awaits(co, e->as.await_expr.expr);
+    if (co->nawaits == co->awaits_cap) {
+      co->awaits_cap = co->awaits_cap ? co->awaits_cap * 2 : 8;
+      co->awaits = realloc(co->awaits, co->awaits_cap * sizeof(Node *));
+    }
+    co->awaits[co->nawaits++] = e;
+    break;
+  default:
+    break;
+  }
+}
+
+static Node *stmt_expr(Node *stmt) {
+  switch (stmt->kind) {
+  case ND_VAR_DECL:
+    return stmt->as.var_decl.init;
+  case ND_EXPR_STMT:
+    return stmt->as.expr_stmt.expr;
+  case ND_RETURN:
+    return stmt->as.ret.expr;
+  case ND_THROW:
+    return stmt->as.throw_stmt.expr;
+  case ND_IF:
+    return stmt->as.if_stmt.cond;
+  case ND_SWITCH:
+    return stmt->as.switch_stmt.expr;
+  default:
+    return NULL;
+  }
+}
+
+/* State k + 1 resumes after the await of slot k. */
+static void emit_suspend(CGCtx *ctx, COut *b, size_t k) {
+  Node *await = ctx->coro->awaits[k];
+  CGOwn own;
+  COut *e = cg_own_begin(ctx, &own, b);
+  c_out_write(e, "dr_f->a%zu = ", k);
+  cg_emit_expr(ctx, e, await->as.await_expr.expr);
+  c_out_write(e, ";");
+  c_out_newline(e);
+  cg_own_end(ctx, &own, CG_OWN_STMT);
+  c_out_write(b, "if (!dr_task_is_complete(dr_f->a%zu)) {\n", k);
+  c_out_indent(b);
+  emit_locals_copy(ctx, b, 1);
+  c_out_write(b, "dr_f->state = %zu;\n", k + 1);
+  c_out_write(b, "if (dr_task_suspend(dr_task, dr_f->a%zu))\n", k);
+  c_out_indent(b);
+  c_out_write(b, "return 1;\n");
+  c_out_dedent(b);
+  c_out_write(b, "dr_s%zu:;\n", k + 1);
+  emit_locals_copy(ctx, b, 0);
+  c_out_dedent(b);
+  c_out_write(b, "}\n");
+}
+
+int cg_coro_stmt_begin(CGCtx *ctx, COut *b, Node *stmt) {
+  CGCoro *co = ctx->coro;
+  Node *e = co ? stmt_expr(stmt) : NULL;
+  /* A try's jump buffer and a region's cleanup do not survive a return. */
+  if (!e || ctx->own || ctx->try_depth || ctx->region_depth ||
+      !locals_distinct(ctx))
+    return 0;
+  size_t first = co->nawaits;
+  collect_awaits(co, e);
+  if (first == co->nawaits)
+    return 0;
+  int opened = stmt->kind != ND_VAR_DECL;
+  if (opened) {
+    c_out_write(b, "{\n");
+    c_out_indent(b);
+  }
+  for (size_t k = first; k < co->nawaits; k++)
+    emit_suspend(ctx, b, k);
+  return opened;
+}
+
+void cg_coro_stmt_end(COut *b, int opened) {
+  if (!opened)
+    return;
+  c_out_dedent(b);
+  c_out_write(b, "}\n");
+}
+
+int cg_coro_await_slot(CGCtx *ctx, Node *n) {
+  CGCoro *co = ctx->coro;
+  for (size_t k = 0; co && k < co->nawaits; k++) {
+    if (co->awaits[k] == n)
+      return (int)k;
+  }
+  return -1;
+}
+
+/* ---- functions ----------------------------------------------------------- */
+
+static void emit_cname(COut *b, Slice prefix, Node *fn, const char *suffix) {
+  if (prefix.len)
+    c_out_write(b, "%.*s_", (int)prefix.len, prefix.start);
+  c_out_write(b, "%.*s%s", (int)fn->as.func.name.len, fn->as.func.name.start,
+              suffix);
+}
+
+static void emit_wrapper_head(COut *b, Slice prefix, Node *fn) {
+  c_out_write(b, "static Task* ");
+  emit_cname(b, prefix, fn, "(");
+  for (size_t i = 0; i < fn->as.func.param_len; i++) {
+    Node *p = fn->as.func.params[i];
+    if (i)
+      c_out_write(b, ", ");
+    cg_emit_decl_type(b, p);
+    c_out_write(b, " %.*s", (int)p->as.var_decl.name.len,
+                p->as.var_decl.name.start);
+  }
+  c_out_write(b, ")");
+}
+
+static void emit_frame(COut *b, Slice prefix, Node *fn, CGCoro *co) {
+  size_t nparams = fn->as.func.param_len;
+  c_out_write(b, "typedef struct {\n");
+  c_out_indent(b);
+  c_out_write(b, "int state;\n");
+  for (size_t k = 0; k < co->nlocals; k++) {
+    if (k >= nparams && !co->saved[k])
+      continue;
+    Node *decl = co->locals[k];
+    cg_emit_decl_type(b, decl);
+    c_out_write(b, " ");
+    emit_field_name(b, co, k);
+    if (decl->as.var_decl.array_len)
+      c_out_write(b, "[%zu]", decl->as.var_decl.array_len);
+    c_out_write(b, ";\n");
+  }
+  for (size_t k = 0; k < co->nawaits; k++)
+    c_out_write(b, "Task* a%zu;\n", k);
+  c_out_dedent(b);
+  c_out_write(b, "} ");
+  emit_cname(b, prefix, fn, "_frame;\n\n");
+}
+
+void cg_coro_emit(COut *b, Slice prefix, Node *fn, const char *src_file) {
+  CGCoro co = {0};
+  for (size_t i = 0; i < fn->as.func.param_len; i++)
+    add_local(&co, fn->as.func.params[i]);
+  collect_locals(&co, fn->as.func.body);
+
+  CGCtx ctx = {0};
+  cg_prof_func_begin(&ctx, prefix, fn->as.func.name);
+  ctx.ret_type = fn->as.func.ret_type;
+  ctx.is_async_worker = 1;
+  ctx.coro = &co;
+
+  /* The body decides which locals the frame needs, so it goes first. */
+  COut body;
+  c_out_init(&body);
+  body.indent = b->indent + 1;
+  body.indent_width = b->indent_width;
+  body.at_line_start = 1;
+  cgctx_scope_enter(&ctx);
+  for (size_t i = 0; i < fn->as.func.param_len; i++) {
+    Node *p = fn->as.func.params[i];
+    cgctx_push(&ctx, p->as.var_decl.name.start, p->as.var_decl.name.len,
+               p->as.var_decl.type,
+               p->as.var_decl.type == TK_IDENT ? p->as.var_decl.type_name
+                                               : (Slice){NULL, 0});
+  }
+  cg_emit_stmt(&ctx, &body, fn->as.func.body, src_file);
+  cgctx_scope_leave(&ctx);
+
+  emit_frame(b, prefix, fn, &co);
+
+  /* The body may start the function again. */
+  emit_wrapper_head(b, prefix, fn);
+  c_out_write(b, ";\n\n");
+
+  c_out_write(b, "static int ");
+  emit_cname(b, prefix, fn, "_resume(Task* dr_task) {\n");
+  c_out_indent(b);
+  emit_cname(b, prefix, fn, "_frame* dr_f = (");
+  emit_cname(b, prefix, fn, "_frame*)dr_task->arg;\n");
+  for (size_t i = 0; i < fn->as.func.param_len; i++) {
+    cg_emit_decl_type(b, co.locals[i]);
+    c_out_write(b, " %.*s = dr_f->", (int)co.locals[i]->as.var_decl.name.len,
+                co.locals[i]->as.var_decl.name.start);
+    emit_field_name(b, &co, i);
+    c_out_write(b, ";\n");
+  }
+  if (co.nawaits) {
+    c_out_write(b, "switch (dr_f->state) {\n");
+    for (size_t k = 0; k < co.nawaits; k++)
+      c_out_write(b, "case %zu: goto dr_s%zu;\n", k + 1, k + 1);
+    c_out_write(b, "}\n");
+  }
+  c_out_append(b, &body);
+  if (!b->at_line_start)
+    c_out_newline(b);
+  c_out_write(b, "return 0;\n");
+  c_out_dedent(b);
+  c_out_write(b, "}\n\n");
+
+  emit_wrapper_head(b, prefix, fn);
+  c_out_write(b, " {\n");
+  c_out_indent(b);
+  int counted = cg_prof_emit_entry(&ctx, b);
+  c_out_write(b, "Task* task = dr_task_create_coroutine(");
+  emit_cname(b, prefix, fn, "_resume, sizeof(");
+  emit_cname(b, prefix, fn, "_frame));\n");
+  if (fn->as.func.param_len) {
+    emit_cname(b, prefix, fn, "_frame* dr_f = (");
+    emit_cname(b, prefix, fn, "_frame*)task->arg;\n");
+  }
+  for (size_t i = 0; i < fn->as.func.param_len; i++) {
+    c_out_write(b, "dr_f->");
+    emit_field_name(b, &co, i);
+    c_out_write(b, " = %.*s;\n", (int)co.locals[i]->as.var_decl.name.len,
+                co.locals[i]->as.var_decl.name.start);
+  }
+  c_out_write(b, "dr_task_start(task);\n");
+  c_out_write(b, "return task;\n");
+  cg_prof_emit_exit(b, counted);
+  c_out_dedent(b);
+  c_out_write(b, "}\n");
+
+  c_out_free(&body);
+  cgctx_free(&ctx);
+  free(co.locals);
+  free(co.saved);
+  free(co.awaits);
+}
@@ -0,0 +1,58 @@
+#ifndef CG_CORO_H
+#define CG_CORO_H
+
+#include "../parser/ast.h"
+#include "c_emit.h"
+#include "context.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Async functions as stackless coroutines.
+ *
+ * An async function becomes a frame struct, a resume function and a
+ * wrapper. The wrapper allocates the task with the frame behind it, stores
+ * the arguments and starts it. The resume function switches on the frame's
+ * state to the suspension point it stopped at, so a coroutine waiting for
+ * another task holds no thread: only its frame stays.
+ *
+ * The locals stay C locals while the coroutine runs. At a suspension point
+ * those in scope are saved to the frame, and restored from it on resume.
+ * An await is a suspension point when the statement around it evaluates it
+ * unconditionally first: in an initializer, expression statement, return,
+ * throw, or if or switch condition, outside &&, ||, ?? and ?:, and not in
+ * a try or region or where a local shadows another. The task is awaited
+ * ahead of the rest of its statement. Other awaits wait in place, running
+ * pending tasks meanwhile.
+ */
+
+typedef struct CGCoro {
+  Node **locals; /* parameters, then the function's declarations */
+  char *saved;   /* per local: saved at some suspension point */
+  size_t nlocals;
+  size_t locals_cap;
+  Node **awaits; /* await whose task is in slot k of the frame */
+  size_t nawaits;
+  size_t awaits_cap;
+} CGCoro;
+
+/* Emits async function fn, a static method of prefix if that is set. */
+void cg_coro_emit(COut *b, Slice prefix, Node *fn, const char *src_file);
+
+/*
+ * Emits the suspension points of stmt ahead of it, opening a block around
+ * them unless stmt declares a local. Returns what cg_coro_stmt_end needs.
+ */
+int cg_coro_stmt_begin(CGCtx *ctx, COut *b, Node *stmt);
+void cg_coro_stmt_end(COut *b, int opened);
+
+/* The frame slot holding the task await n suspended on, or -1. */
+int cg_coro_await_slot(CGCtx *ctx, Node *n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CG_CORO_H
@@ -0,0 +1,312 @@
+#include "escape.h"
+#include "codegen.h"
+#include "reach.h"
+#include "stmt.h"
+#include <string.h>
+
+/* Calls followed into callees before a parameter is assumed to escape. */
+#define ESCAPE_DEPTH 4
+/* Locals remembered per body; later ones are not resolved. */
+#define ESCAPE_LOCALS 64
+
+/* Types of the locals in scope, for resolving method calls. */
+typedef struct {
+  CGCtx *ctx; /* context at the allocation, NULL inside a callee */
+  Slice names[ESCAPE_LOCALS];
+  Slice types[ESCAPE_LOCALS];
+  size_t len;
+} Scope;
+
+static int enabled(void) { return cg_options.opt_level >= 1; }
+
+static int slice_eq(Slice a, Slice b) {
+  return a.len == b.len && a.len && strncmp(a.start, b.start, a.len) == 0;
+}
+
+static int is_name(Node *n, Slice v) {
+  return n && n->kind == ND_IDENT &&
+         slice_eq((Slice){n->as.ident.start, n->as.ident.len}, v);
+}
+
+static void scope_add(Scope *sc, Slice name, Slice type) {
+  if (sc->len < ESCAPE_LOCALS) {
+    sc->names[sc->len] = name;
+    sc->types[sc->len] = type;
+    sc->len++;
+  }
+}
+
+static Slice scope_type(Scope *sc, Node *ident) {
+  Slice name = {ident->as.ident.start, ident->as.ident.len};
+  for (size_t i = sc->len; i-- > 0;) {
+    if (slice_eq(sc->names[i], name))
+      return sc->types[i];
+  }
+  if (sc->ctx)
+    return cgctx_lookup_name(sc->ctx, name.start, name.len);
+  return (Slice){NULL, 0};
+}
+
+static int stays(Scope *sc, Node *n, Slice v, int depth);
+
+/* Nonzero if the function keeps no pointer to the named variable. */
+static int body_stays(Node *fn, Slice owner, Slice v, int depth) {
+  if (!fn || fn->as.func.is_async || depth >= ESCAPE_DEPTH)
+    return 0;
+  Scope sc = {0};
+  if (owner.len && !fn->as.func.is_static)
+    scope_add(&sc, (Slice){"this", 4}, owner);
+  for (size_t i = 0; i < fn->as.func.param_len; i++) {
+    Node *p = fn->as.func.params[i];
+    scope_add(&sc, p->as.var_decl.name,
+              p->as.var_decl.type == TK_IDENT ? p->as.var_decl.type_name
+                                              : (Slice){NULL, 0});
+  }
+  return stays(&sc, fn->as.func.body, v, depth + 1);
+}
+
+static int param_stays(Node *fn, Slice owner, size_t i, int depth) {
+  if (!fn || i >= fn->as.func.param_len)
+    return 0;
+  return body_stays(fn, owner, fn->as.func.params[i]->as.var_decl.name, depth);
+}
+
+/* Nonzero if constructing a type_name keeps no pointer to the instance. */
+static int init_stays(Slice type_name, int depth) {
+  if (!cg_has_init(type_name))
+    return 1;
+  Node *init = cg_reach_method(type_name, (Slice){"init", 4});
+  return body_stays(init, type_name, (Slice){"this", 4}, depth);
+}
+
+/*
+ * The function a call goes to, resolved the way emit_call does, with the
+ * type declaring it in owner and the receiver, if any, in recv.
+ */
+static Node *resolve(Scope *sc, Node *call, Slice *owner, Node **recv) {
+  Node *callee = call->as.call.callee;
+  *owner = (Slice){NULL, 0};
+  *recv = NULL;
+  if (callee && callee->kind == ND_IDENT)
+    return cg_reach_function(
+        (Slice){callee->as.ident.start, callee->as.ident.len});
+  if (!callee || callee->kind != ND_FIELD || !callee->as.field.object ||
+      callee->as.field.object->kind != ND_IDENT)
+    return NULL;
+  Node *obj = callee->as.field.object;
+  Slice ty = scope_type(sc, obj);
+  if (ty.len) {
+    *recv = obj;
+  } else {
+    ty = (Slice){obj->as.ident.start, obj->as.ident.len};
+    if (!cg_is_class_type(ty))
+      return NULL;
+  }
+  Node *fn = cg_reach_method(ty, callee->as.field.name);
+  if (fn && (*recv != NULL) == fn->as.func.is_static)
+    return NULL;
+  *owner = ty;
+  return fn;
+}
+
+static int call_stays(Scope *sc, Node *call, Slice v, int depth) {
+  Slice owner;
+  Node *recv;
+  Node *fn = resolve(sc, call, &owner, &recv);
+  Node *callee = call->as.call.callee;
+  if (recv) {
+    if (is_name(recv, v) && !body_stays(fn, owner, (Slice){"this", 4}, depth))
+      return 0;
+  } else if (callee && callee->kind == ND_FIELD) {
+    if (!fn && !stays(sc, callee->as.field.object, v, depth))
+      return 0;
+  } else if (!fn && !stays(sc, callee, v, depth)) {
+    return 0;
+  }
+  for (size_t i = 0; i < call->as.call.len; i++) {
+    Node *arg = call->as.call.args[i];
+    if (is_name(arg, v) ? !param_stays(fn, owner, i, depth)
+                        : !stays(sc, arg, v, depth))
+      return 0;
+  }
+  return 1;
+}
+
+static int is_assign_op(TokenKind op) {
+  switch (op) {
+  case TK_EQ:
+  case TK_PLUSEQ:
+  case TK_MINUSEQ:
+  case TK_STAREQ:
+  case TK_SLASHEQ:
+  case TK_PERCENTEQ:
+  case TK_ANDEQ:
+  case TK_OREQ:
+  case TK_XOREQ:
+  case TK_LSHIFTEQ:
+  case TK_RSHIFTEQ:
+  case TK_QMARKQMARKEQ:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+/* An operand that may be v itself without letting it escape. */
+static int operand_stays(Scope *sc, Node *n, Slice v, int depth) {
+  return is_name(n, v) || stays(sc, n, v, depth);
+}
+
+/* Nonzero if nothing in n lets the variable v escape. */
+static int stays(Scope *sc, Node *n, Slice v, int depth) {
+  if (!n)
+    return 1;
+  switch (n->kind) {
+  case ND_INT:
+  case ND_FLOAT:
+  case ND_CHAR:
+  case ND_STRING:
+  case ND_BOOL:
+  case ND_NULL:
+  case ND_BASE:
+  case ND_BREAK:
+  case ND_CONTINUE:
+    return 1;
+  case ND_IDENT:
+    return !is_name(n, v);
+  case ND_UNARY:
+  case ND_POST_UNARY:
+    return stays(sc, n->as.unary.expr, v, depth);
+  case ND_BINOP:
+    if (is_assign_op(n->as.bin.op) && is_name(n->as.bin.lhs, v))
+      return 0;
+    if (n->as.bin.op == TK_EQEQ || n->as.bin.op == TK_NEQ)
+      return operand_stays(sc, n->as.bin.lhs, v, depth) &&
+             operand_stays(sc, n->as.bin.rhs, v, depth);
+    return stays(sc, n->as.bin.lhs, v, depth) &&
+           stays(sc, n->as.bin.rhs, v, depth);
+  case ND_COND:
+    return stays(sc, n->as.cond.cond, v, depth) &&
+           stays(sc, n->as.cond.then_expr, v, depth) &&
+           stays(sc, n->as.cond.else_expr, v, depth);
+  case ND_INDEX:
+    return stays(sc, n->as.index.array, v, depth) &&
+           stays(sc, n->as.index.index, v, depth);
+  case ND_FIELD:
+    return operand_stays(sc, n->as.field.object, v, depth);
+  case ND_CONSOLE_CALL:
+    return operand_stays(sc, n->as.console.arg, v, depth);
+  case ND_CALL:
+    return call_stays(sc, n, v, depth);
+  case ND_NEW:
+    for (size_t i = 0; i < n->as.new_expr.arg_len; i++) {
+      Node *arg = n->as.new_expr.args[i];
+      if (is_name(arg, v)
+              ? !param_stays(cg_reach_method(n->as.new_expr.type_name,
+                                             (Slice){"init", 4}),
+                             n->as.new_expr.type_name, i, depth)
+              : !stays(sc, arg, v, depth))
+        return 0;
+    }
+    return 1;
+  case ND_VAR_DECL: {
+    if (slice_eq(n->as.var_decl.name, v) ||
+        !stays(sc, n->as.var_decl.init, v, depth))
+      return 0;
+    scope_add(sc, n->as.var_decl.name,
+              n->as.var_decl.type == TK_IDENT ? n->as.var_decl.type_name
+                                              : (Slice){NULL, 0});
+    return 1;
+  }
+  case ND_IF:
+    return stays(sc, n->as.if_stmt.cond, v, depth) &&
+           stays(sc, n->as.if_stmt.then_br, v, depth) &&
+           stays(sc, n->as.if_stmt.else_br, v, depth);
+  case ND_WHILE:
+    return stays(sc, n->as.while_stmt.cond, v, depth) &&
+           stays(sc, n->as.while_stmt.body, v, depth);
+  case ND_DO_WHILE:
+    return stays(sc, n->as.do_while_stmt.body, v, depth) &&
+           stays(sc, n->as.do_while_stmt.cond, v, depth);
+  case ND_FOR: {
+    size_t mark = sc->len;
+    int ok = stays(sc, n->as.for_stmt.init, v, depth) &&
+             stays(sc, n->as.for_stmt.cond, v, depth) &&
+             stays(sc, n->as.for_stmt.update, v, depth) &&
+             stays(sc, n->as.for_stmt.body, v, depth);
+    sc->len = mark;
+    return ok;
+  }
+  case ND_BLOCK: {
+    size_t mark = sc->len;
+    int ok = 1;
+    for (size_t i = 0; ok && i < n->as.block.len; i++)
+      ok = stays(sc, n->as.block.items[i], v, depth);
+    sc->len = mark;
+    return ok;
+  }
+  case ND_EXPR_STMT:
+    return stays(sc, n->as.expr_stmt.expr, v, depth);
+  case ND_RETURN:
+    return stays(sc, n->as.ret.expr, v, depth);
+  case ND_THROW:
+    return stays(sc, n->as.throw_stmt.expr, v, depth);
+  case ND_AWAIT:
+    return stays(sc, n->as.await_expr.expr, v, depth);
+  case ND_REGION:
+    return stays(sc, n->as.region.body, v, depth);
+  case ND_SWITCH:
+    if (!stays(sc, n->as.switch_stmt.expr, v, depth))
+      return 0;
+    for (size_t i = 0; i < n->as.switch_stmt.len; i++) {
+      if (!stays(sc, n->as.switch_stmt.cases[i].value, v, depth) ||
+          !stays(sc, n->as.switch_stmt.cases[i].body, v, depth))
+        return 0;
+    }
+    return 1;
+  case ND_TRY:
+    return !slice_eq(n->as.try_stmt.catch_param, v) &&
+           stays(sc, n->as.try_stmt.body, v, depth) &&
+           stays(sc, n->as.try_stmt.catch_body, v, depth) &&
+           stays(sc, n->as.try_stmt.finally_body, v, depth);
+  default:
+    return 0;
+  }
+}
+
+static int is_class_new(Node *n) {
+  return n && n->kind == ND_NEW && cg_is_class_type(n->as.new_expr.type_name);
+}
+
+int cg_escape_local(CGCtx *ctx, Node **items, size_t len, size_t i) {
+  Node *n = items[i];
+  if (!enabled() || n->kind != ND_VAR_DECL || n->as.var_decl.type != TK_IDENT ||
+      n->as.var_decl.array_len || n->as.var_decl.is_pointer ||
+      !is_class_new(n->as.var_decl.init) ||
+      !slice_eq(n->as.var_decl.type_name,
+                n->as.var_decl.init->as.new_expr.type_name))
+    return 0;
+  Slice type = n->as.var_decl.type_name;
+  if (!init_stays(type, 0))
+    return 0;
+  Scope sc = {0};
+  sc.ctx = ctx;
+  scope_add(&sc, n->as.var_decl.name, type);
+  for (size_t k = i + 1; k < len; k++) {
+    if (!stays(&sc, items[k], n->as.var_decl.name, 0))
+      return 0;
+  }
+  return 1;
+}
+
+int cg_escape_arg(CGCtx *ctx, Node *call, size_t i) {
+  Node *arg = call->as.call.args[i];
+  if (!enabled() || !is_class_new(arg) ||
+      !init_stays(arg->as.new_expr.type_name, 0))
+    return 0;
+  Scope sc = {0};
+  sc.ctx = ctx;
+  Slice owner;
+  Node *recv;
+  return param_stays(resolve(&sc, call, &owner, &recv), owner, i, 0);
+}
@@ -0,0 +1,43 @@
+#ifndef CG_ESCAPE_H
+#define CG_ESCAPE_H
+
+#include "../parser/ast.h"
+#include "context.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Escape analysis for class instances, from -O1 on.
+ *
+ * An instance escapes when a pointer to it can outlive the block that
+ * created it: it is stored in a variable, field or element, returned,
+ * thrown, compared with ?? or handed to a parameter that escapes. Reading
+ * and writing its fields, calling its methods whose `this` does not escape
+ * and comparing it with == or != are fine. Parameters and `this` are
+ * judged the same way over the body of their function, a few calls deep.
+ *
+ * `new T(...)` that does not escape is built in a stack slot, with a static
+ * DrRef header so that retains and releases reaching it do nothing, and the
+ * local holding it is not released. The slot is a plain struct, so the C
+ * compiler can keep its fields in registers.
+ */
+
+/*
+ * Nonzero if items[i] declares a local of a class initialized with `new` of
+ * that class, and the instance does not escape the rest of the block.
+ */
+int cg_escape_local(CGCtx *ctx, Node **items, size_t len, size_t i);
+
+/*
+ * Nonzero if argument i of the call is a `new` of a class that the callee
+ * does not keep.
+ */
+int cg_escape_arg(CGCtx *ctx, Node *call, size_t i);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CG_ESCAPE_H
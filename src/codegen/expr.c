@@ -1,5 +1,15 @@
 #include "expr.h"
+#include "bounds.h"
+#include "consteval.h"
+#include "coro.h"
+#include "escape.h"
+#include "owner.h"
+#include "profile.h"
+#include "reach.h"
 #include "stmt.h"
+#include "strlit.h"
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 static Slice expr_type(CGCtx *ctx, Node *n) {
@@ -125,6 +135,105 @@ const char *cg_fmt_for_arg(CGCtx *ctx, Node *arg) {
   }
 }
 
+Node *cg_async_callee(Node *e) {
+  if (e->kind != ND_CALL || !e->as.call.callee ||
+      e->as.call.callee->kind != ND_IDENT)
+    return NULL;
+  Node *fn = cg_reach_function((Slice){e->as.call.callee->as.ident.start,
+                                       e->as.call.callee->as.ident.len});
+  return fn && fn->as.func.is_async ? fn : NULL;
+}
+
+/* The Task.X calls: the runtime function, whether it returns a task and
+ * the type of its result, or of awaiting that task, and whether the
+ * arguments are tasks passed as an array. */
+typedef struct {
+  const char *name;
+  const char *fn;
+  int task;
+  TokenKind result;
+  int tasks;
+} CGTaskBuiltin;
+
+static const CGTaskBuiltin task_builtins[] = {
+    {"WhenAll", "dr_task_when_all", 1, TK_KW_INT, 1},
+    {"WhenAny", "dr_task_when_any", 1, TK_KW_INT, 1},
+    {"Delay", "dr_io_delay", 1, TK_KW_INT, 0},
+    {"Read", "dr_io_read", 1, TK_KW_STRING, 0},
+    {"Write", "dr_io_write", 1, TK_KW_INT, 0},
+    {"Pipe", "dr_io_pipe", 0, TK_KW_INT, 0},
+    {"SocketPair", "dr_io_socketpair", 0, TK_KW_INT, 0},
+    {"Close", "dr_io_close", 0, TK_KW_INT, 0},
+};
+
+static const CGTaskBuiltin *find_task_builtin(Slice name) {
+  for (size_t i = 0; i < sizeof task_builtins / sizeof *task_builtins; i++) {
+    if (strlen(task_builtins[i].name) == name.len &&
+        strncmp(task_builtins[i].name, name.start, name.len) == 0)
+      return &task_builtins[i];
+  }
+  return NULL;
+}
+
+static const CGTaskBuiltin *task_builtin_call(Node *e) {
+  if (e->kind != ND_CALL || !e->as.call.callee ||
+      e->as.call.callee->kind != ND_FIELD)
+    return NULL;
+  Node *obj = e->as.call.callee->as.field.object;
+  if (!obj || obj->kind != ND_IDENT || obj->as.ident.len != 4 ||
+      strncmp(obj->as.ident.start, "Task", 4) != 0)
+    return NULL;
+  return find_task_builtin(e->as.call.callee->as.field.name);
+}
+
+Slice cg_task_builtin(Node *e) {
+  const CGTaskBuiltin *tb = task_builtin_call(e);
+  if (!tb || !tb->task)
+    return (Slice){NULL, 0};
+  return e->as.call.callee->as.field.name;
+}
+
+/* The TaskResult member an async function's result is stored in. */
+static const char *task_result_member(TokenKind ret_type) {
+  switch (ret_type) {
+  case TK_KW_VOID:
+    return "";
+  case TK_KW_INT:
+  case TK_KW_BOOL:
+    return ".int_val";
+  case TK_KW_FLOAT:
+    return ".float_val";
+  case TK_KW_STRING:
+    return ".string_val";
+  default:
+    return ".ptr_val";
+  }
+}
+
+/* The result type of the task n awaits, void if unknown: a direct call, or
+ * a Task local, which remembers the async function or Task.X call that
+ * started it. */
+static TokenKind awaited_type(CGCtx *ctx, Node *n) {
+  Node *e = n->as.await_expr.expr;
+  Node *fn = cg_async_callee(e);
+  const CGTaskBuiltin *tb = fn ? NULL : task_builtin_call(e);
+  if (tb && tb->task)
+    return tb->result;
+  if (!fn && e->kind == ND_IDENT &&
+      cgctx_lookup(ctx, e->as.ident.start, e->as.ident.len) == TK_KW_TASK) {
+    Slice name = cgctx_lookup_name(ctx, e->as.ident.start, e->as.ident.len);
+    fn = cg_reach_function(name);
+    tb = !fn && name.len ? find_task_builtin(name) : NULL;
+    if (tb && tb->task)
+      return tb->result;
+  }
+  return fn ? fn->as.func.ret_type : TK_KW_VOID;
+}
+
+static int awaits_type(CGCtx *ctx, Node *n, TokenKind type) {
+  return awaited_type(ctx, n) == type;
+}
+
 int cg_is_string_expr(CGCtx *ctx, Node *n) {
   switch (n->kind) {
   case ND_STRING:
@@ -134,7 +243,15 @@ int cg_is_string_expr(CGCtx *ctx, Node *n) {
            TK_KW_STRING;
   case ND_CONSOLE_CALL:
     return n->as.console.read;
+  case ND_AWAIT:
+    return awaits_type(ctx, n, TK_KW_STRING);
   case ND_CALL:
+    if (n->as.call.callee && n->as.call.callee->kind == ND_IDENT) {
+      Node *fn = cg_reach_function((Slice){n->as.call.callee->as.ident.start,
+                                           n->as.call.callee->as.ident.len});
+      return fn && !fn->as.func.is_async &&
+             fn->as.func.ret_type == TK_KW_STRING;
+    }
     // Handle method calls that might return strings
     if (n->as.call.callee && n->as.call.callee->kind == ND_FIELD) {
       Node *fld = n->as.call.callee;
@@ -152,22 +269,14 @@ int cg_is_string_expr(CGCtx *ctx, Node *n) {
     return 0;
   case ND_BINOP:
     // Handle string concatenation operations (+ operator with strings)
-    if (n->as.bin.op == TK_PLUS) {
-      int lhs_is_string = cg_is_string_expr(ctx, n->as.bin.lhs);
-      int rhs_is_string = cg_is_string_expr(ctx, n->as.bin.rhs);
-      int lhs_is_int = cg_is_int_expr(ctx, n->as.bin.lhs);
-      int rhs_is_int = cg_is_int_expr(ctx, n->as.bin.rhs);
-      int lhs_is_float = cg_is_float_expr(ctx, n->as.bin.lhs);
-      int rhs_is_float = cg_is_float_expr(ctx, n->as.bin.rhs);
-      
-      // Any concatenation with at least one string results in a string
-      return (lhs_is_string && rhs_is_string) ||
-             (lhs_is_string && rhs_is_int) ||
-             (lhs_is_int && rhs_is_string) ||
-             (lhs_is_string && rhs_is_float) ||
-             (lhs_is_float && rhs_is_string);
-    }
+    // Any concatenation with at least one string results in a string
+    if (n->as.bin.op == TK_PLUS)
+      return cg_is_string_expr(ctx, n->as.bin.lhs) ||
+             cg_is_string_expr(ctx, n->as.bin.rhs);
     return 0;
+  case ND_FIELD:
+    return cg_field_type(expr_type(ctx, n->as.field.object),
+                         n->as.field.name) == TK_KW_STRING;
   case ND_INDEX:
     // Array access - check if the array is a string array
     if (n->as.index.array->kind == ND_IDENT) {
@@ -187,6 +296,8 @@ int cg_is_int_expr(CGCtx *ctx, Node *n) {
     return 1;
   case ND_IDENT:
     return cgctx_lookup(ctx, n->as.ident.start, n->as.ident.len) == TK_KW_INT;
+  case ND_AWAIT:
+    return awaits_type(ctx, n, TK_KW_INT);
   default:
     return 0;
   }
@@ -198,12 +309,343 @@ int cg_is_float_expr(CGCtx *ctx, Node *n) {
     return 1;
   case ND_IDENT:
     return cgctx_lookup(ctx, n->as.ident.start, n->as.ident.len) == TK_KW_FLOAT;
+  case ND_AWAIT:
+    return awaits_type(ctx, n, TK_KW_FLOAT);
+  case ND_UNARY:
+    return n->as.unary.op == TK_MINUS && cg_is_float_expr(ctx, n->as.unary.expr);
+  case ND_BINOP:
+    /* Arithmetic with a float operand is float arithmetic. */
+    switch (n->as.bin.op) {
+    case TK_PLUS:
+    case TK_MINUS:
+    case TK_STAR:
+    case TK_SLASH:
+      return !cg_is_string_expr(ctx, n) &&
+             (cg_is_float_expr(ctx, n->as.bin.lhs) ||
+              cg_is_float_expr(ctx, n->as.bin.rhs));
+    default:
+      return 0;
+    }
+  case ND_CALL:
+    if (n->as.call.callee && n->as.call.callee->kind == ND_IDENT) {
+      Node *fn = cg_reach_function((Slice){n->as.call.callee->as.ident.start,
+                                           n->as.call.callee->as.ident.len});
+      return fn && !fn->as.func.is_async &&
+             fn->as.func.ret_type == TK_KW_FLOAT;
+    }
+    return 0;
   default:
     return 0;
   }
 }
 
+/* Nonzero if n is a bool: a literal, a variable, a comparison or a logical
+ * operation. */
+static int is_bool_expr(CGCtx *ctx, Node *n) {
+  switch (n->kind) {
+  case ND_BOOL:
+    return 1;
+  case ND_IDENT:
+    return cgctx_lookup(ctx, n->as.ident.start, n->as.ident.len) == TK_KW_BOOL;
+  case ND_UNARY:
+    return n->as.unary.op == TK_BANG;
+  case ND_BINOP:
+    switch (n->as.bin.op) {
+    case TK_EQEQ:
+    case TK_NEQ:
+    case TK_LT:
+    case TK_GT:
+    case TK_LTEQ:
+    case TK_GTEQ:
+    case TK_ANDAND:
+    case TK_OROR:
+      return 1;
+    default:
+      return 0;
+    }
+  default:
+    return 0;
+  }
+}
+
+static int is_char_expr(CGCtx *ctx, Node *n) {
+  if (n->kind == ND_CHAR)
+    return 1;
+  return n->kind == ND_IDENT &&
+         cgctx_lookup(ctx, n->as.ident.start, n->as.ident.len) == TK_KW_CHAR;
+}
+
+/* The operands of a chain of string concatenations, left to right. */
+static void concat_parts(CGCtx *ctx, Node *n, Node ***parts, size_t *len,
+                         size_t *cap) {
+  if (n->kind == ND_BINOP && n->as.bin.op == TK_PLUS &&
+      cg_is_string_expr(ctx, n)) {
+    concat_parts(ctx, n->as.bin.lhs, parts, len, cap);
+    concat_parts(ctx, n->as.bin.rhs, parts, len, cap);
+    return;
+  }
+  if (*len == *cap) {
+    *cap = *cap ? *cap * 2 : 8;
+    *parts = realloc(*parts, *cap * sizeof(**parts));
+  }
+  (*parts)[(*len)++] = n;
+}
+
+/* How dream_concat_n formats n; anything not otherwise known is an int. */
+static char concat_kind(CGCtx *ctx, Node *n) {
+  if (cg_is_string_expr(ctx, n))
+    return 's';
+  if (cg_is_float_expr(ctx, n))
+    return 'f';
+  if (is_bool_expr(ctx, n))
+    return 'b';
+  if (is_char_expr(ctx, n))
+    return 'c';
+  return 'i';
+}
+
+/* Parts per dream_concat_n call, DREAM_CONCAT_MAX in the runtime. */
+#define CONCAT_MAX 16
+
+/*
+ * One dream_concat_n call for the parts; longer chains nest the leading
+ * parts as its first argument.
+ */
+static void emit_concat_n(CGCtx *ctx, COut *b, Node **parts, size_t len) {
+  size_t first = len > CONCAT_MAX ? len - (CONCAT_MAX - 1) : 0;
+  char kinds[CONCAT_MAX + 1];
+  size_t k = 0;
+  if (first)
+    kinds[k++] = 's';
+  for (size_t i = first; i < len; i++)
+    kinds[k++] = concat_kind(ctx, parts[i]);
+  kinds[k] = '\0';
+  c_out_write(b, "dream_concat_n(\"%s\"", kinds);
+  if (first) {
+    c_out_write(b, ", ");
+    emit_concat_n(ctx, b, parts, first);
+  }
+  for (size_t i = first; i < len; i++) {
+    /* Variadic floats are read back as double. */
+    c_out_write(b, concat_kind(ctx, parts[i]) == 'f' ? ", (double)" : ", ");
+    cg_emit_expr(ctx, b, parts[i]);
+  }
+  c_out_write(b, ")");
+}
+
+/*
+ * Emits a chain of three or more concatenated parts as a single builder
+ * call, which measures everything first and allocates once; returns 0 if n
+ * is not such a chain.
+ */
+static int emit_concat_chain(CGCtx *ctx, COut *b, Node *n) {
+  if (!cg_is_string_expr(ctx, n))
+    return 0;
+  Node **parts = NULL;
+  size_t len = 0, cap = 0;
+  concat_parts(ctx, n, &parts, &len, &cap);
+  int ok = len >= 3;
+  if (ok)
+    emit_concat_n(ctx, b, parts, len);
+  free(parts);
+  return ok;
+}
+
+/* Emits argument i of a call, in a stack slot if the callee cannot keep it. */
+static void emit_arg(CGCtx *ctx, COut *b, Node *call, size_t i) {
+  Node *arg = call->as.call.args[i];
+  Node *saved = ctx->stack_new;
+  int saved_slot = ctx->stack_slot;
+  int slot = cg_escape_arg(ctx, call, i)
+                 ? cg_own_slot(ctx, arg->as.new_expr.type_name)
+                 : 0;
+  if (slot) {
+    ctx->stack_new = arg;
+    ctx->stack_slot = slot;
+  }
+  /* Async calls read their arguments after a region may have closed. */
+  int promoted =
+      ctx->own_suppress && cg_own_promote_begin(ctx, b, call, arg, 0);
+  cg_emit_expr(ctx, b, arg);
+  if (promoted)
+    c_out_write(b, ")");
+  ctx->stack_new = saved;
+  ctx->stack_slot = saved_slot;
+}
+
+static void emit_call(CGCtx *ctx, COut *b, Node *n) {
+  /* Task.WhenAll(a, b, ...) passes its tasks as an array. */
+  const CGTaskBuiltin *tb = task_builtin_call(n);
+  if (tb) {
+    c_out_write(b, "%s(", tb->fn);
+    if (tb->tasks)
+      c_out_write(b, n->as.call.len ? "(Task*[]){" : "NULL");
+    for (size_t i = 0; i < n->as.call.len; i++) {
+      if (i)
+        c_out_write(b, ", ");
+      emit_arg(ctx, b, n, i);
+    }
+    if (tb->tasks)
+      c_out_write(b, "%s, %zu", n->as.call.len ? "}" : "", n->as.call.len);
+    c_out_write(b, ")");
+    return;
+  }
+  if (n->as.call.callee && n->as.call.callee->kind == ND_FIELD) {
+    Node *fld = n->as.call.callee;
+    
+    // Check if this is a module-qualified call (module.function)
+    if (fld->as.field.object && fld->as.field.object->kind == ND_IDENT) {
+      int is_var = cgctx_has_var(ctx, fld->as.field.object->as.ident.start,
+                                 fld->as.field.object->as.ident.len);
+      if (!is_var) {
+        // This appears to be a module-qualified call like math_utils.add()
+        // Convert to C function call: module_function()
+        c_out_write(b, "%.*s_%.*s(", 
+                    (int)fld->as.field.object->as.ident.len, fld->as.field.object->as.ident.start,
+                    (int)fld->as.field.name.len, fld->as.field.name.start);
+        
+        // Emit arguments
+        for (size_t i = 0; i < n->as.call.len; i++) {
+          if (i) c_out_write(b, ", ");
+          emit_arg(ctx, b, n, i);
+        }
+        c_out_write(b, ")");
+        return;
+      }
+    }
+    
+    Slice ty = expr_type(ctx, fld->as.field.object);
+    int is_var = 0;
+    if (fld->as.field.object->kind == ND_IDENT)
+      is_var = cgctx_has_var(ctx, fld->as.field.object->as.ident.start,
+                             fld->as.field.object->as.ident.len);
+    if (ty.len) {
+      c_out_write(b, "%.*s_%.*s(", (int)ty.len, ty.start,
+                  (int)fld->as.field.name.len, fld->as.field.name.start);
+      if (is_var) {
+        if (cg_is_class_type(ty))
+          cg_emit_expr(ctx, b, fld->as.field.object);
+        else {
+          c_out_write(b, "&");
+          cg_emit_expr(ctx, b, fld->as.field.object);
+        }
+      }
+      for (size_t i = 0; i < n->as.call.len; i++) {
+        if (is_var || i)
+          c_out_write(b, ", ");
+        emit_arg(ctx, b, n, i);
+      }
+      c_out_write(b, ")");
+      return;
+    }
+  }
+  cg_emit_expr(ctx, b, n->as.call.callee);
+  c_out_write(b, "(");
+  for (size_t i = 0; i < n->as.call.len; i++) {
+    if (i)
+      c_out_write(b, ", ");
+    emit_arg(ctx, b, n, i);
+  }
+  c_out_write(b, ")");
+}
+
+/*
+ * Names the function a call targets the way the optimizer does, "name" or
+ * "Type.name", resolved like emit_call; NULL if the target is unknown.
+ */
+static const char *call_target(CGCtx *ctx, Node *n, char *buf, size_t size) {
+  Node *callee = n->as.call.callee;
+  if (callee && callee->kind == ND_IDENT) {
+    snprintf(buf, size, "%.*s", (int)callee->as.ident.len, callee->as.ident.start);
+    return buf;
+  }
+  if (!callee || callee->kind != ND_FIELD)
+    return NULL;
+  Node *obj = callee->as.field.object;
+  Slice owner = {NULL, 0};
+  if (obj && obj->kind == ND_IDENT &&
+      !cgctx_has_var(ctx, obj->as.ident.start, obj->as.ident.len))
+    owner = (Slice){obj->as.ident.start, obj->as.ident.len};
+  else if (obj)
+    owner = expr_type(ctx, obj);
+  if (!owner.len)
+    return NULL;
+  snprintf(buf, size, "%.*s.%.*s", (int)owner.len, owner.start,
+           (int)callee->as.field.name.len, callee->as.field.name.start);
+  return buf;
+}
+
+/* Nonzero if the call goes to an async function or method. */
+static int is_async_call(Node *n) {
+  Node *callee = n->as.call.callee;
+  if (callee && callee->kind == ND_IDENT) {
+    Node *fn = cg_reach_function(
+        (Slice){callee->as.ident.start, callee->as.ident.len});
+    return fn && fn->as.func.is_async;
+  }
+  if (callee && callee->kind == ND_FIELD)
+    return cg_reach_async_method(callee->as.field.name);
+  return 0;
+}
+
+/*
+ * Assignments of strings and objects keep the reference counts straight:
+ * an owned local or a field of an object releases the value it held, and
+ * the stored value is retained unless it is fresh. Returns 0 for other
+ * assignments.
+ */
+static int emit_ref_assign(CGCtx *ctx, COut *b, Node *n) {
+  Node *lhs = n->as.bin.lhs, *rhs = n->as.bin.rhs;
+  if (!cg_own_is_ref(ctx, rhs) &&
+      !(lhs->kind == ND_IDENT && cg_own_is_ref(ctx, lhs)))
+    return 0;
+  TokenKind type = lhs->kind == ND_IDENT
+                       ? cgctx_lookup(ctx, lhs->as.ident.start, lhs->as.ident.len)
+                       : (TokenKind)0;
+  /* Struct values are copied field by field, so their fields own nothing. */
+  if (lhs->kind == ND_FIELD &&
+      cg_is_class_type(expr_type(ctx, lhs->as.field.object))) {
+    c_out_write(b, "({ __auto_type dr_at = &");
+    cg_emit_expr(ctx, b, lhs);
+    c_out_write(b, "; __auto_type dr_old = *dr_at; *dr_at = ");
+    int promoted = cg_own_promote_begin(ctx, b, lhs, rhs, type);
+    cg_own_emit_stored(ctx, b, rhs, 0);
+    c_out_write(b, promoted ? ")" : "");
+    c_out_write(b, "; dr_release((void *)dr_old); *dr_at; })");
+  } else if (lhs->kind != ND_IDENT) {
+    c_out_write(b, "(");
+    cg_emit_expr(ctx, b, lhs);
+    c_out_write(b, " = ");
+    int promoted = cg_own_promote_begin(ctx, b, lhs, rhs, type);
+    cg_own_emit_stored(ctx, b, rhs, 0);
+    c_out_write(b, promoted ? "))" : ")");
+  } else if (cgctx_lookup_owned(ctx, lhs->as.ident.start, lhs->as.ident.len)) {
+    int len = (int)lhs->as.ident.len;
+    const char *name = lhs->as.ident.start;
+    c_out_write(b, "({ __auto_type dr_old = %.*s; %.*s = ", len, name, len,
+                name);
+    int promoted = cg_own_promote_begin(ctx, b, lhs, rhs, type);
+    cg_own_emit_stored(ctx, b, rhs, 0);
+    c_out_write(b, promoted ? ")" : "");
+    c_out_write(b, "; dr_release((void *)dr_old); %.*s; })", len, name);
+  } else {
+    /* Parameters are borrowed and never released. */
+    c_out_write(b, "(%.*s = ", (int)lhs->as.ident.len, lhs->as.ident.start);
+    int promoted = cg_own_promote_begin(ctx, b, lhs, rhs, type);
+    cg_emit_expr_owned(ctx, b, rhs);
+    c_out_write(b, promoted ? "))" : ")");
+  }
+  return 1;
+}
+
 void cg_emit_expr(CGCtx *ctx, COut *b, Node *n) {
+  int temp = cg_own_temp_begin(ctx, b, n);
+  cg_emit_expr_owned(ctx, b, n);
+  if (temp)
+    c_out_write(b, ")");
+}
+
+static void emit_node(CGCtx *ctx, COut *b, Node *n) {
   switch (n->kind) {
   case ND_INT:
   case ND_FLOAT:
@@ -221,7 +663,7 @@ void cg_emit_expr(CGCtx *ctx, COut *b, Node *n) {
     } else if (n->kind == ND_CHAR) {
       c_out_write(b, "'%.*s'", (int)n->as.lit.len, n->as.lit.start);
     } else if (n->kind == ND_STRING) {
-      c_out_write(b, "\"%.*s\"", (int)n->as.lit.len, n->as.lit.start);
+      cg_strlit_emit(b, n->as.lit.start, n->as.lit.len);
     } else {
       c_out_write(b, "%.*s", (int)n->as.lit.len, n->as.lit.start);
     }
@@ -242,6 +684,21 @@ void cg_emit_expr(CGCtx *ctx, COut *b, Node *n) {
     c_out_write(b, ")");
     break;
   case ND_BINOP:
+    if (n->as.bin.op == TK_PLUS && emit_concat_chain(ctx, b, n))
+      break;
+    if (n->as.bin.op == TK_EQ && emit_ref_assign(ctx, b, n))
+      break;
+    if ((n->as.bin.op == TK_EQEQ || n->as.bin.op == TK_NEQ) &&
+        cg_is_string_expr(ctx, n->as.bin.lhs) &&
+        cg_is_string_expr(ctx, n->as.bin.rhs)) {
+      /* Strings compare by value; the headers settle most cases in O(1). */
+      c_out_write(b, n->as.bin.op == TK_NEQ ? "(!dr_str_eq(" : "(dr_str_eq(");
+      cg_emit_expr(ctx, b, n->as.bin.lhs);
+      c_out_write(b, ", ");
+      cg_emit_expr(ctx, b, n->as.bin.rhs);
+      c_out_write(b, "))");
+      break;
+    }
     c_out_write(b, "(");
     if (n->as.bin.op == TK_PLUS) {
       int lhs_is_string = cg_is_string_expr(ctx, n->as.bin.lhs);
@@ -287,6 +744,10 @@ void cg_emit_expr(CGCtx *ctx, COut *b, Node *n) {
         c_out_write(b, ", ");
         cg_emit_expr(ctx, b, n->as.bin.rhs);
         c_out_write(b, ")");
+      } else if (lhs_is_string || rhs_is_string) {
+        // String + bool, char or any other operand
+        Node *parts[2] = {n->as.bin.lhs, n->as.bin.rhs};
+        emit_concat_n(ctx, b, parts, 2);
       } else {
         // Regular arithmetic addition
         cg_emit_expr(ctx, b, n->as.bin.lhs);
@@ -310,13 +771,27 @@ void cg_emit_expr(CGCtx *ctx, COut *b, Node *n) {
     cg_emit_expr(ctx, b, n->as.cond.else_expr);
     c_out_write(b, ")");
     break;
-  case ND_INDEX:
+  case ND_INDEX: {
+    CGBoundsCheck chk = cg_bounds_classify(ctx, n);
     c_out_write(b, "(");
     cg_emit_expr(ctx, b, n->as.index.array);
     c_out_write(b, "[");
-    cg_emit_expr(ctx, b, n->as.index.index);
+    if (chk.kind == CG_BOUNDS_HOISTED) {
+      // Comparison was done once in the loop preheader
+      c_out_write(b, "dr_bc_ok%d ? (", chk.flag);
+      cg_emit_expr(ctx, b, n->as.index.index);
+      c_out_write(b, ") : ");
+    }
+    if (chk.kind != CG_BOUNDS_NONE) {
+      c_out_write(b, "dream_check_index(");
+      cg_emit_expr(ctx, b, n->as.index.index);
+      c_out_write(b, ", %zu, __FILE__, __LINE__)", chk.length);
+    } else {
+      cg_emit_expr(ctx, b, n->as.index.index);
+    }
     c_out_write(b, "])");
     break;
+  }
   case ND_FIELD: {
     // Check for enum member access like VkResult.Success
     if (n->as.field.object->kind == ND_IDENT) {
@@ -354,72 +829,60 @@ void cg_emit_expr(CGCtx *ctx, COut *b, Node *n) {
     }
     break;
   }
-  case ND_CALL:
-    if (n->as.call.callee && n->as.call.callee->kind == ND_FIELD) {
-      Node *fld = n->as.call.callee;
-      
-      // Check if this is a module-qualified call (module.function)
-      if (fld->as.field.object && fld->as.field.object->kind == ND_IDENT) {
-        int is_var = cgctx_has_var(ctx, fld->as.field.object->as.ident.start,
-                                   fld->as.field.object->as.ident.len);
-        if (!is_var) {
-          // This appears to be a module-qualified call like math_utils.add()
-          // Convert to C function call: module_function()
-          c_out_write(b, "%.*s_%.*s(", 
-                      (int)fld->as.field.object->as.ident.len, fld->as.field.object->as.ident.start,
-                      (int)fld->as.field.name.len, fld->as.field.name.start);
-          
-          // Emit arguments
-          for (size_t i = 0; i < n->as.call.len; i++) {
-            if (i) c_out_write(b, ", ");
-            cg_emit_expr(ctx, b, n->as.call.args[i]);
-          }
-          c_out_write(b, ")");
-          break;
-        }
-      }
-      
-      Slice ty = expr_type(ctx, fld->as.field.object);
-      int is_var = 0;
-      if (fld->as.field.object->kind == ND_IDENT)
-        is_var = cgctx_has_var(ctx, fld->as.field.object->as.ident.start,
-                               fld->as.field.object->as.ident.len);
-      if (ty.len) {
-        c_out_write(b, "%.*s_%.*s(", (int)ty.len, ty.start,
-                    (int)fld->as.field.name.len, fld->as.field.name.start);
-        if (is_var) {
-          if (cg_is_class_type(ty))
-            cg_emit_expr(ctx, b, fld->as.field.object);
-          else {
-            c_out_write(b, "&");
-            cg_emit_expr(ctx, b, fld->as.field.object);
-          }
-        }
-        for (size_t i = 0; i < n->as.call.len; i++) {
-          if (is_var || i)
-            c_out_write(b, ", ");
-          cg_emit_expr(ctx, b, n->as.call.args[i]);
-        }
-        c_out_write(b, ")");
-        break;
-      }
+  case ND_CALL: {
+    const CValue *folded = cg_eval_pure_call(ctx, n);
+    if (folded) {
+      cg_eval_emit(b, folded);
+      break;
     }
-    cg_emit_expr(ctx, b, n->as.call.callee);
-    c_out_write(b, "(");
-    for (size_t i = 0; i < n->as.call.len; i++) {
-      if (i)
-        c_out_write(b, ", ");
-      cg_emit_expr(ctx, b, n->as.call.args[i]);
+    /* A call the optimizer found constant runs only if it has to. */
+    int runs = 0;
+    const CValue *known = cg_eval_known_call(ctx, n, &runs);
+    if (known && !runs) {
+      cg_eval_emit(b, known);
+      break;
     }
-    c_out_write(b, ")");
+    char target[256];
+    int counted =
+        cg_prof_call_begin(ctx, b, call_target(ctx, n, target, sizeof(target)));
+    /* An async callee reads its arguments after the expression is done. */
+    int async = is_async_call(n);
+    ctx->own_suppress += async;
+    if (known)
+      c_out_write(b, "({ ");
+    emit_call(ctx, b, n);
+    ctx->own_suppress -= async;
+    if (known) {
+      c_out_write(b, "; ");
+      cg_eval_emit(b, known);
+      c_out_write(b, "; })");
+    }
+    if (counted)
+      c_out_write(b, ")");
     break;
+  }
   case ND_NEW:
     if (cg_is_class_type(n->as.new_expr.type_name)) {
-      c_out_write(b, "({struct %.*s *tmp = dr_alloc(sizeof(struct %.*s));",
-                  (int)n->as.new_expr.type_name.len,
-                  n->as.new_expr.type_name.start,
-                  (int)n->as.new_expr.type_name.len,
-                  n->as.new_expr.type_name.start);
+      if (n == ctx->stack_new)
+        c_out_write(b, "({struct %.*s *tmp = &dr_slot_%d.obj;",
+                    (int)n->as.new_expr.type_name.len,
+                    n->as.new_expr.type_name.start, ctx->stack_slot);
+      else if (cg_class_drops(n->as.new_expr.type_name))
+        c_out_write(b,
+                    "({struct %.*s *tmp = dr_alloc_dropping(sizeof(struct "
+                    "%.*s), %.*s_drop);",
+                    (int)n->as.new_expr.type_name.len,
+                    n->as.new_expr.type_name.start,
+                    (int)n->as.new_expr.type_name.len,
+                    n->as.new_expr.type_name.start,
+                    (int)n->as.new_expr.type_name.len,
+                    n->as.new_expr.type_name.start);
+      else
+        c_out_write(b, "({struct %.*s *tmp = dr_alloc(sizeof(struct %.*s));",
+                    (int)n->as.new_expr.type_name.len,
+                    n->as.new_expr.type_name.start,
+                    (int)n->as.new_expr.type_name.len,
+                    n->as.new_expr.type_name.start);
       if (cg_has_init(n->as.new_expr.type_name)) {
         c_out_write(b, "%.*s_init(tmp",
                     (int)n->as.new_expr.type_name.len,
@@ -437,19 +900,41 @@ void cg_emit_expr(CGCtx *ctx, COut *b, Node *n) {
                   n->as.new_expr.type_name.start);
     }
     break;
+  case ND_CONSOLE_CALL:
+    if (n->as.console.read) {
+      c_out_write(b, "dream_readline()");
+      break;
+    }
+    c_out_write(b, "0");
+    break;
   case ND_BASE:
     // Access base class member: since inheritance is flattened, access directly
     // Changed from this->base.member_name to this->member_name 
     c_out_write(b, "this->%.*s", (int)n->as.base.name.len, n->as.base.name.start);
     break;
-  case ND_AWAIT:
-    // Await expression: dr_task_await(expr)
-    c_out_write(b, "dr_task_await(");
-    cg_emit_expr(ctx, b, n->as.await_expr.expr);
-    c_out_write(b, ")");
+  case ND_AWAIT: {
+    /* A task straight from an async call has no other holder; it is
+     * cleaned up once awaited, and its result read as the declared type. */
+    Node *e = n->as.await_expr.expr;
+    int fresh = cg_async_callee(e) || cg_task_builtin(e).len;
+    int slot = cg_coro_await_slot(ctx, n);
+    c_out_write(b, fresh ? "dr_task_take(" : "dr_task_await(");
+    /* At a suspension point the coroutine has awaited the task already. */
+    if (slot >= 0)
+      c_out_write(b, "dr_f->a%d", slot);
+    else
+      cg_emit_expr(ctx, b, e);
+    c_out_write(b, ")%s", task_result_member(awaited_type(ctx, n)));
     break;
+  }
   default:
     c_out_write(b, "0");
     break;
   }
 }
+
+void cg_emit_expr_owned(CGCtx *ctx, COut *b, Node *n) {
+  int site = cg_prof_alloc_begin(ctx, b, n);
+  emit_node(ctx, b, n);
+  cg_prof_alloc_end(b, site);
+}
@@ -9,10 +9,18 @@ extern "C" {
 #endif
 
 void cg_emit_expr(CGCtx *ctx, COut *b, Node *n);
+/* Emits n without making it a temporary, for a consumer that takes over
+ * its reference (see owner.h). */
+void cg_emit_expr_owned(CGCtx *ctx, COut *b, Node *n);
 int cg_is_string_expr(CGCtx *ctx, Node *n);
 int cg_is_int_expr(CGCtx *ctx, Node *n);
 int cg_is_float_expr(CGCtx *ctx, Node *n);
 const char *cg_fmt_for_arg(CGCtx *ctx, Node *arg);
+/* The async function e calls directly, or NULL. */
+Node *cg_async_callee(Node *e);
+/* The name X if e calls a Task.X that returns a task, such as
+ * Task.WhenAll or Task.Read, else empty. */
+Slice cg_task_builtin(Node *e);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,250 @@
+#include "hints.h"
+#include "codegen.h"
+#include <string.h>
+
+/* Largest body, in AST nodes, that is declared inline. */
+#define HINT_INLINE_NODES 32
+
+static int enabled(void) { return cg_options.opt_level >= 1; }
+
+void cg_hint_emit_macros(COut *b) {
+  c_out_write(b, "#if defined(__GNUC__)\n"
+                 "#define DR_LIKELY(c) __builtin_expect(!!(c), 1)\n"
+                 "#define DR_UNLIKELY(c) __builtin_expect(!!(c), 0)\n"
+                 "#define DR_HOT __attribute__((hot))\n"
+                 "#define DR_COLD __attribute__((cold, noinline))\n"
+                 "#define DR_PRAGMA(x) _Pragma(#x)\n"
+                 "#define DR_UNROLL(n) DR_PRAGMA(GCC unroll n)\n"
+                 "#else\n"
+                 "#define DR_LIKELY(c) (c)\n"
+                 "#define DR_UNLIKELY(c) (c)\n"
+                 "#define DR_HOT\n"
+                 "#define DR_COLD\n"
+                 "#define DR_UNROLL(n)\n"
+                 "#endif\n\n");
+}
+
+/*
+ * Calls visit on n and everything below it, expressions included, and
+ * returns 0 as soon as visit does.
+ */
+static int walk(Node *n, int (*visit)(Node *, void *), void *data) {
+  if (!n)
+    return 1;
+  if (!visit(n, data))
+    return 0;
+  switch (n->kind) {
+  case ND_UNARY:
+  case ND_POST_UNARY:
+    return walk(n->as.unary.expr, visit, data);
+  case ND_BINOP:
+    return walk(n->as.bin.lhs, visit, data) && walk(n->as.bin.rhs, visit, data);
+  case ND_COND:
+    return walk(n->as.cond.cond, visit, data) &&
+           walk(n->as.cond.then_expr, visit, data) &&
+           walk(n->as.cond.else_expr, visit, data);
+  case ND_INDEX:
+    return walk(n->as.index.array, visit, data) &&
+           walk(n->as.index.index, visit, data);
+  case ND_FIELD:
+    return walk(n->as.field.object, visit, data);
+  case ND_VAR_DECL:
+    return walk(n->as.var_decl.init, visit, data);
+  case ND_IF:
+    return walk(n->as.if_stmt.cond, visit, data) &&
+           walk(n->as.if_stmt.then_br, visit, data) &&
+           walk(n->as.if_stmt.else_br, visit, data);
+  case ND_WHILE:
+    return walk(n->as.while_stmt.cond, visit, data) &&
+           walk(n->as.while_stmt.body, visit, data);
+  case ND_DO_WHILE:
+    return walk(n->as.do_while_stmt.body, visit, data) &&
+           walk(n->as.do_while_stmt.cond, visit, data);
+  case ND_FOR:
+    return walk(n->as.for_stmt.init, visit, data) &&
+           walk(n->as.for_stmt.cond, visit, data) &&
+           walk(n->as.for_stmt.update, visit, data) &&
+           walk(n->as.for_stmt.body, visit, data);
+  case ND_RETURN:
+    return walk(n->as.ret.expr, visit, data);
+  case ND_BLOCK:
+    for (size_t i = 0; i < n->as.block.len; i++) {
+      if (!walk(n->as.block.items[i], visit, data))
+        return 0;
+    }
+    return 1;
+  case ND_EXPR_STMT:
+    return walk(n->as.expr_stmt.expr, visit, data);
+  case ND_SWITCH:
+    if (!walk(n->as.switch_stmt.expr, visit, data))
+      return 0;
+    for (size_t i = 0; i < n->as.switch_stmt.len; i++) {
+      if (!walk(n->as.switch_stmt.cases[i].value, visit, data) ||
+          !walk(n->as.switch_stmt.cases[i].body, visit, data))
+        return 0;
+    }
+    return 1;
+  case ND_CONSOLE_CALL:
+    return walk(n->as.console.arg, visit, data);
+  case ND_CALL:
+    if (!walk(n->as.call.callee, visit, data))
+      return 0;
+    for (size_t i = 0; i < n->as.call.len; i++) {
+      if (!walk(n->as.call.args[i], visit, data))
+        return 0;
+    }
+    return 1;
+  case ND_NEW:
+    for (size_t i = 0; i < n->as.new_expr.arg_len; i++) {
+      if (!walk(n->as.new_expr.args[i], visit, data))
+        return 0;
+    }
+    return 1;
+  case ND_TRY:
+    return walk(n->as.try_stmt.body, visit, data) &&
+           walk(n->as.try_stmt.catch_body, visit, data) &&
+           walk(n->as.try_stmt.finally_body, visit, data);
+  case ND_THROW:
+    return walk(n->as.throw_stmt.expr, visit, data);
+  case ND_AWAIT:
+    return walk(n->as.await_expr.expr, visit, data);
+  case ND_REGION:
+    return walk(n->as.region.body, visit, data);
+  default:
+    return 1;
+  }
+}
+
+static int no_exit(Node *n, void *data) {
+  (void)data;
+  return n->kind != ND_BREAK && n->kind != ND_CONTINUE && n->kind != ND_RETURN;
+}
+
+int cg_hint_always_throws(Node *stmt) {
+  if (!stmt)
+    return 0;
+  switch (stmt->kind) {
+  case ND_THROW:
+    return 1;
+  case ND_IF:
+    return cg_hint_always_throws(stmt->as.if_stmt.then_br) &&
+           cg_hint_always_throws(stmt->as.if_stmt.else_br);
+  case ND_BLOCK:
+    for (size_t i = 0; i < stmt->as.block.len; i++) {
+      Node *it = stmt->as.block.items[i];
+      if (cg_hint_always_throws(it))
+        return 1;
+      /* Code after a possible way out may not run at all. */
+      if (!walk(it, no_exit, NULL))
+        return 0;
+    }
+    return 0;
+  default:
+    return 0;
+  }
+}
+
+/* A bare break, possibly in braces: the branch leaves the loop. */
+static int is_loop_exit(Node *stmt) {
+  while (stmt && stmt->kind == ND_BLOCK && stmt->as.block.len == 1)
+    stmt = stmt->as.block.items[0];
+  return stmt && stmt->kind == ND_BREAK;
+}
+
+int cg_hint_branch(Node *stmt) {
+  if (!enabled())
+    return 0;
+  switch (stmt->kind) {
+  case ND_IF: {
+    Node *then_br = stmt->as.if_stmt.then_br;
+    Node *else_br = stmt->as.if_stmt.else_br;
+    if (cg_hint_always_throws(then_br) || is_loop_exit(then_br))
+      return cg_hint_always_throws(else_br) ? 0 : -1;
+    if (cg_hint_always_throws(else_br) || is_loop_exit(else_br))
+      return 1;
+    return 0;
+  }
+  case ND_WHILE:
+  case ND_DO_WHILE:
+  case ND_FOR:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+static int is_main(Node *fn) {
+  return fn->as.func.name.len == 4 &&
+         strncmp(fn->as.func.name.start, "main", 4) == 0;
+}
+
+int cg_hint_cold(Node *fn) {
+  return enabled() && !fn->as.func.is_async && !is_main(fn) &&
+         cg_hint_always_throws(fn->as.func.body);
+}
+
+/* Counts nodes, refusing anything that calls, loops or allocates. */
+static int small_leaf(Node *n, void *data) {
+  int *budget = data;
+  switch (n->kind) {
+  case ND_CALL:
+  case ND_NEW:
+  case ND_WHILE:
+  case ND_DO_WHILE:
+  case ND_FOR:
+  case ND_SWITCH:
+  case ND_TRY:
+  case ND_THROW:
+  case ND_AWAIT:
+  case ND_FUNC:
+    return 0;
+  default:
+    return --*budget > 0;
+  }
+}
+
+int cg_hint_inline(Node *fn) {
+  if (!enabled() || fn->as.func.is_async || is_main(fn) ||
+      (fn->as.func.attrs & FUNC_ATTR_MEMOIZE))
+    return 0;
+  int budget = HINT_INLINE_NODES;
+  return walk(fn->as.func.body, small_leaf, &budget);
+}
+
+int cg_hint_restrict_param(Node *param) {
+  return enabled() && param->as.var_decl.type == TK_KW_STRING &&
+         !param->as.var_decl.is_pointer && !param->as.var_decl.array_len;
+}
+
+/*
+ * Refuses whatever could yield a second pointer to an object: calls,
+ * allocations, locals of a named type and fields of anything but a plain
+ * variable, such as this.next.value.
+ */
+static int touches_this_only(Node *n, void *data) {
+  (void)data;
+  switch (n->kind) {
+  case ND_CALL:
+  case ND_NEW:
+  case ND_AWAIT:
+  case ND_TRY:
+  case ND_THROW:
+    return 0;
+  case ND_VAR_DECL:
+    return n->as.var_decl.type != TK_IDENT;
+  case ND_FIELD:
+    return n->as.field.object && n->as.field.object->kind == ND_IDENT;
+  default:
+    return 1;
+  }
+}
+
+int cg_hint_restrict_this(Node *method) {
+  if (!enabled() || method->as.func.is_async)
+    return 0;
+  for (size_t i = 0; i < method->as.func.param_len; i++) {
+    if (method->as.func.params[i]->as.var_decl.type == TK_IDENT)
+      return 0;
+  }
+  return walk(method->as.func.body, touches_this_only, NULL);
+}
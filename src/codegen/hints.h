@@ -0,0 +1,47 @@
+#ifndef CG_HINTS_H
+#define CG_HINTS_H
+
+#include "../parser/ast.h"
+#include "c_emit.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Hints for the C compiler that need no profile.
+ *
+ * From -O1 on, the shape of the code stands in for measurements: a branch
+ * that throws or leaves its loop is unlikely, loop conditions are likely,
+ * functions that can only throw are cold, and small leaf functions are
+ * declared inline. Parameters nothing else can reach are marked restrict:
+ * strings, which the generated code never writes through, and the `this`
+ * of methods that touch no other object.
+ */
+
+/* DR_LIKELY, DR_UNLIKELY, DR_HOT, DR_COLD and DR_UNROLL, empty off GNU C. */
+void cg_hint_emit_macros(COut *b);
+
+/* Nonzero if every path through the statement ends in a throw. */
+int cg_hint_always_throws(Node *stmt);
+
+/* Expected outcome of an if or loop condition: 1 likely, -1 unlikely, 0 unknown. */
+int cg_hint_branch(Node *stmt);
+
+/* Nonzero if the function can only end by throwing. */
+int cg_hint_cold(Node *fn);
+
+/* Nonzero if the function is worth declaring inline. */
+int cg_hint_inline(Node *fn);
+
+/* Nonzero if the parameter can be declared restrict. */
+int cg_hint_restrict_param(Node *param);
+
+/* Nonzero if the `this` of the method can be declared restrict. */
+int cg_hint_restrict_this(Node *method);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CG_HINTS_H
@@ -0,0 +1,174 @@
+#include "memo.h"
+#include "codegen.h"
+#include "reach.h"
+#include <string.h>
+
+#define MEMO_MAX_ARGS 8 /* DR_MEMO_MAX_ARGS in the runtime */
+
+/* Cache sizes: explicit requests get a larger LRU cache. */
+#define MEMO_ATTR_ENTRIES 4096
+#define MEMO_AUTO_ENTRIES 1024
+
+static char memo_kind(Node *p) {
+  if (p->as.var_decl.is_pointer || p->as.var_decl.array_len)
+    return 0;
+  switch (p->as.var_decl.type) {
+  case TK_KW_INT:
+  case TK_KW_BOOL:
+  case TK_KW_CHAR:
+    return 'i';
+  case TK_KW_STRING:
+    return 's';
+  default:
+    return 0;
+  }
+}
+
+static const char *memo_c_type(TokenKind k) {
+  switch (k) {
+  case TK_KW_CHAR:
+    return "char";
+  case TK_KW_FLOAT:
+    return "float";
+  case TK_KW_STRING:
+    return "const char *";
+  default:
+    return "int";
+  }
+}
+
+static int memo_signature_ok(Node *fn) {
+  if (fn->as.func.is_async || fn->as.func.param_len == 0 ||
+      fn->as.func.param_len > MEMO_MAX_ARGS)
+    return 0;
+  switch (fn->as.func.ret_type) {
+  case TK_KW_INT:
+  case TK_KW_BOOL:
+  case TK_KW_CHAR:
+  case TK_KW_FLOAT:
+    break;
+  default:
+    return 0;
+  }
+  for (size_t i = 0; i < fn->as.func.param_len; i++) {
+    if (!memo_kind(fn->as.func.params[i]))
+      return 0;
+  }
+  return !(fn->as.func.name.len == 4 &&
+           strncmp(fn->as.func.name.start, "main", 4) == 0);
+}
+
+/* The optimizer names functions "name" and static methods "Type.name". */
+static int memo_is_candidate(Slice prefix, Node *fn) {
+  Slice name = fn->as.func.name;
+  for (size_t i = 0; i < cg_options.nmemo_candidates; i++) {
+    const char *c = cg_options.memo_candidates[i];
+    if (prefix.len) {
+      if (strncmp(c, prefix.start, prefix.len) || c[prefix.len] != '.')
+        continue;
+      c += prefix.len + 1;
+    }
+    if (strlen(c) == name.len && strncmp(c, name.start, name.len) == 0)
+      return 1;
+  }
+  return 0;
+}
+
+int cg_memo_enabled(Slice prefix, Node *fn) {
+  if (!memo_signature_ok(fn))
+    return 0;
+  if (fn->as.func.attrs & FUNC_ATTR_MEMOIZE)
+    return 1;
+  return cg_options.opt_level >= 3 && memo_is_candidate(prefix, fn);
+}
+
+int cg_memo_any(Node *root) {
+  for (size_t i = 0; i < root->as.block.len; i++) {
+    Node *it = root->as.block.items[i];
+    if (it->kind == ND_FUNC && cg_reach_is_live(it) &&
+        cg_memo_enabled((Slice){NULL, 0}, it))
+      return 1;
+    if (it->kind != ND_CLASS_DECL && it->kind != ND_STRUCT_DECL)
+      continue;
+    for (size_t j = 0; j < it->as.type_decl.len; j++) {
+      Node *m = it->as.type_decl.members[j];
+      if (m->kind == ND_FUNC && m->as.func.is_static && cg_reach_is_live(m) &&
+          cg_memo_enabled(it->as.type_decl.name, m))
+        return 1;
+    }
+  }
+  return 0;
+}
+
+static void emit_name(COut *b, Slice prefix, Node *fn, const char *suffix) {
+  if (prefix.len)
+    c_out_write(b, "%.*s_", (int)prefix.len, prefix.start);
+  c_out_write(b, "%.*s%s", (int)fn->as.func.name.len, fn->as.func.name.start,
+              suffix);
+}
+
+static void emit_signature(COut *b, Slice prefix, Node *fn) {
+  c_out_write(b, "static %s ", memo_c_type(fn->as.func.ret_type));
+  emit_name(b, prefix, fn, "");
+  c_out_write(b, "(");
+  for (size_t i = 0; i < fn->as.func.param_len; i++) {
+    Node *p = fn->as.func.params[i];
+    c_out_write(b, "%s%s %.*s", i ? ", " : "", memo_c_type(p->as.var_decl.type),
+                (int)p->as.var_decl.name.len, p->as.var_decl.name.start);
+  }
+  c_out_write(b, ")");
+}
+
+void cg_memo_emit_prototype(COut *b, Slice prefix, Node *fn) {
+  emit_signature(b, prefix, fn);
+  c_out_write(b, ";\n");
+}
+
+void cg_memo_emit_wrapper(COut *b, Slice prefix, Node *fn) {
+  int lru = (fn->as.func.attrs & FUNC_ATTR_MEMOIZE) != 0;
+  char kinds[MEMO_MAX_ARGS + 1];
+  size_t n = fn->as.func.param_len;
+  for (size_t i = 0; i < n; i++)
+    kinds[i] = memo_kind(fn->as.func.params[i]);
+  kinds[n] = 0;
+  const char *field = fn->as.func.ret_type == TK_KW_FLOAT ? "f" : "i";
+
+  c_out_write(b, "static DrMemo ");
+  emit_name(b, prefix, fn, "_memo");
+  c_out_write(b, " = DR_MEMO_INIT(\"%s\", %d, %d);\n", kinds,
+              lru ? MEMO_ATTR_ENTRIES : MEMO_AUTO_ENTRIES, lru);
+  emit_signature(b, prefix, fn);
+  c_out_write(b, " {\n");
+  c_out_indent(b);
+  c_out_write(b, "DrMemoArg dr_key[%zu] = {", n);
+  for (size_t i = 0; i < n; i++) {
+    Node *p = fn->as.func.params[i];
+    c_out_write(b, "%s{.%s = %.*s}", i ? ", " : "", kinds[i] == 's' ? "s" : "i",
+                (int)p->as.var_decl.name.len, p->as.var_decl.name.start);
+  }
+  c_out_write(b, "};\n");
+  c_out_write(b, "DrMemoValue dr_val;\n");
+  c_out_write(b, "if (dr_memo_get(&");
+  emit_name(b, prefix, fn, "_memo");
+  c_out_write(b, ", dr_key, &dr_val))\n");
+  c_out_indent(b);
+  c_out_write(b, "return (%s)dr_val.%s;\n", memo_c_type(fn->as.func.ret_type),
+              field);
+  c_out_dedent(b);
+  c_out_write(b, "dr_val.%s = ", field);
+  emit_name(b, prefix, fn, "_compute");
+  c_out_write(b, "(");
+  for (size_t i = 0; i < n; i++) {
+    Node *p = fn->as.func.params[i];
+    c_out_write(b, "%s%.*s", i ? ", " : "", (int)p->as.var_decl.name.len,
+                p->as.var_decl.name.start);
+  }
+  c_out_write(b, ");\n");
+  c_out_write(b, "dr_memo_put(&");
+  emit_name(b, prefix, fn, "_memo");
+  c_out_write(b, ", dr_key, dr_val);\n");
+  c_out_write(b, "return (%s)dr_val.%s;\n", memo_c_type(fn->as.func.ret_type),
+              field);
+  c_out_dedent(b);
+  c_out_write(b, "}\n");
+}
@@ -0,0 +1,37 @@
+#ifndef CG_MEMO_H
+#define CG_MEMO_H
+
+#include "../parser/ast.h"
+#include "c_emit.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Memoization of pure functions.
+ *
+ * A function marked [memoize], or at -O3 one the optimizer found to be pure
+ * and recursive, has its body emitted as <name>_compute. <name> becomes a
+ * wrapper that looks the arguments up in a DrMemo cache first, so recursive
+ * calls hit the cache too. Only functions taking int, bool, char or string
+ * arguments and returning int, bool, char or float qualify.
+ */
+
+/* Nonzero if the function (a static method when prefix is set) is memoized. */
+int cg_memo_enabled(Slice prefix, Node *fn);
+
+/* Nonzero if some live function of the program is memoized. */
+int cg_memo_any(Node *root);
+
+/* Declares the wrapper ahead of <name>_compute, which calls it. */
+void cg_memo_emit_prototype(COut *b, Slice prefix, Node *fn);
+
+/* Emits the cache and the wrapper calling <name>_compute. */
+void cg_memo_emit_wrapper(COut *b, Slice prefix, Node *fn);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CG_MEMO_H
@@ -0,0 +1,428 @@
+#include "owner.h"
+#include "codegen.h"
+#include "expr.h"
+#include "reach.h"
+#include "stmt.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Temporaries are numbered across the file so nested scopes never shadow. */
+static int next_temp;
+
+static Slice ident_slice(Node *e) {
+  return (Slice){e->as.ident.start, e->as.ident.len};
+}
+
+/* Nonzero if e calls a top-level function that returns a fresh string. */
+static int is_string_call(Node *e) {
+  if (e->kind != ND_CALL || !e->as.call.callee ||
+      e->as.call.callee->kind != ND_IDENT)
+    return 0;
+  Node *fn = cg_reach_function(ident_slice(e->as.call.callee));
+  return fn && !fn->as.func.is_async && fn->as.func.ret_type == TK_KW_STRING;
+}
+
+int cg_own_is_ref(CGCtx *ctx, Node *e) {
+  switch (e->kind) {
+  case ND_NEW:
+    return cg_is_class_type(e->as.new_expr.type_name);
+  case ND_IDENT:
+    if (cgctx_lookup(ctx, e->as.ident.start, e->as.ident.len) == TK_IDENT)
+      return cg_is_class_type(
+          cgctx_lookup_name(ctx, e->as.ident.start, e->as.ident.len));
+    break;
+  case ND_CALL:
+    if (is_string_call(e))
+      return 1;
+    break;
+  default:
+    break;
+  }
+  return cg_is_string_expr(ctx, e);
+}
+
+int cg_own_is_fresh(CGCtx *ctx, Node *e) {
+  switch (e->kind) {
+  case ND_BINOP:
+    return e->as.bin.op == TK_PLUS && cg_is_string_expr(ctx, e);
+  case ND_CONSOLE_CALL:
+    return e->as.console.read;
+  case ND_NEW:
+    return cg_is_class_type(e->as.new_expr.type_name) && e != ctx->stack_new;
+  case ND_CALL:
+    return is_string_call(e);
+  default:
+    return 0;
+  }
+}
+
+static CGOwnTemp *add_temp(CGOwn *own, Slice class_name, int stack) {
+  if (own->len + 1 > own->cap) {
+    own->cap = own->cap ? own->cap * 2 : 4;
+    own->temps = realloc(own->temps, own->cap * sizeof(CGOwnTemp));
+  }
+  CGOwnTemp *t = &own->temps[own->len++];
+  t->id = ++next_temp;
+  t->class_name = class_name;
+  t->stack = stack;
+  return t;
+}
+
+int cg_own_temp_begin(CGCtx *ctx, COut *b, Node *e) {
+  CGOwn *own = ctx->own;
+  if (!own || ctx->own_suppress || !cg_own_is_fresh(ctx, e))
+    return 0;
+  CGOwnTemp *t = add_temp(
+      own, e->kind == ND_NEW ? e->as.new_expr.type_name : (Slice){NULL, 0}, 0);
+  c_out_write(b, "(dr_tmp_%d = ", t->id);
+  return 1;
+}
+
+int cg_own_slot(CGCtx *ctx, Slice class_name) {
+  if (!ctx->own || ctx->own_suppress)
+    return 0;
+  return add_temp(ctx->own, class_name, 1)->id;
+}
+
+/*
+ * The slot carries a DrRef right ahead of the instance, as dr_alloc does;
+ * an instance whose fields hold references is dropped once the slot goes
+ * out of scope.
+ */
+static void emit_slot_decl(COut *out, Slice class_name, int id) {
+  if (cg_class_drops(class_name))
+    c_out_write(out,
+                "struct { DrDrop drop; DrRef ref; struct %.*s obj; } "
+                "dr_slot_%d __attribute__((cleanup(dr_slot_end))) = "
+                "{{%.*s_drop, 0}, DR_REF_STATIC_INIT}; ",
+                (int)class_name.len, class_name.start, id,
+                (int)class_name.len, class_name.start);
+  else
+    c_out_write(out,
+                "struct { DrRef ref; struct %.*s obj; } dr_slot_%d = "
+                "{DR_REF_STATIC_INIT}; ",
+                (int)class_name.len, class_name.start, id);
+}
+
+int cg_own_emit_slot(COut *b, Slice class_name) {
+  int id = ++next_temp;
+  emit_slot_decl(b, class_name, id);
+  c_out_newline(b);
+  return id;
+}
+
+static int enabled(void) { return cg_options.opt_level >= 1; }
+
+static int is_assign_op(TokenKind op) {
+  switch (op) {
+  case TK_EQ:
+  case TK_PLUSEQ:
+  case TK_MINUSEQ:
+  case TK_STAREQ:
+  case TK_SLASHEQ:
+  case TK_PERCENTEQ:
+  case TK_ANDEQ:
+  case TK_OREQ:
+  case TK_XOREQ:
+  case TK_LSHIFTEQ:
+  case TK_RSHIFTEQ:
+  case TK_QMARKQMARKEQ:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+/* How a statement list uses one variable. */
+typedef struct {
+  Slice name;
+  int uses;     /* mentions, declarations of the name included */
+  int assigned; /* mentions on the left of an assignment */
+} Uses;
+
+static int is_name(Node *n, Slice v) {
+  return n && n->kind == ND_IDENT && n->as.ident.len == v.len &&
+         strncmp(n->as.ident.start, v.start, v.len) == 0;
+}
+
+/* Adds the uses in n; nodes the walk does not know use and assign it. */
+static void count_uses(Uses *u, Node *n) {
+  if (!n)
+    return;
+  switch (n->kind) {
+  case ND_INT:
+  case ND_FLOAT:
+  case ND_CHAR:
+  case ND_STRING:
+  case ND_BOOL:
+  case ND_NULL:
+  case ND_BASE:
+  case ND_BREAK:
+  case ND_CONTINUE:
+    break;
+  case ND_IDENT:
+    u->uses += is_name(n, u->name);
+    break;
+  case ND_UNARY:
+  case ND_POST_UNARY:
+    count_uses(u, n->as.unary.expr);
+    break;
+  case ND_BINOP:
+    if (is_assign_op(n->as.bin.op) && is_name(n->as.bin.lhs, u->name))
+      u->assigned++;
+    count_uses(u, n->as.bin.lhs);
+    count_uses(u, n->as.bin.rhs);
+    break;
+  case ND_COND:
+    count_uses(u, n->as.cond.cond);
+    count_uses(u, n->as.cond.then_expr);
+    count_uses(u, n->as.cond.else_expr);
+    break;
+  case ND_INDEX:
+    count_uses(u, n->as.index.array);
+    count_uses(u, n->as.index.index);
+    break;
+  case ND_FIELD:
+    count_uses(u, n->as.field.object);
+    break;
+  case ND_CONSOLE_CALL:
+    count_uses(u, n->as.console.arg);
+    break;
+  case ND_CALL:
+    count_uses(u, n->as.call.callee);
+    for (size_t i = 0; i < n->as.call.len; i++)
+      count_uses(u, n->as.call.args[i]);
+    break;
+  case ND_NEW:
+    for (size_t i = 0; i < n->as.new_expr.arg_len; i++)
+      count_uses(u, n->as.new_expr.args[i]);
+    break;
+  case ND_VAR_DECL:
+    if (n->as.var_decl.name.len == u->name.len &&
+        strncmp(n->as.var_decl.name.start, u->name.start, u->name.len) == 0)
+      u->uses++;
+    count_uses(u, n->as.var_decl.init);
+    break;
+  case ND_IF:
+    count_uses(u, n->as.if_stmt.cond);
+    count_uses(u, n->as.if_stmt.then_br);
+    count_uses(u, n->as.if_stmt.else_br);
+    break;
+  case ND_WHILE:
+    count_uses(u, n->as.while_stmt.cond);
+    count_uses(u, n->as.while_stmt.body);
+    break;
+  case ND_DO_WHILE:
+    count_uses(u, n->as.do_while_stmt.body);
+    count_uses(u, n->as.do_while_stmt.cond);
+    break;
+  case ND_FOR:
+    count_uses(u, n->as.for_stmt.init);
+    count_uses(u, n->as.for_stmt.cond);
+    count_uses(u, n->as.for_stmt.update);
+    count_uses(u, n->as.for_stmt.body);
+    break;
+  case ND_BLOCK:
+    for (size_t i = 0; i < n->as.block.len; i++)
+      count_uses(u, n->as.block.items[i]);
+    break;
+  case ND_EXPR_STMT:
+    count_uses(u, n->as.expr_stmt.expr);
+    break;
+  case ND_RETURN:
+    count_uses(u, n->as.ret.expr);
+    break;
+  case ND_THROW:
+    count_uses(u, n->as.throw_stmt.expr);
+    break;
+  case ND_AWAIT:
+    count_uses(u, n->as.await_expr.expr);
+    break;
+  case ND_REGION:
+    count_uses(u, n->as.region.body);
+    break;
+  case ND_SWITCH:
+    count_uses(u, n->as.switch_stmt.expr);
+    for (size_t i = 0; i < n->as.switch_stmt.len; i++) {
+      count_uses(u, n->as.switch_stmt.cases[i].value);
+      count_uses(u, n->as.switch_stmt.cases[i].body);
+    }
+    break;
+  case ND_TRY:
+    count_uses(u, n->as.try_stmt.body);
+    count_uses(u, n->as.try_stmt.catch_body);
+    count_uses(u, n->as.try_stmt.finally_body);
+    break;
+  default:
+    u->uses++;
+    u->assigned++;
+    break;
+  }
+}
+
+/* Uses of name in the block item being emitted and the items after it. */
+static Uses uses_from_here(CGCtx *ctx, Slice name) {
+  Uses u = {name, 0, 0};
+  count_uses(&u, ctx->own_stmt);
+  for (size_t i = 0; i < ctx->own_rest_len; i++)
+    count_uses(&u, ctx->own_rest[i]);
+  return u;
+}
+
+/* Nonzero if the block item being emitted stores e as a whole. */
+static int stores(CGCtx *ctx, Node *e) {
+  Node *s = ctx->own_stmt;
+  if (s->kind == ND_VAR_DECL)
+    return s->as.var_decl.init == e;
+  if (s->kind != ND_EXPR_STMT)
+    return 0;
+  Node *x = s->as.expr_stmt.expr;
+  return x && x->kind == ND_BINOP && x->as.bin.op == TK_EQ &&
+         x->as.bin.rhs == e;
+}
+
+/*
+ * The owned local e when this store is its last use, so that its reference
+ * can move; NULL otherwise. Only a local of the current block qualifies, as
+ * the items after the store are all that is left of its scope.
+ */
+static VarBinding *last_use(CGCtx *ctx, Node *e) {
+  if (!enabled() || !ctx->own_stmt || e->kind != ND_IDENT || !stores(ctx, e))
+    return NULL;
+  VarBinding *v = cgctx_find(ctx, e->as.ident.start, e->as.ident.len);
+  if (!v || !v->owned || v->lent || v->depth != ctx->depth)
+    return NULL;
+  Uses u = uses_from_here(ctx, ident_slice(e));
+  return u.uses == 1 ? v : NULL;
+}
+
+/*
+ * Nonzero if a string stored into lhs may outlive the region it lives in;
+ * lhs is NULL for a return and the call for an async argument. Outside a
+ * region body the string may still come from a region a caller opened:
+ * fields, elements and async arguments can keep it past that, while locals
+ * and returns go back to the caller, which checks its own stores.
+ */
+static int outlives_region(CGCtx *ctx, Node *lhs) {
+  if (!lhs)
+    return ctx->region_depth != 0;
+  if (!ctx->region_depth && lhs->kind != ND_IDENT)
+    return 1;
+  while (lhs->kind == ND_FIELD || lhs->kind == ND_INDEX)
+    lhs = lhs->kind == ND_FIELD ? lhs->as.field.object : lhs->as.index.array;
+  if (lhs->kind != ND_IDENT)
+    return 1;
+  VarBinding *v = cgctx_find(ctx, lhs->as.ident.start, lhs->as.ident.len);
+  return !v || v->depth < ctx->region_depth;
+}
+
+int cg_own_promote_begin(CGCtx *ctx, COut *b, Node *lhs, Node *e,
+                         TokenKind type) {
+  if (e->kind == ND_STRING || e->kind == ND_NULL ||
+      !(type == TK_KW_STRING || cg_is_string_expr(ctx, e) ||
+        is_string_call(e)) ||
+      !outlives_region(ctx, lhs))
+    return 0;
+  c_out_write(b, "dr_str_promote(");
+  return 1;
+}
+
+int cg_own_borrows(CGCtx *ctx, Node *decl) {
+  Node *init = decl->as.var_decl.init;
+  if (!enabled() || decl != ctx->own_stmt || !init || init->kind != ND_IDENT ||
+      !cg_own_is_ref(ctx, init) || last_use(ctx, init))
+    return 0;
+  VarBinding *v = cgctx_find(ctx, init->as.ident.start, init->as.ident.len);
+  if (!v || uses_from_here(ctx, ident_slice(init)).assigned ||
+      uses_from_here(ctx, decl->as.var_decl.name).assigned)
+    return 0;
+  v->lent = 1;
+  return 1;
+}
+
+void cg_own_emit_stored(CGCtx *ctx, COut *b, Node *e, int returning) {
+  if (cg_own_is_fresh(ctx, e)) {
+    cg_emit_expr_owned(ctx, b, e);
+    return;
+  }
+  VarBinding *moved = returning ? NULL : last_use(ctx, e);
+  if (moved)
+    moved->owned = 0;
+  if (e->kind == ND_STRING || e->kind == ND_NULL || e == ctx->stack_new ||
+      moved ||
+      (returning && e->kind == ND_IDENT &&
+       cgctx_lookup_owned(ctx, e->as.ident.start, e->as.ident.len))) {
+    cg_emit_expr(ctx, b, e);
+    return;
+  }
+  c_out_write(b, "dr_retained((void *)");
+  cg_emit_expr(ctx, b, e);
+  c_out_write(b, ")");
+}
+
+COut *cg_own_begin(CGCtx *ctx, CGOwn *own, COut *out) {
+  memset(own, 0, sizeof(*own));
+  c_out_init(&own->buf);
+  own->buf.indent = out->indent;
+  own->buf.indent_width = out->indent_width;
+  own->buf.at_line_start = out->at_line_start;
+  own->out = out;
+  own->outer = ctx->own;
+  ctx->own = own;
+  return &own->buf;
+}
+
+static void emit_temp_decls(COut *out, const CGOwn *own) {
+  for (size_t i = 0; i < own->len; i++) {
+    const CGOwnTemp *t = &own->temps[i];
+    if (t->stack) {
+      emit_slot_decl(out, t->class_name, t->id);
+      continue;
+    }
+    if (t->class_name.len)
+      c_out_write(out, "struct %.*s *", (int)t->class_name.len,
+                  t->class_name.start);
+    else
+      c_out_write(out, "const char *");
+    c_out_write(out, "dr_tmp_%d = NULL; ", t->id);
+  }
+}
+
+static void emit_temp_releases(COut *out, const CGOwn *own) {
+  for (size_t i = own->len; i-- > 0;) {
+    if (!own->temps[i].stack)
+      c_out_write(out, "dr_release((void *)dr_tmp_%d); ", own->temps[i].id);
+  }
+}
+
+void cg_own_end(CGCtx *ctx, CGOwn *own, CGOwnKind kind) {
+  COut *out = own->out;
+  ctx->own = own->outer;
+  if (!own->len) {
+    c_out_append(out, &own->buf);
+  } else if (kind == CG_OWN_STMT) {
+    /* { decls
+     *   statement
+     * releases } */
+    c_out_write(out, "{ ");
+    emit_temp_decls(out, own);
+    c_out_newline(out);
+    c_out_append(out, &own->buf);
+    if (!out->at_line_start)
+      c_out_newline(out);
+    emit_temp_releases(out, own);
+    c_out_write(out, "}");
+    c_out_newline(out);
+  } else {
+    c_out_write(out, "({ ");
+    emit_temp_decls(out, own);
+    if (kind == CG_OWN_VALUE)
+      c_out_write(out, "__auto_type dr_v = (");
+    c_out_append(out, &own->buf);
+    c_out_write(out, kind == CG_OWN_VALUE ? "); " : "; ");
+    emit_temp_releases(out, own);
+    c_out_write(out, kind == CG_OWN_VALUE ? "dr_v; })" : "})");
+  }
+  c_out_free(&own->buf);
+  free(own->temps);
+}
@@ -0,0 +1,121 @@
+#ifndef CG_OWNER_H
+#define CG_OWNER_H
+
+#include "../parser/ast.h"
+#include "c_emit.h"
+#include "context.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Ownership of strings and objects.
+ *
+ * Strings and class instances are reference counted. A local declared
+ * with one owns a reference, released when its block ends or when the
+ * local is assigned another value. The result of a concatenation, `new`,
+ * ReadLine or a call returning a string is fresh: it carries a reference
+ * of its own, which storing it in a local, field or element or returning
+ * it hands over. Other values are borrowed and are retained when stored
+ * or returned.
+ *
+ * A fresh value that is not stored becomes a temporary of the full
+ * expression it appears in. Statements emit each full expression through
+ * cg_own_begin and cg_own_end, which release the temporaries as soon as
+ * the expression has been evaluated. Arguments of async calls are left
+ * alone, as the task reads them later. A `new` built in a stack slot (see
+ * escape.h) is neither fresh nor released.
+ *
+ * From -O1 on, block items are emitted with the rest of their block in
+ * view (CGCtx.own_stmt and own_rest) so that reference counting is elided
+ * where it cancels out. A local stored by its last use moves: its reference
+ * goes to the new location, with neither a retain nor the release at the
+ * end of the block. A local initialized from another local that is not
+ * assigned for as long as the new one is in scope borrows: it holds no
+ * reference and is never released. Parameters always borrow.
+ *
+ * Inside a `using region` block, allocations come from the region (see
+ * region.h) and retains and releases of them do nothing. A string stored
+ * where it outlives the region, returned, or passed to an async call is
+ * promoted to the heap on the way; objects that would escape are rejected
+ * by semantic analysis.
+ */
+
+typedef struct CGOwnTemp {
+  int id;
+  Slice class_name; /* empty for strings */
+  int stack;        /* a stack slot for class_name, never released */
+} CGOwnTemp;
+
+typedef struct CGOwn {
+  COut buf; /* the full expression, written out in cg_own_end */
+  COut *out;
+  struct CGOwn *outer;
+  CGOwnTemp *temps;
+  size_t len, cap;
+} CGOwn;
+
+typedef enum {
+  CG_OWN_STMT,  /* buf holds statements; wrapped in a block */
+  CG_OWN_VOID,  /* buf holds an expression whose value is not used */
+  CG_OWN_VALUE, /* buf holds an expression whose value is used */
+} CGOwnKind;
+
+/* Starts a full expression for out; returns the builder to emit it into. */
+COut *cg_own_begin(CGCtx *ctx, CGOwn *own, COut *out);
+
+/* Writes the full expression to out, releasing its temporaries after it. */
+void cg_own_end(CGCtx *ctx, CGOwn *own, CGOwnKind kind);
+
+/* Nonzero if e is a string or an instance of a class. */
+int cg_own_is_ref(CGCtx *ctx, Node *e);
+
+/* Nonzero if e carries a reference its consumer must release. */
+int cg_own_is_fresh(CGCtx *ctx, Node *e);
+
+/*
+ * Starts e as a temporary when it is fresh and a full expression collects
+ * temporaries; returns nonzero if the caller has to close it with ")".
+ */
+int cg_own_temp_begin(CGCtx *ctx, COut *b, Node *e);
+
+/*
+ * Reserves a stack slot for an instance of class_name that dies with the
+ * current full expression; returns its number, or 0 if there is no full
+ * expression to hold it.
+ */
+int cg_own_slot(CGCtx *ctx, Slice class_name);
+
+/* Declares a stack slot that lives until the end of the block; returns its
+ * number. */
+int cg_own_emit_slot(COut *b, Slice class_name);
+
+/*
+ * Starts promoting e out of a region when it is a string stored into lhs,
+ * returned when lhs is NULL, or passed to the async call lhs, that may
+ * outlive the region; outside a region body only in case a caller opened
+ * one. type is that of the target when known. Returns nonzero if the
+ * caller has to close it with ")".
+ */
+int cg_own_promote_begin(CGCtx *ctx, COut *b, Node *lhs, Node *e,
+                         TokenKind type);
+
+/*
+ * Nonzero if the local declared by decl, the block item being emitted,
+ * borrows the reference of the local it is initialized from.
+ */
+int cg_own_borrows(CGCtx *ctx, Node *decl);
+
+/*
+ * Emits e as the value stored in a string or object location: fresh values
+ * hand their reference over, borrowed ones are retained. A returned local
+ * and a local stored by its last use hand over their own reference.
+ */
+void cg_own_emit_stored(CGCtx *ctx, COut *b, Node *e, int returning);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CG_OWNER_H
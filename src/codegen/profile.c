@@ -0,0 +1,331 @@
+#include "profile.h"
+#include "codegen.h"
+#include "expr.h"
+#include "owner.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* A condition needs this many samples, and this bias in tenths, for a hint. */
+#define PROF_MIN_SAMPLES 8
+#define PROF_BIAS_TENTHS 9
+
+/* Loops iterating at most this often on average are unrolled completely. */
+#define PROF_FULL_UNROLL 8
+#define PROF_PARTIAL_UNROLL 4
+
+typedef struct {
+  char kind;
+  const char *func;
+  size_t line;
+  size_t column;
+  char *callee;
+} ProfSite;
+
+static ProfSite *sites;
+static size_t nsites, sites_cap;
+static size_t nslots;
+
+/* Allocation sites of --profile-alloc, numbered from 1; what is owned. */
+typedef struct {
+  const char *func;
+  size_t line;
+  char *what;
+} AllocSite;
+
+/* Site numbers have to fit the DrRef of the objects they tag. */
+#define PROF_MAX_ALLOC_SITES 65535
+
+static AllocSite *alloc_sites;
+static size_t nalloc_sites, alloc_sites_cap;
+
+/* Qualified names of the functions seen, freed with the sites. */
+static char **funcs;
+static size_t nfuncs, funcs_cap;
+
+static size_t add_site(char kind, const char *func, size_t line, size_t column,
+                       const char *callee) {
+  if (nsites == sites_cap) {
+    sites_cap = sites_cap ? sites_cap * 2 : 64;
+    sites = realloc(sites, sites_cap * sizeof(ProfSite));
+  }
+  sites[nsites++] = (ProfSite){kind, func, line, column,
+                               callee ? strdup(callee) : NULL};
+  size_t slot = nslots;
+  nslots += kind == 'b' ? 2 : 1;
+  return slot;
+}
+
+int cg_prof_active(void) {
+  return cg_options.profile_generate || cg_options.profile != NULL ||
+         cg_options.profile_alloc;
+}
+
+void cg_prof_emit_preamble(COut *b) {
+  if (cg_options.profile_generate) {
+    c_out_write(b, "#include \"../libs/profile.h\"\n");
+    c_out_write(b, "extern unsigned long long dr_prof_counts[];\n");
+    c_out_write(b, "#define DR_PROF_BRANCH(k, c) ((c) ? (dr_prof_counts[k]++, 1) "
+                   ": (dr_prof_counts[(k) + 1]++, 0))\n\n");
+  }
+  if (cg_options.profile_alloc) {
+    c_out_write(b, "#include \"../libs/allocprof.h\"\n\n");
+  }
+}
+
+static void free_sites(void) {
+  for (size_t i = 0; i < nsites; i++)
+    free(sites[i].callee);
+  for (size_t i = 0; i < nfuncs; i++)
+    free(funcs[i]);
+  for (size_t i = 0; i < nalloc_sites; i++)
+    free(alloc_sites[i].what);
+  free(sites);
+  free(funcs);
+  free(alloc_sites);
+  sites = NULL;
+  funcs = NULL;
+  alloc_sites = NULL;
+  nsites = sites_cap = nslots = 0;
+  nalloc_sites = alloc_sites_cap = 0;
+  nfuncs = funcs_cap = 0;
+}
+
+static void emit_c_string(COut *b, const char *s) {
+  c_out_write(b, "\"");
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\')
+      c_out_write(b, "\\%c", *s);
+    else
+      c_out_write(b, "%c", *s);
+  }
+  c_out_write(b, "\"");
+}
+
+static void emit_alloc_trailer(COut *b, const char *src_file) {
+  c_out_write(b, "static const DrAllocSite dr_alloc_sites[%zu] = {\n",
+              nalloc_sites ? nalloc_sites : 1);
+  c_out_indent(b);
+  for (size_t i = 0; i < nalloc_sites; i++) {
+    AllocSite *s = &alloc_sites[i];
+    c_out_write(b, "{\"%s\", %zu, ", s->func, s->line);
+    emit_c_string(b, s->what);
+    c_out_write(b, "},\n");
+  }
+  c_out_dedent(b);
+  c_out_write(b, "};\n");
+  c_out_write(b, "__attribute__((constructor)) static void "
+                 "dr_alloc_profile_init(void) {\n");
+  c_out_indent(b);
+  c_out_write(b, "dr_alloc_profile_start(dr_alloc_sites, %zu, ", nalloc_sites);
+  emit_c_string(b, src_file);
+  c_out_write(b, ", ");
+  emit_c_string(b, cg_options.profile_alloc_path);
+  c_out_write(b, ");\n");
+  c_out_dedent(b);
+  c_out_write(b, "}\n");
+}
+
+void cg_prof_emit_trailer(COut *b, const char *src_file) {
+  if (cg_options.profile_alloc)
+    emit_alloc_trailer(b, src_file);
+  if (cg_options.profile_generate) {
+    c_out_write(b, "const DrProfSite dr_prof_sites[%zu] = {\n",
+                nsites ? nsites : 1);
+    c_out_indent(b);
+    for (size_t i = 0; i < nsites; i++) {
+      ProfSite *s = &sites[i];
+      c_out_write(b, "{'%c', \"%s\", %zu, %zu, ", s->kind, s->func, s->line,
+                  s->column);
+      if (s->callee)
+        c_out_write(b, "\"%s\"},\n", s->callee);
+      else
+        c_out_write(b, "NULL},\n");
+    }
+    c_out_dedent(b);
+    c_out_write(b, "};\n");
+    c_out_write(b, "unsigned long long dr_prof_counts[%zu];\n",
+                nslots ? nslots : 1);
+    c_out_write(b, "__attribute__((constructor)) static void dr_profile_init(void) {\n");
+    c_out_indent(b);
+    c_out_write(b, "dr_profile_start(dr_prof_sites, dr_prof_counts, %zu, ", nsites);
+    emit_c_string(b, cg_options.profile_path);
+    c_out_write(b, ");\n");
+    c_out_dedent(b);
+    c_out_write(b, "}\n");
+  }
+  free_sites();
+}
+
+void cg_prof_func_begin(CGCtx *ctx, Slice prefix, Slice name) {
+  ctx->prof_func = NULL;
+  ctx->site_line = 0;
+  ctx->site_ordinal = 0;
+  if (!cg_prof_active())
+    return;
+  size_t len = prefix.len ? prefix.len + 1 + name.len : name.len;
+  char *q = malloc(len + 1);
+  if (prefix.len) {
+    memcpy(q, prefix.start, prefix.len);
+    q[prefix.len] = '.';
+    memcpy(q + prefix.len + 1, name.start, name.len);
+  } else {
+    memcpy(q, name.start, name.len);
+  }
+  q[len] = 0;
+  if (nfuncs == funcs_cap) {
+    funcs_cap = funcs_cap ? funcs_cap * 2 : 16;
+    funcs = realloc(funcs, funcs_cap * sizeof(char *));
+  }
+  funcs[nfuncs++] = q;
+  ctx->prof_func = q;
+}
+
+int cg_prof_emit_func_attr(CGCtx *ctx, COut *b) {
+  if (!cg_options.profile || !ctx->prof_func ||
+      strcmp(ctx->prof_func, "main") == 0)
+    return 0;
+  const ProfileEntry *e = profile_lookup(cg_options.profile, PROFILE_FUNC,
+                                         ctx->prof_func, 0, 0, NULL);
+  if (!e)
+    return 0;
+  if (e->count[0] == 0)
+    c_out_write(b, "DR_COLD ");
+  else if (e->count[0] >= profile_hot_threshold(cg_options.profile))
+    c_out_write(b, "DR_HOT ");
+  return 1;
+}
+
+int cg_prof_emit_entry(CGCtx *ctx, COut *b) {
+  if (!cg_options.profile_generate || !ctx->prof_func)
+    return 0;
+  size_t k = add_site('f', ctx->prof_func, 0, 0, NULL);
+  c_out_write(b, "{\n");
+  c_out_indent(b);
+  c_out_write(b, "dr_prof_counts[%zu]++;\n", k);
+  return 1;
+}
+
+void cg_prof_emit_exit(COut *b, int opened) {
+  if (!opened)
+    return;
+  c_out_dedent(b);
+  c_out_write(b, "}\n");
+}
+
+int cg_prof_call_begin(CGCtx *ctx, COut *b, const char *callee) {
+  if (!cg_options.profile_generate || !ctx->prof_func || !callee)
+    return 0;
+  size_t k = add_site('c', ctx->prof_func, ctx->site_line,
+                      (size_t)ctx->site_ordinal++, callee);
+  c_out_write(b, "(dr_prof_counts[%zu]++, ", k);
+  return 1;
+}
+
+/* What e allocates, as the report names it. */
+static char *alloc_what(Node *e) {
+  char buf[128];
+  switch (e->kind) {
+  case ND_NEW:
+    snprintf(buf, sizeof(buf), "new %.*s", (int)e->as.new_expr.type_name.len,
+             e->as.new_expr.type_name.start);
+    break;
+  case ND_CONSOLE_CALL:
+    snprintf(buf, sizeof(buf), "Console.ReadLine");
+    break;
+  case ND_CALL:
+    snprintf(buf, sizeof(buf), "%.*s()", (int)e->as.call.callee->as.ident.len,
+             e->as.call.callee->as.ident.start);
+    break;
+  default:
+    snprintf(buf, sizeof(buf), "string +");
+    break;
+  }
+  return strdup(buf);
+}
+
+int cg_prof_alloc_begin(CGCtx *ctx, COut *b, Node *e) {
+  if (!cg_options.profile_alloc || !ctx->prof_func ||
+      nalloc_sites == PROF_MAX_ALLOC_SITES || !cg_own_is_fresh(ctx, e))
+    return 0;
+  if (nalloc_sites == alloc_sites_cap) {
+    alloc_sites_cap = alloc_sites_cap ? alloc_sites_cap * 2 : 64;
+    alloc_sites = realloc(alloc_sites, alloc_sites_cap * sizeof(AllocSite));
+  }
+  alloc_sites[nalloc_sites++] =
+      (AllocSite){ctx->prof_func, ctx->site_line, alloc_what(e)};
+  c_out_write(b, "({ __auto_type dr_at = (");
+  return (int)nalloc_sites;
+}
+
+void cg_prof_alloc_end(COut *b, int site) {
+  if (site)
+    c_out_write(b, "); dr_alloc_tag(dr_at, %d); dr_at; })", site);
+}
+
+static const ProfileEntry *branch_entry(CGCtx *ctx, Node *stmt) {
+  if (!cg_options.profile || !ctx->prof_func || !stmt->pos.line)
+    return NULL;
+  const ProfileEntry *e =
+      profile_lookup(cg_options.profile, PROFILE_BRANCH, ctx->prof_func,
+                     stmt->pos.line, stmt->pos.column, NULL);
+  if (!e || e->count[0] + e->count[1] < PROF_MIN_SAMPLES)
+    return NULL;
+  return e;
+}
+
+/* 1 if mostly taken, -1 if mostly not taken, 0 if unbiased or unknown. */
+static int branch_bias(const ProfileEntry *e) {
+  if (!e)
+    return 0;
+  unsigned long long total = e->count[0] + e->count[1];
+  if (e->count[0] * 10 >= total * PROF_BIAS_TENTHS)
+    return 1;
+  if (e->count[1] * 10 >= total * PROF_BIAS_TENTHS)
+    return -1;
+  return 0;
+}
+
+void cg_prof_emit_cond(CGCtx *ctx, COut *b, Node *stmt, Node *cond,
+                       int fallback) {
+  if (cg_options.profile_generate && ctx->prof_func && stmt->pos.line) {
+    size_t k = add_site('b', ctx->prof_func, stmt->pos.line, stmt->pos.column,
+                        NULL);
+    c_out_write(b, "DR_PROF_BRANCH(%zu, ", k);
+    cg_emit_expr(ctx, b, cond);
+    c_out_write(b, ")");
+    return;
+  }
+  const ProfileEntry *e = branch_entry(ctx, stmt);
+  int bias = e ? branch_bias(e) : fallback;
+  if (stmt->kind == ND_IF && bias < 0 && cg_prof_invert_if(ctx, stmt)) {
+    c_out_write(b, "DR_LIKELY(!");
+    cg_emit_expr(ctx, b, cond);
+    c_out_write(b, ")");
+    return;
+  }
+  if (bias)
+    c_out_write(b, bias > 0 ? "DR_LIKELY(" : "DR_UNLIKELY(");
+  cg_emit_expr(ctx, b, cond);
+  if (bias)
+    c_out_write(b, ")");
+}
+
+int cg_prof_invert_if(CGCtx *ctx, Node *stmt) {
+  return stmt->as.if_stmt.else_br && !cg_options.profile_generate &&
+         branch_bias(branch_entry(ctx, stmt)) < 0;
+}
+
+void cg_prof_emit_loop_hint(CGCtx *ctx, COut *b, Node *loop) {
+  const ProfileEntry *e = branch_entry(ctx, loop);
+  if (!e || e->count[0] < profile_hot_threshold(cg_options.profile))
+    return;
+  /* A do-while condition is not tested on the way in. */
+  unsigned long long entries = e->count[1] ? e->count[1] : 1;
+  unsigned long long iterations =
+      loop->kind == ND_DO_WHILE ? e->count[0] + e->count[1] : e->count[0];
+  unsigned long long trips = (iterations + entries - 1) / entries;
+  unsigned long long n = trips <= PROF_FULL_UNROLL ? trips : PROF_PARTIAL_UNROLL;
+  if (n >= 2)
+    c_out_write(b, "DR_UNROLL(%llu)\n", n);
+}
@@ -0,0 +1,81 @@
+#ifndef CG_PROFILE_H
+#define CG_PROFILE_H
+
+#include "../parser/ast.h"
+#include "c_emit.h"
+#include "context.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Profile-guided code generation.
+ *
+ * With --profile-generate every function entry, call site and branch or
+ * loop condition gets a counter, and the program writes the counts to a
+ * .drprof file when it exits. With --profile-use the recorded counts turn
+ * into hints for the C compiler: biased conditions are wrapped in
+ * __builtin_expect, an if whose else branch is the hot one is emitted
+ * inverted so the hot code falls through, hot loops get an unroll pragma
+ * sized by their average trip count, and functions are marked hot or cold.
+ *
+ * Call sites are numbered in emission order within their line, so a
+ * profile matches the build that recorded it only when both use the same
+ * optimization level.
+ *
+ * With --profile-alloc every expression that allocates an object or a
+ * string is numbered and passed through dr_alloc_tag(), and the program
+ * reports what each of these sites allocated when it exits (allocprof.h).
+ */
+
+/* Nonzero if counters are emitted or a profile is applied. */
+int cg_prof_active(void);
+
+/* Declarations the instrumented code relies on. */
+void cg_prof_emit_preamble(COut *b);
+
+/* Counter and site tables and the exit hooks; releases the collected
+ * sites. */
+void cg_prof_emit_trailer(COut *b, const char *src_file);
+
+/* Starts a function (prefix is the owning type, if any); sets ctx->prof_func. */
+void cg_prof_func_begin(CGCtx *ctx, Slice prefix, Slice name);
+
+/* DR_HOT or DR_COLD ahead of the signature of the current function;
+ * nonzero if the profile knows the function. */
+int cg_prof_emit_func_attr(CGCtx *ctx, COut *b);
+
+/* Opens the body with the entry counter; returns nonzero if it did. */
+int cg_prof_emit_entry(CGCtx *ctx, COut *b);
+
+/* Closes what cg_prof_emit_entry opened. */
+void cg_prof_emit_exit(COut *b, int opened);
+
+/* Starts counting a call of callee ("name" or "Type.name"); nonzero if the
+ * call has to be closed with a parenthesis. */
+int cg_prof_call_begin(CGCtx *ctx, COut *b, const char *callee);
+
+/* Starts tagging the allocation e makes, if it makes one; returns the
+ * site to pass to cg_prof_alloc_end, 0 if there is nothing to close. */
+int cg_prof_alloc_begin(CGCtx *ctx, COut *b, Node *e);
+
+/* Closes what cg_prof_alloc_begin opened. */
+void cg_prof_alloc_end(COut *b, int site);
+
+/* Emits cond, instrumented or wrapped in a likelihood hint; fallback is
+ * the expected outcome (1, -1 or 0) where the profile has no data. */
+void cg_prof_emit_cond(CGCtx *ctx, COut *b, Node *stmt, Node *cond,
+                       int fallback);
+
+/* Nonzero if the else branch of the if statement is the hot one. */
+int cg_prof_invert_if(CGCtx *ctx, Node *stmt);
+
+/* Unroll pragma for a hot loop, emitted right before the loop keyword. */
+void cg_prof_emit_loop_hint(CGCtx *ctx, COut *b, Node *loop);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CG_PROFILE_H
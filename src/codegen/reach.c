@@ -0,0 +1,466 @@
+#include "reach.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* A function, method or type declaration that may be left out. */
+typedef struct {
+  Node *node;
+  int owner; /* index of the enclosing type for methods, -1 otherwise */
+  int live;
+  int scanned;
+  int *callees; /* top-level functions named in the body */
+  size_t ncallees;
+  int scc;      /* strongly connected component of the call graph */
+} Decl;
+
+static Decl *g_decls = NULL;
+static size_t g_len = 0, g_cap = 0;
+static int *g_work = NULL;
+static size_t g_work_len = 0, g_work_cap = 0;
+static int g_active = 0;
+static int g_cur = -1; /* declaration being scanned */
+static int g_tasks = 0; /* reached code awaits or calls Task.X */
+static int *g_scc_size = NULL;
+
+static int slice_eq(Slice a, Slice b) {
+  return a.len == b.len && a.len && strncmp(a.start, b.start, a.len) == 0;
+}
+
+static int is_type(Node *n) {
+  return n->kind == ND_STRUCT_DECL || n->kind == ND_CLASS_DECL ||
+         n->kind == ND_ENUM_DECL;
+}
+
+static Slice decl_name(Node *n) {
+  if (n->kind == ND_FUNC)
+    return n->as.func.name;
+  if (n->kind == ND_ENUM_DECL)
+    return n->as.enum_decl.name;
+  return n->as.type_decl.name;
+}
+
+static int add_decl(Node *n, int owner) {
+  if (g_len + 1 > g_cap) {
+    g_cap = g_cap ? g_cap * 2 : 32;
+    g_decls = realloc(g_decls, g_cap * sizeof(Decl));
+  }
+  g_decls[g_len] = (Decl){n, owner, 0, 0, NULL, 0, -1};
+  return (int)g_len++;
+}
+
+static void add_callee(int callee) {
+  Decl *d = &g_decls[g_cur];
+  for (size_t i = 0; i < d->ncallees; i++) {
+    if (d->callees[i] == callee)
+      return;
+  }
+  d->callees = realloc(d->callees, (d->ncallees + 1) * sizeof(int));
+  d->callees[d->ncallees++] = callee;
+}
+
+static void mark(int i) {
+  if (g_decls[i].live)
+    return;
+  g_decls[i].live = 1;
+  if (g_work_len + 1 > g_work_cap) {
+    g_work_cap = g_work_cap ? g_work_cap * 2 : 32;
+    g_work = realloc(g_work, g_work_cap * sizeof(int));
+  }
+  g_work[g_work_len++] = i;
+}
+
+/* Top-level functions, or with methods also every method, called name. */
+static void mark_funcs(Slice name, int methods) {
+  for (size_t i = 0; i < g_len; i++) {
+    Decl *d = &g_decls[i];
+    if (d->node->kind == ND_FUNC && (methods || d->owner < 0) &&
+        slice_eq(d->node->as.func.name, name)) {
+      mark((int)i);
+      if (!methods && g_cur >= 0 && g_decls[g_cur].owner < 0 &&
+          g_decls[g_cur].node->kind == ND_FUNC)
+        add_callee((int)i);
+    }
+  }
+}
+
+/* Types called name, and enums declaring a member called name. */
+static void mark_types(Slice name) {
+  for (size_t i = 0; i < g_len; i++) {
+    Node *n = g_decls[i].node;
+    if (!is_type(n))
+      continue;
+    if (slice_eq(decl_name(n), name)) {
+      mark((int)i);
+      continue;
+    }
+    if (n->kind == ND_ENUM_DECL) {
+      for (size_t j = 0; j < n->as.enum_decl.len; j++) {
+        if (slice_eq(n->as.enum_decl.members[j]->as.var_decl.name, name)) {
+          mark((int)i);
+          break;
+        }
+      }
+    }
+  }
+}
+
+/* The constructor called by `new T(...)`. */
+static void mark_init(Slice type_name) {
+  for (size_t i = 0; i < g_len; i++) {
+    Decl *d = &g_decls[i];
+    if (d->owner >= 0 && d->node->as.func.name.len == 4 &&
+        strncmp(d->node->as.func.name.start, "init", 4) == 0 &&
+        slice_eq(decl_name(g_decls[d->owner].node), type_name))
+      mark((int)i);
+  }
+}
+
+static void scan(Node *n) {
+  if (!n)
+    return;
+  switch (n->kind) {
+  case ND_IDENT:
+    mark_types(n->as.ident);
+    mark_funcs(n->as.ident, 0);
+    break;
+  case ND_UNARY:
+  case ND_POST_UNARY:
+    scan(n->as.unary.expr);
+    break;
+  case ND_BINOP:
+    scan(n->as.bin.lhs);
+    scan(n->as.bin.rhs);
+    break;
+  case ND_COND:
+    scan(n->as.cond.cond);
+    scan(n->as.cond.then_expr);
+    scan(n->as.cond.else_expr);
+    break;
+  case ND_INDEX:
+    scan(n->as.index.array);
+    scan(n->as.index.index);
+    break;
+  case ND_FIELD:
+    scan(n->as.field.object);
+    break;
+  case ND_BASE:
+    mark_funcs(n->as.base.name, 1);
+    break;
+  case ND_VAR_DECL:
+    if (n->as.var_decl.type_name.len)
+      mark_types(n->as.var_decl.type_name);
+    scan(n->as.var_decl.init);
+    break;
+  case ND_IF:
+    scan(n->as.if_stmt.cond);
+    scan(n->as.if_stmt.then_br);
+    scan(n->as.if_stmt.else_br);
+    break;
+  case ND_WHILE:
+    scan(n->as.while_stmt.cond);
+    scan(n->as.while_stmt.body);
+    break;
+  case ND_DO_WHILE:
+    scan(n->as.do_while_stmt.body);
+    scan(n->as.do_while_stmt.cond);
+    break;
+  case ND_FOR:
+    scan(n->as.for_stmt.init);
+    scan(n->as.for_stmt.cond);
+    scan(n->as.for_stmt.update);
+    scan(n->as.for_stmt.body);
+    break;
+  case ND_RETURN:
+    scan(n->as.ret.expr);
+    break;
+  case ND_BLOCK:
+    for (size_t i = 0; i < n->as.block.len; i++)
+      scan(n->as.block.items[i]);
+    break;
+  case ND_EXPR_STMT:
+    scan(n->as.expr_stmt.expr);
+    break;
+  case ND_SWITCH:
+    scan(n->as.switch_stmt.expr);
+    for (size_t i = 0; i < n->as.switch_stmt.len; i++) {
+      scan(n->as.switch_stmt.cases[i].value);
+      scan(n->as.switch_stmt.cases[i].body);
+    }
+    break;
+  case ND_CONSOLE_CALL:
+    scan(n->as.console.arg);
+    break;
+  case ND_CALL: {
+    Node *callee = n->as.call.callee;
+    if (callee && callee->kind == ND_FIELD) {
+      Node *obj = callee->as.field.object;
+      if (obj && obj->kind == ND_IDENT && obj->as.ident.len == 4 &&
+          strncmp(obj->as.ident.start, "Task", 4) == 0)
+        g_tasks = 1;
+      /* the receiver's type is not known here: any method of that name */
+      mark_funcs(callee->as.field.name, 1);
+      scan(callee->as.field.object);
+    } else {
+      scan(callee);
+    }
+    for (size_t i = 0; i < n->as.call.len; i++)
+      scan(n->as.call.args[i]);
+    break;
+  }
+  case ND_FUNC:
+    for (size_t i = 0; i < n->as.func.param_len; i++)
+      scan(n->as.func.params[i]);
+    scan(n->as.func.body);
+    break;
+  case ND_NEW:
+    mark_types(n->as.new_expr.type_name);
+    mark_init(n->as.new_expr.type_name);
+    for (size_t i = 0; i < n->as.new_expr.arg_len; i++)
+      scan(n->as.new_expr.args[i]);
+    break;
+  case ND_TRY:
+    if (n->as.try_stmt.catch_type.len)
+      mark_types(n->as.try_stmt.catch_type);
+    scan(n->as.try_stmt.body);
+    scan(n->as.try_stmt.catch_body);
+    scan(n->as.try_stmt.finally_body);
+    break;
+  case ND_THROW:
+    scan(n->as.throw_stmt.expr);
+    break;
+  case ND_AWAIT:
+    g_tasks = 1;
+    scan(n->as.await_expr.expr);
+    break;
+  case ND_REGION:
+    scan(n->as.region.body);
+    break;
+  case ND_EXPORT:
+    scan(n->as.export.decl);
+    break;
+  default:
+    break;
+  }
+}
+
+static void process(int i) {
+  Decl *d = &g_decls[i];
+  if (d->scanned)
+    return;
+  /* a method is scanned once its class is known to be emitted */
+  if (d->owner >= 0 && !g_decls[d->owner].live)
+    return;
+  d->scanned = 1;
+  Node *n = d->node;
+  switch (n->kind) {
+  case ND_FUNC:
+    g_cur = i;
+    scan(n);
+    g_cur = -1;
+    break;
+  case ND_ENUM_DECL:
+    for (size_t j = 0; j < n->as.enum_decl.len; j++)
+      scan(n->as.enum_decl.members[j]->as.var_decl.init);
+    break;
+  default:
+    if (n->as.type_decl.base_name.len)
+      mark_types(n->as.type_decl.base_name);
+    for (size_t j = 0; j < n->as.type_decl.len; j++) {
+      if (n->as.type_decl.members[j]->kind == ND_VAR_DECL)
+        scan(n->as.type_decl.members[j]);
+    }
+    /* methods reached before their class was */
+    for (size_t j = 0; j < g_len; j++) {
+      if (g_decls[j].owner == i && g_decls[j].live && !g_decls[j].scanned)
+        process((int)j);
+    }
+    break;
+  }
+}
+
+/* Tarjan's algorithm over the calls between live top-level functions. */
+static int *g_index, *g_low, *g_stack, g_depth, g_top, g_nscc;
+static char *g_on_stack;
+
+static void strongconnect(int v) {
+  g_index[v] = g_low[v] = g_depth++;
+  g_stack[g_top++] = v;
+  g_on_stack[v] = 1;
+  for (size_t i = 0; i < g_decls[v].ncallees; i++) {
+    int w = g_decls[v].callees[i];
+    if (g_index[w] < 0) {
+      strongconnect(w);
+      if (g_low[w] < g_low[v])
+        g_low[v] = g_low[w];
+    } else if (g_on_stack[w] && g_index[w] < g_low[v]) {
+      g_low[v] = g_index[w];
+    }
+  }
+  if (g_low[v] == g_index[v]) {
+    int size = 0, w;
+    do {
+      w = g_stack[--g_top];
+      g_on_stack[w] = 0;
+      g_decls[w].scc = g_nscc;
+      size++;
+    } while (w != v);
+    g_scc_size[g_nscc++] = size;
+  }
+}
+
+static void find_cycles(void) {
+  g_index = malloc((g_len + 1) * sizeof(int));
+  g_low = malloc((g_len + 1) * sizeof(int));
+  g_stack = malloc((g_len + 1) * sizeof(int));
+  g_on_stack = calloc(g_len + 1, 1);
+  g_scc_size = calloc(g_len + 1, sizeof(int));
+  g_depth = g_top = g_nscc = 0;
+  for (size_t i = 0; i < g_len; i++)
+    g_index[i] = -1;
+  for (size_t i = 0; i < g_len; i++) {
+    Decl *d = &g_decls[i];
+    if (d->node->kind == ND_FUNC && d->owner < 0 && d->live && g_index[i] < 0)
+      strongconnect((int)i);
+  }
+  free(g_index);
+  free(g_low);
+  free(g_stack);
+  free(g_on_stack);
+}
+
+void cg_reach_compute(Node *root) {
+  cg_reach_reset();
+  int main_decl = -1;
+  for (size_t i = 0; i < root->as.block.len; i++) {
+    Node *it = root->as.block.items[i];
+    if (it->kind == ND_FUNC) {
+      int d = add_decl(it, -1);
+      if (main_decl < 0 && it->as.func.name.len == 4 &&
+          strncmp(it->as.func.name.start, "main", 4) == 0)
+        main_decl = d;
+    } else if (it->kind == ND_ENUM_DECL) {
+      add_decl(it, -1);
+    } else if (it->kind == ND_STRUCT_DECL || it->kind == ND_CLASS_DECL) {
+      int owner = add_decl(it, -1);
+      for (size_t j = 0; j < it->as.type_decl.len; j++) {
+        if (it->as.type_decl.members[j]->kind == ND_FUNC)
+          add_decl(it->as.type_decl.members[j], owner);
+      }
+    }
+  }
+
+  /* Roots, chosen the same way codegen_emit_c picks the entry point */
+  if (main_decl >= 0) {
+    mark(main_decl);
+  } else {
+    int static_main = -1;
+    for (size_t i = 0; i < g_len && static_main < 0; i++) {
+      Node *n = g_decls[i].node;
+      if (g_decls[i].owner >= 0 && n->as.func.is_static &&
+          n->as.func.name.len == 4 && strncmp(n->as.func.name.start, "main", 4) == 0)
+        static_main = (int)i;
+    }
+    if (static_main >= 0) {
+      mark(g_decls[static_main].owner);
+      mark(static_main);
+    } else {
+      for (size_t i = 0; i < root->as.block.len; i++) {
+        Node *it = root->as.block.items[i];
+        if (it->kind != ND_FUNC && !is_type(it))
+          scan(it);
+      }
+    }
+  }
+
+  while (g_work_len > 0)
+    process(g_work[--g_work_len]);
+  find_cycles();
+  g_active = 1;
+}
+
+void cg_reach_reset(void) {
+  for (size_t i = 0; i < g_len; i++)
+    free(g_decls[i].callees);
+  free(g_decls);
+  free(g_scc_size);
+  g_scc_size = NULL;
+  free(g_work);
+  g_decls = NULL;
+  g_work = NULL;
+  g_len = g_cap = g_work_len = g_work_cap = 0;
+  g_active = 0;
+  g_tasks = 0;
+}
+
+int cg_reach_uses_tasks(void) { return g_tasks; }
+
+int cg_reach_is_live(Node *decl) {
+  if (!g_active)
+    return 1;
+  for (size_t i = 0; i < g_len; i++) {
+    if (g_decls[i].node == decl)
+      return g_decls[i].live;
+  }
+  return 1;
+}
+
+static int find_decl(Node *decl) {
+  for (size_t i = 0; i < g_len; i++) {
+    if (g_decls[i].node == decl)
+      return (int)i;
+  }
+  return -1;
+}
+
+Node *cg_reach_function(Slice name) {
+  for (size_t i = 0; i < g_len; i++) {
+    Decl *d = &g_decls[i];
+    if (d->node->kind == ND_FUNC && d->owner < 0 &&
+        slice_eq(d->node->as.func.name, name))
+      return d->node;
+  }
+  return NULL;
+}
+
+Node *cg_reach_method(Slice type_name, Slice name) {
+  for (size_t i = 0; i < g_len; i++) {
+    Decl *d = &g_decls[i];
+    if (d->node->kind == ND_FUNC && d->owner >= 0 &&
+        slice_eq(d->node->as.func.name, name) &&
+        slice_eq(decl_name(g_decls[d->owner].node), type_name))
+      return d->node;
+  }
+  return NULL;
+}
+
+int cg_reach_async_method(Slice name) {
+  for (size_t i = 0; i < g_len; i++) {
+    Decl *d = &g_decls[i];
+    if (d->node->kind == ND_FUNC && d->owner >= 0 &&
+        d->node->as.func.is_async && slice_eq(d->node->as.func.name, name))
+      return 1;
+  }
+  return 0;
+}
+
+int cg_reach_same_cycle(Node *caller, Node *callee) {
+  if (!g_active)
+    return 0;
+  int a = find_decl(caller), b = find_decl(callee);
+  if (a < 0 || b < 0 || g_decls[a].scc < 0 || g_decls[a].scc != g_decls[b].scc)
+    return 0;
+  if (a != b)
+    return 1;
+  for (size_t i = 0; i < g_decls[a].ncallees; i++) {
+    if (g_decls[a].callees[i] == a)
+      return 1;
+  }
+  return 0;
+}
+
+int cg_reach_mutually_recursive(Node *fn) {
+  if (!g_active)
+    return 0;
+  int i = find_decl(fn);
+  return i >= 0 && g_decls[i].scc >= 0 && g_scc_size[g_decls[i].scc] > 1;
+}
@@ -0,0 +1,51 @@
+#ifndef CG_REACH_H
+#define CG_REACH_H
+
+#include "../parser/ast.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Whole-program reachability for dead function and type elimination.
+ *
+ * Starting from main (a top-level function, a static Class.main, or the
+ * top-level statements), function bodies are scanned for calls and type
+ * uses. Calls are resolved by name, so a method call marks every method of
+ * that name; the result over-approximates what the program can reach.
+ * Declarations that are not reached are left out of the generated C.
+ *
+ * The calls between live top-level functions are kept as a call graph whose
+ * cycles drive tail-call emission and forward declarations.
+ */
+
+void cg_reach_compute(Node *root);
+void cg_reach_reset(void);
+
+/* Nonzero if the function, method or type declaration must be emitted. */
+int cg_reach_is_live(Node *decl);
+
+/* The top-level function called name, or NULL. */
+Node *cg_reach_function(Slice name);
+
+/* The method called name declared in type_name itself, or NULL. */
+Node *cg_reach_method(Slice type_name, Slice name);
+
+/* Nonzero if the reached code awaits or calls Task.WhenAll and the like. */
+int cg_reach_uses_tasks(void);
+
+/* Nonzero if some method called name is async. */
+int cg_reach_async_method(Slice name);
+
+/* Nonzero if callee can call back into caller (or caller calls itself). */
+int cg_reach_same_cycle(Node *caller, Node *callee);
+
+/* Nonzero if the function lies on a cycle through another function. */
+int cg_reach_mutually_recursive(Node *fn);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CG_REACH_H
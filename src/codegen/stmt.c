@@ -1,4 +1,15 @@
 #include "stmt.h"
+#include "bounds.h"
+#include "codegen.h"
+#include "consteval.h"
+#include "coro.h"
+#include "escape.h"
+#include "hints.h"
+#include "memo.h"
+#include "owner.h"
+#include "profile.h"
+#include "reach.h"
+#include "switch.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -61,6 +72,49 @@ int cg_has_init(Slice name) {
   return 0;
 }
 
+/* Nonzero if m, a member, is an instance field holding a reference. */
+static int is_ref_field(Node *m) {
+  if (m->kind != ND_VAR_DECL || m->as.var_decl.is_static ||
+      m->as.var_decl.array_len || m->as.var_decl.is_pointer)
+    return 0;
+  return m->as.var_decl.type == TK_KW_STRING ||
+         (m->as.var_decl.type == TK_IDENT &&
+          cg_is_class_type(m->as.var_decl.type_name));
+}
+
+int cg_class_drops(Slice name) {
+  for (size_t i = 0; i < g_type_len; i++) {
+    Node *decl = g_types[i].decl;
+    if (!decl || !g_types[i].is_class || g_types[i].name.len != name.len ||
+        strncmp(g_types[i].name.start, name.start, name.len) != 0)
+      continue;
+    for (size_t j = 0; j < decl->as.type_decl.len; j++)
+      if (is_ref_field(decl->as.type_decl.members[j]))
+        return 1;
+    return 0;
+  }
+  return 0;
+}
+
+TokenKind cg_field_type(Slice type, Slice field) {
+  for (size_t i = 0; i < g_type_len; i++) {
+    Node *decl = g_types[i].decl;
+    if (!decl || g_types[i].name.len != type.len ||
+        strncmp(g_types[i].name.start, type.start, type.len) != 0)
+      continue;
+    for (size_t j = 0; j < decl->as.type_decl.len; j++) {
+      Node *m = decl->as.type_decl.members[j];
+      if (m->kind == ND_VAR_DECL && m->as.var_decl.name.len == field.len &&
+          strncmp(m->as.var_decl.name.start, field.start, field.len) == 0)
+        return m->as.var_decl.array_len ? (TokenKind)0 : m->as.var_decl.type;
+    }
+    if (decl->as.type_decl.base_name.len)
+      return cg_field_type(decl->as.type_decl.base_name, field);
+    return 0;
+  }
+  return 0;
+}
+
 static const char *type_to_c(TokenKind k) {
   switch (k) {
   case TK_KW_INT:
@@ -106,6 +160,11 @@ static void emit_type_with_pointer(COut *b, TokenKind k, Slice name, int is_poin
   }
 }
 
+void cg_emit_decl_type(COut *b, Node *decl) {
+  emit_type_with_pointer(b, decl->as.var_decl.type, decl->as.var_decl.type_name,
+                         decl->as.var_decl.is_pointer);
+}
+
 void emit_type_decl(COut *b, Node *n, const char *src_file) {
   const char *type_kind = (n->kind == ND_CLASS_DECL) ? "class" : "struct";
   c_out_write(b, "/* Dream %s %.*s", type_kind, (int)n->as.type_decl.name.len,
@@ -183,6 +242,29 @@ void emit_type_decl(COut *b, Node *n, const char *src_file) {
   c_out_write(b, "};");
   c_out_newline(b);
   c_out_newline(b);
+  /* Instances hold a reference to what their fields point at, dropped
+   * with them. */
+  if (n->kind == ND_CLASS_DECL && cg_class_drops(n->as.type_decl.name)) {
+    Slice name = n->as.type_decl.name;
+    c_out_write(b, "static void %.*s_drop(void *self) {", (int)name.len,
+                name.start);
+    c_out_newline(b);
+    c_out_indent(b);
+    c_out_write(b, "struct %.*s *o = self;", (int)name.len, name.start);
+    c_out_newline(b);
+    for (size_t i = 0; i < n->as.type_decl.len; i++) {
+      Node *m = n->as.type_decl.members[i];
+      if (!is_ref_field(m))
+        continue;
+      c_out_write(b, "dr_release((void *)o->%.*s);",
+                  (int)m->as.var_decl.name.len, m->as.var_decl.name.start);
+      c_out_newline(b);
+    }
+    c_out_dedent(b);
+    c_out_write(b, "}");
+    c_out_newline(b);
+    c_out_newline(b);
+  }
   for (size_t i = 0; i < n->as.type_decl.len; i++) {
     Node *m = n->as.type_decl.members[i];
     if (m->kind == ND_VAR_DECL && m->as.var_decl.is_static) {
@@ -199,7 +281,7 @@ void emit_type_decl(COut *b, Node *n, const char *src_file) {
   }
   for (size_t i = 0; i < n->as.type_decl.len; i++) {
     Node *m = n->as.type_decl.members[i];
-    if (m->kind == ND_FUNC) {
+    if (m->kind == ND_FUNC && cg_reach_is_live(m)) {
       if (m->as.func.is_static)
         emit_func_impl(b, n->as.type_decl.name, m, src_file);
       else
@@ -240,6 +322,114 @@ void emit_enum_decl(COut *b, Node *n, const char *src_file) {
   c_out_newline(b);
 }
 
+static int slice_eq(Slice a, Slice b) {
+  return a.len == b.len && strncmp(a.start, b.start, a.len) == 0;
+}
+
+/* A call of fn by itself, named as its body would name it. */
+static int is_self_call(Node *fn, Slice prefix, Node *e) {
+  if (!e || e->kind != ND_CALL || e->as.call.len != fn->as.func.param_len)
+    return 0;
+  Node *callee = e->as.call.callee;
+  if (!prefix.len)
+    return callee->kind == ND_IDENT &&
+           slice_eq(callee->as.ident, fn->as.func.name);
+  return callee->kind == ND_FIELD &&
+         callee->as.field.object->kind == ND_IDENT &&
+         slice_eq(callee->as.field.object->as.ident, prefix) &&
+         slice_eq(callee->as.field.name, fn->as.func.name);
+}
+
+/* Whether some return outside a try statement is a self tail call. */
+static int has_self_tail_call(Node *fn, Slice prefix, Node *n) {
+  if (!n)
+    return 0;
+  switch (n->kind) {
+  case ND_RETURN:
+    return is_self_call(fn, prefix, n->as.ret.expr);
+  case ND_BLOCK:
+    for (size_t i = 0; i < n->as.block.len; i++) {
+      if (has_self_tail_call(fn, prefix, n->as.block.items[i]))
+        return 1;
+    }
+    return 0;
+  case ND_IF:
+    return has_self_tail_call(fn, prefix, n->as.if_stmt.then_br) ||
+           has_self_tail_call(fn, prefix, n->as.if_stmt.else_br);
+  case ND_WHILE:
+    return has_self_tail_call(fn, prefix, n->as.while_stmt.body);
+  case ND_DO_WHILE:
+    return has_self_tail_call(fn, prefix, n->as.do_while_stmt.body);
+  case ND_FOR:
+    return has_self_tail_call(fn, prefix, n->as.for_stmt.body);
+  case ND_SWITCH:
+    for (size_t i = 0; i < n->as.switch_stmt.len; i++) {
+      if (has_self_tail_call(fn, prefix, n->as.switch_stmt.cases[i].body))
+        return 1;
+    }
+    return 0;
+  default:
+    return 0;
+  }
+}
+
+/*
+ * Emits `return f(args)` where f calls itself: the arguments are evaluated
+ * into temporaries, assigned to the parameters, and control jumps back to
+ * the top of the body, so deep recursion runs in constant stack space.
+ */
+static void emit_self_tail_call(CGCtx *ctx, COut *b, Node *call) {
+  Node *fn = ctx->func;
+  c_out_write(b, "{\n");
+  c_out_indent(b);
+  for (size_t i = 0; i < fn->as.func.param_len; i++) {
+    Node *p = fn->as.func.params[i];
+    c_out_write(b, "%s dr_tail_%zu = ", type_to_c(p->as.var_decl.type), i);
+    cg_emit_expr(ctx, b, call->as.call.args[i]);
+    c_out_write(b, ";\n");
+  }
+  for (size_t i = 0; i < fn->as.func.param_len; i++) {
+    Node *p = fn->as.func.params[i];
+    c_out_write(b, "%.*s = dr_tail_%zu;\n", (int)p->as.var_decl.name.len,
+                p->as.var_decl.name.start, i);
+  }
+  c_out_write(b, "goto dr_tail_entry;\n");
+  c_out_dedent(b);
+  c_out_write(b, "}");
+}
+
+/*
+ * A call to another function on the same call cycle that can be forced
+ * into a tail call: C requires matching signatures for musttail.
+ */
+static int is_cycle_tail_call(CGCtx *ctx, Node *e) {
+  if (!ctx->func || ctx->func_prefix.len || ctx->try_depth ||
+      ctx->ret_type == TK_KW_VOID || !e || e->kind != ND_CALL ||
+      e->as.call.callee->kind != ND_IDENT)
+    return 0;
+  Node *callee = cg_reach_function(e->as.call.callee->as.ident);
+  Node *fn = ctx->func;
+  if (!callee || callee == fn || callee->as.func.is_async ||
+      !cg_reach_same_cycle(fn, callee) ||
+      strcmp(type_to_c(callee->as.func.ret_type), type_to_c(fn->as.func.ret_type)) ||
+      callee->as.func.param_len != fn->as.func.param_len ||
+      e->as.call.len != fn->as.func.param_len)
+    return 0;
+  for (size_t i = 0; i < fn->as.func.param_len; i++) {
+    if (strcmp(type_to_c(callee->as.func.params[i]->as.var_decl.type),
+               type_to_c(fn->as.func.params[i]->as.var_decl.type)))
+      return 0;
+  }
+  return 1;
+}
+
+/* A parameter in a signature; hinted allows restrict where it is safe. */
+static void emit_param(COut *b, Node *p, int hinted) {
+  emit_type(b, p->as.var_decl.type, p->as.var_decl.type_name);
+  c_out_write(b, " %s%.*s", hinted && cg_hint_restrict_param(p) ? "restrict " : "",
+              (int)p->as.var_decl.name.len, p->as.var_decl.name.start);
+}
+
 static void emit_func_impl(COut *b, Slice prefix, Node *n,
                            const char *src_file) {
   if (n->pos.line)
@@ -254,140 +444,94 @@ static void emit_func_impl(COut *b, Slice prefix, Node *n,
     c_out_write(b, " (async)");
   }
   c_out_write(b, " at line %zu */\n", n->pos.line);
-  
-  // For async functions, we need to emit a wrapper that returns Task* and a worker function
   if (n->as.func.is_async) {
-    // If function has parameters, emit a parameter struct
-    if (n->as.func.param_len > 0) {
-      c_out_write(b, "typedef struct {\n");
-      c_out_indent(b);
-      for (size_t i = 0; i < n->as.func.param_len; i++) {
-        Node *p = n->as.func.params[i];
-        emit_type_with_pointer(b, p->as.var_decl.type, p->as.var_decl.type_name, p->as.var_decl.is_pointer);
-        c_out_write(b, " %.*s;\n", (int)p->as.var_decl.name.len, p->as.var_decl.name.start);
-      }
-      c_out_dedent(b);
-      c_out_write(b, "} %.*s_args;\n\n", (int)n->as.func.name.len, n->as.func.name.start);
-    }
-    
-    // Create a global task variable for this worker function
-    c_out_write(b, "static Task* %.*s_current_task = NULL;\n\n", 
-                (int)n->as.func.name.len, n->as.func.name.start);
-    
-    // Emit the worker function that contains the actual logic
-    c_out_write(b, "static void* %.*s_worker(void* arg) {\n", 
-                (int)n->as.func.name.len, n->as.func.name.start);
-    c_out_indent(b);
-    
-    // Extract parameters from arg if any
-    if (n->as.func.param_len > 0) {
-      c_out_write(b, "%.*s_args* params = (%.*s_args*)arg;\n",
-                  (int)n->as.func.name.len, n->as.func.name.start,
-                  (int)n->as.func.name.len, n->as.func.name.start);
-      for (size_t i = 0; i < n->as.func.param_len; i++) {
-        Node *p = n->as.func.params[i];
-        emit_type_with_pointer(b, p->as.var_decl.type, p->as.var_decl.type_name, p->as.var_decl.is_pointer);
-        c_out_write(b, " %.*s = params->%.*s;\n", 
-                    (int)p->as.var_decl.name.len, p->as.var_decl.name.start,
-                    (int)p->as.var_decl.name.len, p->as.var_decl.name.start);
-      }
-    }
-    
-    // Create a context to track return value handling
-    CGCtx ctx = {0};
-    ctx.ret_type = n->as.func.ret_type;
-    ctx.is_async_worker = 1;
-    ctx.async_func_name = n->as.func.name;
-    cgctx_scope_enter(&ctx);
-    
-    // Handle the function body with return value interception
-    cg_emit_stmt(&ctx, b, n->as.func.body, src_file);
-    
-    cgctx_scope_leave(&ctx);
-    free(ctx.vars);
-    
-    c_out_write(b, "return NULL;\n");
-    c_out_dedent(b);
-    c_out_write(b, "}\n\n");
-    
-    // Now emit the wrapper function that creates and returns a Task
-    if (prefix.len)
-      c_out_write(b, "static Task* %.*s_%.*s(", 
-                  (int)prefix.len, prefix.start, (int)n->as.func.name.len,
-                  n->as.func.name.start);
-    else
-      c_out_write(b, "static Task* %.*s(", 
-                  (int)n->as.func.name.len, n->as.func.name.start);
-  } else {
-    // Regular synchronous function
-    if (prefix.len)
-      c_out_write(b, "static %s %.*s_%.*s(", type_to_c(n->as.func.ret_type),
-                  (int)prefix.len, prefix.start, (int)n->as.func.name.len,
-                  n->as.func.name.start);
-    else if (n->as.func.name.len == 4 &&
-             strncmp(n->as.func.name.start, "main", 4) == 0)
-      c_out_write(b, "%s %.*s(", type_to_c(n->as.func.ret_type),
-                  (int)n->as.func.name.len, n->as.func.name.start);
-    else
-      c_out_write(b, "static %s %.*s(", type_to_c(n->as.func.ret_type),
-                  (int)n->as.func.name.len, n->as.func.name.start);
+    cg_coro_emit(b, prefix, n, src_file);
+    c_out_newline(b);
+    return;
+  }
+  int memo = cg_memo_enabled(prefix, n);
+  CGCtx ctx = {0};
+  cg_prof_func_begin(&ctx, prefix, n->as.func.name);
+
+  // A memoized body sits behind its cache
+  const char *suffix = "";
+  if (memo) {
+    cg_memo_emit_prototype(b, prefix, n);
+    suffix = "_compute";
   }
+  if (!cg_prof_emit_func_attr(&ctx, b) && cg_hint_cold(n))
+    c_out_write(b, "DR_COLD ");
+  const char *storage = cg_hint_inline(n) ? "static inline" : "static";
+  if (prefix.len)
+    c_out_write(b, "%s %s %.*s_%.*s%s(", storage,
+                type_to_c(n->as.func.ret_type), (int)prefix.len, prefix.start,
+                (int)n->as.func.name.len, n->as.func.name.start, suffix);
+  else if (n->as.func.name.len == 4 &&
+           strncmp(n->as.func.name.start, "main", 4) == 0)
+    c_out_write(b, "%s %.*s(", type_to_c(n->as.func.ret_type),
+                (int)n->as.func.name.len, n->as.func.name.start);
+  else
+    c_out_write(b, "%s %s %.*s%s(", storage, type_to_c(n->as.func.ret_type),
+                (int)n->as.func.name.len, n->as.func.name.start, suffix);
   for (size_t i = 0; i < n->as.func.param_len; i++) {
-    Node *p = n->as.func.params[i];
     if (i)
       c_out_write(b, ", ");
-    c_out_write(b, "%s %.*s", type_to_c(p->as.var_decl.type),
-                (int)p->as.var_decl.name.len, p->as.var_decl.name.start);
+    emit_param(b, n->as.func.params[i], 1);
   }
   c_out_write(b, ") ");
-  
-  if (n->as.func.is_async) {
-    // For async functions, create task and return it
+
+  ctx.ret_type = n->as.func.ret_type;
+  ctx.func = n;
+  ctx.func_prefix = prefix;
+  cgctx_scope_enter(&ctx);
+  for (size_t i = 0; i < n->as.func.param_len; i++) {
+    Node *p = n->as.func.params[i];
+    cgctx_push(&ctx, p->as.var_decl.name.start, p->as.var_decl.name.len,
+               p->as.var_decl.type,
+               p->as.var_decl.type == TK_IDENT ? p->as.var_decl.type_name
+                                               : (Slice){NULL, 0});
+  }
+  // Self tail calls jump back here instead of growing the stack, unless
+  // they have to go through the cache
+  int tail_loop = cg_options.opt_level >= 1 && !memo &&
+                  has_self_tail_call(n, prefix, n->as.func.body);
+  int counted = cg_prof_emit_entry(&ctx, b);
+  if (tail_loop) {
+    ctx.tail_loop = 1;
     c_out_write(b, "{\n");
     c_out_indent(b);
-    
-    c_out_write(b, "Task* task;\n");
-    if (n->as.func.param_len > 0) {
-      c_out_write(b, "%.*s_args* args = dr_alloc(sizeof(%.*s_args));\n",
-                  (int)n->as.func.name.len, n->as.func.name.start,
-                  (int)n->as.func.name.len, n->as.func.name.start);
-      for (size_t i = 0; i < n->as.func.param_len; i++) {
-        Node *p = n->as.func.params[i];
-        c_out_write(b, "args->%.*s = %.*s;\n",
-                    (int)p->as.var_decl.name.len, p->as.var_decl.name.start,
-                    (int)p->as.var_decl.name.len, p->as.var_decl.name.start);
-      }
-      c_out_write(b, "task = dr_task_create(%.*s_worker, args);\n", 
-                  (int)n->as.func.name.len, n->as.func.name.start);
-    } else {
-      c_out_write(b, "task = dr_task_create(%.*s_worker, NULL);\n", 
-                  (int)n->as.func.name.len, n->as.func.name.start);
-    }
-    c_out_write(b, "%.*s_current_task = task;\n", 
-                (int)n->as.func.name.len, n->as.func.name.start);
-    c_out_write(b, "return task;\n");
-    
+    c_out_write(b, "dr_tail_entry:;\n");
+  }
+  cg_emit_stmt(&ctx, b, n->as.func.body, src_file);
+  if (tail_loop) {
     c_out_dedent(b);
     c_out_write(b, "}\n");
-  } else {
-    // Regular function - emit the function body
-    CGCtx ctx = {0};
-    ctx.ret_type = n->as.func.ret_type;
-    cgctx_scope_enter(&ctx);
-    for (size_t i = 0; i < n->as.func.param_len; i++) {
-      Node *p = n->as.func.params[i];
-      cgctx_push(&ctx, p->as.var_decl.name.start, p->as.var_decl.name.len,
-                 p->as.var_decl.type,
-                 p->as.var_decl.type == TK_IDENT ? p->as.var_decl.type_name
-                                                 : (Slice){NULL, 0});
-    }
-    cg_emit_stmt(&ctx, b, n->as.func.body, src_file);
-    cgctx_scope_leave(&ctx);
-    free(ctx.vars);
   }
+  cg_prof_emit_exit(b, counted);
+  cgctx_scope_leave(&ctx);
+  cgctx_free(&ctx);
+  if (memo)
+    cg_memo_emit_wrapper(b, prefix, n);
   c_out_newline(b);
 }
 
+void emit_func_prototype(COut *b, Node *n) {
+  int is_main = n->as.func.name.len == 4 &&
+                strncmp(n->as.func.name.start, "main", 4) == 0;
+  c_out_write(b, "%s%s %.*s(", is_main ? "" : "static ",
+              type_to_c(n->as.func.ret_type), (int)n->as.func.name.len,
+              n->as.func.name.start);
+  for (size_t i = 0; i < n->as.func.param_len; i++) {
+    Node *p = n->as.func.params[i];
+    if (i)
+      c_out_write(b, ", ");
+    emit_type(b, p->as.var_decl.type, p->as.var_decl.type_name);
+    c_out_write(b, " %.*s", (int)p->as.var_decl.name.len,
+                p->as.var_decl.name.start);
+  }
+  c_out_write(b, ");\n");
+}
+
 void emit_func(COut *b, Node *n, const char *src_file) {
   emit_func_impl(b, (Slice){NULL, 0}, n, src_file);
 }
@@ -406,17 +550,21 @@ void emit_method(COut *b, Slice class_name, Node *n, const char *src_file) {
     c_out_write(b, " (async)");
   }
   c_out_write(b, " at line %zu */\n", n->pos.line);
-  c_out_write(b, "static %s %.*s_%.*s(struct %.*s *this",
+  CGCtx ctx = {0};
+  cg_prof_func_begin(&ctx, class_name, n->as.func.name);
+  if (!cg_prof_emit_func_attr(&ctx, b) && cg_hint_cold(n))
+    c_out_write(b, "DR_COLD ");
+  c_out_write(b, "%s %s %.*s_%.*s(struct %.*s *%sthis",
+              cg_hint_inline(n) ? "static inline" : "static",
               type_to_c(n->as.func.ret_type), (int)class_name.len,
               class_name.start, (int)n->as.func.name.len, n->as.func.name.start,
-              (int)class_name.len, class_name.start);
+              (int)class_name.len, class_name.start,
+              cg_hint_restrict_this(n) ? "restrict " : "");
   for (size_t i = 0; i < n->as.func.param_len; i++) {
-    Node *p = n->as.func.params[i];
-    c_out_write(b, ", %s %.*s", type_to_c(p->as.var_decl.type),
-                (int)p->as.var_decl.name.len, p->as.var_decl.name.start);
+    c_out_write(b, ", ");
+    emit_param(b, n->as.func.params[i], 1);
   }
   c_out_write(b, ") ");
-  CGCtx ctx = {0};
   ctx.ret_type = n->as.func.ret_type;
   cgctx_scope_enter(&ctx);
   cgctx_push(&ctx, "this", 4, TK_IDENT, class_name);
@@ -427,12 +575,107 @@ void emit_method(COut *b, Slice class_name, Node *n, const char *src_file) {
                p->as.var_decl.type == TK_IDENT ? p->as.var_decl.type_name
                                                : (Slice){NULL, 0});
   }
+  int counted = cg_prof_emit_entry(&ctx, b);
   cg_emit_stmt(&ctx, b, n->as.func.body, src_file);
+  cg_prof_emit_exit(b, counted);
   cgctx_scope_leave(&ctx);
-  free(ctx.vars);
+  cgctx_free(&ctx);
   c_out_newline(b);
 }
 
+/* Nonzero if a local of this declaration holds a reference of its own. */
+static int is_ref_decl(Node *n) {
+  if (n->as.var_decl.array_len > 0 || n->as.var_decl.is_pointer)
+    return 0;
+  return n->as.var_decl.type == TK_KW_STRING ||
+         (n->as.var_decl.type == TK_IDENT &&
+          cg_is_class_type(n->as.var_decl.type_name));
+}
+
+/* Emits a loop or branch condition as a full expression of its own. */
+static void emit_cond(CGCtx *ctx, COut *b, Node *stmt, Node *cond) {
+  CGOwn own;
+  COut *e = cg_own_begin(ctx, &own, b);
+  cg_prof_emit_cond(ctx, e, stmt, cond, cg_hint_branch(stmt));
+  cg_own_end(ctx, &own, CG_OWN_VALUE);
+}
+
+/* Emits items[i] with the rest of its block in view (see owner.h). */
+static void emit_item(CGCtx *ctx, COut *b, Node **items, size_t len, size_t i,
+                      const char *src_file) {
+  Node *stmt = ctx->own_stmt;
+  Node **rest = ctx->own_rest;
+  size_t rest_len = ctx->own_rest_len;
+  ctx->own_stmt = items[i];
+  ctx->own_rest = items + i + 1;
+  ctx->own_rest_len = len - i - 1;
+  cg_emit_stmt(ctx, b, items[i], src_file);
+  ctx->own_stmt = stmt;
+  ctx->own_rest = rest;
+  ctx->own_rest_len = rest_len;
+}
+
+/*
+ * An array declared without initializer and filled by the loop right after
+ * it becomes an initialized table when the loop can run at compile time.
+ */
+size_t cg_emit_block_item(CGCtx *ctx, COut *b, Node **items, size_t len,
+                          size_t i, const char *src_file) {
+  Node *n = items[i];
+  const CValue *table =
+      n->kind == ND_VAR_DECL && i + 1 < len
+          ? cg_eval_table(ctx, n, items[i + 1])
+          : NULL;
+  /* A stack slot would not survive a coroutine's suspension points. */
+  if (!table && !ctx->coro && cg_escape_local(ctx, items, len, i)) {
+    Node *saved = ctx->stack_new;
+    int saved_slot = ctx->stack_slot;
+    ctx->stack_new = n->as.var_decl.init;
+    ctx->stack_slot = cg_own_emit_slot(b, n->as.var_decl.type_name);
+    emit_item(ctx, b, items, len, i, src_file);
+    ctx->stack_new = saved;
+    ctx->stack_slot = saved_slot;
+    return 1;
+  }
+  if (!table) {
+    emit_item(ctx, b, items, len, i, src_file);
+    return 1;
+  }
+  emit_debug_line(b, n, src_file, "lookup table");
+  emit_type(b, n->as.var_decl.type, n->as.var_decl.type_name);
+  c_out_write(b, " %.*s[%zu] = {", (int)n->as.var_decl.name.len,
+              n->as.var_decl.name.start, n->as.var_decl.array_len);
+  c_out_indent(b);
+  for (size_t k = 0; k < n->as.var_decl.array_len; k++) {
+    if (k % 8 == 0)
+      c_out_newline(b);
+    cg_eval_emit(b, &table[k]);
+    c_out_write(b, k + 1 < n->as.var_decl.array_len ? ", " : "");
+  }
+  c_out_dedent(b);
+  c_out_newline(b);
+  c_out_write(b, "};");
+  c_out_newline(b);
+  cgctx_push(ctx, n->as.var_decl.name.start, n->as.var_decl.name.len,
+             n->as.var_decl.type, (Slice){NULL, 0});
+  cgctx_set_array_len(ctx, n->as.var_decl.array_len);
+  return 2;
+}
+
+/* The class of a class local; for a Task local started by an async call
+ * or a combinator, the name of the async function or combinator. */
+static Slice decl_type_name(Node *n) {
+  if (n->as.var_decl.type == TK_IDENT)
+    return n->as.var_decl.type_name;
+  Node *init = n->as.var_decl.init;
+  if (n->as.var_decl.type != TK_KW_TASK || !init)
+    return (Slice){NULL, 0};
+  if (cg_async_callee(init))
+    return (Slice){init->as.call.callee->as.ident.start,
+                   init->as.call.callee->as.ident.len};
+  return cg_task_builtin(init);
+}
+
 void cg_emit_stmt(CGCtx *ctx, COut *b, Node *n, const char *src_file) {
   // Emit debug line directive for this statement
   switch (n->kind) {
@@ -484,11 +727,22 @@ void cg_emit_stmt(CGCtx *ctx, COut *b, Node *n, const char *src_file) {
     }
     break;
   }
-  
+  // Call sites are numbered per line for the profiler
+  if (n->pos.line && n->pos.line != ctx->site_line) {
+    ctx->site_line = n->pos.line;
+    ctx->site_ordinal = 0;
+  }
+
+  int coro_block = cg_coro_stmt_begin(ctx, b, n);
+  size_t bc_mark = cg_bounds_stmt_begin(ctx, n);
   switch (n->kind) {
-  case ND_VAR_DECL:
+  case ND_VAR_DECL: {
+    const CValue *value = NULL;
+    int borrowed = is_ref_decl(n) && cg_own_borrows(ctx, n);
+    /* A coroutine restores its locals after a suspension point. */
+    int is_const = n->as.var_decl.is_const && !ctx->coro;
     if (n->as.var_decl.array_len > 0) {
-      if (n->as.var_decl.is_const) {
+      if (is_const) {
         c_out_write(b, "const ");
       }
       emit_type_with_pointer(b, n->as.var_decl.type, n->as.var_decl.type_name, n->as.var_decl.is_pointer);
@@ -500,51 +754,102 @@ void cg_emit_stmt(CGCtx *ctx, COut *b, Node *n, const char *src_file) {
       }
     } else {
       if (n->as.var_decl.is_const) {
-        c_out_write(b, "const ");
+        if (is_const)
+          c_out_write(b, "const ");
+        if (n->as.var_decl.init && !n->as.var_decl.is_pointer)
+          value = cg_eval_expr(ctx, n->as.var_decl.init, n->as.var_decl.type);
       }
       emit_type_with_pointer(b, n->as.var_decl.type, n->as.var_decl.type_name, n->as.var_decl.is_pointer);
       c_out_write(b, " %.*s", (int)n->as.var_decl.name.len,
                   n->as.var_decl.name.start);
-      if (n->as.var_decl.init) {
+      if (value) {
         c_out_write(b, " = ");
-        cg_emit_expr(ctx, b, n->as.var_decl.init);
+        cg_eval_emit(b, value);
+      } else if (n->as.var_decl.init) {
+        c_out_write(b, " = ");
+        CGOwn own;
+        COut *e = cg_own_begin(ctx, &own, b);
+        if (is_ref_decl(n) && !borrowed)
+          cg_own_emit_stored(ctx, e, n->as.var_decl.init, 0);
+        else
+          cg_emit_expr(ctx, e, n->as.var_decl.init);
+        cg_own_end(ctx, &own, CG_OWN_VALUE);
+      } else if (is_ref_decl(n)) {
+        c_out_write(b, " = NULL");
       }
     }
     cgctx_push(ctx, n->as.var_decl.name.start, n->as.var_decl.name.len,
-               n->as.var_decl.type,
-               n->as.var_decl.type == TK_IDENT ? n->as.var_decl.type_name
-                                               : (Slice){NULL, 0});
+               n->as.var_decl.type, decl_type_name(n));
+    cgctx_set_array_len(ctx, n->as.var_decl.array_len);
+    cgctx_set_value(ctx, value);
+    if (is_ref_decl(n) && !borrowed &&
+        !(ctx->stack_new && n->as.var_decl.init == ctx->stack_new))
+      cgctx_set_owned(ctx);
     c_out_write(b, ";");
     c_out_newline(b);
     break;
+  }
   case ND_FUNC:
     emit_func(b, n, src_file);
     break;
-  case ND_IF:
+  case ND_IF: {
     c_out_write(b, "if (");
-    cg_emit_expr(ctx, b, n->as.if_stmt.cond);
+    emit_cond(ctx, b, n, n->as.if_stmt.cond);
     c_out_write(b, ") ");
+    cg_bounds_note_expr(ctx, n->as.if_stmt.cond);
+    size_t branch_mark = cg_bounds_mark(ctx);
+    if (cg_prof_invert_if(ctx, n)) {
+      // The profile found the else branch hot: it goes first, and the
+      // condition above was negated to match
+      cg_bounds_assume(ctx, n->as.if_stmt.cond, 0);
+      cg_emit_stmt(ctx, b, n->as.if_stmt.else_br, src_file);
+      cg_bounds_restore(ctx, branch_mark);
+      c_out_write(b, " else ");
+      cg_bounds_assume(ctx, n->as.if_stmt.cond, 1);
+      cg_emit_stmt(ctx, b, n->as.if_stmt.then_br, src_file);
+      cg_bounds_restore(ctx, branch_mark);
+      break;
+    }
+    cg_bounds_assume(ctx, n->as.if_stmt.cond, 1);
     cg_emit_stmt(ctx, b, n->as.if_stmt.then_br, src_file);
+    cg_bounds_restore(ctx, branch_mark);
     if (n->as.if_stmt.else_br) {
       c_out_write(b, " else ");
+      cg_bounds_assume(ctx, n->as.if_stmt.cond, 0);
       cg_emit_stmt(ctx, b, n->as.if_stmt.else_br, src_file);
+      cg_bounds_restore(ctx, branch_mark);
     }
     break;
-  case ND_WHILE:
+  }
+  case ND_WHILE: {
+    CGBoundsLoop loop = cg_bounds_loop_begin(ctx, b, n);
+    cg_prof_emit_loop_hint(ctx, b, n);
     c_out_write(b, "while (");
-    cg_emit_expr(ctx, b, n->as.while_stmt.cond);
+    emit_cond(ctx, b, n, n->as.while_stmt.cond);
     c_out_write(b, ") ");
+    size_t body_mark = cg_bounds_loop_body(ctx, n, &loop);
     cg_emit_stmt(ctx, b, n->as.while_stmt.body, src_file);
+    cg_bounds_restore(ctx, body_mark);
+    cg_bounds_loop_end(ctx, b, &loop);
     break;
-  case ND_DO_WHILE:
+  }
+  case ND_DO_WHILE: {
+    CGBoundsLoop loop = cg_bounds_loop_begin(ctx, b, n);
+    size_t body_mark = cg_bounds_loop_body(ctx, n, &loop);
+    cg_prof_emit_loop_hint(ctx, b, n);
     c_out_write(b, "do ");
     cg_emit_stmt(ctx, b, n->as.do_while_stmt.body, src_file);
+    cg_bounds_restore(ctx, body_mark);
     c_out_write(b, " while (");
-    cg_emit_expr(ctx, b, n->as.do_while_stmt.cond);
+    emit_cond(ctx, b, n, n->as.do_while_stmt.cond);
     c_out_write(b, ");");
     c_out_newline(b);
+    cg_bounds_loop_end(ctx, b, &loop);
     break;
-  case ND_FOR:
+  }
+  case ND_FOR: {
+    CGBoundsLoop loop = cg_bounds_loop_begin(ctx, b, n);
+    cg_prof_emit_loop_hint(ctx, b, n);
     c_out_write(b, "for (");
     if (n->as.for_stmt.init) {
       if (n->as.for_stmt.init->kind == ND_VAR_DECL) {
@@ -569,47 +874,47 @@ void cg_emit_stmt(CGCtx *ctx, COut *b, Node *n, const char *src_file) {
                       vd->as.var_decl.name.start);
           if (vd->as.var_decl.init) {
             c_out_write(b, " = ");
-            cg_emit_expr(ctx, b, vd->as.var_decl.init);
+            if (is_ref_decl(vd))
+              cg_own_emit_stored(ctx, b, vd->as.var_decl.init, 0);
+            else
+              cg_emit_expr(ctx, b, vd->as.var_decl.init);
+          } else if (is_ref_decl(vd)) {
+            c_out_write(b, " = NULL");
           }
         }
         cgctx_push(ctx, vd->as.var_decl.name.start, vd->as.var_decl.name.len,
                    vd->as.var_decl.type,
                    vd->as.var_decl.type == TK_IDENT ? vd->as.var_decl.type_name
                                                     : (Slice){NULL, 0});
+        cgctx_set_array_len(ctx, vd->as.var_decl.array_len);
+        if (is_ref_decl(vd))
+          cgctx_set_owned(ctx);
       } else {
-        cg_emit_expr(ctx, b, n->as.for_stmt.init);
+        CGOwn own;
+        COut *e = cg_own_begin(ctx, &own, b);
+        cg_emit_expr(ctx, e, n->as.for_stmt.init);
+        cg_own_end(ctx, &own, CG_OWN_VOID);
       }
     }
     c_out_write(b, "; ");
     if (n->as.for_stmt.cond)
-      cg_emit_expr(ctx, b, n->as.for_stmt.cond);
+      emit_cond(ctx, b, n, n->as.for_stmt.cond);
     c_out_write(b, "; ");
-    if (n->as.for_stmt.update)
-      cg_emit_expr(ctx, b, n->as.for_stmt.update);
+    if (n->as.for_stmt.update) {
+      CGOwn own;
+      COut *e = cg_own_begin(ctx, &own, b);
+      cg_emit_expr(ctx, e, n->as.for_stmt.update);
+      cg_own_end(ctx, &own, CG_OWN_VOID);
+    }
     c_out_write(b, ") ");
+    size_t body_mark = cg_bounds_loop_body(ctx, n, &loop);
     cg_emit_stmt(ctx, b, n->as.for_stmt.body, src_file);
+    cg_bounds_restore(ctx, body_mark);
+    cg_bounds_loop_end(ctx, b, &loop);
     break;
+  }
   case ND_SWITCH:
-    c_out_write(b, "switch (");
-    cg_emit_expr(ctx, b, n->as.switch_stmt.expr);
-    c_out_write(b, ") {");
-    c_out_newline(b);
-    c_out_indent(b);
-    for (size_t i = 0; i < n->as.switch_stmt.len; i++) {
-      SwitchCase *sc = &n->as.switch_stmt.cases[i];
-      if (sc->is_default) {
-        c_out_write(b, "default:");
-      } else {
-        c_out_write(b, "case ");
-        cg_emit_expr(ctx, b, sc->value);
-        c_out_write(b, ":");
-      }
-      c_out_newline(b);
-      cg_emit_stmt(ctx, b, sc->body, src_file);
-    }
-    c_out_dedent(b);
-    c_out_write(b, "}");
-    c_out_newline(b);
+    cg_switch_emit(ctx, b, n, src_file);
     break;
   case ND_BREAK:
     c_out_write(b, "break;");
@@ -621,41 +926,58 @@ void cg_emit_stmt(CGCtx *ctx, COut *b, Node *n, const char *src_file) {
     break;
   case ND_RETURN:
     if (ctx->is_async_worker) {
-      // In async worker, set task result instead of returning directly
+      // A coroutine sets its task's result and reports that it finished
       if (n->as.ret.expr) {
         switch (ctx->ret_type) {
           case TK_KW_INT:
           case TK_KW_BOOL:
-            c_out_write(b, "dr_task_set_int_result(%.*s_current_task, ", 
-                        (int)ctx->async_func_name.len, ctx->async_func_name.start);
+            c_out_write(b, "dr_task_set_int_result(dr_task, ");
             cg_emit_expr(ctx, b, n->as.ret.expr);
             c_out_write(b, ");");
             break;
           case TK_KW_FLOAT:
-            c_out_write(b, "dr_task_set_float_result(%.*s_current_task, ", 
-                        (int)ctx->async_func_name.len, ctx->async_func_name.start);
+            c_out_write(b, "dr_task_set_float_result(dr_task, ");
             cg_emit_expr(ctx, b, n->as.ret.expr);
             c_out_write(b, ");");
             break;
           case TK_KW_STRING:
-            c_out_write(b, "dr_task_set_string_result(%.*s_current_task, ", 
-                        (int)ctx->async_func_name.len, ctx->async_func_name.start);
+            c_out_write(b, "dr_task_set_string_result(dr_task, ");
             cg_emit_expr(ctx, b, n->as.ret.expr);
             c_out_write(b, ");");
             break;
           default:
-            c_out_write(b, "dr_task_set_ptr_result(%.*s_current_task, ", 
-                        (int)ctx->async_func_name.len, ctx->async_func_name.start);
+            c_out_write(b, "dr_task_set_ptr_result(dr_task, ");
             cg_emit_expr(ctx, b, n->as.ret.expr);
             c_out_write(b, ");");
             break;
         }
       }
-      c_out_write(b, "\nreturn NULL;");
+      c_out_write(b, "\nreturn 0;");
+    } else if (ctx->tail_loop && !ctx->try_depth &&
+               is_self_call(ctx->func, ctx->func_prefix, n->as.ret.expr)) {
+      emit_self_tail_call(ctx, b, n->as.ret.expr);
     } else {
       // Regular function return
+      // A counted call is no longer a plain call musttail accepts
+      if (cg_options.opt_level >= 1 && !cg_options.profile_generate &&
+          !ctx->region_depth && is_cycle_tail_call(ctx, n->as.ret.expr))
+        c_out_write(b, "DR_MUSTTAIL ");
       c_out_write(b, "return");
-      if (n->as.ret.expr) {
+      if (n->as.ret.expr && ctx->func) {
+        /* Functions hand a string result over to the caller. */
+        c_out_write(b, " ");
+        CGOwn own;
+        COut *e = cg_own_begin(ctx, &own, b);
+        if (ctx->ret_type == TK_KW_STRING) {
+          int promoted =
+              cg_own_promote_begin(ctx, e, NULL, n->as.ret.expr, TK_KW_STRING);
+          cg_own_emit_stored(ctx, e, n->as.ret.expr, 1);
+          if (promoted)
+            c_out_write(e, ")");
+        } else
+          cg_emit_expr(ctx, e, n->as.ret.expr);
+        cg_own_end(ctx, &own, CG_OWN_VALUE);
+      } else if (n->as.ret.expr) {
         c_out_write(b, " ");
         cg_emit_expr(ctx, b, n->as.ret.expr);
       } else if (ctx->ret_type != TK_KW_VOID) {
@@ -681,20 +1003,36 @@ void cg_emit_stmt(CGCtx *ctx, COut *b, Node *n, const char *src_file) {
       c_out_write(b, "dream_exception_throw(DREAM_EXC_GENERIC, \"An exception occurred\", __FILE__, __LINE__);\n");
     }
     break;
+  case ND_REGION: {
+    /* The cleanup closes the region however the block is left. */
+    c_out_write(b, "{");
+    c_out_newline(b);
+    c_out_indent(b);
+    c_out_write(b, "int dr_region __attribute__((cleanup(dr_region_exit))) = "
+                   "dr_region_begin();");
+    c_out_newline(b);
+    int saved = ctx->region_depth;
+    ctx->region_depth = ctx->depth + 1;
+    cg_emit_stmt(ctx, b, n->as.region.body, src_file);
+    ctx->region_depth = saved;
+    c_out_dedent(b);
+    c_out_write(b, "}");
+    c_out_newline(b);
+    break;
+  }
   case ND_BLOCK: {
     c_out_write(b, "{");
     c_out_newline(b);
     c_out_indent(b);
     size_t block_start = ctx->len;
     cgctx_scope_enter(ctx);
-    for (size_t i = 0; i < n->as.block.len; i++)
-      cg_emit_stmt(ctx, b, n->as.block.items[i], src_file);
+    for (size_t i = 0; i < n->as.block.len;)
+      i += cg_emit_block_item(ctx, b, n->as.block.items, n->as.block.len, i,
+                              src_file);
     for (size_t i = ctx->len; i-- > block_start;) {
       VarBinding *v = &ctx->vars[i];
-      if (v->type == TK_KW_STRING ||
-          (v->type == TK_IDENT && cg_is_class_type(v->type_name))) {
-        c_out_write(b, "dr_release(%.*s);\n", (int)v->len, v->start);
-      }
+      if (v->owned)
+        c_out_write(b, "dr_release((void *)%.*s);\n", (int)v->len, v->start);
     }
     cgctx_scope_leave(ctx);
     c_out_dedent(b);
@@ -702,11 +1040,14 @@ void cg_emit_stmt(CGCtx *ctx, COut *b, Node *n, const char *src_file) {
     c_out_newline(b);
     break;
   }
-  case ND_EXPR_STMT:
+  case ND_EXPR_STMT: {
+    CGOwn own;
+    COut *out = b;
+    b = cg_own_begin(ctx, &own, out);
     if (n->as.expr_stmt.expr->kind == ND_CONSOLE_CALL) {
       Node *call = n->as.expr_stmt.expr;
       if (call->as.console.read) {
-        c_out_write(b, "dream_readline();");
+        c_out_write(b, "dr_release(dream_readline());");
         c_out_newline(b);
       } else if (cg_is_string_expr(ctx, call->as.console.arg)) {
         c_out_write(b, call->as.console.newline ? "dr_console_writeln("
@@ -729,7 +1070,10 @@ void cg_emit_stmt(CGCtx *ctx, COut *b, Node *n, const char *src_file) {
       c_out_write(b, ";");
       c_out_newline(b);
     }
+    b = out;
+    cg_own_end(ctx, &own, CG_OWN_STMT);
     break;
+  }
   case ND_CONSOLE_CALL:
     if (n->as.console.read) {
       c_out_write(b, "dream_readline()");
@@ -761,6 +1105,7 @@ void cg_emit_stmt(CGCtx *ctx, COut *b, Node *n, const char *src_file) {
     c_out_indent(b);
     
     // Try block
+    ctx->try_depth++;
     cg_emit_stmt(ctx, b, n->as.try_stmt.body, src_file);
     
     c_out_dedent(b);
@@ -806,6 +1151,7 @@ void cg_emit_stmt(CGCtx *ctx, COut *b, Node *n, const char *src_file) {
     
     // Pop exception context
     c_out_write(b, "dream_exception_pop();\n");
+    ctx->try_depth--;
     
     c_out_dedent(b);
     c_out_write(b, "}\n");
@@ -819,4 +1165,6 @@ void cg_emit_stmt(CGCtx *ctx, COut *b, Node *n, const char *src_file) {
   default:
     break;
   }
+  cg_bounds_stmt_end(ctx, n, bc_mark);
+  cg_coro_stmt_end(b, coro_block);
 }
@@ -11,21 +11,34 @@ extern "C" {
 #endif
 
 void cg_emit_stmt(CGCtx *ctx, COut *b, Node *n, const char *src_file);
+/* Emits items[i] of a block; returns how many items it covered. */
+size_t cg_emit_block_item(CGCtx *ctx, COut *b, Node **items, size_t len,
+                          size_t i, const char *src_file);
+/* Emits the C type of a local or parameter declaration. */
+void cg_emit_decl_type(COut *b, Node *decl);
 void emit_type_decl(COut *b, Node *n, const char *src_file);
 void emit_enum_decl(COut *b, Node *n, const char *src_file);
 void emit_func(COut *b, Node *n, const char *src_file);
+void emit_func_prototype(COut *b, Node *n);
 void emit_method(COut *b, Slice class_name, Node *n, const char *src_file);
 
 typedef struct {
   Slice name;
   int is_class;
   int has_init;
+  Node *decl;
 } CGTypeInfo;
 
 void cg_register_types(CGTypeInfo *types, size_t n);
 int cg_is_class_type(Slice name);
 int cg_is_known_type(Slice name);
 int cg_has_init(Slice name);
+/* The declared type of a field of a struct or class, its bases included; 0
+ * if there is no such field or it is an array. */
+TokenKind cg_field_type(Slice type, Slice field);
+/* Nonzero if instances of the class hold references in their fields, which
+ * its generated Name_drop releases. */
+int cg_class_drops(Slice name);
 
 #ifdef __cplusplus
 }
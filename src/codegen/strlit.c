@@ -0,0 +1,82 @@
+#include "strlit.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  char *text;
+  size_t len;
+  unsigned hash;
+} StrLit;
+
+static StrLit *lits;
+static size_t lit_len, lit_cap;
+/* Open-addressing index into lits, entries are 1-based. */
+static size_t *slots;
+static size_t slot_cap;
+
+static unsigned text_hash(const char *text, size_t len) {
+  unsigned h = 2166136261u;
+  for (size_t i = 0; i < len; i++)
+    h = (h ^ (unsigned char)text[i]) * 16777619u;
+  return h;
+}
+
+static void rehash(void) {
+  size_t cap = slot_cap ? slot_cap * 2 : 64;
+  size_t *fresh = calloc(cap, sizeof(size_t));
+  for (size_t i = 0; i < lit_len; i++) {
+    size_t k = lits[i].hash & (cap - 1);
+    while (fresh[k])
+      k = (k + 1) & (cap - 1);
+    fresh[k] = i + 1;
+  }
+  free(slots);
+  slots = fresh;
+  slot_cap = cap;
+}
+
+static size_t intern(const char *text, size_t len) {
+  if ((lit_len + 1) * 2 > slot_cap)
+    rehash();
+  unsigned h = text_hash(text, len);
+  size_t k = h & (slot_cap - 1);
+  for (; slots[k]; k = (k + 1) & (slot_cap - 1)) {
+    StrLit *l = &lits[slots[k] - 1];
+    if (l->hash == h && l->len == len && memcmp(l->text, text, len) == 0)
+      return slots[k] - 1;
+  }
+  if (lit_len == lit_cap) {
+    lit_cap = lit_cap ? lit_cap * 2 : 32;
+    lits = realloc(lits, lit_cap * sizeof(StrLit));
+  }
+  StrLit *l = &lits[lit_len];
+  l->text = malloc(len + 1);
+  memcpy(l->text, text, len);
+  l->text[len] = 0;
+  l->len = len;
+  l->hash = h;
+  slots[k] = ++lit_len;
+  return lit_len - 1;
+}
+
+void cg_strlit_emit(COut *b, const char *text, size_t len) {
+  c_out_write(b, "dr_lit_%zu.s", intern(text, len));
+}
+
+void cg_strlit_emit_table(COut *b) {
+  for (size_t i = 0; i < lit_len; i++)
+    c_out_write(b, "DR_STR_LITERAL(dr_lit_%zu, \"%.*s\");\n", i,
+                (int)lits[i].len, lits[i].text);
+  if (lit_len)
+    c_out_newline(b);
+}
+
+void cg_strlit_reset(void) {
+  for (size_t i = 0; i < lit_len; i++)
+    free(lits[i].text);
+  free(lits);
+  free(slots);
+  lits = NULL;
+  slots = NULL;
+  lit_len = lit_cap = slot_cap = 0;
+}
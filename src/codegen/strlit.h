@@ -0,0 +1,33 @@
+#ifndef CG_STRLIT_H
+#define CG_STRLIT_H
+
+#include "c_emit.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * String literals.
+ *
+ * Every distinct literal becomes one static DrString, defined ahead of the
+ * code by DR_STR_LITERAL, so literals carry the length header other strings
+ * have, share storage and survive retain and release. Uses are emitted
+ * while the code is generated; the definitions are collected on the way and
+ * written out at the end.
+ */
+
+/* Emits a use of the literal whose C-escaped body (no quotes) is text. */
+void cg_strlit_emit(COut *b, const char *text, size_t len);
+
+/* Defines every literal used so far. */
+void cg_strlit_emit_table(COut *b);
+
+/* Forgets the literals. */
+void cg_strlit_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CG_STRLIT_H
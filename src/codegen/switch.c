@@ -0,0 +1,327 @@
+#include "switch.h"
+#include "bounds.h"
+#include "codegen.h"
+#include "consteval.h"
+#include "expr.h"
+#include "stmt.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Sparse integer switches with at least this many cases use binary search. */
+#define SWITCH_BSEARCH_MIN 5
+/* Values spanning at most this many slots per case count as dense. */
+#define SWITCH_DENSE_FACTOR 3
+/* Cases left when the binary search turns into a compare chain. */
+#define SWITCH_LINEAR_MAX 3
+
+/* Perfect hash search: table sizes up to this multiple, and seeds tried. */
+#define SWITCH_HASH_GROWTH 8
+#define SWITCH_HASH_SEEDS 4096
+
+#define FNV_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+static int switch_counter;
+
+typedef struct {
+  long long value;
+  size_t index; /* position of the case in the switch */
+} IntCase;
+
+typedef struct {
+  char *bytes;
+  size_t len;
+  size_t index;
+  unsigned slot;
+} StrCase;
+
+static unsigned fnv(unsigned basis, const char *s, size_t len) {
+  unsigned h = basis;
+  for (size_t i = 0; i < len; i++)
+    h = (h ^ (unsigned char)s[i]) * FNV_PRIME;
+  return h;
+}
+
+/*
+ * Looks for a seed and a power-of-two table size under which the case
+ * strings land in distinct slots.
+ */
+static int find_perfect_hash(StrCase *c, size_t n, unsigned *basis,
+                             unsigned *mask) {
+  unsigned size = 1;
+  while (size < n)
+    size <<= 1;
+  unsigned char *used = malloc((size_t)size * SWITCH_HASH_GROWTH);
+  for (unsigned m = size; m <= size * SWITCH_HASH_GROWTH; m <<= 1) {
+    for (unsigned seed = 0; seed < SWITCH_HASH_SEEDS; seed++) {
+      unsigned b0 = FNV_BASIS ^ (seed * 0x9e3779b9u);
+      memset(used, 0, m);
+      size_t i = 0;
+      for (; i < n; i++) {
+        unsigned slot = fnv(b0, c[i].bytes, c[i].len) & (m - 1);
+        if (used[slot])
+          break;
+        used[slot] = 1;
+        c[i].slot = slot;
+      }
+      if (i == n) {
+        free(used);
+        *basis = b0;
+        *mask = m - 1;
+        return 1;
+      }
+    }
+  }
+  free(used);
+  return 0;
+}
+
+static void emit_plain(CGCtx *ctx, COut *b, Node *n, const char *src_file) {
+  c_out_write(b, "switch (");
+  cg_emit_expr(ctx, b, n->as.switch_stmt.expr);
+  c_out_write(b, ") {");
+  c_out_newline(b);
+  c_out_indent(b);
+  for (size_t i = 0; i < n->as.switch_stmt.len; i++) {
+    SwitchCase *sc = &n->as.switch_stmt.cases[i];
+    if (sc->is_default) {
+      c_out_write(b, "default:");
+    } else {
+      c_out_write(b, "case ");
+      cg_emit_expr(ctx, b, sc->value);
+      c_out_write(b, ":");
+    }
+    c_out_newline(b);
+    size_t case_mark = cg_bounds_mark(ctx);
+    cg_emit_stmt(ctx, b, sc->body, src_file);
+    cg_bounds_restore(ctx, case_mark);
+  }
+  c_out_dedent(b);
+  c_out_write(b, "}");
+  c_out_newline(b);
+}
+
+static long default_case(Node *n) {
+  for (size_t i = 0; i < n->as.switch_stmt.len; i++) {
+    if (n->as.switch_stmt.cases[i].is_default)
+      return (long)i;
+  }
+  return -1;
+}
+
+/* Where control goes when no case matches. */
+static void emit_miss(COut *b, Node *n, int id) {
+  long d = default_case(n);
+  if (d >= 0)
+    c_out_write(b, "goto dr_sw_%d_%ld;\n", id, d);
+  else
+    c_out_write(b, "break;\n");
+}
+
+/* Opens the dispatch scope and evaluates the scrutinee once. */
+static void emit_open(CGCtx *ctx, COut *b, Node *n, int id, const char *type) {
+  c_out_write(b, "switch (0) {\n");
+  c_out_write(b, "default: {\n");
+  c_out_indent(b);
+  c_out_write(b, "%s dr_sw_%d = ", type, id);
+  cg_emit_expr(ctx, b, n->as.switch_stmt.expr);
+  c_out_write(b, ";\n");
+}
+
+/*
+ * Emits the case bodies behind their labels and closes the scope; dead
+ * lists the cases nothing jumps to, if any.
+ */
+static void emit_bodies(CGCtx *ctx, COut *b, Node *n, int id,
+                        const unsigned char *dead, const char *src_file) {
+  for (size_t i = 0; i < n->as.switch_stmt.len; i++) {
+    SwitchCase *sc = &n->as.switch_stmt.cases[i];
+    if (!dead || !dead[i])
+      c_out_write(b, "dr_sw_%d_%zu:\n", id, i);
+    size_t case_mark = cg_bounds_mark(ctx);
+    cg_emit_stmt(ctx, b, sc->body, src_file);
+    cg_bounds_restore(ctx, case_mark);
+  }
+  c_out_dedent(b);
+  c_out_write(b, "}\n");
+  c_out_write(b, "}\n");
+}
+
+static int cmp_int_case(const void *a, const void *b) {
+  const IntCase *x = a, *y = b;
+  return x->value < y->value ? -1 : x->value > y->value;
+}
+
+static void emit_bsearch(COut *b, Node *n, int id, IntCase *c, size_t lo,
+                         size_t hi) {
+  if (hi - lo <= SWITCH_LINEAR_MAX) {
+    for (size_t i = lo; i < hi; i++)
+      c_out_write(b, "if (dr_sw_%d == %lld) goto dr_sw_%d_%zu;\n", id,
+                  c[i].value, id, c[i].index);
+    emit_miss(b, n, id);
+    return;
+  }
+  size_t mid = lo + (hi - lo) / 2;
+  c_out_write(b, "if (dr_sw_%d < %lld) {\n", id, c[mid].value);
+  c_out_indent(b);
+  emit_bsearch(b, n, id, c, lo, mid);
+  c_out_dedent(b);
+  c_out_write(b, "}\n");
+  emit_bsearch(b, n, id, c, mid, hi);
+}
+
+/* Lowers a sparse integer switch; returns 0 if it should stay a C switch. */
+static int emit_int_switch(CGCtx *ctx, COut *b, Node *n, const char *src_file) {
+  if (cg_options.opt_level < 1)
+    return 0;
+  size_t len = n->as.switch_stmt.len;
+  IntCase *c = malloc((len ? len : 1) * sizeof(IntCase));
+  size_t nc = 0;
+  for (size_t i = 0; i < len; i++) {
+    SwitchCase *sc = &n->as.switch_stmt.cases[i];
+    if (sc->is_default)
+      continue;
+    const CValue *v = cg_eval_expr(ctx, sc->value, 0);
+    if (!v || (v->kind != CV_INT && v->kind != CV_CHAR)) {
+      free(c);
+      return 0;
+    }
+    c[nc].value = v->i;
+    c[nc++].index = i;
+  }
+  if (nc < SWITCH_BSEARCH_MIN) {
+    free(c);
+    return 0;
+  }
+  qsort(c, nc, sizeof(IntCase), cmp_int_case);
+  unsigned long long span =
+      (unsigned long long)c[nc - 1].value - (unsigned long long)c[0].value;
+  int dup = 0;
+  for (size_t i = 1; i < nc; i++)
+    dup |= c[i].value == c[i - 1].value;
+  /* Duplicates stay with the C compiler, which reports them. */
+  if (dup || span < (unsigned long long)nc * SWITCH_DENSE_FACTOR) {
+    free(c);
+    return 0;
+  }
+  int id = switch_counter++;
+  emit_open(ctx, b, n, id, "long long");
+  emit_bsearch(b, n, id, c, 0, nc);
+  free(c);
+  emit_bodies(ctx, b, n, id, NULL, src_file);
+  return 1;
+}
+
+static int is_string_switch(CGCtx *ctx, Node *n) {
+  if (cg_is_string_expr(ctx, n->as.switch_stmt.expr))
+    return 1;
+  for (size_t i = 0; i < n->as.switch_stmt.len; i++) {
+    Node *v = n->as.switch_stmt.cases[i].value;
+    if (v && v->kind == ND_STRING)
+      return 1;
+  }
+  return 0;
+}
+
+static void emit_compare_chain(CGCtx *ctx, COut *b, Node *n, int id) {
+  c_out_write(b, "if (dr_sw_%d) {\n", id);
+  c_out_indent(b);
+  for (size_t i = 0; i < n->as.switch_stmt.len; i++) {
+    SwitchCase *sc = &n->as.switch_stmt.cases[i];
+    if (sc->is_default)
+      continue;
+    c_out_write(b, "if (dr_str_eq(dr_sw_%d, ", id);
+    cg_emit_expr(ctx, b, sc->value);
+    c_out_write(b, ")) goto dr_sw_%d_%zu;\n", id, i);
+  }
+  c_out_dedent(b);
+  c_out_write(b, "}\n");
+}
+
+static void emit_hash_dispatch(COut *b, int id, StrCase *c, size_t nc,
+                               unsigned basis, unsigned mask) {
+  c_out_write(b, "if (dr_sw_%d) {\n", id);
+  c_out_indent(b);
+  c_out_write(b, "unsigned dr_sw_%d_h = 0x%08xu;\n", id, basis);
+  c_out_write(b, "size_t dr_sw_%d_n = 0;\n", id);
+  c_out_write(b, "for (; dr_sw_%d[dr_sw_%d_n]; dr_sw_%d_n++)\n", id, id, id);
+  c_out_write(b, "  dr_sw_%d_h = (dr_sw_%d_h ^ (unsigned char)dr_sw_%d[dr_sw_%d_n]) * %uu;\n",
+              id, id, id, id, FNV_PRIME);
+  c_out_write(b, "switch (dr_sw_%d_h & 0x%xu) {\n", id, mask);
+  for (size_t i = 0; i < nc; i++) {
+    c_out_write(b, "case %u:\n", c[i].slot);
+    c_out_indent(b);
+    c_out_write(b, "if (dr_sw_%d_n == %zu && memcmp(dr_sw_%d, \"", id, c[i].len,
+                id);
+    for (size_t k = 0; k < c[i].len; k++) {
+      unsigned char ch = (unsigned char)c[i].bytes[k];
+      if (ch == '"' || ch == '\\')
+        c_out_write(b, "\\%c", ch);
+      else if (ch < 32 || ch >= 127)
+        c_out_write(b, "\\%03o", ch);
+      else
+        c_out_write(b, "%c", ch);
+    }
+    c_out_write(b, "\", %zu) == 0)\n", c[i].len);
+    c_out_write(b, "  goto dr_sw_%d_%zu;\n", id, c[i].index);
+    c_out_write(b, "break;\n");
+    c_out_dedent(b);
+  }
+  c_out_write(b, "}\n");
+  c_out_dedent(b);
+  c_out_write(b, "}\n");
+}
+
+static void emit_string_switch(CGCtx *ctx, COut *b, Node *n,
+                               const char *src_file) {
+  size_t len = n->as.switch_stmt.len;
+  StrCase *c = calloc(len ? len : 1, sizeof(StrCase));
+  unsigned char *dead = calloc(len ? len : 1, 1);
+  size_t nc = 0;
+  int literal = 1;
+  for (size_t i = 0; i < len && literal; i++) {
+    SwitchCase *sc = &n->as.switch_stmt.cases[i];
+    if (sc->is_default)
+      continue;
+    size_t slen;
+    char *bytes = sc->value && sc->value->kind == ND_STRING
+                      ? cg_eval_decode_string(sc->value, &slen)
+                      : NULL;
+    if (!bytes) {
+      literal = 0;
+      break;
+    }
+    /* A repeated literal can only ever reach its first case. */
+    int seen = 0;
+    for (size_t k = 0; k < nc && !seen; k++)
+      seen = c[k].len == slen && memcmp(c[k].bytes, bytes, slen) == 0;
+    if (seen) {
+      free(bytes);
+      dead[i] = 1;
+      continue;
+    }
+    c[nc++] = (StrCase){bytes, slen, i, 0};
+  }
+  unsigned basis = 0, mask = 0;
+  int id = switch_counter++;
+  emit_open(ctx, b, n, id, "const char *");
+  if (literal && nc && find_perfect_hash(c, nc, &basis, &mask))
+    emit_hash_dispatch(b, id, c, nc, basis, mask);
+  else if (nc || !literal)
+    emit_compare_chain(ctx, b, n, id);
+  for (size_t i = 0; i < nc; i++)
+    free(c[i].bytes);
+  free(c);
+  emit_miss(b, n, id);
+  emit_bodies(ctx, b, n, id, literal ? dead : NULL, src_file);
+  free(dead);
+}
+
+void cg_switch_emit(CGCtx *ctx, COut *b, Node *n, const char *src_file) {
+  if (is_string_switch(ctx, n)) {
+    emit_string_switch(ctx, b, n, src_file);
+    return;
+  }
+  if (!emit_int_switch(ctx, b, n, src_file))
+    emit_plain(ctx, b, n, src_file);
+}
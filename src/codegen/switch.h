@@ -0,0 +1,37 @@
+#ifndef CG_SWITCH_H
+#define CG_SWITCH_H
+
+#include "../parser/ast.h"
+#include "c_emit.h"
+#include "context.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Switch lowering.
+ *
+ * Integer switches whose cases are literals stay a C switch while the
+ * values are dense or few, which C compilers turn into a jump table or a
+ * short compare chain. From -O1 on, sparse ones are lowered to a balanced
+ * binary search over the sorted values instead.
+ *
+ * Switches over strings dispatch on a perfect hash of the case literals,
+ * found at compile time, so the scrutinee is hashed once and compared with
+ * at most one candidate by length and memcmp. Cases that are not literals
+ * fall back to a chain of comparisons.
+ *
+ * Lowered switches keep their fallthrough and break semantics: the case
+ * bodies are emitted in order behind labels inside a `switch (0)` that only
+ * break leaves.
+ */
+
+/* Emits the switch statement n. */
+void cg_switch_emit(CGCtx *ctx, COut *b, Node *n, const char *src_file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CG_SWITCH_H
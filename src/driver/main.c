@@ -2,7 +2,9 @@
 #include "../codegen/module.h"
 #include "../ir/lower.h"
 #include "../lexer/lexer.h"
+#include "../opt/interprocedural.h"
 #include "../opt/pipeline.h"
+#include "../opt/profile.h"
 #include "../parser/diagnostic.h"
 #include "../parser/parser.h"
 #include "../parser/warnings.h"
@@ -11,6 +13,7 @@
 #include "../util/console_debug.h"
 #include "../util/platform.h"
 #include <stdio.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <dirent.h>
@@ -67,6 +70,180 @@ static char *read_file(const char *path) {
   return buf;
 }
 
+/**
+ * Lowers each function and method of the program to its own CFG and
+ * collects them into a function table for the interprocedural passes. The
+ * table takes ownership of the names and parameter arrays.
+ */
+static FunctionTable *build_function_table(Node *root) {
+  size_t count = 0;
+  IRFunction *funcs = ir_lower_functions(root, &count);
+  FunctionTable *table = function_table_new();
+  for (size_t i = 0; i < count; i++) {
+    FunctionInfo info;
+    memset(&info, 0, sizeof(info));
+    info.name = funcs[i].name;
+    info.cfg = funcs[i].cfg;
+    info.params = funcs[i].params;
+    info.nparam = funcs[i].nparam;
+    info.globals = funcs[i].globals;
+    info.nglobals = funcs[i].nglobals;
+    info.return_val = (IRValue){.id = -1};
+    info.exact = funcs[i].exact;
+    cfg_compute_dominators(info.cfg);
+    function_table_add(table, &info);
+  }
+  free(funcs);
+  /* A function is only as exact as the functions it calls */
+  for (int changed = 1; changed;) {
+    changed = 0;
+    for (size_t i = 0; i < table->nfunctions; i++) {
+      FunctionInfo *f = &table->functions[i];
+      for (size_t j = 0; f->exact && j < f->cfg->nblocks; j++) {
+        BasicBlock *b = f->cfg->blocks[j];
+        for (size_t k = 0; k < b->ninstrs; k++) {
+          IRInstr *ins = b->instrs[k];
+          if (ins->op == IR_CALL && ins->extra.call.func_id >= 0 &&
+              !table->functions[ins->extra.call.func_id].exact) {
+            f->exact = false;
+            changed = 1;
+            break;
+          }
+        }
+      }
+    }
+  }
+  return table;
+}
+
+/**
+ * Counts the call sites of each function that call the function itself,
+ * before inlining blurs them.
+ */
+static size_t *count_self_calls(FunctionTable *table) {
+  size_t *counts = calloc(table->nfunctions ? table->nfunctions : 1,
+                          sizeof(size_t));
+  for (size_t i = 0; i < table->nfunctions; i++) {
+    CFG *cfg = table->functions[i].cfg;
+    for (size_t j = 0; cfg && j < cfg->nblocks; j++) {
+      BasicBlock *b = cfg->blocks[j];
+      for (size_t k = 0; k < b->ninstrs; k++) {
+        if (b->instrs[k]->op == IR_CALL &&
+            b->instrs[k]->extra.call.func_id == (int)i)
+          counts[i]++;
+      }
+    }
+  }
+  return counts;
+}
+
+/**
+ * Hands the pure functions that call themselves more than once to code
+ * generation, which puts a result cache in front of those whose signature
+ * allows it. A single self call is plain iteration that a cache cannot
+ * shorten, and the tail-call rewrite handles it better.
+ */
+static void collect_memo_candidates(FunctionTable *table,
+                                    const size_t *self_calls, size_t n) {
+  const char **names = malloc(sizeof(char *) * (n + 1));
+  size_t count = 0;
+  for (size_t i = 0; i < n; i++) {
+    FunctionInfo *f = &table->functions[i];
+    if (f->is_pure && self_calls[i] >= 2 && f->nparam > 0)
+      names[count++] = strdup(f->name);
+  }
+  cg_options.memo_candidates = names;
+  cg_options.nmemo_candidates = count;
+}
+
+/* Nonzero if the body makes a call, which may have an effect. */
+static int makes_calls(FunctionInfo *f) {
+  for (size_t i = 0; i < f->cfg->nblocks; i++) {
+    BasicBlock *b = f->cfg->blocks[i];
+    for (size_t j = 0; j < b->ninstrs; j++) {
+      if (b->instrs[j]->op == IR_CALL)
+        return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Hands the calls the optimizer found to return a constant to code
+ * generation, which emits from the AST: calls to a source function that
+ * always returns one, and to a specialization of one that does once its
+ * bound constants are in. Only functions lowered exactly are trusted.
+ * Specializations of specializations are left out, as their parameters no
+ * longer line up with the source.
+ */
+static void collect_constant_calls(FunctionTable *table, size_t n) {
+  CGConstCall *calls = malloc(sizeof(CGConstCall) * (table->nfunctions + 1));
+  size_t count = 0;
+  for (size_t i = 0; i < table->nfunctions; i++) {
+    FunctionInfo *f = &table->functions[i];
+    FunctionInfo *origin =
+        f->bound ? function_table_get(table, f->origin_id) : f;
+    IRValue result;
+    if ((f->bound && (size_t)f->origin_id >= n) || (!f->bound && i >= n) ||
+        !origin || !f->cfg || !f->exact ||
+        !function_constant_return(f, &result))
+      continue;
+    CGConstCall *c = &calls[count++];
+    c->name = strdup(origin->name);
+    c->nargs = origin->nparam;
+    c->args = calloc(c->nargs + 1, sizeof(int));
+    c->bound = calloc(c->nargs + 1, 1);
+    for (size_t k = 0; f->bound && k < c->nargs; k++) {
+      if (ir_is_const(f->bound[k])) {
+        c->args[k] = ir_const_value(f->bound[k]);
+        c->bound[k] = 1;
+      }
+    }
+    c->result = ir_const_value(result);
+    c->has_effects = makes_calls(f);
+  }
+  cg_options.const_calls = calls;
+  cg_options.nconst_calls = count;
+}
+
+/**
+ * Replaces the static call estimates the inliner works from with the calls
+ * a profile measured. Functions the profile does not mention are newer than
+ * it and are left neutral, at the hot threshold.
+ */
+static void apply_profile(FunctionTable *table, const Profile *profile) {
+  unsigned long long hot = profile_hot_threshold(profile);
+  table->profiled = true;
+  table->hot_count = hot > INT_MAX ? INT_MAX : (int)hot;
+  for (size_t i = 0; i < table->nfunctions; i++) {
+    FunctionInfo *f = &table->functions[i];
+    const ProfileEntry *e =
+        profile_lookup(profile, PROFILE_FUNC, f->name, 0, 0, NULL);
+    unsigned long long calls = profile_calls_to(profile, f->name);
+    if (e && e->count[0] > calls)
+      calls = e->count[0];
+    if (!e)
+      calls = hot;
+    f->call_count = calls > INT_MAX ? INT_MAX : (int)calls;
+  }
+}
+
+/**
+ * Default profile location: the input with its extension replaced by ext,
+ * .drprof for counters and .allocprof for allocation reports.
+ */
+static char *default_profile_path(const char *input, const char *ext) {
+  size_t len = strlen(input);
+  const char *dot = strrchr(input, '.');
+  const char *sep = strrchr(input, DR_PATH_SEP);
+  if (dot && (!sep || dot > sep))
+    len = (size_t)(dot - input);
+  char *path = malloc(len + strlen(ext) + 1);
+  memcpy(path, input, len);
+  strcpy(path + len, ext);
+  return path;
+}
+
 /**
  * @brief Entry point for the compiler program.
  *
@@ -90,6 +267,13 @@ int main(int argc, char *argv[]) {
   bool warnings_as_errors = false;
   bool disable_warnings = false;
 
+  // Profile-guided optimization: NULL path means next to the input
+  bool profile_generate = false;
+  bool profile_use = false;
+  const char *profile_path = NULL;
+  bool profile_alloc = false;
+  const char *profile_alloc_path = NULL;
+
   for (int i = 1; i < argc; i++) {
     if (strcmp(argv[i], "-O1") == 0 || strcmp(argv[i], "--O1") == 0) {
       opt_level = 1;
@@ -133,9 +317,38 @@ int main(int argc, char *argv[]) {
       multi_file = true;
       continue;
     }
+    if (strcmp(argv[i], "--bounds-check") == 0) {
+      cg_options.bounds_check = 1;
+      continue;
+    }
+    if (strncmp(argv[i], "--profile-generate", 18) == 0 &&
+        (argv[i][18] == 0 || argv[i][18] == '=')) {
+      profile_generate = true;
+      if (argv[i][18] == '=')
+        profile_path = argv[i] + 19;
+      continue;
+    }
+    if (strncmp(argv[i], "--profile-alloc", 15) == 0 &&
+        (argv[i][15] == 0 || argv[i][15] == '=')) {
+      profile_alloc = true;
+      if (argv[i][15] == '=')
+        profile_alloc_path = argv[i] + 16;
+      continue;
+    }
+    if (strncmp(argv[i], "--profile-use", 13) == 0 &&
+        (argv[i][13] == 0 || argv[i][13] == '=')) {
+      profile_use = true;
+      if (argv[i][13] == '=')
+        profile_path = argv[i] + 14;
+      else if (i + 1 < argc && strstr(argv[i + 1], ".drprof"))
+        profile_path = argv[++i];
+      continue;
+    }
     input = argv[i];
   }
 
+  cg_options.opt_level = opt_level;
+
   if (!input) {
     fprintf(stderr, "usage: %s [options] file\n", argv[0]);
     return 1;
@@ -148,6 +361,29 @@ int main(int argc, char *argv[]) {
   }
   normalize_newlines(src);
 
+  char *default_profile = NULL;
+  Profile *profile = NULL;
+  if ((profile_generate || profile_use) && !profile_path)
+    profile_path = default_profile = default_profile_path(input, ".drprof");
+  if (profile_generate) {
+    cg_options.profile_generate = 1;
+    cg_options.profile_path = profile_path;
+  } else if (profile_use) {
+    profile = profile_load(profile_path);
+    if (!profile)
+      fprintf(stderr, "warning: cannot read profile %s; compiling without it\n",
+              profile_path);
+    cg_options.profile = profile;
+  }
+  char *default_alloc_profile = NULL;
+  if (profile_alloc) {
+    if (!profile_alloc_path)
+      profile_alloc_path = default_alloc_profile =
+          default_profile_path(input, ".allocprof");
+    cg_options.profile_alloc = 1;
+    cg_options.profile_alloc_path = profile_alloc_path;
+  }
+
   Console.WriteLine("compiling %s", input);
 
   Arena arena;
@@ -171,12 +407,22 @@ int main(int argc, char *argv[]) {
   sem_analyze_program(&sem, root);
   print_diagnostics(src, &sem.diags);
 
-  int nvars = 0;
-  CFG *cfg = ir_lower_program(root, &nvars);
-  cfg_compute_dominators(cfg);
   /* SSA construction disabled for now while control-flow lowering evolves */
-  run_pipeline(cfg, opt_level);
-  cfg_free(cfg);
+  FunctionTable *functions = build_function_table(root);
+  size_t nsource = functions->nfunctions;
+  size_t *self_calls = opt_level >= 3 ? count_self_calls(functions) : NULL;
+  if (profile)
+    apply_profile(functions, profile);
+  run_pipeline_on_program(functions, opt_level);
+  if (opt_level >= 2)
+    collect_constant_calls(functions, nsource);
+  if (self_calls) {
+    collect_memo_candidates(functions, self_calls, nsource);
+    free(self_calls);
+  }
+  for (size_t i = 0; i < functions->nfunctions; i++)
+    cfg_free(functions->functions[i].cfg);
+  function_table_free(functions);
 
   if (emit_c) {
     dr_mkdir("build");
@@ -187,8 +433,15 @@ int main(int argc, char *argv[]) {
     const char *headers[][2] = {
       {"io/console.h", "console.h"},
       {"memory/memory.h", "memory.h"},
+      {"memory/memo.h", "memo.h"},
+      {"memory/drstring.h", "drstring.h"},
+      {"memory/region.h", "region.h"},
+      {"memory/allocprof.h", "allocprof.h"},
       {"extensions/custom.h", "custom.h"},
       {"system/task.h", "task.h"},
+      {"system/scheduler.h", "scheduler.h"},
+      {"system/eventloop.h", "eventloop.h"},
+      {"system/profile.h", "profile.h"},
       {"exceptions/exception.h", "exception.h"}
     };
     for (size_t i = 0; i < sizeof(headers)/sizeof(headers[0]); i++) {
@@ -256,9 +509,22 @@ int main(int argc, char *argv[]) {
     codegen_emit_obj(root, "a.o", input);
   }
 
+  for (size_t i = 0; i < cg_options.nmemo_candidates; i++)
+    free((char *)cg_options.memo_candidates[i]);
+  free(cg_options.memo_candidates);
+  for (size_t i = 0; i < cg_options.nconst_calls; i++) {
+    CGConstCall *c = (CGConstCall *)&cg_options.const_calls[i];
+    free((char *)c->name);
+    free(c->args);
+    free(c->bound);
+  }
+  free((CGConstCall *)cg_options.const_calls);
+  profile_free(profile);
+  free(default_profile);
+  free(default_alloc_profile);
   free(src);
   free(p.diags.data);
   sem_analyzer_free(&sem);
-  free(arena.ptr);
+  arena_free(&arena);
   return 0;
 }
@@ -174,6 +174,6 @@ int main(int argc, char **argv) {
     print_diagnostics(src, &p.diags);
     free(src);
     free(p.diags.data);
-    free(arena.ptr);
+    arena_free(&arena);
     return 0;
 }
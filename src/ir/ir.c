@@ -1,5 +1,6 @@
 #include "ir.h"
 #include <stdlib.h>
+#include <string.h>
 /**
  * @brief Creates a new IR instruction.
  *
@@ -11,6 +12,7 @@
  */
 IRInstr *ir_instr_new(IROp op, IRValue dst, IRValue a, IRValue b) {
     IRInstr *in = malloc(sizeof(IRInstr));
+    memset(&in->extra, 0, sizeof(in->extra));
     in->op = op;
     in->dst = dst;
     in->a = a;
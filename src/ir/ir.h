@@ -47,6 +47,13 @@ typedef struct {
  */
 typedef struct IRInstr IRInstr;
 
+/** Callee id of calls that leave the program (runtime, console, stores). */
+#define IR_CALL_EXTERNAL (-1)
+/** Callee id of Dream calls whose target the lowering could not determine. */
+#define IR_CALL_UNRESOLVED (-2)
+/** Callee id of literals the IR does not model (strings, floats); no side effects. */
+#define IR_CALL_OPAQUE (-3)
+
 /**
  * @brief Extra information for call instructions.
  */
@@ -2,6 +2,7 @@
 #include "../cfg/cfg.h"
 #include "../parser/ast.h"
 #include "ir.h"
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -9,6 +10,8 @@ typedef struct Var Var;
 struct Var {
   char *name;
   int id;
+  Slice type_name; /* declared class or struct type, empty otherwise */
+  int declared;    /* a parameter or local, not a variable of the program */
   Var *next;
 };
 
@@ -29,11 +32,118 @@ static int get_var_id(const char *s, size_t n, int *next) {
   Var *v = malloc(sizeof(Var));
   v->name = strdup_n(s, n);
   v->id = (*next)++;
+  v->type_name = (Slice){NULL, 0};
+  v->declared = 0;
   v->next = vars;
   vars = v;
   return v->id;
 }
 
+static Var *find_var(const char *s, size_t n) {
+  for (Var *v = vars; v; v = v->next) {
+    if (strlen(v->name) == n && strncmp(v->name, s, n) == 0)
+      return v;
+  }
+  return NULL;
+}
+
+static void free_vars(void) {
+  while (vars) {
+    Var *n = vars->next;
+    free(vars->name);
+    free(vars);
+    vars = n;
+  }
+}
+
+/*
+ * Functions known to the lowering, in the order they are returned by
+ * ir_lower_functions(). Calls are resolved against this list so that
+ * CallInfo.func_id is the index of the callee.
+ */
+typedef struct {
+  char *name;  /* "f" for free functions, "Class.m" for methods */
+  Node *decl;  /* ND_FUNC, or NULL for the top-level statements */
+  Slice owner; /* class or struct declaring a method */
+} FuncEntry;
+
+static FuncEntry *funcs;
+static size_t nfuncs;
+/* Cleared once the function being lowered uses something the IR only
+ * approximates. */
+static int exact;
+
+static char *qualified_name(Slice owner, const char *s, size_t n) {
+  size_t len = owner.len ? owner.len + 1 + n : n;
+  char *r = malloc(len + 1);
+  if (owner.len) {
+    memcpy(r, owner.start, owner.len);
+    r[owner.len] = '.';
+    memcpy(r + owner.len + 1, s, n);
+  } else {
+    memcpy(r, s, n);
+  }
+  r[len] = '\0';
+  return r;
+}
+
+static int find_func(Slice owner, const char *s, size_t n) {
+  char *name = qualified_name(owner, s, n);
+  int id = -1;
+  for (size_t i = 0; i < nfuncs; i++) {
+    if (strcmp(funcs[i].name, name) == 0) {
+      id = (int)i;
+      break;
+    }
+  }
+  free(name);
+  return id;
+}
+
+static int is_type_name(const char *s, size_t n) {
+  for (size_t i = 0; i < nfuncs; i++) {
+    Slice o = funcs[i].owner;
+    if (o.len == n && strncmp(o.start, s, n) == 0)
+      return 1;
+  }
+  return 0;
+}
+
+/*
+ * Resolves the callee of an ND_CALL. Instance method calls store the
+ * receiver in *recv so it can be passed as the implicit first argument.
+ * Returns -1 for calls that do not target a Dream function.
+ */
+static int resolve_call(Node *call, Node **recv) {
+  Node *callee = call->as.call.callee;
+  *recv = NULL;
+  if (callee->kind == ND_IDENT)
+    return find_func((Slice){NULL, 0}, callee->as.ident.start,
+                     callee->as.ident.len);
+  if (callee->kind != ND_FIELD || callee->as.field.object->kind != ND_IDENT)
+    return -1;
+  Node *obj = callee->as.field.object;
+  Slice name = callee->as.field.name;
+  Var *v = find_var(obj->as.ident.start, obj->as.ident.len);
+  if (v && v->type_name.len) {
+    int id = find_func(v->type_name, name.start, name.len);
+    if (id >= 0 && !funcs[id].decl->as.func.is_static)
+      *recv = obj;
+    return id;
+  }
+  if (!v && is_type_name(obj->as.ident.start, obj->as.ident.len)) {
+    Slice owner = {obj->as.ident.start, obj->as.ident.len};
+    int id = find_func(owner, name.start, name.len);
+    return id >= 0 && funcs[id].decl->as.func.is_static ? id : -1;
+  }
+  return -1;
+}
+
+static void push_instr(BasicBlock *bb, IRInstr *ins) {
+  bb->instrs = realloc(bb->instrs, sizeof(IRInstr *) * (bb->ninstrs + 1));
+  bb->instrs[bb->ninstrs++] = ins;
+}
+
 typedef struct CFContext CFContext;
 struct CFContext {
   BasicBlock *brk;
@@ -41,6 +151,73 @@ struct CFContext {
   CFContext *parent;
 };
 
+/* Nonzero for the operators binop_from_token maps. */
+static int models_op(TokenKind tk) {
+  switch (tk) {
+  case TK_PLUS:
+  case TK_MINUS:
+  case TK_STAR:
+  case TK_SLASH:
+  case TK_PERCENT:
+  case TK_AND:
+  case TK_OR:
+  case TK_CARET:
+  case TK_LSHIFT:
+  case TK_RSHIFT:
+  case TK_LT:
+  case TK_LTEQ:
+  case TK_GT:
+  case TK_GTEQ:
+  case TK_EQEQ:
+  case TK_NEQ:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+/* Nonzero if evaluating n may assign a variable. */
+static int writes(Node *n) {
+  if (!n)
+    return 0;
+  switch (n->kind) {
+  case ND_UNARY:
+    return n->as.unary.op == TK_PLUSPLUS || n->as.unary.op == TK_MINUSMINUS ||
+           writes(n->as.unary.expr);
+  case ND_POST_UNARY:
+    return 1;
+  case ND_BINOP:
+    return n->as.bin.op == TK_EQ || (!models_op(n->as.bin.op) &&
+                                     n->as.bin.op != TK_ANDAND &&
+                                     n->as.bin.op != TK_OROR &&
+                                     n->as.bin.op != TK_QMARKQMARK) ||
+           writes(n->as.bin.lhs) || writes(n->as.bin.rhs);
+  case ND_COND:
+    return writes(n->as.cond.cond) || writes(n->as.cond.then_expr) ||
+           writes(n->as.cond.else_expr);
+  case ND_INDEX:
+    return writes(n->as.index.array) || writes(n->as.index.index);
+  case ND_FIELD:
+    return writes(n->as.field.object);
+  case ND_CALL:
+    for (size_t i = 0; i < n->as.call.len; i++) {
+      if (writes(n->as.call.args[i]))
+        return 1;
+    }
+    return 0;
+  case ND_NEW:
+    for (size_t i = 0; i < n->as.new_expr.arg_len; i++) {
+      if (writes(n->as.new_expr.args[i]))
+        return 1;
+    }
+    return 0;
+  case ND_AWAIT:
+    return writes(n->as.await_expr.expr);
+  default:
+    return 0;
+  }
+}
+
 static IROp binop_from_token(TokenKind tk) {
   switch (tk) {
   case TK_PLUS:
@@ -80,14 +257,43 @@ static IROp binop_from_token(TokenKind tk) {
   }
 }
 
+/*
+ * Emits a call outside the program. Expressions the IR cannot model yield
+ * the result of such a call, so analyses treat them as unknown instead of
+ * constant; side effects (console output, stores through fields and
+ * indices) are recorded the same way so summaries see them.
+ */
+static IRValue emit_external(BasicBlock *bb, IRValue *args, size_t nargs,
+                             int *next) {
+  IRValue dst = {.id = (*next)++};
+  IRInstr *ins = ir_instr_new(IR_CALL, dst, (IRValue){0}, (IRValue){0});
+  ins->extra.call = (CallInfo){IR_CALL_EXTERNAL, args, nargs};
+  push_instr(bb, ins);
+  return dst;
+}
+
 static IRValue emit_expr(BasicBlock *bb, Node *n, int *next) {
   switch (n->kind) {
   case ND_INT: {
     char buf[32];
-    memcpy(buf, n->as.lit.start, n->as.lit.len);
-    buf[n->as.lit.len] = '\0';
-    int v = atoi(buf);
-    return ir_const(v);
+    size_t len = n->as.lit.len < sizeof buf ? n->as.lit.len : sizeof buf - 1;
+    memcpy(buf, n->as.lit.start, len);
+    buf[len] = '\0';
+    char *end;
+    long long v = strtoll(buf, &end, 10);
+    if (*end || len != n->as.lit.len || v > INT_MAX || v <= INT_MIN)
+      exact = 0;
+    return ir_const((int)v);
+  }
+  case ND_BOOL:
+    return ir_const(n->as.lit.len == 4 && strncmp(n->as.lit.start, "true", 4) == 0);
+  case ND_STRING:
+  case ND_FLOAT:
+  case ND_CHAR:
+  case ND_NULL: {
+    IRValue dst = emit_external(bb, NULL, 0, next);
+    bb->instrs[bb->ninstrs - 1]->extra.call.func_id = IR_CALL_OPAQUE;
+    return dst;
   }
   case ND_IDENT: {
     int id = get_var_id(n->as.ident.start, n->as.ident.len, next);
@@ -104,6 +310,14 @@ static IRValue emit_expr(BasicBlock *bb, Node *n, int *next) {
       bb->instrs[bb->ninstrs++] = ins;
       return (IRValue){.id = id};
     }
+    if (n->as.bin.op == TK_EQ) {
+      IRValue *args = malloc(sizeof(IRValue));
+      args[0] = emit_expr(bb, n->as.bin.rhs, next);
+      emit_external(bb, args, 1, next);
+      return args[0];
+    }
+    if (!models_op(n->as.bin.op))
+      exact = 0;
     IRValue lhs = emit_expr(bb, n->as.bin.lhs, next);
     IRValue rhs = emit_expr(bb, n->as.bin.rhs, next);
     IRValue dst = {.id = (*next)++};
@@ -112,8 +326,38 @@ static IRValue emit_expr(BasicBlock *bb, Node *n, int *next) {
     bb->instrs[bb->ninstrs++] = ins;
     return dst;
   }
+  case ND_CALL: {
+    Node *recv = NULL;
+    int func_id = resolve_call(n, &recv);
+    if (func_id < 0)
+      func_id = IR_CALL_UNRESOLVED;
+    size_t nargs = n->as.call.len + (recv ? 1 : 0);
+    IRValue *args = nargs ? malloc(sizeof(IRValue) * nargs) : NULL;
+    size_t k = 0;
+    if (recv)
+      args[k++] = emit_expr(bb, recv, next);
+    for (size_t i = 0; i < n->as.call.len; i++)
+      args[k++] = emit_expr(bb, n->as.call.args[i], next);
+    IRValue dst = {.id = (*next)++};
+    IRInstr *ins = ir_instr_new(IR_CALL, dst, (IRValue){0}, (IRValue){0});
+    ins->extra.call = (CallInfo){func_id, args, nargs};
+    push_instr(bb, ins);
+    return dst;
+  }
+  case ND_CONSOLE_CALL: {
+    /* Lowered so that calls in the argument reach the call graph */
+    IRValue *args = NULL;
+    size_t nargs = 0;
+    if (n->as.console.arg) {
+      args = malloc(sizeof(IRValue));
+      args[nargs++] = emit_expr(bb, n->as.console.arg, next);
+    }
+    return emit_external(bb, args, nargs, next);
+  }
   default:
-    return ir_const(0);
+    if (writes(n))
+      exact = 0;
+    return emit_external(bb, NULL, 0, next);
   }
 }
 
@@ -125,8 +369,17 @@ static BasicBlock *emit_stmt(CFG *cfg, BasicBlock *bb, Node *n, int *next,
       bb = emit_stmt(cfg, bb, n->as.block.items[i], next, ctx);
     return bb;
   case ND_VAR_DECL: {
+    int fresh = !find_var(n->as.var_decl.name.start, n->as.var_decl.name.len);
     int id =
         get_var_id(n->as.var_decl.name.start, n->as.var_decl.name.len, next);
+    if (fresh)
+      vars->declared = 1;
+    if (n->as.var_decl.type == TK_IDENT)
+      find_var(n->as.var_decl.name.start, n->as.var_decl.name.len)->type_name =
+          n->as.var_decl.type_name;
+    /* Values are ints; a float would divide and truncate differently. */
+    if (n->as.var_decl.type == TK_KW_FLOAT)
+      exact = 0;
     if (n->as.var_decl.init) {
       IRValue val = emit_expr(bb, n->as.var_decl.init, next);
       IRInstr *ins =
@@ -139,6 +392,16 @@ static BasicBlock *emit_stmt(CFG *cfg, BasicBlock *bb, Node *n, int *next,
   case ND_EXPR_STMT:
     emit_expr(bb, n->as.expr_stmt.expr, next);
     return bb;
+  case ND_CONSOLE_CALL: {
+    IRValue *args = NULL;
+    size_t nargs = 0;
+    if (n->as.console.arg) {
+      args = malloc(sizeof(IRValue));
+      args[nargs++] = emit_expr(bb, n->as.console.arg, next);
+    }
+    emit_external(bb, args, nargs, next);
+    return bb;
+  }
   case ND_IF: {
     IRValue cond = emit_expr(bb, n->as.if_stmt.cond, next);
     IRInstr *cj =
@@ -197,6 +460,26 @@ static BasicBlock *emit_stmt(CFG *cfg, BasicBlock *bb, Node *n, int *next,
     cfg_add_edge(body_end, cond_bb);
     return after;
   }
+  case ND_DO_WHILE: {
+    BasicBlock *body_bb = cfg_add_block(cfg);
+    push_instr(bb, ir_instr_new(IR_JUMP, (IRValue){.id = -1}, (IRValue){0},
+                                (IRValue){0}));
+    cfg_add_edge(bb, body_bb);
+    BasicBlock *cond_bb = cfg_add_block(cfg);
+    BasicBlock *after = cfg_add_block(cfg);
+    CFContext inner = {after, cond_bb, ctx};
+    BasicBlock *body_end =
+        emit_stmt(cfg, body_bb, n->as.do_while_stmt.body, next, &inner);
+    push_instr(body_end, ir_instr_new(IR_JUMP, (IRValue){.id = -1},
+                                      (IRValue){0}, (IRValue){0}));
+    cfg_add_edge(body_end, cond_bb);
+    IRValue cond = emit_expr(cond_bb, n->as.do_while_stmt.cond, next);
+    push_instr(cond_bb,
+               ir_instr_new(IR_CJUMP, (IRValue){.id = -1}, cond, (IRValue){0}));
+    cfg_add_edge(cond_bb, body_bb);
+    cfg_add_edge(cond_bb, after);
+    return after;
+  }
   case ND_FOR: {
     if (n->as.for_stmt.init)
       bb = emit_stmt(cfg, bb, n->as.for_stmt.init, next, ctx);
@@ -218,9 +501,15 @@ static BasicBlock *emit_stmt(CFG *cfg, BasicBlock *bb, Node *n, int *next,
     BasicBlock *after = cfg_add_block(cfg);
     cfg_add_edge(cond_bb, body_bb);
     cfg_add_edge(cond_bb, after);
-    CFContext inner = {after, cond_bb, ctx};
+    /* continue goes through the update */
+    BasicBlock *update_bb = cfg_add_block(cfg);
+    CFContext inner = {after, update_bb, ctx};
     BasicBlock *body_end =
         emit_stmt(cfg, body_bb, n->as.for_stmt.body, next, &inner);
+    push_instr(body_end, ir_instr_new(IR_JUMP, (IRValue){.id = -1},
+                                      (IRValue){0}, (IRValue){0}));
+    cfg_add_edge(body_end, update_bb);
+    body_end = update_bb;
     if (n->as.for_stmt.update)
       body_end = emit_stmt(cfg, body_end, n->as.for_stmt.update, next, &inner);
     IRInstr *bj =
@@ -261,6 +550,7 @@ static BasicBlock *emit_stmt(CFG *cfg, BasicBlock *bb, Node *n, int *next,
     return cfg_add_block(cfg);
   }
   default:
+    exact = 0;
     return bb;
   }
 }
@@ -276,13 +566,124 @@ CFG *ir_lower_program(Node *root, int *nvars) {
   return cfg;
 }
 
+static void add_func(Slice owner, Node *decl, const char *s, size_t n) {
+  funcs = realloc(funcs, sizeof(FuncEntry) * (nfuncs + 1));
+  funcs[nfuncs++] = (FuncEntry){qualified_name(owner, s, n), decl, owner};
+}
+
+/* Lowers one function body; params receive the first value ids. */
+static void lower_function(FuncEntry *fe, Node *body, IRFunction *out) {
+  CFG *cfg = cfg_new();
+  BasicBlock *bb = cfg_add_block(cfg);
+  int next = 0;
+  free_vars();
+  exact = 1;
+  Node *decl = fe->decl;
+  size_t nparam = 0;
+  IRValue *params = NULL;
+  if (decl) {
+    int has_this = fe->owner.len && !decl->as.func.is_static;
+    nparam = decl->as.func.param_len + (has_this ? 1 : 0);
+    params = nparam ? malloc(sizeof(IRValue) * nparam) : NULL;
+    size_t k = 0;
+    if (has_this) {
+      params[k++] = (IRValue){.id = get_var_id("this", 4, &next)};
+      vars->type_name = fe->owner;
+      vars->declared = 1;
+    }
+    for (size_t i = 0; i < decl->as.func.param_len; i++) {
+      Node *p = decl->as.func.params[i];
+      params[k++] = (IRValue){.id = get_var_id(p->as.var_decl.name.start,
+                                                p->as.var_decl.name.len, &next)};
+      vars->declared = 1;
+      if (p->as.var_decl.type == TK_IDENT)
+        vars->type_name = p->as.var_decl.type_name;
+      if (p->as.var_decl.type == TK_KW_FLOAT)
+        exact = 0;
+    }
+  }
+  BasicBlock *end = emit_stmt(cfg, bb, body, &next, NULL);
+  push_instr(end, ir_instr_new(IR_RETURN, (IRValue){.id = -1}, ir_const(0),
+                               (IRValue){0}));
+  out->name = strdup_n(fe->name, strlen(fe->name));
+  out->cfg = cfg;
+  out->params = params;
+  out->nparam = nparam;
+  out->nvars = next;
+  out->globals = NULL;
+  out->nglobals = 0;
+  for (Var *v = vars; v; v = v->next) {
+    if (v->declared)
+      continue;
+    out->globals = realloc(out->globals, sizeof(IRValue) * (out->nglobals + 1));
+    out->globals[out->nglobals++] = (IRValue){.id = v->id};
+  }
+  out->exact = exact && !out->nglobals;
+}
+
+IRFunction *ir_lower_functions(Node *root, size_t *count) {
+  funcs = NULL;
+  nfuncs = 0;
+  vars = NULL;
+  /* The top-level statements only run when no main function is declared. */
+  int has_main = 0;
+  for (size_t i = 0; i < root->as.block.len; i++) {
+    Node *it = root->as.block.items[i];
+    if (it->kind == ND_FUNC && it->as.func.name.len == 4 &&
+        strncmp(it->as.func.name.start, "main", 4) == 0)
+      has_main = 1;
+    if (it->kind != ND_CLASS_DECL && it->kind != ND_STRUCT_DECL)
+      continue;
+    for (size_t j = 0; j < it->as.type_decl.len; j++) {
+      Node *m = it->as.type_decl.members[j];
+      if (m->kind == ND_FUNC && m->as.func.is_static &&
+          m->as.func.name.len == 4 &&
+          strncmp(m->as.func.name.start, "main", 4) == 0)
+        has_main = 1;
+    }
+  }
+  if (!has_main)
+    add_func((Slice){NULL, 0}, NULL, "main", 4);
+  for (size_t i = 0; i < root->as.block.len; i++) {
+    Node *it = root->as.block.items[i];
+    if (it->kind == ND_FUNC) {
+      add_func((Slice){NULL, 0}, it, it->as.func.name.start,
+               it->as.func.name.len);
+    } else if (it->kind == ND_CLASS_DECL || it->kind == ND_STRUCT_DECL) {
+      for (size_t j = 0; j < it->as.type_decl.len; j++) {
+        Node *m = it->as.type_decl.members[j];
+        if (m->kind == ND_FUNC)
+          add_func(it->as.type_decl.name, m, m->as.func.name.start,
+                   m->as.func.name.len);
+      }
+    }
+  }
+
+  IRFunction *out = calloc(nfuncs ? nfuncs : 1, sizeof(IRFunction));
+  for (size_t i = 0; i < nfuncs; i++)
+    lower_function(&funcs[i], funcs[i].decl ? funcs[i].decl->as.func.body : root,
+                   &out[i]);
+  free_vars();
+  for (size_t i = 0; i < nfuncs; i++)
+    free(funcs[i].name);
+  free(funcs);
+  funcs = NULL;
+  if (count)
+    *count = nfuncs;
+  nfuncs = 0;
+  return out;
+}
+
 void cfg_free(CFG *cfg) {
   if (!cfg)
     return;
   for (size_t i = 0; i < cfg->nblocks; i++) {
     BasicBlock *b = cfg->blocks[i];
-    for (size_t j = 0; j < b->ninstrs; j++)
+    for (size_t j = 0; j < b->ninstrs; j++) {
+      if (b->instrs[j]->op == IR_CALL)
+        free(b->instrs[j]->extra.call.args);
       free(b->instrs[j]);
+    }
     free(b->instrs);
     free(b->succ);
     free(b->pred);
@@ -3,7 +3,28 @@
 #include "../cfg/cfg.h"
 #include "../parser/ast.h"
 
+/* A Dream function or method lowered to its own CFG. */
+typedef struct {
+  char *name;      /* "f" for free functions, "Class.m" for methods */
+  CFG *cfg;        /* body, ending in IR_RETURN on every path */
+  IRValue *params; /* parameter value ids, the receiver first for methods */
+  size_t nparam;   /* number of parameters */
+  int nvars;       /* number of value ids used by the body */
+  IRValue *globals; /* variables the body names without declaring them */
+  size_t nglobals;
+  int exact;       /* the CFG computes what the body does, nothing skipped */
+} IRFunction;
+
 CFG *ir_lower_program(Node *root, int *nvars);
+
+/*
+ * Lowers every function and method of the program into its own CFG. When the
+ * program has no main function, the top-level statements form a function
+ * named "main" at index 0. IR_CALL instructions carry a CallInfo whose
+ * func_id indexes the returned array, or is IR_CALL_UNRESOLVED for calls
+ * whose target is unknown and IR_CALL_EXTERNAL for calls outside the program.
+ */
+IRFunction *ir_lower_functions(Node *root, size_t *count);
 void cfg_free(CFG *cfg);
 
 #endif
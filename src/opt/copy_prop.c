@@ -24,6 +24,14 @@ bool copy_propagation(CFG *cfg) {
                         use->b = src;
                         changed = true;
                     }
+                    if (use->op == IR_CALL) {
+                        for (size_t k = 0; k < use->extra.call.nargs; k++) {
+                            if (use->extra.call.args[k].id == dst_id) {
+                                use->extra.call.args[k] = src;
+                                changed = true;
+                            }
+                        }
+                    }
                     if (use->dst.id == dst_id)
                         break; // killed
                 }
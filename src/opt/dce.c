@@ -12,8 +12,15 @@ static int is_used(CFG *cfg, IRValue v) {
     BasicBlock *b = cfg->blocks[i];
     for (size_t j = 0; j < b->ninstrs; j++) {
       IRInstr *ins = b->instrs[j];
+      if (!ins) /* already removed by the current sweep */
+        continue;
       if ((ins->a.id == v.id || ins->b.id == v.id) && ins->op != IR_PHI)
         return 1;
+      if (ins->op == IR_CALL) {
+        for (size_t k = 0; k < ins->extra.call.nargs; k++)
+          if (ins->extra.call.args[k].id == v.id)
+            return 1;
+      }
     }
   }
   return 0;
@@ -47,6 +54,7 @@ bool dce(CFG *cfg) {
       case IR_NE:
       case IR_MOV:
         if (!is_used(cfg, ins->dst)) {
+          b->instrs[j] = NULL;
           free(ins);
           changed = true;
           continue;
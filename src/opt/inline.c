@@ -23,6 +23,8 @@ FunctionTable *function_table_new(void) {
     table->functions = NULL;
     table->nfunctions = 0;
     table->capacity = 0;
+    table->profiled = false;
+    table->hot_count = 0;
     return table;
 }
 
@@ -237,6 +239,12 @@ CFG *clone_cfg_for_inline(CFG *source, int var_offset,
         
         *cloned_bb = *src_bb; // Copy metadata
         cloned_bb->id += var_offset; // Rename block ID
+        cloned_bb->succ = NULL;
+        cloned_bb->pred = NULL;
+        cloned_bb->idom = NULL;
+        cloned_bb->df = NULL;
+        cloned_bb->ndf = 0;
+        cloned_bb->visited = 0;
         
         // Clone instructions
         cloned_bb->instrs = malloc(sizeof(IRInstr*) * src_bb->ninstrs);
@@ -293,8 +301,51 @@ CFG *clone_cfg_for_inline(CFG *source, int var_offset,
     return cloned;
 }
 
+/**
+ * @brief Returns an id above every value and block id used in a CFG.
+ * @param cfg Pointer to the control flow graph to scan.
+ * @return First id that is free for both values and blocks.
+ */
+static int next_free_id(CFG *cfg) {
+    int max = -1;
+    for (size_t i = 0; i < cfg->nblocks; i++) {
+        BasicBlock *bb = cfg->blocks[i];
+        if (bb->id > max) max = bb->id;
+        for (size_t j = 0; j < bb->ninstrs; j++) {
+            IRInstr *instr = bb->instrs[j];
+            if (instr->dst.id > max) max = instr->dst.id;
+            if (instr->a.id > max) max = instr->a.id;
+            if (instr->b.id > max) max = instr->b.id;
+            if (instr->op == IR_CALL) {
+                for (size_t k = 0; k < instr->extra.call.nargs; k++) {
+                    if (instr->extra.call.args[k].id > max)
+                        max = instr->extra.call.args[k].id;
+                }
+            }
+        }
+    }
+    return max + 1;
+}
+
+/**
+ * @brief Appends an instruction to the end of a basic block.
+ * @param bb Pointer to the basic block.
+ * @param instr Instruction to append.
+ */
+static void append_instr(BasicBlock *bb, IRInstr *instr) {
+    bb->instrs = realloc(bb->instrs, sizeof(IRInstr*) * (bb->ninstrs + 1));
+    bb->instrs[bb->ninstrs++] = instr;
+}
+
 /**
  * @brief Inlines a specific function at a call site.
+ *
+ * The call block is split after the call. The callee's parameters are bound
+ * to the arguments with moves, each return becomes a move into the call's
+ * destination followed by a jump to the continuation, and the call
+ * instruction itself is freed. Block ids are renumbered afterwards so they
+ * stay dense.
+ *
  * @param caller_cfg Pointer to the caller's CFG.
  * @param call_block Pointer to the block containing the call.
  * @param call_instr Pointer to the call instruction.
@@ -303,95 +354,100 @@ CFG *clone_cfg_for_inline(CFG *source, int var_offset,
  */
 bool inline_function_at_site(CFG *caller_cfg, BasicBlock *call_block, 
                              IRInstr *call_instr, FunctionInfo *callee) {
-    if (!callee->cfg || call_instr->op != IR_CALL) return false;
-    
-    // Create parameter mapping from arguments to parameters
-    IRValue *param_mapping = malloc(sizeof(IRValue) * callee->nparam);
-    for (size_t i = 0; i < callee->nparam; i++) {
-        if (i < call_instr->extra.call.nargs) {
-            param_mapping[i] = call_instr->extra.call.args[i];
-        } else {
-            param_mapping[i] = ir_const(0); // Default parameter value
-        }
-    }
-    
-    // Generate unique variable offset for inlined function
-    int var_offset = 1000; // Simple offset strategy
-    
-    // Clone the callee's CFG
-    CFG *inlined_cfg = clone_cfg_for_inline(callee->cfg, var_offset, 
-                                           param_mapping, callee->nparam);
+    if (!callee->cfg || call_instr->op != IR_CALL ||
+        callee->cfg == caller_cfg) return false;
     
     // Find call instruction position in block
-    size_t call_pos = 0;
+    size_t call_pos = call_block->ninstrs;
     for (size_t i = 0; i < call_block->ninstrs; i++) {
         if (call_block->instrs[i] == call_instr) {
             call_pos = i;
             break;
         }
     }
+    if (call_pos == call_block->ninstrs) return false;
     
-    // Split the call block at the call instruction
-    BasicBlock *after_call_block = malloc(sizeof(BasicBlock));
-    after_call_block->id = var_offset + 999;
-    after_call_block->ninstrs = call_block->ninstrs - call_pos - 1;
-    after_call_block->instrs = malloc(sizeof(IRInstr*) * after_call_block->ninstrs);
+    // Rename callee values and blocks above everything the caller uses
+    int var_offset = next_free_id(caller_cfg);
+    CFG *inlined_cfg = clone_cfg_for_inline(callee->cfg, var_offset, NULL, 0);
     
-    // Move instructions after call to new block
+    // Split the call block: the continuation takes the instructions after
+    // the call together with the outgoing edges
+    BasicBlock *after_call_block = calloc(1, sizeof(BasicBlock));
+    after_call_block->ninstrs = call_block->ninstrs - call_pos - 1;
+    after_call_block->instrs = malloc(sizeof(IRInstr*) *
+                                      (after_call_block->ninstrs + 1));
     for (size_t i = 0; i < after_call_block->ninstrs; i++) {
         after_call_block->instrs[i] = call_block->instrs[call_pos + 1 + i];
     }
-    
-    // Truncate call block before call instruction
+    after_call_block->succ = call_block->succ;
+    after_call_block->nsucc = call_block->nsucc;
+    for (size_t i = 0; i < after_call_block->nsucc; i++) {
+        BasicBlock *succ = after_call_block->succ[i];
+        for (size_t j = 0; j < succ->npred; j++) {
+            if (succ->pred[j] == call_block) succ->pred[j] = after_call_block;
+        }
+    }
+    call_block->succ = NULL;
+    call_block->nsucc = 0;
     call_block->ninstrs = call_pos;
-    call_block->instrs = realloc(call_block->instrs, 
-                                sizeof(IRInstr*) * call_pos);
-    
-    // Connect call block to inlined function entry
-    call_block->nsucc = 1;
-    call_block->succ = malloc(sizeof(BasicBlock*));
-    call_block->succ[0] = inlined_cfg->entry;
-    
-    // Add inlined CFG blocks to caller CFG
-    size_t old_nblocks = caller_cfg->nblocks;
-    caller_cfg->nblocks += inlined_cfg->nblocks + 1; // +1 for after_call_block
-    caller_cfg->blocks = realloc(caller_cfg->blocks, 
-                                sizeof(BasicBlock*) * caller_cfg->nblocks);
     
-    // Add inlined blocks
-    for (size_t i = 0; i < inlined_cfg->nblocks; i++) {
-        caller_cfg->blocks[old_nblocks + i] = inlined_cfg->blocks[i];
+    // Bind parameters to the call arguments and enter the inlined body
+    for (size_t i = 0; i < callee->nparam; i++) {
+        IRValue arg = i < call_instr->extra.call.nargs
+                          ? call_instr->extra.call.args[i]
+                          : ir_const(0); // Default parameter value
+        IRValue param = {.id = callee->params[i].id + var_offset};
+        append_instr(call_block, ir_instr_new(IR_MOV, param, arg, (IRValue){0}));
     }
+    append_instr(call_block, ir_instr_new(IR_JUMP, (IRValue){.id = -1},
+                                          (IRValue){0}, (IRValue){0}));
+    cfg_add_edge(call_block, inlined_cfg->entry);
     
-    // Add after-call block
-    caller_cfg->blocks[caller_cfg->nblocks - 1] = after_call_block;
-    
-    // Find and redirect return instructions to after-call block
+    // Turn returns into moves to the call result and jumps to the continuation
     for (size_t i = 0; i < inlined_cfg->nblocks; i++) {
         BasicBlock *bb = inlined_cfg->blocks[i];
         for (size_t j = 0; j < bb->ninstrs; j++) {
             IRInstr *instr = bb->instrs[j];
-            if (instr->op == IR_RETURN) {
-                // Replace return with move to call result variable
-                if (call_instr->dst.id != 0) { // Has return value
-                    instr->op = IR_MOV;
-                    instr->dst = call_instr->dst;
-                    // instr->a remains the return value
-                    instr->b = (IRValue){.id = 0}; // Unused
-                } else {
-                    // Void return - replace with NOP
-                    instr->op = IR_NOP;
-                }
-                
-                // Add jump to after-call block
-                bb->nsucc = 1;
-                bb->succ = malloc(sizeof(BasicBlock*));
-                bb->succ[0] = after_call_block;
+            if (instr->op != IR_RETURN) continue;
+            
+            if (call_instr->dst.id >= 0) { // Has return value
+                instr->op = IR_MOV;
+                instr->dst = call_instr->dst;
+                instr->b = (IRValue){.id = 0}; // Unused
+            } else {
+                instr->op = IR_NOP;
+            }
+            
+            // Anything after the return is unreachable
+            for (size_t k = j + 1; k < bb->ninstrs; k++) {
+                if (bb->instrs[k]->op == IR_CALL)
+                    free(bb->instrs[k]->extra.call.args);
+                free(bb->instrs[k]);
             }
+            bb->ninstrs = j + 1;
+            append_instr(bb, ir_instr_new(IR_JUMP, (IRValue){.id = -1},
+                                          (IRValue){0}, (IRValue){0}));
+            cfg_add_edge(bb, after_call_block);
+            break;
         }
     }
     
-    free(param_mapping);
+    // Add inlined blocks and the continuation to the caller
+    size_t old_nblocks = caller_cfg->nblocks;
+    caller_cfg->nblocks += inlined_cfg->nblocks + 1;
+    caller_cfg->blocks = realloc(caller_cfg->blocks, 
+                                sizeof(BasicBlock*) * caller_cfg->nblocks);
+    for (size_t i = 0; i < inlined_cfg->nblocks; i++) {
+        caller_cfg->blocks[old_nblocks + i] = inlined_cfg->blocks[i];
+    }
+    caller_cfg->blocks[caller_cfg->nblocks - 1] = after_call_block;
+    for (size_t i = 0; i < caller_cfg->nblocks; i++) {
+        caller_cfg->blocks[i]->id = (int)i;
+    }
+    
+    free(call_instr->extra.call.args);
+    free(call_instr);
     free(inlined_cfg->blocks); // Don't free individual blocks, they're now in caller
     free(inlined_cfg);
     
@@ -400,6 +456,12 @@ bool inline_function_at_site(CFG *caller_cfg, BasicBlock *call_block,
 
 /**
  * @brief Performs function inlining on a CFG.
+ *
+ * Only the calls present when the pass starts are considered. Calls that
+ * arrive with an inlined body were already rejected for the callee itself,
+ * so when functions are processed bottom-up over the call graph a single
+ * pass reaches the configured depth without re-expanding bodies.
+ *
  * @param cfg Pointer to the control flow graph to optimize.
  * @param table Pointer to the function table.
  * @param config Pointer to the inlining configuration.
@@ -410,38 +472,49 @@ bool inline_functions(CFG *cfg, FunctionTable *table, InlineConfig *config) {
     
     if (!config) config = (InlineConfig*)&default_config;
     
-    bool changed = false;
-    bool made_changes;
+    // The caller's entry, if the CFG belongs to a function in the table
+    FunctionInfo *caller = NULL;
+    for (size_t i = 0; i < table->nfunctions; i++) {
+        if (table->functions[i].cfg == cfg) caller = &table->functions[i];
+    }
     
-    // Iterate until no more inlining opportunities
-    do {
-        made_changes = false;
-        
-        // Scan all basic blocks for function calls
-        for (size_t i = 0; i < cfg->nblocks; i++) {
-            BasicBlock *bb = cfg->blocks[i];
-            
-            for (size_t j = 0; j < bb->ninstrs; j++) {
-                IRInstr *instr = bb->instrs[j];
-                
-                if (instr->op == IR_CALL) {
-                    FunctionInfo *callee = function_table_get(table, 
-                                                             instr->extra.call.func_id);
-                    
-                    if (callee && should_inline(callee, config, 0)) {
-                        if (inline_function_at_site(cfg, bb, instr, callee)) {
-                            made_changes = true;
-                            changed = true;
-                            // Restart scanning since CFG structure changed
-                            goto restart_scan;
-                        }
-                    }
-                }
+    // Collect call sites first; inlining splits blocks as it goes
+    size_t nsites = 0, cap = 0;
+    BasicBlock **site_blocks = NULL;
+    IRInstr **site_instrs = NULL;
+    for (size_t i = 0; i < cfg->nblocks; i++) {
+        BasicBlock *bb = cfg->blocks[i];
+        for (size_t j = 0; j < bb->ninstrs; j++) {
+            if (bb->instrs[j]->op != IR_CALL) continue;
+            if (nsites == cap) {
+                cap = cap ? cap * 2 : 8;
+                site_blocks = realloc(site_blocks, cap * sizeof(BasicBlock*));
+                site_instrs = realloc(site_instrs, cap * sizeof(IRInstr*));
             }
+            site_blocks[nsites] = bb;
+            site_instrs[nsites++] = bb->instrs[j];
         }
-        
-        restart_scan:;
-    } while (made_changes);
+    }
+    
+    // Visit sites last to first so splitting a block never moves a pending
+    // call out of the block recorded for it
+    bool changed = false;
+    for (size_t i = nsites; i-- > 0;) {
+        FunctionInfo *callee = function_table_get(table,
+                                                  site_instrs[i]->extra.call.func_id);
+        if (!callee || callee == caller ||
+            !should_inline(callee, config, callee->inline_depth)) continue;
+        if (inline_function_at_site(cfg, site_blocks[i], site_instrs[i], callee)) {
+            changed = true;
+            if (caller && caller->inline_depth < callee->inline_depth + 1)
+                caller->inline_depth = callee->inline_depth + 1;
+        }
+    }
+    free(site_blocks);
+    free(site_instrs);
+    
+    // The body grew, so its cost as a callee has to be recomputed
+    if (changed && caller) caller->inline_cost = 0;
     
     return changed;
 }
@@ -456,6 +529,8 @@ void function_table_free(FunctionTable *table) {
     for (size_t i = 0; i < table->nfunctions; i++) {
         free(table->functions[i].name);
         free(table->functions[i].params);
+        free(table->functions[i].globals);
+        free(table->functions[i].bound);
     }
     
     free(table->functions);
@@ -27,6 +27,14 @@ typedef struct {
     int inline_cost;        /**< Cached inline cost. */
     int call_count;         /**< Number of times this function is called. */
     bool is_recursive;      /**< True if function is recursive. */
+    int inline_depth;       /**< Longest chain of calls already inlined into the body. */
+    IRValue *globals;       /**< Program variables the body reads or writes. */
+    size_t nglobals;        /**< Number of entries in globals. */
+    bool is_pure;           /**< True if calls depend only on the arguments. */
+    bool exact;             /**< Lowered exactly, and so is every function it calls. */
+    int origin_id;          /**< For a specialization, the function it clones. */
+    IRValue *bound;         /**< For a specialization, the constants it binds, id 0
+                                 where a parameter is kept; NULL otherwise. */
 } FunctionInfo;
 
 /**
@@ -36,6 +44,8 @@ typedef struct {
     FunctionInfo *functions;  /**< Array of function metadata. */
     size_t nfunctions;       /**< Number of functions. */
     size_t capacity;         /**< Allocated capacity. */
+    bool profiled;           /**< call_count holds measured calls from a profile. */
+    int hot_count;           /**< Measured calls from which a function is hot. */
 } FunctionTable;
 
 /**
@@ -1,7 +1,11 @@
 #include "interprocedural.h"
 #include "../cfg/cfg.h"
 #include "../ir/ir.h"
+#include "../ir/lower.h"
 #include "inline.h"
+#include "sccp.h"
+#include "dce.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -61,9 +65,9 @@ void call_graph_add_edge(CallGraph *graph, int caller_id, int callee_id,
     graph->edges[caller_id] = edge;
     graph->edge_counts[caller_id]++;
     
-    // Update call count in function info
+    // Update call count in function info, unless a profile measured it
     FunctionInfo *callee = function_table_get(graph->functions, callee_id);
-    if (callee) {
+    if (callee && !graph->functions->profiled) {
         callee->call_count++;
     }
 }
@@ -129,8 +133,10 @@ void call_graph_detect_recursion(CallGraph *graph) {
     // Use DFS to detect cycles (strongly connected components)
     memset(graph->visited, 0, graph->functions->nfunctions * sizeof(bool));
     
+    // Every function gets its own search: a function already reached from an
+    // earlier start can still lie on a cycle of its own
     for (size_t i = 0; i < graph->functions->nfunctions; i++) {
-        if (!graph->visited[i]) {
+        {
             // Simple cycle detection: if we can reach ourselves, we're recursive
             bool *in_path = calloc(graph->functions->nfunctions, sizeof(bool));
             
@@ -192,30 +198,41 @@ FunctionSummary *build_function_summaries(CallGraph *graph) {
             for (size_t k = 0; k < bb->ninstrs; k++) {
                 IRInstr *instr = bb->instrs[k];
                 
-                switch (instr->op) {
-                    case IR_CALL:
-                        // Function calls potentially have side effects
+                if (instr->op == IR_CALL) {
+                    // Calls within the program are settled by
+                    // identify_pure_functions(); anything else leaves it
+                    int callee = instr->extra.call.func_id;
+                    if (callee != IR_CALL_OPAQUE &&
+                        (callee < 0 || callee >= (int)graph->functions->nfunctions)) {
+                        summary->calls_external = true;
                         summary->is_pure = false;
-                        // Check if calling external function
-                        if (instr->extra.call.func_id >= (int)graph->functions->nfunctions) {
-                            summary->calls_external = true;
-                        }
-                        break;
-                    
-                    // Memory operations that might modify global state
-                    case IR_MOV:
-                        // Check if storing to global variable (simple heuristic)
-                        if (instr->dst.id < 100) { // Assume low IDs are globals
-                            summary->modifies_globals = true;
-                            summary->is_pure = false;
+                    }
+                }
+                
+                // Program variables are state shared with other functions
+                bool uses_a = instr->op != IR_NOP && instr->op != IR_JUMP &&
+                              instr->op != IR_CALL;
+                bool uses_b = instr->op >= IR_ADD && instr->op <= IR_NE;
+                for (size_t g = 0; g < func->nglobals; g++) {
+                    int id = func->globals[g].id;
+                    if (instr->dst.id == id) {
+                        summary->modifies_globals = true;
+                        summary->is_pure = false;
+                    }
+                    if ((uses_a && instr->a.id == id) || (uses_b && instr->b.id == id))
+                        summary->is_pure = false;
+                    if (instr->op == IR_CALL) {
+                        for (size_t a = 0; a < instr->extra.call.nargs; a++) {
+                            if (instr->extra.call.args[a].id == id)
+                                summary->is_pure = false;
                         }
-                        break;
-                    
-                    default:
-                        break;
+                    }
                 }
             }
         }
+        
+        summary->has_constant_return =
+            function_constant_return(func, &summary->constant_return);
     }
     
     return summaries;
@@ -323,6 +340,412 @@ bool interprocedural_constant_propagation(CallGraph *graph, FunctionSummary *sum
     return changed;
 }
 
+/**
+ * @brief Checks whether every reachable return of a function yields one constant.
+ * @param func Pointer to the function info.
+ * @param value Receives the returned constant on success.
+ * @return true if the function always returns @p value, false otherwise.
+ */
+bool function_constant_return(FunctionInfo *func, IRValue *value) {
+    if (!func || !func->cfg || !func->cfg->entry) return false;
+    CFG *cfg = func->cfg;
+    
+    for (size_t i = 0; i < cfg->nblocks; i++) cfg->blocks[i]->visited = 0;
+    BasicBlock **stack = malloc(sizeof(BasicBlock*) * (cfg->nblocks + 1));
+    size_t top = 0;
+    stack[top++] = cfg->entry;
+    cfg->entry->visited = 1;
+    
+    bool found = false, constant = true;
+    while (top > 0 && constant) {
+        BasicBlock *bb = stack[--top];
+        bool returns = false;
+        for (size_t j = 0; j < bb->ninstrs && !returns; j++) {
+            IRInstr *instr = bb->instrs[j];
+            if (instr->op != IR_RETURN) continue;
+            returns = true;
+            if (!ir_is_const(instr->a) || (found && instr->a.id != value->id)) {
+                constant = false;
+            } else {
+                *value = instr->a;
+                found = true;
+            }
+        }
+        if (returns) continue;
+        for (size_t j = 0; j < bb->nsucc; j++) {
+            if (!bb->succ[j]->visited) {
+                bb->succ[j]->visited = 1;
+                stack[top++] = bb->succ[j];
+            }
+        }
+    }
+    
+    for (size_t i = 0; i < cfg->nblocks; i++) cfg->blocks[i]->visited = 0;
+    free(stack);
+    return found && constant;
+}
+
+/**
+ * @brief Checks whether a block lies on a cycle of its CFG.
+ * @param cfg Pointer to the control flow graph.
+ * @param start Block to test.
+ * @return true if @p start can reach itself, false otherwise.
+ */
+static bool block_in_loop(CFG *cfg, BasicBlock *start) {
+    for (size_t i = 0; i < cfg->nblocks; i++) cfg->blocks[i]->visited = 0;
+    BasicBlock **stack = malloc(sizeof(BasicBlock*) * (cfg->nblocks + 1));
+    size_t top = 0;
+    bool found = false;
+    
+    for (size_t i = 0; i < start->nsucc; i++) {
+        if (!start->succ[i]->visited) {
+            start->succ[i]->visited = 1;
+            stack[top++] = start->succ[i];
+        }
+    }
+    while (top > 0 && !found) {
+        BasicBlock *bb = stack[--top];
+        if (bb == start) {
+            found = true;
+            break;
+        }
+        for (size_t i = 0; i < bb->nsucc; i++) {
+            if (!bb->succ[i]->visited) {
+                bb->succ[i]->visited = 1;
+                stack[top++] = bb->succ[i];
+            }
+        }
+    }
+    
+    for (size_t i = 0; i < cfg->nblocks; i++) cfg->blocks[i]->visited = 0;
+    free(stack);
+    return found;
+}
+
+/**
+ * @brief Checks whether a specialization binds the same constants as a call.
+ * @param spec Pointer to the specialization.
+ * @param origin_id ID of the called function.
+ * @param call Pointer to the call instruction.
+ * @return true if the call can use the specialization, false otherwise.
+ */
+static bool specialization_matches(Specialization *spec, int origin_id, IRInstr *call) {
+    if (spec->origin_id != origin_id || spec->nargs != call->extra.call.nargs) return false;
+    for (size_t i = 0; i < spec->nargs; i++) {
+        IRValue arg = call->extra.call.args[i];
+        IRValue bound = spec->args[i];
+        if (ir_is_const(arg) != ir_is_const(bound)) return false;
+        if (ir_is_const(arg) && arg.id != bound.id) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Clones a function with the constant arguments of a call bound.
+ * @param table Pointer to the function table.
+ * @param origin_id ID of the function to clone.
+ * @param call Call instruction supplying the constants.
+ * @param serial Number of clones already made of this function.
+ * @return ID of the new function.
+ */
+static int create_specialization(FunctionTable *table, int origin_id,
+                                 IRInstr *call, int serial) {
+    FunctionInfo *origin = function_table_get(table, origin_id);
+    CFG *clone = clone_cfg_for_inline(origin->cfg, 0, NULL, 0);
+    
+    // Bind constant parameters in a new entry block so SCCP can fold them
+    int max_id = -1;
+    for (size_t i = 0; i < clone->nblocks; i++) {
+        if (clone->blocks[i]->id > max_id) max_id = clone->blocks[i]->id;
+    }
+    BasicBlock *old_entry = clone->entry;
+    clone->entry = NULL;
+    BasicBlock *bind = cfg_add_block(clone);
+    bind->id = max_id + 1;
+    
+    IRValue *params = malloc(sizeof(IRValue) * (origin->nparam + 1));
+    size_t nparam = 0;
+    for (size_t i = 0; i < origin->nparam; i++) {
+        IRValue arg = call->extra.call.args[i];
+        if (ir_is_const(arg)) {
+            IRInstr *mov = ir_instr_new(IR_MOV, origin->params[i], arg, (IRValue){0});
+            bind->instrs = realloc(bind->instrs, sizeof(IRInstr*) * (bind->ninstrs + 1));
+            bind->instrs[bind->ninstrs++] = mov;
+        } else {
+            params[nparam++] = origin->params[i];
+        }
+    }
+    IRInstr *jump = ir_instr_new(IR_JUMP, (IRValue){.id = -1}, (IRValue){0}, (IRValue){0});
+    bind->instrs = realloc(bind->instrs, sizeof(IRInstr*) * (bind->ninstrs + 1));
+    bind->instrs[bind->ninstrs++] = jump;
+    cfg_add_edge(bind, old_entry);
+    
+    for (int i = 0; i < 8; i++) {
+        bool changed = sccp(clone);
+        changed |= dce(clone);
+        if (!changed) break;
+    }
+    cfg_compute_dominators(clone);
+    
+    FunctionInfo info;
+    memset(&info, 0, sizeof(info));
+    size_t len = strlen(origin->name) + 16;
+    info.name = malloc(len);
+    snprintf(info.name, len, "%s.spec%d", origin->name, serial);
+    info.cfg = clone;
+    info.params = params;
+    info.nparam = nparam;
+    info.return_val = (IRValue){.id = -1};
+    info.inline_depth = origin->inline_depth;
+    info.is_pure = origin->is_pure;
+    info.exact = origin->exact;
+    info.origin_id = origin_id;
+    info.bound = malloc(sizeof(IRValue) * (origin->nparam + 1));
+    for (size_t i = 0; i < origin->nparam; i++) {
+        IRValue arg = call->extra.call.args[i];
+        info.bound[i] = ir_is_const(arg) ? arg : (IRValue){.id = 0};
+    }
+    if (origin->nglobals) {
+        info.globals = malloc(sizeof(IRValue) * origin->nglobals);
+        memcpy(info.globals, origin->globals, sizeof(IRValue) * origin->nglobals);
+        info.nglobals = origin->nglobals;
+    }
+    return function_table_add(table, &info);
+}
+
+/**
+ * @brief Checks whether a function body contains any call.
+ * @param func Pointer to the function info.
+ * @return true if the body has no IR_CALL, false otherwise.
+ */
+static bool has_no_calls(FunctionInfo *func) {
+    for (size_t i = 0; i < func->cfg->nblocks; i++) {
+        BasicBlock *bb = func->cfg->blocks[i];
+        for (size_t j = 0; j < bb->ninstrs; j++) {
+            if (bb->instrs[j]->op == IR_CALL) return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Specializes the calls of one function that pass constant arguments.
+ * @param table Function table holding every function of the program.
+ * @param caller_id ID of the function whose call sites are rewritten.
+ * @param cache Specializations shared across callers.
+ * @param config Specialization limits.
+ * @return true if the caller was modified, false otherwise.
+ */
+bool specialize_call_sites(FunctionTable *table, int caller_id,
+                           SpecializationCache *cache,
+                           const SpecializeConfig *config) {
+    FunctionInfo *caller = function_table_get(table, caller_id);
+    if (!caller || !caller->cfg) return false;
+    CFG *cfg = caller->cfg;
+    bool changed = false;
+    
+    for (size_t i = 0; i < cfg->nblocks; i++) {
+        BasicBlock *bb = cfg->blocks[i];
+        for (size_t j = 0; j < bb->ninstrs; j++) {
+            IRInstr *call = bb->instrs[j];
+            if (call->op != IR_CALL || call->extra.call.func_id == caller_id) continue;
+            FunctionInfo *callee = function_table_get(table, call->extra.call.func_id);
+            if (!callee || !callee->cfg) continue;
+            
+            bool has_const = false;
+            for (size_t k = 0; k < call->extra.call.nargs; k++) {
+                if (ir_is_const(call->extra.call.args[k])) has_const = true;
+            }
+            if (has_const && !callee->is_recursive &&
+                call->extra.call.nargs == callee->nparam &&
+                (!config->hot_only || block_in_loop(cfg, bb))) {
+                int origin_id = call->extra.call.func_id;
+                int clone_id = -1, serial = 0;
+                for (size_t k = 0; k < cache->count; k++) {
+                    Specialization *spec = &cache->items[k];
+                    if (spec->origin_id == origin_id) serial++;
+                    if (specialization_matches(spec, origin_id, call)) {
+                        clone_id = spec->clone_id;
+                    }
+                }
+                if (callee->inline_cost == 0) calculate_inline_cost(callee);
+                if (clone_id < 0 && serial < config->max_clones &&
+                    callee->inline_cost <= config->max_clone_cost) {
+                    clone_id = create_specialization(table, origin_id, call, serial);
+                    if (cache->count == cache->capacity) {
+                        cache->capacity = cache->capacity ? cache->capacity * 2 : 8;
+                        cache->items = realloc(cache->items,
+                                               cache->capacity * sizeof(Specialization));
+                    }
+                    Specialization *spec = &cache->items[cache->count++];
+                    spec->origin_id = origin_id;
+                    spec->clone_id = clone_id;
+                    spec->nargs = call->extra.call.nargs;
+                    spec->args = malloc(sizeof(IRValue) * (spec->nargs + 1));
+                    for (size_t k = 0; k < spec->nargs; k++) {
+                        IRValue arg = call->extra.call.args[k];
+                        spec->args[k] = ir_is_const(arg) ? arg : (IRValue){.id = 0};
+                    }
+                }
+                if (clone_id >= 0) {
+                    // Drop the bound arguments and call the clone
+                    size_t nargs = 0;
+                    for (size_t k = 0; k < call->extra.call.nargs; k++) {
+                        if (!ir_is_const(call->extra.call.args[k]))
+                            call->extra.call.args[nargs++] = call->extra.call.args[k];
+                    }
+                    call->extra.call.nargs = nargs;
+                    call->extra.call.func_id = clone_id;
+                    changed = true;
+                }
+            }
+            
+            // Substitute a constant result; the table may have grown above
+            FunctionInfo *target = function_table_get(table, call->extra.call.func_id);
+            IRValue result;
+            if (!function_constant_return(target, &result)) continue;
+            if (has_no_calls(target)) {
+                free(call->extra.call.args);
+                call->extra.call.args = NULL;
+                call->extra.call.nargs = 0;
+                call->op = IR_MOV;
+                call->a = result;
+                call->b = (IRValue){0};
+                if (call->dst.id < 0) call->op = IR_NOP;
+                changed = true;
+            } else if (call->dst.id >= 0) {
+                // Keep the call for its side effects
+                IRInstr *mov = ir_instr_new(IR_MOV, call->dst, result, (IRValue){0});
+                call->dst = (IRValue){.id = -1};
+                bb->instrs = realloc(bb->instrs, sizeof(IRInstr*) * (bb->ninstrs + 1));
+                memmove(&bb->instrs[j + 2], &bb->instrs[j + 1],
+                        sizeof(IRInstr*) * (bb->ninstrs - j - 1));
+                bb->instrs[j + 1] = mov;
+                bb->ninstrs++;
+                changed = true;
+            }
+        }
+    }
+    
+    return changed;
+}
+
+/**
+ * @brief Frees the specializations recorded in a cache.
+ * @param cache Pointer to the cache; the struct itself is not freed.
+ */
+void specialization_cache_free(SpecializationCache *cache) {
+    for (size_t i = 0; i < cache->count; i++) {
+        free(cache->items[i].args);
+    }
+    free(cache->items);
+    cache->items = NULL;
+    cache->count = cache->capacity = 0;
+}
+
+/**
+ * @brief Finds the index of a self tail call in a block.
+ * @param bb Block to scan.
+ * @param func_id ID of the function owning the block.
+ * @param nparam Number of parameters of that function.
+ * @return Index of a call whose result is returned right away, or -1.
+ */
+static int find_self_tail_call(BasicBlock *bb, int func_id, size_t nparam) {
+    if (bb->ninstrs < 2) return -1;
+    IRInstr *ret = bb->instrs[bb->ninstrs - 1];
+    if (ret->op != IR_RETURN || ret->a.id < 0) return -1;
+
+    size_t k = bb->ninstrs - 1;
+    while (k-- > 0 && bb->instrs[k]->op == IR_NOP) {}
+    if (k >= bb->ninstrs) return -1;
+    IRInstr *call = bb->instrs[k];
+    if (call->op != IR_CALL || call->extra.call.func_id != func_id ||
+        call->extra.call.nargs != nparam || call->dst.id != ret->a.id)
+        return -1;
+    return (int)k;
+}
+
+/**
+ * @brief Turns self tail calls into jumps back to the start of the function.
+ * @param func Pointer to the function info.
+ * @param func_id ID of @p func in the function table.
+ * @return true if any call was rewritten, false otherwise.
+ */
+bool eliminate_tail_recursion(FunctionInfo *func, int func_id) {
+    if (!func || !func->cfg || !func->is_recursive) return false;
+    CFG *cfg = func->cfg;
+    BasicBlock *header = NULL;
+    int next_id = -1;
+
+    size_t nblocks = cfg->nblocks;
+    for (size_t i = 0; i < nblocks; i++) {
+        BasicBlock *bb = cfg->blocks[i];
+        int k = find_self_tail_call(bb, func_id, func->nparam);
+        if (k < 0) continue;
+
+        if (!header) {
+            // The old entry becomes the loop header behind a fresh entry
+            int max_block = -1;
+            for (size_t j = 0; j < cfg->nblocks; j++) {
+                BasicBlock *b = cfg->blocks[j];
+                if (b->id > max_block) max_block = b->id;
+                for (size_t m = 0; m < b->ninstrs; m++) {
+                    IRInstr *ins = b->instrs[m];
+                    if (ins->dst.id > next_id) next_id = ins->dst.id;
+                    if (ins->a.id > next_id) next_id = ins->a.id;
+                    if (ins->b.id > next_id) next_id = ins->b.id;
+                    if (ins->op == IR_CALL) {
+                        for (size_t a = 0; a < ins->extra.call.nargs; a++) {
+                            if (ins->extra.call.args[a].id > next_id)
+                                next_id = ins->extra.call.args[a].id;
+                        }
+                    }
+                }
+            }
+            for (size_t j = 0; j < func->nparam; j++) {
+                if (func->params[j].id > next_id) next_id = func->params[j].id;
+            }
+            next_id++;
+
+            header = cfg->entry;
+            cfg->entry = NULL;
+            BasicBlock *entry = cfg_add_block(cfg);
+            entry->id = max_block + 1;
+            IRInstr *jump = ir_instr_new(IR_JUMP, (IRValue){.id = -1}, (IRValue){0}, (IRValue){0});
+            entry->instrs = malloc(sizeof(IRInstr*));
+            entry->instrs[0] = jump;
+            entry->ninstrs = 1;
+            cfg_add_edge(entry, header);
+        }
+
+        // Copy the arguments to temporaries first, since an argument may
+        // read a parameter that is reassigned before it
+        IRInstr *call = bb->instrs[k];
+        size_t nparam = func->nparam;
+        for (size_t j = k + 1; j < bb->ninstrs; j++) free(bb->instrs[j]);
+        bb->ninstrs = (size_t)k;
+        bb->instrs = realloc(bb->instrs, sizeof(IRInstr*) * (k + 2 * nparam + 1));
+        for (size_t j = 0; j < nparam; j++) {
+            IRValue tmp = {.id = next_id + (int)j};
+            bb->instrs[bb->ninstrs++] =
+                ir_instr_new(IR_MOV, tmp, call->extra.call.args[j], (IRValue){0});
+        }
+        for (size_t j = 0; j < nparam; j++) {
+            IRValue tmp = {.id = next_id + (int)j};
+            bb->instrs[bb->ninstrs++] =
+                ir_instr_new(IR_MOV, func->params[j], tmp, (IRValue){0});
+        }
+        next_id += (int)nparam;
+        bb->instrs[bb->ninstrs++] =
+            ir_instr_new(IR_JUMP, (IRValue){.id = -1}, (IRValue){0}, (IRValue){0});
+        free(call->extra.call.args);
+        free(call);
+        cfg_add_edge(bb, header);
+    }
+
+    return header != NULL;
+}
+
 /**
  * @brief Marks reachable functions from a given entry point.
  * @param graph Pointer to the call graph.
@@ -362,8 +785,8 @@ bool eliminate_dead_functions(CallGraph *graph, int entry_function_id) {
         if (!graph->visited[i]) {
             FunctionInfo *func = &graph->functions->functions[i];
             if (func->cfg) {
-                // Free the CFG to mark function as dead
-                // Note: In a real implementation, you'd want to properly free the CFG
+                // A function without a body is dead; its id stays valid
+                cfg_free(func->cfg);
                 func->cfg = NULL;
                 changed = true;
             }
@@ -412,8 +835,11 @@ void identify_pure_functions(CallGraph *graph, FunctionSummary *summaries) {
  * @return true if any optimizations were applied, false otherwise.
  */
 bool perform_escape_analysis(CallGraph *graph, FunctionSummary *summaries) {
+    // Class allocations are placed by the AST-level analysis in
+    // src/codegen/escape.c; this IR pass only looks for candidates.
     // This is a simplified escape analysis
     // In a full implementation, you'd track object allocations and their uses
+    (void)summaries;
     bool changed = false;
     
     for (size_t i = 0; i < graph->functions->nfunctions; i++) {
@@ -60,6 +60,34 @@ typedef struct {
     bool has_constant_return;       /**< True if function always returns constant. */
 } FunctionSummary;
 
+/**
+ * @brief Limits for call-site specialization.
+ */
+typedef struct {
+    int max_clone_cost;     /**< Largest callee, by inline cost, worth cloning. */
+    int max_clones;         /**< Clones allowed per original function. */
+    bool hot_only;          /**< Only specialize call sites inside loops. */
+} SpecializeConfig;
+
+/**
+ * @brief A clone of a function with some parameters bound to constants.
+ */
+typedef struct {
+    int origin_id;          /**< Function that was cloned. */
+    int clone_id;           /**< Function table id of the clone. */
+    IRValue *args;          /**< Bound constants, with id 0 for kept parameters. */
+    size_t nargs;           /**< Number of parameters of the original. */
+} Specialization;
+
+/**
+ * @brief Specializations created so far, reused by every call site they match.
+ */
+typedef struct {
+    Specialization *items;  /**< Array of specializations. */
+    size_t count;           /**< Number of specializations. */
+    size_t capacity;        /**< Allocated capacity. */
+} SpecializationCache;
+
 /**
  * @brief Creates a new call graph from a function table.
  * @param functions Pointer to the function table.
@@ -106,6 +134,56 @@ FunctionSummary *build_function_summaries(CallGraph *graph);
  */
 bool interprocedural_constant_propagation(CallGraph *graph, FunctionSummary *summaries);
 
+/**
+ * @brief Checks whether every reachable return of a function yields one constant.
+ * @param func Pointer to the function info.
+ * @param value Receives the returned constant on success.
+ * @return true if the function always returns @p value, false otherwise.
+ */
+bool function_constant_return(FunctionInfo *func, IRValue *value);
+
+/**
+ * @brief Specializes the calls of one function that pass constant arguments.
+ *
+ * A qualifying callee is cloned with the constant parameters bound in a new
+ * entry block, SCCP folds the clone, and the call is redirected to it with
+ * the constant arguments dropped. Afterwards, calls whose target always
+ * returns the same constant have their result replaced by that constant;
+ * targets without calls of their own are removed from the caller entirely.
+ * Clones are appended to @p table, so FunctionInfo pointers taken before
+ * the call may be stale afterwards.
+ *
+ * @param table Function table holding every function of the program.
+ * @param caller_id ID of the function whose call sites are rewritten.
+ * @param cache Specializations shared across callers.
+ * @param config Specialization limits.
+ * @return true if the caller was modified, false otherwise.
+ */
+bool specialize_call_sites(FunctionTable *table, int caller_id,
+                           SpecializationCache *cache,
+                           const SpecializeConfig *config);
+
+/**
+ * @brief Frees the specializations recorded in a cache.
+ * @param cache Pointer to the cache; the struct itself is not freed.
+ */
+void specialization_cache_free(SpecializationCache *cache);
+
+/**
+ * @brief Turns self tail calls into jumps back to the start of the function.
+ *
+ * A call to the function itself whose result is returned right away is
+ * replaced by moves of the arguments into the parameters and a jump to the
+ * old entry block, which a fresh entry block now precedes. The recursion
+ * becomes a loop the loop passes can work on. Only functions flagged by
+ * call_graph_detect_recursion() are considered.
+ *
+ * @param func Pointer to the function info.
+ * @param func_id ID of @p func in the function table.
+ * @return true if any call was rewritten, false otherwise.
+ */
+bool eliminate_tail_recursion(FunctionInfo *func, int func_id);
+
 /**
  * @brief Eliminates dead (unreachable) functions from the program.
  * @param graph Pointer to the call graph.
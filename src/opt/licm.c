@@ -1,6 +1,7 @@
 #include "licm.h"
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 /**
  * @brief Checks if a basic block dominates another basic block.
  *
@@ -196,12 +197,29 @@ static void hoist_loop(BasicBlock **loop, size_t n, BasicBlock *pre) {
       if (value_in_set(ins->b.id, defined, ndef) &&
           !value_in_set(ins->b.id, hoisted, nhoisted))
         continue;
+      // a value assigned more than once in the loop must stay in place
+      size_t ndefs = 0;
+      for (size_t k = 0; k < ndef; k++)
+        if (defined[k] == ins->dst.id)
+          ndefs++;
+      if (ndefs > 1)
+        continue;
       // alias check for stores would go here
       (void)may_alias;
+      // move the instruction itself in front of the preheader's terminator
+      // and leave a fresh NOP behind, so each instruction has one owner
       pre->instrs =
           realloc(pre->instrs, sizeof(IRInstr *) * (pre->ninstrs + 1));
-      pre->instrs[pre->ninstrs++] = ins;
-      ins->op = IR_NOP;
+      size_t at = pre->ninstrs;
+      if (at > 0 && (pre->instrs[at - 1]->op == IR_JUMP ||
+                     pre->instrs[at - 1]->op == IR_CJUMP))
+        at--;
+      memmove(&pre->instrs[at + 1], &pre->instrs[at],
+              sizeof(IRInstr *) * (pre->ninstrs - at));
+      pre->instrs[at] = ins;
+      pre->ninstrs++;
+      b->instrs[j] = ir_instr_new(IR_NOP, (IRValue){.id = -1}, (IRValue){0},
+                                  (IRValue){0});
       hoisted = realloc(hoisted, sizeof(int) * (nhoisted + 1));
       hoisted[nhoisted++] = ins->dst.id;
     }
@@ -331,6 +331,15 @@ static BasicBlock *clone_block_for_unroll(BasicBlock *original, int var_offset,
         if (!ir_is_const(cloned_instr->b)) {
             cloned_instr->b.id += var_offset + iteration * 100;
         }
+        if (orig_instr->op == IR_CALL && orig_instr->extra.call.nargs > 0) {
+            size_t nargs = orig_instr->extra.call.nargs;
+            cloned_instr->extra.call.args = malloc(nargs * sizeof(IRValue));
+            for (size_t k = 0; k < nargs; k++) {
+                IRValue arg = orig_instr->extra.call.args[k];
+                if (!ir_is_const(arg)) arg.id += var_offset + iteration * 100;
+                cloned_instr->extra.call.args[k] = arg;
+            }
+        }
         
         cloned->instrs[i] = cloned_instr;
     }
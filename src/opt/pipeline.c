@@ -8,8 +8,20 @@
 #include "peephole.h"
 #include "inline.h"
 #include "loop_opt.h"
+#include "vrp.h"
+#include "interprocedural.h"
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Upper bound on fixpoint iterations at -O2 and above.
+ *
+ * Some loop passes report a change whenever they find a candidate loop, so
+ * the pipeline would otherwise never settle on programs containing loops.
+ */
+#define PIPELINE_MAX_ITERATIONS 8
+
 /**
  * @brief Executes a series of optimization passes on a control flow graph (CFG).
  *
@@ -38,6 +50,11 @@ static bool remove_unreachable(CFG *cfg) {
     for (size_t i = 0; i < cfg->nblocks; i++) {
         BasicBlock *b = cfg->blocks[i];
         if (!b->visited) {
+            for (size_t j = 0; j < b->ninstrs; j++) {
+                if (b->instrs[j]->op == IR_CALL)
+                    free(b->instrs[j]->extra.call.args);
+                free(b->instrs[j]);
+            }
             free(b->instrs);
             free(b->succ);
             free(b->pred);
@@ -48,15 +65,29 @@ static bool remove_unreachable(CFG *cfg) {
         cfg->blocks[w++] = b;
     }
     cfg->nblocks = w;
-    return changed;
+    if (!changed) return false;
+    // Drop edges coming from the removed blocks
+    for (size_t i = 0; i < cfg->nblocks; i++) {
+        BasicBlock *b = cfg->blocks[i];
+        size_t np = 0;
+        for (size_t j = 0; j < b->npred; j++) {
+            if (b->pred[j]->visited)
+                b->pred[np++] = b->pred[j];
+        }
+        b->npred = np;
+    }
+    return true;
 }
 
 void run_pipeline(CFG *cfg, int opt_level) {
     if (!cfg || opt_level <= 0) return;
     bool changed;
+    int iterations = 0;
     do {
         changed = false;
         changed |= sccp(cfg);
+        if (opt_level >= 2)
+            changed |= vrp(cfg);
         changed |= remove_unreachable(cfg);
         changed |= dce(cfg);
         changed |= copy_propagation(cfg);
@@ -77,34 +108,40 @@ void run_pipeline(CFG *cfg, int opt_level) {
         
         changed |= licm(cfg);
         changed |= peephole(cfg);
-    } while (opt_level >= 2 && changed);
+    } while (opt_level >= 2 && changed &&
+             ++iterations < PIPELINE_MAX_ITERATIONS);
 }
 
 void run_pipeline_with_inlining(CFG *cfg, FunctionTable *func_table, int opt_level) {
     if (!cfg || opt_level <= 0) return;
     bool changed;
+    int iterations = 0;
     
     // Run initial optimization passes to clean up the IR before inlining
     sccp(cfg);
     remove_unreachable(cfg);
     dce(cfg);
     
+    // Inline once, before the aggressive passes. Callees were optimized
+    // first, so their bodies already contain whatever they inlined.
+    if (func_table) {
+        InlineConfig config = {
+            .max_inline_cost = opt_level >= 3 ? 150 : 100,
+            .max_inline_depth = opt_level >= 3 ? 5 : 3,
+            .inline_hot_only = func_table->profiled || opt_level <= 1,
+            .hot_threshold = func_table->profiled ? func_table->hot_count : 3
+        };
+        if (inline_functions(cfg, func_table, &config))
+            cfg_compute_dominators(cfg);
+    }
+    
     do {
         changed = false;
         
-        // Run inlining pass early, after basic optimizations but before aggressive ones
-        if (func_table && opt_level >= 1) {
-            InlineConfig config = {
-                .max_inline_cost = opt_level >= 3 ? 150 : 100,
-                .max_inline_depth = opt_level >= 3 ? 5 : 3,
-                .inline_hot_only = opt_level <= 1,
-                .hot_threshold = 3
-            };
-            changed |= inline_functions(cfg, func_table, &config);
-        }
-        
         // Standard optimization passes
         changed |= sccp(cfg);
+        if (opt_level >= 2)
+            changed |= vrp(cfg);
         changed |= remove_unreachable(cfg);
         changed |= dce(cfg);
         changed |= copy_propagation(cfg);
@@ -126,5 +163,89 @@ void run_pipeline_with_inlining(CFG *cfg, FunctionTable *func_table, int opt_lev
         changed |= licm(cfg);
         changed |= peephole(cfg);
         
-    } while (opt_level >= 2 && changed);
+    } while (opt_level >= 2 && changed &&
+             ++iterations < PIPELINE_MAX_ITERATIONS);
+}
+
+/**
+ * @brief Checks for calls the lowering could not resolve to a function.
+ *
+ * Such a call may target any method, so the call graph is incomplete and
+ * cannot prove a function dead.
+ */
+static bool has_unresolved_calls(FunctionTable *table) {
+    for (size_t i = 0; i < table->nfunctions; i++) {
+        CFG *cfg = table->functions[i].cfg;
+        if (!cfg) continue;
+        for (size_t j = 0; j < cfg->nblocks; j++) {
+            BasicBlock *b = cfg->blocks[j];
+            for (size_t k = 0; k < b->ninstrs; k++) {
+                IRInstr *ins = b->instrs[k];
+                if (ins->op == IR_CALL &&
+                    ins->extra.call.func_id == IR_CALL_UNRESOLVED)
+                    return true;
+            }
+        }
+    }
+    return false;
+}
+
+void run_pipeline_on_program(FunctionTable *table, int opt_level) {
+    if (!table || opt_level <= 0) return;
+    
+    // The graph's call sites go stale once inlining rewrites the bodies, so
+    // only the ordering and the recursion flags are kept
+    CallGraph *graph = call_graph_new(table);
+    
+    // Drop the bodies of functions the entry point never calls
+    int entry = -1;
+    for (size_t i = 0; i < table->nfunctions && entry < 0; i++) {
+        const char *name = table->functions[i].name;
+        const char *dot = name ? strrchr(name, '.') : NULL;
+        if (name && strcmp(dot ? dot + 1 : name, "main") == 0)
+            entry = (int)i;
+    }
+    if (entry >= 0 && !has_unresolved_calls(table))
+        eliminate_dead_functions(graph, entry);
+    
+    call_graph_detect_recursion(graph);
+    
+    // Purity is judged on the bodies as written, before inlining merges them
+    FunctionSummary *summaries = build_function_summaries(graph);
+    identify_pure_functions(graph, summaries);
+    for (size_t i = 0; i < table->nfunctions; i++)
+        table->functions[i].is_pure = table->functions[i].cfg &&
+                                      summaries[i].is_pure &&
+                                      !summaries[i].calls_external;
+    function_summaries_free(summaries, table->nfunctions);
+    
+    call_graph_topological_sort(graph);
+    size_t n = table->nfunctions;
+    int *order = malloc(n * sizeof(int));
+    memcpy(order, graph->topo_order, n * sizeof(int));
+    call_graph_free(graph);
+    
+    SpecializeConfig spec_config = {
+        .max_clone_cost = opt_level >= 3 ? 150 : 100,
+        .max_clones = 4,
+        .hot_only = opt_level < 3
+    };
+    SpecializationCache specializations = {0};
+    
+    // Callees before callers
+    for (size_t i = n; i-- > 0;) {
+        if (opt_level >= 2)
+            specialize_call_sites(table, order[i], &specializations, &spec_config);
+        // Specialization may have grown the table
+        FunctionInfo *func = function_table_get(table, order[i]);
+        if (!func || !func->cfg) continue;
+        if (eliminate_tail_recursion(func, order[i]))
+            cfg_compute_dominators(func->cfg);
+        // Code a profile never saw run is not worth the aggressive passes
+        bool cold = table->profiled && func->call_count == 0;
+        run_pipeline_with_inlining(func->cfg, table, cold ? 1 : opt_level);
+        func->inline_cost = 0;
+    }
+    specialization_cache_free(&specializations);
+    free(order);
 }
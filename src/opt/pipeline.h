@@ -29,4 +29,16 @@ void run_pipeline(CFG *cfg, int opt_level);
  */
 void run_pipeline_with_inlining(CFG *cfg, FunctionTable *func_table, int opt_level);
 
+/**
+ * @brief Optimizes every function of a program bottom-up over the call graph.
+ *
+ * Callees are optimized before their callers, so a caller inlines bodies that
+ * have already been simplified and reaches the configured inlining depth in
+ * a single pass.
+ *
+ * @param table Function table holding one CFG per function.
+ * @param opt_level Optimization level (0-3).
+ */
+void run_pipeline_on_program(FunctionTable *table, int opt_level);
+
 #endif
\ No newline at end of file
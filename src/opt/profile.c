@@ -0,0 +1,151 @@
+#include "profile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Hashes the fields that identify a site.
+ */
+static size_t site_hash(ProfileKind kind, const char *func, size_t line,
+                        size_t column, const char *callee) {
+    unsigned long long h = 1469598103934665603ULL ^ (unsigned)kind;
+    for (const char *s = func; *s; s++)
+        h = (h ^ (unsigned char)*s) * 1099511628211ULL;
+    if (callee) {
+        for (const char *s = callee; *s; s++)
+            h = (h ^ (unsigned char)*s) * 1099511628211ULL;
+    }
+    h = (h ^ line) * 1099511628211ULL;
+    h = (h ^ column) * 1099511628211ULL;
+    return (size_t)(h ^ (h >> 32));
+}
+
+static bool site_matches(const ProfileEntry *e, ProfileKind kind,
+                         const char *func, size_t line, size_t column,
+                         const char *callee) {
+    if (e->kind != kind || e->line != line || e->column != column ||
+        strcmp(e->func, func) != 0)
+        return false;
+    if (!callee || !e->callee) return !callee && !e->callee;
+    return strcmp(e->callee, callee) == 0;
+}
+
+/**
+ * @brief Builds the lookup table once every entry has been read.
+ */
+static void build_index(Profile *profile) {
+    size_t size = 16;
+    while (size < profile->count * 2) size <<= 1;
+    profile->index = calloc(size, sizeof(size_t));
+    profile->index_mask = size - 1;
+    for (size_t i = 0; i < profile->count; i++) {
+        ProfileEntry *e = &profile->entries[i];
+        size_t slot = site_hash(e->kind, e->func, e->line, e->column, e->callee) &
+                      profile->index_mask;
+        while (profile->index[slot]) {
+            // A site recorded twice keeps the sum of its counts
+            ProfileEntry *other = &profile->entries[profile->index[slot] - 1];
+            if (site_matches(other, e->kind, e->func, e->line, e->column, e->callee)) {
+                other->count[0] += e->count[0];
+                other->count[1] += e->count[1];
+                break;
+            }
+            slot = (slot + 1) & profile->index_mask;
+        }
+        if (!profile->index[slot]) profile->index[slot] = i + 1;
+    }
+}
+
+static void add_entry(Profile *profile, ProfileEntry entry) {
+    if (profile->count == profile->capacity) {
+        profile->capacity = profile->capacity ? profile->capacity * 2 : 64;
+        profile->entries = realloc(profile->entries,
+                                   profile->capacity * sizeof(ProfileEntry));
+    }
+    profile->entries[profile->count++] = entry;
+    if (entry.kind == PROFILE_FUNC && entry.count[0] > profile->max_func_count)
+        profile->max_func_count = entry.count[0];
+}
+
+Profile *profile_load(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) return NULL;
+
+    char line[1024];
+    if (!fgets(line, sizeof(line), f) || strncmp(line, "drprof 1", 8) != 0) {
+        fclose(f);
+        return NULL;
+    }
+
+    Profile *profile = calloc(1, sizeof(Profile));
+    char kind[16], func[256], callee[256];
+    while (fgets(line, sizeof(line), f)) {
+        ProfileEntry e;
+        memset(&e, 0, sizeof(e));
+        if (sscanf(line, "%15s", kind) != 1) continue;
+        if (strcmp(kind, "func") == 0 &&
+            sscanf(line, "func %255s %llu", func, &e.count[0]) == 2) {
+            e.kind = PROFILE_FUNC;
+        } else if (strcmp(kind, "call") == 0 &&
+                   sscanf(line, "call %255s %zu %zu %255s %llu", func, &e.line,
+                          &e.column, callee, &e.count[0]) == 5) {
+            e.kind = PROFILE_CALL;
+            e.callee = strdup(callee);
+        } else if (strcmp(kind, "branch") == 0 &&
+                   sscanf(line, "branch %255s %zu %zu %llu %llu", func, &e.line,
+                          &e.column, &e.count[0], &e.count[1]) == 5) {
+            e.kind = PROFILE_BRANCH;
+        } else {
+            continue; // Unknown records are skipped for forward compatibility
+        }
+        e.func = strdup(func);
+        add_entry(profile, e);
+    }
+    fclose(f);
+
+    build_index(profile);
+    return profile;
+}
+
+void profile_free(Profile *profile) {
+    if (!profile) return;
+    for (size_t i = 0; i < profile->count; i++) {
+        free(profile->entries[i].func);
+        free(profile->entries[i].callee);
+    }
+    free(profile->entries);
+    free(profile->index);
+    free(profile);
+}
+
+const ProfileEntry *profile_lookup(const Profile *profile, ProfileKind kind,
+                                   const char *func, size_t line,
+                                   size_t column, const char *callee) {
+    if (!profile || !profile->index) return NULL;
+    size_t slot = site_hash(kind, func, line, column, callee) & profile->index_mask;
+    while (profile->index[slot]) {
+        const ProfileEntry *e = &profile->entries[profile->index[slot] - 1];
+        if (site_matches(e, kind, func, line, column, callee)) return e;
+        slot = (slot + 1) & profile->index_mask;
+    }
+    return NULL;
+}
+
+unsigned long long profile_calls_to(const Profile *profile, const char *callee) {
+    unsigned long long total = 0;
+    if (!profile || !profile->index) return 0;
+    // Duplicates were folded into the indexed entry, so only count those
+    for (size_t slot = 0; slot <= profile->index_mask; slot++) {
+        if (!profile->index[slot]) continue;
+        const ProfileEntry *e = &profile->entries[profile->index[slot] - 1];
+        if (e->kind == PROFILE_CALL && strcmp(e->callee, callee) == 0)
+            total += e->count[0];
+    }
+    return total;
+}
+
+unsigned long long profile_hot_threshold(const Profile *profile) {
+    if (!profile) return 1;
+    unsigned long long threshold = profile->max_func_count / 100;
+    return threshold ? threshold : 1;
+}
@@ -0,0 +1,102 @@
+/**
+ * @file profile.h
+ * @brief Execution profiles recorded by --profile-generate builds.
+ *
+ * An instrumented program writes a `.drprof` text file when it exits. Each
+ * line after the `drprof 1` header records one counter site:
+ *
+ *     func <function> <entries>
+ *     call <caller> <line> <ordinal> <callee> <count>
+ *     branch <function> <line> <column> <taken> <not-taken>
+ *
+ * Functions are named as in the function table ("name" or "Type.name", with
+ * the top-level statements as "main"). Call sites are numbered in source
+ * order within their line. Loop conditions are recorded as branches, so
+ * `taken` counts iterations and `not-taken` counts loop exits.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Kind of a recorded counter site.
+ */
+typedef enum {
+    PROFILE_FUNC,       /**< Function entries. */
+    PROFILE_CALL,       /**< Executions of one call site. */
+    PROFILE_BRANCH      /**< Outcomes of one condition. */
+} ProfileKind;
+
+/**
+ * @brief One counter site read from a profile.
+ */
+typedef struct {
+    ProfileKind kind;   /**< Kind of site. */
+    char *func;         /**< Function containing the site. */
+    size_t line;        /**< Source line, 0 for PROFILE_FUNC. */
+    size_t column;      /**< Column for branches, ordinal for calls. */
+    char *callee;       /**< Called function for PROFILE_CALL, else NULL. */
+    unsigned long long count[2]; /**< Count, or taken/not-taken for branches. */
+} ProfileEntry;
+
+/**
+ * @brief A loaded profile, indexed for lookup by site.
+ */
+typedef struct Profile {
+    ProfileEntry *entries;  /**< Array of sites. */
+    size_t count;           /**< Number of sites. */
+    size_t capacity;        /**< Allocated capacity. */
+    size_t *index;          /**< Open-addressing table of entry indices + 1. */
+    size_t index_mask;      /**< Index table size - 1. */
+    unsigned long long max_func_count; /**< Entries of the hottest function. */
+} Profile;
+
+/**
+ * @brief Reads a `.drprof` file.
+ * @param path Path of the profile.
+ * @return The profile, or NULL if the file is missing or malformed.
+ */
+Profile *profile_load(const char *path);
+
+/**
+ * @brief Frees a profile.
+ * @param profile Profile to free; may be NULL.
+ */
+void profile_free(Profile *profile);
+
+/**
+ * @brief Finds a site.
+ * @param profile Profile to search.
+ * @param kind Kind of site.
+ * @param func Function containing the site.
+ * @param line Source line (0 for functions).
+ * @param column Column or call ordinal (0 for functions).
+ * @param callee Called function for call sites, NULL otherwise.
+ * @return The entry, or NULL if the profile has no such site.
+ */
+const ProfileEntry *profile_lookup(const Profile *profile, ProfileKind kind,
+                                   const char *func, size_t line,
+                                   size_t column, const char *callee);
+
+/**
+ * @brief Sums the recorded calls of every call site targeting a function.
+ * @param profile Profile to search.
+ * @param callee Function name.
+ * @return Total number of calls.
+ */
+unsigned long long profile_calls_to(const Profile *profile, const char *callee);
+
+/**
+ * @brief Execution count from which a function or call site counts as hot.
+ *
+ * Hot means within two orders of magnitude of the hottest function.
+ *
+ * @param profile Profile to inspect.
+ * @return The threshold, at least 1.
+ */
+unsigned long long profile_hot_threshold(const Profile *profile);
+
+#endif
@@ -7,6 +7,7 @@
  */
 
 #include "sccp.h"
+#include <limits.h>
 #include <stdlib.h>
 
 // Simplified Sparse Conditional Constant Propagation implementation.
@@ -50,29 +51,36 @@ static int max_value_id(CFG *cfg) {
 
 static int is_binop(IROp op) { return op >= IR_ADD && op <= IR_NE; }
 
-static IRValue fold_bin(IROp op, IRValue a, IRValue b) {
+/*
+ * Folds a binary operation on two constants into *out, wrapping like the
+ * generated C. Fails where C would trap or leave the result undefined, and
+ * for INT_MIN, which has no constant encoding.
+ */
+static int fold_bin(IROp op, IRValue a, IRValue b, IRValue *out) {
   if (a.id >= 0 || b.id >= 0)
-    return (IRValue){0};
+    return 0;
   int lhs = -a.id - 1;
   int rhs = -b.id - 1;
   int res = 0;
   switch (op) {
   case IR_ADD:
-    res = lhs + rhs;
+    res = (int)((unsigned)lhs + (unsigned)rhs);
     break;
   case IR_SUB:
-    res = lhs - rhs;
+    res = (int)((unsigned)lhs - (unsigned)rhs);
     break;
   case IR_MUL:
-    res = lhs * rhs;
+    res = (int)((unsigned)lhs * (unsigned)rhs);
     break;
   case IR_DIV:
-    if (rhs)
-      res = lhs / rhs;
+    if (!rhs || (lhs == INT_MIN && rhs == -1))
+      return 0;
+    res = lhs / rhs;
     break;
   case IR_MOD:
-    if (rhs)
-      res = lhs % rhs;
+    if (!rhs || (lhs == INT_MIN && rhs == -1))
+      return 0;
+    res = lhs % rhs;
     break;
   case IR_AND:
     res = lhs & rhs;
@@ -84,9 +92,13 @@ static IRValue fold_bin(IROp op, IRValue a, IRValue b) {
     res = lhs ^ rhs;
     break;
   case IR_SHL:
-    res = lhs << rhs;
+    if (rhs < 0 || rhs > 31 || lhs < 0)
+      return 0;
+    res = (int)((unsigned)lhs << rhs);
     break;
   case IR_SHR:
+    if (rhs < 0 || rhs > 31)
+      return 0;
     res = lhs >> rhs;
     break;
   case IR_LT:
@@ -108,9 +120,12 @@ static IRValue fold_bin(IROp op, IRValue a, IRValue b) {
     res = lhs != rhs;
     break;
   default:
-    break;
+    return 0;
   }
-  return (IRValue){.id = -res - 1};
+  if (res == INT_MIN)
+    return 0;
+  *out = ir_const(res);
+  return 1;
 }
 
 bool sccp(CFG *cfg) {
@@ -121,15 +136,24 @@ bool sccp(CFG *cfg) {
   if (nvals <= 0)
     return false;
   LatticeVal *vals = calloc((size_t)nvals, sizeof(LatticeVal));
+  int *ndefs = calloc((size_t)nvals, sizeof(int));
+  IRValue c;
   for (size_t i = 0; i < cfg->nblocks; i++) {
     BasicBlock *b = cfg->blocks[i];
     for (size_t j = 0; j < b->ninstrs; j++) {
       IRInstr *ins = b->instrs[j];
+      if (ins->dst.id < 0 || ins->op == IR_NOP)
+        continue;
+      /* a variable assigned in several places has no single value */
+      if (ndefs[ins->dst.id]++ > 0) {
+        vals[ins->dst.id].kind = VAL_OVERDEF;
+        continue;
+      }
       if (ins->op == IR_MOV && ins->a.id < 0) {
         vals[ins->dst.id].kind = VAL_CONST;
         vals[ins->dst.id].value = -ins->a.id - 1;
-      } else if (is_binop(ins->op) && ins->a.id < 0 && ins->b.id < 0) {
-        IRValue c = fold_bin(ins->op, ins->a, ins->b);
+      } else if (is_binop(ins->op) && ins->a.id < 0 && ins->b.id < 0 &&
+                 fold_bin(ins->op, ins->a, ins->b, &c)) {
         vals[ins->dst.id].kind = VAL_CONST;
         vals[ins->dst.id].value = ir_const_value(c);
       } else {
@@ -141,7 +165,8 @@ bool sccp(CFG *cfg) {
     BasicBlock *b = cfg->blocks[i];
     for (size_t j = 0; j < b->ninstrs; j++) {
       IRInstr *ins = b->instrs[j];
-      if (ins->op == IR_MOV && vals[ins->dst.id].kind == VAL_CONST) {
+      if (ins->op == IR_MOV && ins->dst.id >= 0 &&
+          vals[ins->dst.id].kind == VAL_CONST) {
         int newv = -vals[ins->dst.id].value - 1;
         if (ins->a.id != newv) {
           ins->a.id = newv;
@@ -149,28 +174,43 @@ bool sccp(CFG *cfg) {
         }
       }
       if (is_binop(ins->op)) {
-        if (vals[ins->a.id].kind == VAL_CONST) {
+        if (ins->a.id >= 0 && vals[ins->a.id].kind == VAL_CONST) {
           int newv = -vals[ins->a.id].value - 1;
           if (ins->a.id != newv) {
             ins->a.id = newv;
             changed = true;
           }
         }
-        if (vals[ins->b.id].kind == VAL_CONST) {
+        if (ins->b.id >= 0 && vals[ins->b.id].kind == VAL_CONST) {
           int newv = -vals[ins->b.id].value - 1;
           if (ins->b.id != newv) {
             ins->b.id = newv;
             changed = true;
           }
         }
-        if (ins->a.id < 0 && ins->b.id < 0) {
-          IRValue c = fold_bin(ins->op, ins->a, ins->b);
+        if (ins->a.id < 0 && ins->b.id < 0 &&
+            fold_bin(ins->op, ins->a, ins->b, &c)) {
           ins->op = IR_MOV;
           ins->a = c;
           ins->b.id = 0;
           changed = true;
         }
       }
+      if ((ins->op == IR_CJUMP || ins->op == IR_RETURN) && ins->a.id >= 0 &&
+          ins->a.id < nvals && vals[ins->a.id].kind == VAL_CONST) {
+        ins->a.id = -vals[ins->a.id].value - 1;
+        changed = true;
+      }
+      if (ins->op == IR_CALL) {
+        for (size_t k = 0; k < ins->extra.call.nargs; k++) {
+          IRValue *arg = &ins->extra.call.args[k];
+          if (arg->id >= 0 && arg->id < nvals &&
+              vals[arg->id].kind == VAL_CONST) {
+            arg->id = -vals[arg->id].value - 1;
+            changed = true;
+          }
+        }
+      }
       if (ins->op == IR_CJUMP && ir_is_const(ins->a)) {
         int cond = ir_const_value(ins->a);
         BasicBlock *taken = cond ? b->succ[0] : b->succ[1];
@@ -192,6 +232,7 @@ bool sccp(CFG *cfg) {
       }
     }
   }
+  free(ndefs);
   free(vals);
   return changed;
 }
\ No newline at end of file
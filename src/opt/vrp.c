@@ -0,0 +1,662 @@
+/**
+ * @file vrp.c
+ * @brief Implementation of value-range analysis and propagation.
+ *
+ * The analysis is a forward interval dataflow over the CFG. Every block keeps
+ * the range of each value at its entry; conditional jumps refine the operands
+ * of the comparison feeding them along each outgoing edge. Loop headers (the
+ * targets of back edges) are widened after a few visits and a short
+ * narrowing phase recovers finite bounds afterwards. PHI nodes need no
+ * special handling because the ranges reaching a block are already joined at
+ * its entry.
+ */
+
+#include "vrp.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** @brief Number of ascending visits to a loop header before widening. */
+#define VRP_WIDEN_DELAY 2
+/** @brief Number of narrowing sweeps performed after the fixpoint. */
+#define VRP_NARROW_PASSES 2
+/** @brief Safety bound on ascending sweeps; the widening ensures convergence. */
+#define VRP_MAX_PASSES 64
+
+ValueRange range_full(void) {
+    return (ValueRange){.lo = INT_MIN, .hi = INT_MAX, .empty = false};
+}
+
+ValueRange range_const(long long v) {
+    return (ValueRange){.lo = v, .hi = v, .empty = false};
+}
+
+bool range_is_const(ValueRange r) {
+    return !r.empty && r.lo == r.hi;
+}
+
+/** @brief Returns the empty (unreachable) range. */
+static ValueRange range_empty(void) {
+    return (ValueRange){.lo = 0, .hi = 0, .empty = true};
+}
+
+/** @brief Builds a range, falling back to the full range on 32-bit overflow. */
+static ValueRange range_make(long long lo, long long hi) {
+    if (lo < INT_MIN || hi > INT_MAX || lo > hi)
+        return range_full();
+    return (ValueRange){.lo = lo, .hi = hi, .empty = false};
+}
+
+static bool range_equal(ValueRange a, ValueRange b) {
+    if (a.empty || b.empty)
+        return a.empty == b.empty;
+    return a.lo == b.lo && a.hi == b.hi;
+}
+
+ValueRange range_join(ValueRange a, ValueRange b) {
+    if (a.empty)
+        return b;
+    if (b.empty)
+        return a;
+    return (ValueRange){.lo = a.lo < b.lo ? a.lo : b.lo,
+                        .hi = a.hi > b.hi ? a.hi : b.hi,
+                        .empty = false};
+}
+
+ValueRange range_meet(ValueRange a, ValueRange b) {
+    if (a.empty || b.empty)
+        return range_empty();
+    long long lo = a.lo > b.lo ? a.lo : b.lo;
+    long long hi = a.hi < b.hi ? a.hi : b.hi;
+    if (lo > hi)
+        return range_empty();
+    return (ValueRange){.lo = lo, .hi = hi, .empty = false};
+}
+
+/** @brief Pushes every bound that grew since @p old to the type limits. */
+static ValueRange range_widen(ValueRange old, ValueRange cur) {
+    if (old.empty || cur.empty)
+        return cur;
+    ValueRange r = cur;
+    if (cur.lo < old.lo)
+        r.lo = INT_MIN;
+    if (cur.hi > old.hi)
+        r.hi = INT_MAX;
+    return r;
+}
+
+/** @brief Smallest 2^k - 1 that is >= v, for non-negative v. */
+static long long range_bit_mask(long long v) {
+    long long m = 0;
+    while (m < v)
+        m = (m << 1) | 1;
+    return m;
+}
+
+ValueRange range_binop(IROp op, ValueRange a, ValueRange b) {
+    if (a.empty || b.empty)
+        return range_empty();
+    switch (op) {
+    case IR_ADD:
+        return range_make(a.lo + b.lo, a.hi + b.hi);
+    case IR_SUB:
+        return range_make(a.lo - b.hi, a.hi - b.lo);
+    case IR_MUL: {
+        long long c[4] = {a.lo * b.lo, a.lo * b.hi, a.hi * b.lo, a.hi * b.hi};
+        long long lo = c[0], hi = c[0];
+        for (int i = 1; i < 4; i++) {
+            if (c[i] < lo) lo = c[i];
+            if (c[i] > hi) hi = c[i];
+        }
+        return range_make(lo, hi);
+    }
+    case IR_DIV: {
+        if (b.lo <= 0 && b.hi >= 0)
+            return range_full();
+        long long c[4] = {a.lo / b.lo, a.lo / b.hi, a.hi / b.lo, a.hi / b.hi};
+        long long lo = c[0], hi = c[0];
+        for (int i = 1; i < 4; i++) {
+            if (c[i] < lo) lo = c[i];
+            if (c[i] > hi) hi = c[i];
+        }
+        return range_make(lo, hi);
+    }
+    case IR_MOD: {
+        if (b.lo <= 0 && b.hi >= 0)
+            return range_full();
+        long long m = b.lo > 0 ? b.hi : -b.lo;
+        if (a.lo >= 0)
+            return range_make(0, a.hi < m - 1 ? a.hi : m - 1);
+        if (a.hi <= 0)
+            return range_make(a.lo > -(m - 1) ? a.lo : -(m - 1), 0);
+        return range_make(-(m - 1), m - 1);
+    }
+    case IR_AND:
+        if (a.lo >= 0 && b.lo >= 0)
+            return range_make(0, a.hi < b.hi ? a.hi : b.hi);
+        if (a.lo >= 0)
+            return range_make(0, a.hi);
+        if (b.lo >= 0)
+            return range_make(0, b.hi);
+        return range_full();
+    case IR_OR:
+    case IR_XOR:
+        if (a.lo >= 0 && b.lo >= 0)
+            return range_make(0, range_bit_mask(a.hi > b.hi ? a.hi : b.hi));
+        return range_full();
+    case IR_SHL:
+        if (b.lo >= 0 && b.hi < 31 && a.lo >= 0)
+            return range_make(a.lo << b.lo, a.hi << b.hi);
+        return range_full();
+    case IR_SHR:
+        if (b.lo >= 0 && b.hi < 32) {
+            if (a.lo >= 0)
+                return range_make(a.lo >> b.hi, a.hi >> b.lo);
+            return range_make(a.lo >> b.lo, a.hi >= 0 ? a.hi >> b.lo : a.hi >> b.hi);
+        }
+        return range_full();
+    case IR_LT:
+        if (a.hi < b.lo) return range_const(1);
+        if (a.lo >= b.hi) return range_const(0);
+        return range_make(0, 1);
+    case IR_LE:
+        if (a.hi <= b.lo) return range_const(1);
+        if (a.lo > b.hi) return range_const(0);
+        return range_make(0, 1);
+    case IR_GT:
+        if (a.lo > b.hi) return range_const(1);
+        if (a.hi <= b.lo) return range_const(0);
+        return range_make(0, 1);
+    case IR_GE:
+        if (a.lo >= b.hi) return range_const(1);
+        if (a.hi < b.lo) return range_const(0);
+        return range_make(0, 1);
+    case IR_EQ:
+        if (range_is_const(a) && range_is_const(b) && a.lo == b.lo)
+            return range_const(1);
+        if (a.hi < b.lo || b.hi < a.lo) return range_const(0);
+        return range_make(0, 1);
+    case IR_NE:
+        if (range_is_const(a) && range_is_const(b) && a.lo == b.lo)
+            return range_const(0);
+        if (a.hi < b.lo || b.hi < a.lo) return range_const(1);
+        return range_make(0, 1);
+    default:
+        return range_full();
+    }
+}
+
+/** @brief Reads the range of an operand from an environment. */
+static ValueRange env_get(const ValueRange *env, int nvals, IRValue v) {
+    if (ir_is_const(v))
+        return range_const(ir_const_value(v));
+    if (v.id >= nvals)
+        return range_full();
+    return env[v.id];
+}
+
+/**
+ * @brief Applies the effect of one instruction to an environment.
+ */
+static void transfer(ValueRange *env, int nvals, IRInstr *ins) {
+    if (ins->dst.id < 0 || ins->dst.id >= nvals)
+        return;
+    switch (ins->op) {
+    case IR_NOP:
+    case IR_PHI:
+    case IR_JUMP:
+    case IR_CJUMP:
+        return;
+    case IR_MOV:
+        env[ins->dst.id] = env_get(env, nvals, ins->a);
+        return;
+    default:
+        if (ins->op >= IR_ADD && ins->op <= IR_NE) {
+            env[ins->dst.id] = range_binop(ins->op, env_get(env, nvals, ins->a),
+                                           env_get(env, nvals, ins->b));
+        } else {
+            env[ins->dst.id] = range_full();
+        }
+        return;
+    }
+}
+
+/** @brief Maps a comparison to the one holding when it evaluates to false. */
+static IROp negate_cmp(IROp op) {
+    switch (op) {
+    case IR_LT: return IR_GE;
+    case IR_LE: return IR_GT;
+    case IR_GT: return IR_LE;
+    case IR_GE: return IR_LT;
+    case IR_EQ: return IR_NE;
+    case IR_NE: return IR_EQ;
+    default: return op;
+    }
+}
+
+/**
+ * @brief Narrows the range of @p x given that "x op y" holds.
+ */
+static ValueRange refine_cmp(IROp op, ValueRange x, ValueRange y) {
+    if (x.empty || y.empty)
+        return range_empty();
+    ValueRange bound = range_full();
+    switch (op) {
+    case IR_LT: bound.hi = y.hi - 1; break;
+    case IR_LE: bound.hi = y.hi; break;
+    case IR_GT: bound.lo = y.lo + 1; break;
+    case IR_GE: bound.lo = y.lo; break;
+    case IR_EQ: bound = y; break;
+    case IR_NE:
+        if (range_is_const(y)) {
+            if (x.lo == y.lo) bound.lo = y.lo + 1;
+            if (x.hi == y.lo) bound.hi = y.lo - 1;
+        }
+        break;
+    default: break;
+    }
+    if (bound.lo > bound.hi)
+        return range_empty();
+    return range_meet(x, bound);
+}
+
+/** @brief Swaps the operands of a comparison: a op b <=> b swap(op) a. */
+static IROp swap_cmp(IROp op) {
+    switch (op) {
+    case IR_LT: return IR_GT;
+    case IR_LE: return IR_GE;
+    case IR_GT: return IR_LT;
+    case IR_GE: return IR_LE;
+    default: return op;
+    }
+}
+
+/**
+ * @brief Checks whether value @p v is redefined in b->instrs[from, to).
+ */
+static bool redefined_between(BasicBlock *b, size_t from, size_t to, IRValue v) {
+    if (ir_is_const(v))
+        return false;
+    for (size_t i = from; i < to; i++) {
+        if (b->instrs[i]->dst.id == v.id)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Computes the environment flowing along edge @p b -> b->succ[k].
+ *
+ * @param out Environment at the end of @p b.
+ * @param edge Output buffer receiving the refined environment.
+ * @return false if the edge is provably never taken.
+ */
+static bool edge_state(BasicBlock *b, size_t k, const ValueRange *out,
+                       ValueRange *edge, int nvals) {
+    memcpy(edge, out, sizeof(ValueRange) * (size_t)nvals);
+    if (b->ninstrs == 0 || b->nsucc != 2)
+        return true;
+    size_t last = b->ninstrs - 1;
+    IRInstr *cj = b->instrs[last];
+    if (cj->op != IR_CJUMP)
+        return true;
+    bool taken = k == 0;
+    IRValue c = cj->a;
+    ValueRange cr = env_get(out, nvals, c);
+    if (cr.empty)
+        return false;
+    if (taken && range_is_const(cr) && cr.lo == 0)
+        return false;
+    if (!taken && (cr.lo > 0 || cr.hi < 0))
+        return false;
+    if (ir_is_const(c) || c.id >= nvals)
+        return true;
+
+    edge[c.id] = taken ? refine_cmp(IR_NE, cr, range_const(0)) : range_const(0);
+
+    /* Find the comparison defining the condition inside this block. */
+    size_t def = last;
+    while (def > 0) {
+        def--;
+        if (b->instrs[def]->dst.id == c.id)
+            break;
+        if (def == 0)
+            return true;
+    }
+    IRInstr *cmp = b->instrs[def];
+    if (cmp->dst.id != c.id || cmp->op < IR_LT || cmp->op > IR_NE)
+        return true;
+    if (cmp->a.id == c.id || cmp->b.id == c.id)
+        return true;
+    if (redefined_between(b, def + 1, last, cmp->a) ||
+        redefined_between(b, def + 1, last, cmp->b))
+        return true;
+
+    IROp op = taken ? cmp->op : negate_cmp(cmp->op);
+    ValueRange ra = env_get(out, nvals, cmp->a);
+    ValueRange rb = env_get(out, nvals, cmp->b);
+    if (!ir_is_const(cmp->a) && cmp->a.id < nvals) {
+        edge[cmp->a.id] = refine_cmp(op, ra, rb);
+        if (edge[cmp->a.id].empty)
+            return false;
+    }
+    if (!ir_is_const(cmp->b) && cmp->b.id < nvals) {
+        edge[cmp->b.id] = refine_cmp(swap_cmp(op), rb, ra);
+        if (edge[cmp->b.id].empty)
+            return false;
+    }
+    return true;
+}
+
+static int max_value_id(CFG *cfg) {
+    int max = -1;
+    for (size_t i = 0; i < cfg->nblocks; i++) {
+        BasicBlock *b = cfg->blocks[i];
+        for (size_t j = 0; j < b->ninstrs; j++) {
+            IRInstr *ins = b->instrs[j];
+            if (ins->dst.id > max) max = ins->dst.id;
+            if (ins->a.id > max) max = ins->a.id;
+            if (ins->b.id > max) max = ins->b.id;
+            if (ins->op == IR_CALL) {
+                for (size_t k = 0; k < ins->extra.call.nargs; k++) {
+                    if (ins->extra.call.args[k].id > max)
+                        max = ins->extra.call.args[k].id;
+                }
+            }
+        }
+    }
+    return max + 1;
+}
+
+static int index_of(const RangeInfo *info, BasicBlock *b) {
+    if (!b || b->id < 0 || b->id > info->max_block_id)
+        return -1;
+    return info->block_index[b->id];
+}
+
+/**
+ * @brief Computes a reverse post-order and marks back-edge targets.
+ */
+static size_t compute_rpo(const RangeInfo *info, int *rpo, bool *is_header) {
+    CFG *cfg = info->cfg;
+    size_t n = cfg->nblocks;
+    int *state = calloc(n, sizeof(int));   /* 0 new, 1 on stack, 2 done */
+    int *stack = malloc(sizeof(int) * n);
+    size_t *next = calloc(n, sizeof(size_t));
+    size_t sp = 0, count = 0;
+    int entry = index_of(info, cfg->entry);
+    if (entry >= 0) {
+        stack[sp++] = entry;
+        state[entry] = 1;
+    }
+    int *post = malloc(sizeof(int) * n);
+    while (sp > 0) {
+        int top = stack[sp - 1];
+        BasicBlock *b = cfg->blocks[top];
+        if (next[top] < b->nsucc) {
+            int s = index_of(info, b->succ[next[top]++]);
+            if (s < 0)
+                continue;
+            if (state[s] == 0) {
+                state[s] = 1;
+                stack[sp++] = s;
+            } else if (state[s] == 1) {
+                is_header[s] = true;
+            }
+        } else {
+            state[top] = 2;
+            post[count++] = top;
+            sp--;
+        }
+    }
+    for (size_t i = 0; i < count; i++)
+        rpo[i] = post[count - 1 - i];
+    free(post);
+    free(next);
+    free(stack);
+    free(state);
+    return count;
+}
+
+/**
+ * @brief Computes the end-of-block environment of block @p idx into @p out.
+ */
+static void block_out(const RangeInfo *info, int idx, ValueRange *out) {
+    int nvals = info->nvals;
+    BasicBlock *b = info->cfg->blocks[idx];
+    memcpy(out, info->entry + (size_t)idx * (size_t)nvals,
+           sizeof(ValueRange) * (size_t)nvals);
+    for (size_t j = 0; j < b->ninstrs; j++)
+        transfer(out, nvals, b->instrs[j]);
+}
+
+/**
+ * @brief Joins the environments arriving at block @p idx over all feasible edges.
+ * @return true if at least one edge is feasible.
+ */
+static bool join_preds(const RangeInfo *info, int idx, ValueRange *in,
+                       ValueRange *out, ValueRange *edge) {
+    int nvals = info->nvals;
+    BasicBlock *b = info->cfg->blocks[idx];
+    bool any = false;
+    for (int v = 0; v < nvals; v++)
+        in[v] = range_empty();
+    for (size_t p = 0; p < b->npred; p++) {
+        BasicBlock *pb = b->pred[p];
+        int pi = index_of(info, pb);
+        if (pi < 0 || !info->reachable[pi])
+            continue;
+        bool seen = false;
+        for (size_t q = 0; q < p; q++)
+            seen |= b->pred[q] == pb;
+        if (seen)
+            continue;
+        block_out(info, pi, out);
+        for (size_t k = 0; k < pb->nsucc; k++) {
+            if (pb->succ[k] != b || !edge_state(pb, k, out, edge, nvals))
+                continue;
+            any = true;
+            for (int v = 0; v < nvals; v++)
+                in[v] = range_join(in[v], edge[v]);
+        }
+    }
+    return any;
+}
+
+RangeInfo *range_analysis(CFG *cfg) {
+    if (!cfg || !cfg->entry || cfg->nblocks == 0)
+        return NULL;
+    RangeInfo *info = calloc(1, sizeof(RangeInfo));
+    info->cfg = cfg;
+    info->nvals = max_value_id(cfg);
+    if (info->nvals <= 0)
+        info->nvals = 1;
+    info->max_block_id = 0;
+    for (size_t i = 0; i < cfg->nblocks; i++) {
+        if (cfg->blocks[i]->id > info->max_block_id)
+            info->max_block_id = cfg->blocks[i]->id;
+    }
+    info->block_index = malloc(sizeof(int) * (size_t)(info->max_block_id + 1));
+    for (int i = 0; i <= info->max_block_id; i++)
+        info->block_index[i] = -1;
+    for (size_t i = 0; i < cfg->nblocks; i++) {
+        if (cfg->blocks[i]->id >= 0)
+            info->block_index[cfg->blocks[i]->id] = (int)i;
+    }
+
+    size_t n = cfg->nblocks;
+    int nvals = info->nvals;
+    info->entry = malloc(sizeof(ValueRange) * n * (size_t)nvals);
+    info->reachable = calloc(n, sizeof(bool));
+    for (size_t i = 0; i < n * (size_t)nvals; i++)
+        info->entry[i] = range_empty();
+
+    int *rpo = malloc(sizeof(int) * n);
+    bool *is_header = calloc(n, sizeof(bool));
+    int *visits = calloc(n, sizeof(int));
+    size_t nrpo = compute_rpo(info, rpo, is_header);
+
+    ValueRange *in = malloc(sizeof(ValueRange) * (size_t)nvals);
+    ValueRange *out = malloc(sizeof(ValueRange) * (size_t)nvals);
+    ValueRange *edge = malloc(sizeof(ValueRange) * (size_t)nvals);
+
+    int entry = index_of(info, cfg->entry);
+    bool narrowing = false;
+    int narrow_left = VRP_NARROW_PASSES;
+    for (int pass = 0;; pass++) {
+        bool changed = false;
+        for (size_t r = 0; r < nrpo; r++) {
+            int idx = rpo[r];
+            ValueRange *cur = info->entry + (size_t)idx * (size_t)nvals;
+            bool reach;
+            if (idx == entry) {
+                /* Parameters and globals are unknown on entry. */
+                for (int v = 0; v < nvals; v++)
+                    in[v] = range_full();
+                reach = true;
+            } else {
+                reach = join_preds(info, idx, in, out, edge);
+            }
+            if (!reach) {
+                if (narrowing && info->reachable[idx]) {
+                    info->reachable[idx] = false;
+                    changed = true;
+                }
+                continue;
+            }
+            if (!narrowing) {
+                if (is_header[idx] && ++visits[idx] > VRP_WIDEN_DELAY) {
+                    for (int v = 0; v < nvals; v++)
+                        in[v] = range_widen(cur[v], range_join(cur[v], in[v]));
+                } else {
+                    for (int v = 0; v < nvals; v++)
+                        in[v] = range_join(cur[v], in[v]);
+                }
+            }
+            changed |= !info->reachable[idx];
+            for (int v = 0; v < nvals && !changed; v++)
+                changed = !range_equal(cur[v], in[v]);
+            memcpy(cur, in, sizeof(ValueRange) * (size_t)nvals);
+            info->reachable[idx] = true;
+        }
+        if (narrowing) {
+            if (!changed || --narrow_left == 0)
+                break;
+        } else if (!changed) {
+            narrowing = true;
+        } else if (pass + 1 >= VRP_MAX_PASSES) {
+            /* Did not stabilise: fall back to knowing nothing. */
+            for (size_t i = 0; i < n * (size_t)nvals; i++)
+                info->entry[i] = range_full();
+            for (size_t i = 0; i < n; i++)
+                info->reachable[i] = true;
+            break;
+        }
+    }
+
+    free(edge);
+    free(out);
+    free(in);
+    free(visits);
+    free(is_header);
+    free(rpo);
+    return info;
+}
+
+bool range_block_reachable(const RangeInfo *info, BasicBlock *b) {
+    int idx = info ? index_of(info, b) : -1;
+    return idx >= 0 && info->reachable[idx];
+}
+
+ValueRange range_at(const RangeInfo *info, BasicBlock *b, size_t instr_index,
+                    IRValue v) {
+    if (ir_is_const(v))
+        return range_const(ir_const_value(v));
+    int idx = info ? index_of(info, b) : -1;
+    if (idx < 0)
+        return range_full();
+    if (!info->reachable[idx])
+        return range_empty();
+    if (v.id >= info->nvals)
+        return range_full();
+    ValueRange *env = malloc(sizeof(ValueRange) * (size_t)info->nvals);
+    memcpy(env, info->entry + (size_t)idx * (size_t)info->nvals,
+           sizeof(ValueRange) * (size_t)info->nvals);
+    for (size_t j = 0; j < instr_index && j < b->ninstrs; j++)
+        transfer(env, info->nvals, b->instrs[j]);
+    ValueRange r = env[v.id];
+    free(env);
+    return r;
+}
+
+void range_info_free(RangeInfo *info) {
+    if (!info)
+        return;
+    free(info->block_index);
+    free(info->entry);
+    free(info->reachable);
+    free(info);
+}
+
+/**
+ * @brief Removes the edge @p from -> @p to from the predecessor list of @p to.
+ */
+static void drop_pred(BasicBlock *to, BasicBlock *from) {
+    for (size_t k = 0; k < to->npred; k++) {
+        if (to->pred[k] == from) {
+            for (size_t m = k + 1; m < to->npred; m++)
+                to->pred[m - 1] = to->pred[m];
+            to->npred--;
+            return;
+        }
+    }
+}
+
+bool vrp(CFG *cfg) {
+    RangeInfo *info = range_analysis(cfg);
+    if (!info)
+        return false;
+    bool changed = false;
+    int nvals = info->nvals;
+    ValueRange *env = malloc(sizeof(ValueRange) * (size_t)nvals);
+    for (size_t i = 0; i < cfg->nblocks; i++) {
+        BasicBlock *b = cfg->blocks[i];
+        if (!info->reachable[i])
+            continue;
+        memcpy(env, info->entry + i * (size_t)nvals,
+               sizeof(ValueRange) * (size_t)nvals);
+        for (size_t j = 0; j < b->ninstrs; j++) {
+            IRInstr *ins = b->instrs[j];
+            if (ins->op >= IR_LT && ins->op <= IR_NE &&
+                !(ir_is_const(ins->a) && ir_is_const(ins->b))) {
+                ValueRange r = range_binop(ins->op, env_get(env, nvals, ins->a),
+                                           env_get(env, nvals, ins->b));
+                if (range_is_const(r)) {
+                    ins->op = IR_MOV;
+                    ins->a = ir_const((int)r.lo);
+                    ins->b.id = 0;
+                    changed = true;
+                }
+            } else if (ins->op == IR_CJUMP && b->nsucc == 2 &&
+                       j + 1 == b->ninstrs) {
+                ValueRange c = env_get(env, nvals, ins->a);
+                bool never_true = range_is_const(c) && c.lo == 0;
+                bool always_true = !c.empty && (c.lo > 0 || c.hi < 0);
+                if (never_true || always_true) {
+                    BasicBlock *taken = always_true ? b->succ[0] : b->succ[1];
+                    BasicBlock *dead = always_true ? b->succ[1] : b->succ[0];
+                    b->succ[0] = taken;
+                    b->nsucc = 1;
+                    if (dead != taken)
+                        drop_pred(dead, b);
+                    ins->op = IR_JUMP;
+                    changed = true;
+                }
+            }
+            transfer(env, nvals, ins);
+        }
+    }
+    free(env);
+    range_info_free(info);
+    return changed;
+}
@@ -0,0 +1,121 @@
+/**
+ * @file vrp.h
+ * @brief Header file for value-range analysis and propagation.
+ *
+ * This file declares an interval analysis over the IR together with the
+ * Value-Range Propagation (VRP) pass built on top of it. The analysis is
+ * exposed separately so other passes can query the proven range of a value
+ * at any instruction.
+ */
+
+#ifndef VRP_H
+#define VRP_H
+
+#include "../cfg/cfg.h"
+#include "../ir/ir.h"
+#include <stdbool.h>
+
+/**
+ * @brief Closed integer interval describing the possible values of an IR value.
+ *
+ * An empty range means the program point is unreachable or the value has no
+ * reaching definition yet.
+ */
+typedef struct {
+    long long lo;   /**< Smallest possible value (inclusive). */
+    long long hi;   /**< Largest possible value (inclusive). */
+    bool empty;     /**< True when no value can reach this point. */
+} ValueRange;
+
+/**
+ * @brief Result of running range analysis over a CFG.
+ */
+typedef struct {
+    CFG *cfg;               /**< Analysed control flow graph. */
+    int nvals;              /**< Number of tracked value ids. */
+    int max_block_id;       /**< Largest block id present in the CFG. */
+    int *block_index;       /**< Maps block id to its index in cfg->blocks. */
+    ValueRange *entry;      /**< Ranges at block entry, nblocks * nvals. */
+    bool *reachable;        /**< Per-block reachability proven by the analysis. */
+} RangeInfo;
+
+/**
+ * @brief Returns the range covering every 32-bit integer.
+ */
+ValueRange range_full(void);
+
+/**
+ * @brief Returns the single-value range [v, v].
+ */
+ValueRange range_const(long long v);
+
+/**
+ * @brief Checks whether a range contains exactly one value.
+ */
+bool range_is_const(ValueRange r);
+
+/**
+ * @brief Returns the smallest range containing both @p a and @p b.
+ */
+ValueRange range_join(ValueRange a, ValueRange b);
+
+/**
+ * @brief Returns the intersection of @p a and @p b (empty if disjoint).
+ */
+ValueRange range_meet(ValueRange a, ValueRange b);
+
+/**
+ * @brief Evaluates an arithmetic, bitwise or comparison IR operation on ranges.
+ *
+ * The result falls back to the full range whenever the operation could
+ * overflow a 32-bit integer.
+ */
+ValueRange range_binop(IROp op, ValueRange a, ValueRange b);
+
+/**
+ * @brief Computes value ranges for every block of a CFG.
+ *
+ * Loop headers are widened to guarantee termination and the result is then
+ * narrowed again, so induction variables guarded by a comparison against a
+ * constant receive finite bounds.
+ *
+ * @param cfg Pointer to the control flow graph to analyse.
+ * @return Newly allocated range information, or NULL on failure.
+ */
+RangeInfo *range_analysis(CFG *cfg);
+
+/**
+ * @brief Queries the range of a value immediately before an instruction.
+ *
+ * @param info Result of range_analysis().
+ * @param b Block containing the instruction.
+ * @param instr_index Index of the instruction within @p b.
+ * @param v Value to query (constants yield a single-value range).
+ * @return The proven range, or an empty range if @p b is unreachable.
+ */
+ValueRange range_at(const RangeInfo *info, BasicBlock *b, size_t instr_index,
+                    IRValue v);
+
+/**
+ * @brief Checks whether the analysis proved a block reachable.
+ */
+bool range_block_reachable(const RangeInfo *info, BasicBlock *b);
+
+/**
+ * @brief Frees range information returned by range_analysis().
+ */
+void range_info_free(RangeInfo *info);
+
+/**
+ * @brief Performs Value-Range Propagation on a control flow graph (CFG).
+ *
+ * Comparisons whose outcome follows from the operand ranges are replaced by
+ * constant moves and conditional jumps with a provably dead arm are turned
+ * into unconditional jumps.
+ *
+ * @param cfg Pointer to the control flow graph to optimize.
+ * @return true if the CFG was modified.
+ */
+bool vrp(CFG *cfg);
+
+#endif
@@ -16,20 +16,26 @@ void arena_init(Arena *a) {
   a->cap = 0;
 }
 
+/** Bytes reserved at the start of each chunk for the link to the previous one. */
+#define ARENA_CHUNK_HEADER 16
+
 /**
- * @brief Expands the memory arena to accommodate additional space.
+ * @brief Starts a new chunk in the memory arena.
  *
- * This function increases the capacity of the memory arena to ensure
- * it can hold at least the specified minimum additional size.
+ * Earlier chunks are kept alive and linked from the new one, so pointers
+ * handed out before the arena grew stay valid.
  *
  * @param a Pointer to the memory arena to grow.
  * @param min Minimum additional size required.
  */
 static void arena_grow(Arena *a, size_t min) {
   size_t new_cap = a->cap ? a->cap * 2 : 4096;
-  if (new_cap < a->len + min)
-    new_cap = a->len + min;
-  a->ptr = realloc(a->ptr, new_cap);
+  if (new_cap < ARENA_CHUNK_HEADER + min)
+    new_cap = ARENA_CHUNK_HEADER + min;
+  char *chunk = malloc(new_cap);
+  memcpy(chunk, &a->ptr, sizeof(char *));
+  a->ptr = chunk;
+  a->len = ARENA_CHUNK_HEADER;
   a->cap = new_cap;
 }
 
@@ -46,6 +52,7 @@ static void arena_grow(Arena *a, size_t min) {
  * @return Pointer to the allocated memory block.
  */
 void *arena_alloc(Arena *a, size_t size) {
+  size = (size + 15) & ~(size_t)15;
   if (a->len + size > a->cap)
     arena_grow(a, size);
   void *ptr = a->ptr + a->len;
@@ -55,6 +62,22 @@ void *arena_alloc(Arena *a, size_t size) {
   return ptr;
 }
 
+/**
+ * @brief Releases every chunk owned by the memory arena.
+ *
+ * @param a Pointer to the memory arena to free.
+ */
+void arena_free(Arena *a) {
+  while (a->ptr) {
+    char *prev;
+    memcpy(&prev, a->ptr, sizeof(char *));
+    free(a->ptr);
+    a->ptr = prev;
+  }
+  a->len = 0;
+  a->cap = 0;
+}
+
 /**
  * @brief Creates a new node in the memory arena.
  *
@@ -6,13 +6,13 @@
 /**
  * @brief Represents a memory arena for dynamic memory allocation.
  *
- * This structure is used to manage a resizable memory buffer,
- * including its pointer, current length, and capacity.
+ * Memory is handed out from the current chunk; when it fills up a new
+ * chunk is linked in front of it, so earlier allocations never move.
  */
 typedef struct {
-  char *ptr;
-  size_t len;
-  size_t cap;
+  char *ptr;  /**< Current chunk; its first bytes link to the previous chunk. */
+  size_t len; /**< Bytes used in the current chunk. */
+  size_t cap; /**< Size of the current chunk. */
 } Arena;
 
 /**
@@ -31,6 +31,13 @@ void arena_init(Arena *a);
  */
 void *arena_alloc(Arena *a, size_t size);
 
+/**
+ * @brief Frees all memory owned by the memory arena.
+ *
+ * @param a Pointer to the memory arena to free.
+ */
+void arena_free(Arena *a);
+
 /**
  * @brief Enumerates the different kinds of nodes in the abstract syntax tree
  * (AST).
@@ -74,6 +81,7 @@ typedef enum {
   ND_MODULE,
   ND_IMPORT,
   ND_EXPORT,
+  ND_REGION,
   ND_ERROR
 } NodeKind;
 
@@ -102,6 +110,15 @@ typedef struct {
  */
 Node *node_new(Arena *a, NodeKind kind);
 
+/**
+ * @brief Attributes that can precede a function declaration, as in
+ * `[memoize] func int fib(int n)`.
+ */
+typedef enum {
+  FUNC_ATTR_MEMOIZE = 1 << 0, /**< Cache results keyed by the arguments. */
+  FUNC_ATTR_PURE = 1 << 1,    /**< Fold calls with known arguments at compile time. */
+} FuncAttr;
+
 /**
  * @brief Represents a case in a switch statement.
  *
@@ -226,6 +243,7 @@ struct Node {
       int is_static;      /**< 1 if this is a static method. */
       int is_async;       /**< 1 if this is an async function. */
       int is_public;      /**< 1 if this is a public method (0 = private). */
+      int attrs;          /**< FuncAttr flags from a leading [attribute] list. */
     } func;
     struct {
       Slice name;     /**< Name of the struct or class. */
@@ -260,6 +278,9 @@ struct Node {
     struct {
       Node *decl; /**< Declaration being exported for ND_EXPORT nodes. */
     } export;
+    struct {
+      Node *body; /**< Block whose allocations go to the region. */
+    } region;
   } as;
 };
 
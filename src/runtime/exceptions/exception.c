@@ -1,4 +1,5 @@
 #include "exception.h"
+#include "../memory/region.h"
 #include <stdio.h>
 
 /**
@@ -24,6 +25,7 @@ jmp_buf* dream_exception_push(int has_finally) {
     ctx->has_finally = has_finally;
     ctx->finally_executed = 0;
     ctx->in_catch = 0;
+    ctx->region_depth = dr_region_depth();
     
     return &ctx->jmp_buffer;
 }
@@ -86,6 +88,8 @@ void dream_exception_throw(DreamExceptionType type, const char *message,
                 dream_exception_state.current.message = strdup(saved_message);
             }
             
+            // Close the regions the handler did not have open
+            dr_region_unwind(outer_ctx->region_depth);
             longjmp(outer_ctx->jmp_buffer, 1);
         }
         
@@ -113,7 +117,8 @@ void dream_exception_throw(DreamExceptionType type, const char *message,
         dream_exception_state.current.message = strdup(message);
     }
     
-    // Jump to exception handler
+    // Jump to exception handler, closing the regions opened since
+    dr_region_unwind(ctx->region_depth);
     longjmp(ctx->jmp_buffer, 1);
 }
 
@@ -146,6 +151,13 @@ void dream_throw_generic(void) {
     dream_exception_throw(DREAM_EXC_GENERIC, "An exception occurred", __FILE__, __LINE__);
 }
 
+void dream_throw_out_of_bounds(int index, int length, const char *file, int line) {
+    char msg[96];
+    snprintf(msg, sizeof(msg), "Index %d is out of range for array of length %d",
+             index, length);
+    dream_exception_throw(DREAM_EXC_OUT_OF_BOUNDS, msg, file, line);
+}
+
 void dream_exception_enter_catch(void) {
     if (dream_exception_state.top >= 0) {
         dream_exception_state.stack[dream_exception_state.top].in_catch = 1;
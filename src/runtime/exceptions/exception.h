@@ -10,6 +10,18 @@
  */
 #define DREAM_EXCEPTION_STACK_SIZE 32
 
+/**
+ * @brief Attributes for the throw and catch paths, which are expected to be
+ *        rare: the compiler moves them out of the way of the normal flow
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define DREAM_EXC_COLD __attribute__((cold))
+#define DREAM_EXC_NORETURN __attribute__((cold, noreturn))
+#else
+#define DREAM_EXC_COLD
+#define DREAM_EXC_NORETURN
+#endif
+
 /**
  * @brief Exception types supported by Dream
  */
@@ -40,6 +52,7 @@ typedef struct {
     int has_finally;        /**< Whether this context has a finally block */
     int finally_executed;   /**< Whether finally block has been executed */
     int in_catch;           /**< Whether currently executing catch block */
+    int region_depth;       /**< Regions open when the try block was entered */
 } DreamExceptionContext;
 
 /**
@@ -80,8 +93,9 @@ void dream_exception_pop(void);
  * @param file Source file name
  * @param line Line number
  */
-void dream_exception_throw(DreamExceptionType type, const char *message, 
-                          const char *file, int line);
+DREAM_EXC_NORETURN void dream_exception_throw(DreamExceptionType type,
+                                             const char *message,
+                                             const char *file, int line);
 
 /**
  * @brief Get the current exception information
@@ -104,17 +118,45 @@ int dream_exception_should_execute_finally(void);
  * @brief Create a string exception (convenience function)
  * @param message Exception message
  */
-void dream_throw_string(const char *message);
+DREAM_EXC_NORETURN void dream_throw_string(const char *message);
 
 /**
  * @brief Create a generic exception (convenience function)
  */
-void dream_throw_generic(void);
+DREAM_EXC_NORETURN void dream_throw_generic(void);
+
+/**
+ * @brief Throw DREAM_EXC_OUT_OF_BOUNDS for a failed array index check
+ * @param index Offending index
+ * @param length Length of the indexed array
+ * @param file Source file name
+ * @param line Line number
+ */
+DREAM_EXC_NORETURN void dream_throw_out_of_bounds(int index, int length,
+                                                 const char *file, int line);
+
+/**
+ * @brief Validate an array index emitted under --bounds-check
+ * @param index Index being accessed
+ * @param length Length of the indexed array
+ * @param file Source file name
+ * @param line Line number
+ * @return The index, so the call can be used directly as a subscript
+ */
+static inline int dream_check_index(int index, int length, const char *file, int line) {
+#if defined(__GNUC__) || defined(__clang__)
+    if (__builtin_expect((unsigned)index >= (unsigned)length, 0))
+#else
+    if ((unsigned)index >= (unsigned)length)
+#endif
+        dream_throw_out_of_bounds(index, length, file, line);
+    return index;
+}
 
 /**
  * @brief Mark that we're currently in a catch block
  */
-void dream_exception_enter_catch(void);
+DREAM_EXC_COLD void dream_exception_enter_catch(void);
 
 /**
  * @brief Mark that we're no longer in a catch block
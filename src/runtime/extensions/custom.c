@@ -1,82 +1,147 @@
 #include "custom.h"
+#include "../memory/drstring.h"
 #include "../memory/memory.h"
 
 int dr_custom_value(void) { return 42; }
 
 char *dream_concat(const char *str1, const char *str2) {
-    size_t len1 = strlen(str1);
-    size_t len2 = strlen(str2);
-    char *result = dr_alloc(len1 + len2 + 1);
-    
-    strcpy(result, str1);
-    strcat(result, str2);
-    
-    return result;
+    return dream_concat_n("ss", str1, str2);
 }
 
 char *dream_int_to_string(int value) {
-    // Allocate enough space for largest int + null terminator
-    char *result = dr_alloc(32);
-    snprintf(result, 32, "%d", value);
-    return result;
+    return dream_concat_n("i", value);
 }
 
 char *dream_float_to_string(float value) {
-    // Allocate enough space for float representation + null terminator
-    char *result = dr_alloc(64);
-    snprintf(result, 64, "%f", value);
-    return result;
+    return dream_concat_n("f", (double)value);
 }
 
 char *dream_concat_string_int(const char *str, int value) {
-    char *int_str = dream_int_to_string(value);
-    
-    size_t str_len = strlen(str);
-    size_t int_len = strlen(int_str);
-    char *result = dr_alloc(str_len + int_len + 1);
-    
-    strcpy(result, str);
-    strcat(result, int_str);
-    
-    // Note: int_str is allocated with dr_alloc, will be freed by dr_release_all
-    return result;
+    return dream_concat_n("si", str, value);
 }
 
 char *dream_concat_int_string(int value, const char *str) {
-    char *int_str = dream_int_to_string(value);
-    
-    size_t int_len = strlen(int_str);
-    size_t str_len = strlen(str);
-    char *result = dr_alloc(int_len + str_len + 1);
-    
-    strcpy(result, int_str);
-    strcat(result, str);
-    
-    return result;
+    return dream_concat_n("is", value, str);
 }
 
 char *dream_concat_string_float(const char *str, float value) {
-    char *float_str = dream_float_to_string(value);
-    
-    size_t str_len = strlen(str);
-    size_t float_len = strlen(float_str);
-    char *result = dr_alloc(str_len + float_len + 1);
-    
-    strcpy(result, str);
-    strcat(result, float_str);
-    
-    return result;
+    return dream_concat_n("sf", str, (double)value);
 }
 
 char *dream_concat_float_string(float value, const char *str) {
-    char *float_str = dream_float_to_string(value);
-    
-    size_t float_len = strlen(float_str);
-    size_t str_len = strlen(str);
-    char *result = dr_alloc(float_len + str_len + 1);
-    
-    strcpy(result, float_str);
-    strcat(result, str);
-    
+    return dream_concat_n("fs", (double)value, str);
+}
+
+static size_t int_digits(int value) {
+    unsigned magnitude = value < 0 ? 0u - (unsigned)value : (unsigned)value;
+    size_t len = value < 0 ? 2 : 1;
+    while (magnitude >= 10) {
+        magnitude /= 10;
+        len++;
+    }
+    return len;
+}
+
+static void int_write(char *dst, size_t len, int value) {
+    unsigned magnitude = value < 0 ? 0u - (unsigned)value : (unsigned)value;
+    char *p = dst + len;
+    do {
+        *--p = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+    if (value < 0) *--p = '-';
+}
+
+/* Writes the parts into dst, total bytes and a terminator; lens holds the
+ * lengths of the first DREAM_CONCAT_MAX parts. */
+static void concat_write(char *dst, size_t total, const char *kinds,
+                         const size_t *lens, va_list args) {
+    char *p = dst;
+    for (size_t i = 0; kinds[i]; i++) {
+        size_t len = i < DREAM_CONCAT_MAX ? lens[i] : (size_t)-1;
+        switch (kinds[i]) {
+        case 's': {
+            const char *s = va_arg(args, const char *);
+            if (!s) {
+                len = 0;
+                break;
+            }
+            if (len == (size_t)-1) len = dr_str_len(s);
+            memcpy(p, s, len);
+            break;
+        }
+        case 'i': {
+            int v = va_arg(args, int);
+            if (len == (size_t)-1) len = int_digits(v);
+            int_write(p, len, v);
+            break;
+        }
+        case 'b': {
+            const char *word = va_arg(args, int) ? "true" : "false";
+            len = strlen(word);
+            memcpy(p, word, len);
+            break;
+        }
+        case 'c':
+            *p = (char)va_arg(args, int);
+            len = 1;
+            break;
+        default: {
+            /* The terminator snprintf writes lands on the next part. */
+            int n = snprintf(p, total + 1 - (size_t)(p - dst), "%f",
+                             va_arg(args, double));
+            len = (size_t)n;
+            break;
+        }
+        }
+        p += len;
+    }
+    *p = '\0';
+}
+
+char *dream_concat_n(const char *kinds, ...) {
+    /* Lengths measured in the first pass, reused by the second. */
+    size_t lens[DREAM_CONCAT_MAX];
+    size_t total = 0;
+    va_list args;
+    va_start(args, kinds);
+    for (size_t i = 0; kinds[i]; i++) {
+        size_t len;
+        switch (kinds[i]) {
+        case 's':
+            len = dr_str_len(va_arg(args, const char *));
+            break;
+        case 'i':
+            len = int_digits(va_arg(args, int));
+            break;
+        case 'b':
+            len = va_arg(args, int) ? 4 : 5;
+            break;
+        case 'c':
+            (void)va_arg(args, int);
+            len = 1;
+            break;
+        default:
+            len = (size_t)snprintf(NULL, 0, "%f", va_arg(args, double));
+            break;
+        }
+        if (i < DREAM_CONCAT_MAX) lens[i] = len;
+        total += len;
+    }
+    va_end(args);
+
+    /* Results of at most one character come out as shared strings. */
+    if (total <= 1) {
+        char tiny[2];
+        va_start(args, kinds);
+        concat_write(tiny, total, kinds, lens, args);
+        va_end(args);
+        return (char *)dr_str_from(tiny, total);
+    }
+    char *result = dr_str_new(total);
+    if (!result) return NULL;
+    va_start(args, kinds);
+    concat_write(result, total, kinds, lens, args);
+    va_end(args);
     return result;
 }
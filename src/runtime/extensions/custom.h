@@ -1,6 +1,7 @@
 #ifndef DR_CUSTOM_H
 #define DR_CUSTOM_H
 
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -33,6 +34,18 @@ char *dream_concat_float_string(float value, const char *str);
  */
 char *dream_concat(const char *str1, const char *str2);
 
+/** Most parts a single dream_concat_n call takes. */
+#define DREAM_CONCAT_MAX 16
+
+/**
+ * Concatenate several parts with one allocation. Each character of kinds
+ * describes the next argument: 's' a Dream string, 'i' an int, 'f' a float
+ * (passed as double), 'b' a bool written as true or false, 'c' a char. String
+ * lengths come from their headers and numbers are formatted straight into
+ * the result.
+ */
+char *dream_concat_n(const char *kinds, ...);
+
 /**
  * Convert integer to string for concatenation
  */
@@ -1,3 +1,4 @@
 #include "console.h"
-void dr_console_write(const char* s) { printf("%s", s); }
-void dr_console_writeln(const char* s) { printf("%s\n", s); }
+/* A null string, such as ReadLine's at end of input, prints as "(null)". */
+void dr_console_write(const char* s) { printf("%s", s ? s : "(null)"); }
+void dr_console_writeln(const char* s) { printf("%s\n", s ? s : "(null)"); }
@@ -0,0 +1,235 @@
+#include "allocprof.h"
+#include "memory.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* One cache line per site, so threads allocating at different sites do
+ * not contend. */
+typedef struct {
+    _Alignas(64) _Atomic unsigned long long allocs;
+    _Atomic unsigned long long bytes;
+    _Atomic unsigned long long frees;
+    _Atomic unsigned long long life_ns; /* summed over the freed objects */
+    _Atomic long long live;             /* bytes */
+    _Atomic long long peak;
+} DrSiteStats;
+
+int dr_alloc_profiling = 0;
+
+static const DrAllocSite *prof_sites;
+static size_t prof_nsites;
+static DrSiteStats *prof_stats; /* prof_nsites + 1, site 0 first */
+static const char *prof_file;
+static const char *prof_path;
+
+static const DrAllocSite runtime_site = {"(runtime)", 0, "untagged"};
+
+static inline unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull +
+           (unsigned long long)ts.tv_nsec;
+}
+
+static inline void add(_Atomic unsigned long long *c, unsigned long long n) {
+    atomic_fetch_add_explicit(c, n, memory_order_relaxed);
+}
+
+static inline void sub(_Atomic unsigned long long *c, unsigned long long n) {
+    atomic_fetch_sub_explicit(c, n, memory_order_relaxed);
+}
+
+static void grow_live(DrSiteStats *s, long long bytes) {
+    long long live = atomic_fetch_add_explicit(&s->live, bytes,
+                                               memory_order_relaxed) + bytes;
+    long long peak = atomic_load_explicit(&s->peak, memory_order_relaxed);
+    while (live > peak &&
+           !atomic_compare_exchange_weak_explicit(&s->peak, &peak, live,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed))
+        ;
+}
+
+static void dr_alloc_profile_atexit(void) {
+    dr_alloc_profile_dump();
+}
+
+void dr_alloc_profile_start(const DrAllocSite *sites, size_t n,
+                            const char *file, const char *path) {
+    if (prof_stats) return;
+    prof_stats = aligned_alloc(_Alignof(DrSiteStats),
+                               (n + 1) * sizeof(DrSiteStats));
+    if (!prof_stats) return;
+    memset(prof_stats, 0, (n + 1) * sizeof(DrSiteStats));
+    const char *env = getenv("DREAM_ALLOC_PROFILE");
+    prof_sites = sites;
+    prof_nsites = n;
+    prof_file = file;
+    prof_path = env && *env ? env : path;
+    dr_alloc_profiling = 1;
+    atexit(dr_alloc_profile_atexit);
+}
+
+void dr_alloc_profile_born(DrStamp *stamp, size_t bytes) {
+    stamp->born = now_ns();
+    stamp->bytes = bytes;
+    DrSiteStats *s = &prof_stats[0];
+    add(&s->allocs, 1);
+    add(&s->bytes, bytes);
+    grow_live(s, (long long)bytes);
+}
+
+void dr_alloc_profile_died(const DrStamp *stamp, unsigned site) {
+    unsigned long long life = now_ns() - stamp->born;
+    DrSiteStats *s = &prof_stats[site <= prof_nsites ? site : 0];
+    add(&s->frees, 1);
+    add(&s->life_ns, life);
+    atomic_fetch_sub_explicit(&s->live, (long long)stamp->bytes,
+                              memory_order_relaxed);
+}
+
+/* The stamp sits right ahead of the caller's prefix, see memory.c. */
+void dr_alloc_tag(const void *ptr, unsigned site) {
+    if (!ptr || !site || site > prof_nsites) return;
+    DrRef *r = (DrRef *)ptr - 1;
+    if (!(r->flags & DR_REF_STAMPED) || r->site) return;
+    const DrStamp *stamp = (const DrStamp *)((char *)r - r->prefix) - 1;
+    r->site = (unsigned short)site;
+    DrSiteStats *from = &prof_stats[0];
+    sub(&from->allocs, 1);
+    sub(&from->bytes, stamp->bytes);
+    atomic_fetch_sub_explicit(&from->live, (long long)stamp->bytes,
+                              memory_order_relaxed);
+    DrSiteStats *to = &prof_stats[site];
+    add(&to->allocs, 1);
+    add(&to->bytes, stamp->bytes);
+    grow_live(to, (long long)stamp->bytes);
+}
+
+static const DrAllocSite *site_info(size_t i) {
+    return i ? &prof_sites[i - 1] : &runtime_site;
+}
+
+static unsigned long long load(_Atomic unsigned long long *c) {
+    return atomic_load_explicit(c, memory_order_relaxed);
+}
+
+static int by_bytes(const void *a, const void *b) {
+    unsigned long long x = load(&prof_stats[*(const size_t *)a].bytes);
+    unsigned long long y = load(&prof_stats[*(const size_t *)b].bytes);
+    if (x != y) return x < y ? 1 : -1;
+    size_t i = *(const size_t *)a, j = *(const size_t *)b;
+    return i < j ? -1 : i > j;
+}
+
+static void write_lifetime(FILE *f, unsigned long long ns) {
+    if (ns < 10000)
+        fprintf(f, "%8lluns", ns);
+    else if (ns < 10000000)
+        fprintf(f, "%8lluus", ns / 1000);
+    else if (ns < 10000000000ull)
+        fprintf(f, "%8llums", ns / 1000000);
+    else
+        fprintf(f, "%8llus ", ns / 1000000000);
+}
+
+static void write_json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; s && *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fprintf(f, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(f, "\\u%04x", *s);
+        else
+            fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+static int write_text(const size_t *order, size_t n) {
+    FILE *f = fopen(prof_path, "w");
+    if (!f) return -1;
+    unsigned long long allocs = 0, bytes = 0;
+    for (size_t i = 0; i < n; i++) {
+        allocs += load(&prof_stats[order[i]].allocs);
+        bytes += load(&prof_stats[order[i]].bytes);
+    }
+    fprintf(f, "dream allocation profile of %s: %llu allocations, %llu bytes\n",
+            prof_file, allocs, bytes);
+    fprintf(f, "%12s %10s %12s %12s %10s  %s\n", "bytes", "allocs",
+            "peak live", "live", "mean life", "site");
+    for (size_t i = 0; i < n; i++) {
+        DrSiteStats *s = &prof_stats[order[i]];
+        const DrAllocSite *site = site_info(order[i]);
+        unsigned long long frees = load(&s->frees);
+        fprintf(f, "%12llu %10llu %12lld %12lld ", load(&s->bytes),
+                load(&s->allocs),
+                atomic_load_explicit(&s->peak, memory_order_relaxed),
+                atomic_load_explicit(&s->live, memory_order_relaxed));
+        if (frees)
+            write_lifetime(f, load(&s->life_ns) / frees);
+        else
+            fprintf(f, "%10s", "-");
+        if (site->line)
+            fprintf(f, "  %s:%u %s: %s\n", prof_file, site->line, site->func,
+                    site->what);
+        else
+            fprintf(f, "  %s: %s\n", site->func, site->what);
+    }
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+static int write_json(const size_t *order, size_t n) {
+    size_t len = strlen(prof_path);
+    char *path = malloc(len + sizeof(".json"));
+    if (!path) return -1;
+    memcpy(path, prof_path, len);
+    strcpy(path + len, ".json");
+    FILE *f = fopen(path, "w");
+    free(path);
+    if (!f) return -1;
+    fprintf(f, "{\"file\": ");
+    write_json_string(f, prof_file);
+    fprintf(f, ", \"sites\": [");
+    for (size_t i = 0; i < n; i++) {
+        DrSiteStats *s = &prof_stats[order[i]];
+        const DrAllocSite *site = site_info(order[i]);
+        unsigned long long frees = load(&s->frees);
+        fprintf(f, "%s\n  {\"site\": %zu, \"function\": ", i ? "," : "",
+                order[i]);
+        write_json_string(f, site->func);
+        fprintf(f, ", \"line\": %u, \"what\": ", site->line);
+        write_json_string(f, site->what);
+        fprintf(f,
+                ", \"allocs\": %llu, \"bytes\": %llu, \"frees\": %llu, "
+                "\"live_bytes\": %lld, \"peak_live_bytes\": %lld, "
+                "\"mean_lifetime_ns\": %llu}",
+                load(&s->allocs), load(&s->bytes), frees,
+                atomic_load_explicit(&s->live, memory_order_relaxed),
+                atomic_load_explicit(&s->peak, memory_order_relaxed),
+                frees ? load(&s->life_ns) / frees : 0);
+    }
+    fprintf(f, "\n]}\n");
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+int dr_alloc_profile_dump(void) {
+    if (!prof_stats) return -1;
+    size_t *order = malloc((prof_nsites + 1) * sizeof(size_t));
+    if (!order) return -1;
+    size_t n = 0;
+    for (size_t i = 0; i <= prof_nsites; i++)
+        if (load(&prof_stats[i].allocs)) order[n++] = i;
+    qsort(order, n, sizeof(size_t), by_bytes);
+    int rc = 0;
+    if (write_text(order, n) != 0 || write_json(order, n) != 0) {
+        fprintf(stderr, "dream: cannot write allocation profile %s\n",
+                prof_path);
+        rc = -1;
+    }
+    free(order);
+    return rc;
+}
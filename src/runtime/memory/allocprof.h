@@ -0,0 +1,71 @@
+#pragma once
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Allocation profiler of --profile-alloc builds.
+ *
+ * The generated program numbers every expression that allocates, from 1,
+ * describes the sites in a DrAllocSite table and passes each new object
+ * through dr_alloc_tag() with its site number. While the profiler runs,
+ * heap blocks carry a DrStamp with their birth time and size, and the
+ * object's DrRef records the site, so frees are charged to the site that
+ * allocated. Per site the profiler keeps the allocations, bytes, frees,
+ * live and peak live bytes and the summed lifetime of freed objects, in
+ * relaxed atomic counters. Objects nothing tagged count as site 0, the
+ * runtime's own. Region and static objects are not counted.
+ *
+ * At exit the sites are written, most bytes first, as text to the path
+ * given to dr_alloc_profile_start() and as JSON to the same path with
+ * ".json" appended. DREAM_ALLOC_PROFILE, if set, overrides the path.
+ */
+
+typedef struct {
+    const char *func; /**< Function containing the site. */
+    unsigned line;    /**< Source line of the statement. */
+    const char *what; /**< What is allocated, e.g. "new Node" or "string +". */
+} DrAllocSite;
+
+/* Ahead of the prefix of a block allocated while profiling. */
+typedef struct {
+    unsigned long long born; /* CLOCK_MONOTONIC nanoseconds */
+    size_t bytes;            /* block size, as counted by dr_alloc_stats */
+} DrStamp;
+
+/**
+ * @brief Starts profiling and registers the report to write at exit.
+ * @param sites Sites 1 to n, sites[0] being site 1.
+ * @param n Number of sites.
+ * @param file Source file the lines refer to.
+ * @param path Text report; an existing one is overwritten.
+ */
+void dr_alloc_profile_start(const DrAllocSite *sites, size_t n,
+                            const char *file, const char *path);
+
+/**
+ * @brief Charges ptr, fresh from dr_alloc, to site. An object keeps the
+ * first site it is tagged with.
+ */
+void dr_alloc_tag(const void *ptr, unsigned site);
+
+/**
+ * @brief Writes the report now.
+ * @return 0 on success, -1 if profiling is off or a file cannot be written.
+ */
+int dr_alloc_profile_dump(void);
+
+/* Nonzero while profiling; blocks allocated then get a DrStamp. */
+extern int dr_alloc_profiling;
+
+/* Used by dr_alloc: stamps a new block of the given size, site 0. */
+void dr_alloc_profile_born(DrStamp *stamp, size_t bytes);
+
+/* Used by dr_alloc: charges the death of a stamped block to its site. */
+void dr_alloc_profile_died(const DrStamp *stamp, unsigned site);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,63 @@
+#include "drstring.h"
+#include <string.h>
+
+_Static_assert(sizeof(DrString) ==
+                   offsetof(DrString, ref) + sizeof(DrRef),
+               "the characters must follow the DrRef");
+
+DR_STR_LITERAL(dr_str_empty, "");
+
+typedef struct {
+    DrString h;
+    char s[2];
+} DrCharString;
+
+#define CHAR1(c) {{1, 1, 0, DR_REF_STATIC_INIT}, {(char)(c), 0}}
+#define CHAR4(c) CHAR1(c), CHAR1((c) + 1), CHAR1((c) + 2), CHAR1((c) + 3)
+#define CHAR16(c) CHAR4(c), CHAR4((c) + 4), CHAR4((c) + 8), CHAR4((c) + 12)
+#define CHAR64(c) CHAR16(c), CHAR16((c) + 16), CHAR16((c) + 32), CHAR16((c) + 48)
+
+static DrCharString dr_str_chars[256] = {CHAR64(0), CHAR64(64), CHAR64(128),
+                                         CHAR64(192)};
+
+char *dr_str_new(size_t len) {
+    /* Round up so the allocation ends on a word boundary. */
+    size_t cap = len | (sizeof(size_t) - 1);
+    char *s = dr_alloc_prefixed(sizeof(DrString) - sizeof(DrRef), cap + 1);
+    if (!s) return NULL;
+    DrString *h = dr_str_header(s);
+    h->len = len;
+    h->cap = cap;
+    return s;
+}
+
+const char *dr_str_from(const char *s, size_t len) {
+    if (len == 0) return dr_str_empty.s;
+    if (len == 1) return dr_str_chars[(unsigned char)s[0]].s;
+    char *copy = dr_str_new(len);
+    if (copy) memcpy(copy, s, len);
+    return copy;
+}
+
+size_t dr_str_hash(const char *s) {
+    if (!s) return 0;
+    DrString *h = dr_str_header(s);
+    if (!h->hash) {
+        unsigned hash = 2166136261u;
+        for (size_t i = 0; i < h->len; i++)
+            hash = (hash ^ (unsigned char)s[i]) * 16777619u;
+        /* 0 means not computed yet. */
+        h->hash = hash ? hash : 1;
+    }
+    return h->hash;
+}
+
+int dr_str_eq(const char *a, const char *b) {
+    if (a == b) return 1;
+    if (!a || !b) return 0;
+    DrString *ha = dr_str_header(a);
+    DrString *hb = dr_str_header(b);
+    if (ha->len != hb->len) return 0;
+    if (ha->hash && hb->hash && ha->hash != hb->hash) return 0;
+    return memcmp(a, b, ha->len) == 0;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <stddef.h>
+#include "memory.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Runtime strings.
+ *
+ * A Dream string is a pointer to NUL-terminated characters, so it passes
+ * straight to C, with a DrString header right in front of them: the length,
+ * the capacity, a hash cached on first use and the DrRef that counts its
+ * references. The characters live inline behind the header, one allocation
+ * per string, and the empty string and single characters built at run time
+ * are shared static strings. String literals are static DrStrings as well,
+ * emitted once per distinct literal by the compiler; retain and release
+ * leave all of these alone.
+ */
+
+typedef struct DrString {
+    size_t len;
+    size_t cap;  /* characters that fit, not counting the NUL */
+    size_t hash; /* FNV-1a of the characters, 0 until computed */
+    DrRef ref;   /* last, so the characters follow it */
+} DrString;
+
+/* Defines the static string name for a C string literal; name.s is the
+ * Dream string. */
+#define DR_STR_LITERAL(name, text)                                         \
+    static struct {                                                         \
+        DrString h;                                                         \
+        char s[sizeof(text)];                                               \
+    } name = {{sizeof(text) - 1, sizeof(text) - 1, 0,                       \
+               DR_REF_STATIC_INIT},                                         \
+              text}
+
+static inline DrString *dr_str_header(const char *s) {
+    return (DrString *)(void *)(s - sizeof(DrString));
+}
+
+/* Length in O(1); 0 for NULL. */
+static inline size_t dr_str_len(const char *s) {
+    return s ? dr_str_header(s)->len : 0;
+}
+
+/* A new string of len characters to fill in, NUL-terminated. */
+char *dr_str_new(size_t len);
+
+/* A string holding a copy of the len bytes at s. */
+const char *dr_str_from(const char *s, size_t len);
+
+/* Hash of the characters, computed once per string. */
+size_t dr_str_hash(const char *s);
+
+/* Nonzero if both strings hold the same characters (or both are NULL). */
+int dr_str_eq(const char *a, const char *b);
+
+#ifdef __cplusplus
+}
+#endif
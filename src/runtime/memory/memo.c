@@ -0,0 +1,204 @@
+#include "memo.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Async workers may share a cache; the lock only guards the table, the
+// memoized function itself runs unlocked
+static void memo_lock(DrMemo *m) {
+    while (__atomic_exchange_n(&m->lock, 1, __ATOMIC_ACQUIRE))
+        ;
+}
+
+static void memo_unlock(DrMemo *m) {
+    __atomic_store_n(&m->lock, 0, __ATOMIC_RELEASE);
+}
+
+static size_t memo_hash(const DrMemo *m, const DrMemoArg *args) {
+    unsigned long long h = 1469598103934665603ULL;
+    for (size_t i = 0; i < m->nargs; i++) {
+        if (m->kinds[i] == 's') {
+            const unsigned char *s = (const unsigned char *)args[i].s;
+            if (!s) {
+                h ^= 0x9e3779b97f4a7c15ULL;
+            } else {
+                while (*s) {
+                    h ^= *s++;
+                    h *= 1099511628211ULL;
+                }
+            }
+        } else {
+            h ^= (unsigned long long)args[i].i;
+            h *= 0xff51afd7ed558ccdULL;
+            h ^= h >> 33;
+        }
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 29;
+    return h ? (size_t)h : 1;
+}
+
+static int memo_keys_equal(const DrMemo *m, const DrMemoArg *a,
+                           const DrMemoArg *b) {
+    for (size_t i = 0; i < m->nargs; i++) {
+        if (m->kinds[i] == 's') {
+            if (a[i].s == b[i].s) continue;
+            if (!a[i].s || !b[i].s || strcmp(a[i].s, b[i].s) != 0) return 0;
+        } else if (a[i].i != b[i].i) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static DrMemoArg *memo_key(DrMemo *m, size_t slot) {
+    return m->keys + slot * m->nargs;
+}
+
+static size_t memo_find(DrMemo *m, size_t hash, const DrMemoArg *args) {
+    for (size_t i = hash & m->mask;; i = (i + 1) & m->mask) {
+        if (m->slots[i].hash == 0) return DR_MEMO_NONE;
+        if (m->slots[i].hash == hash && memo_keys_equal(m, memo_key(m, i), args))
+            return i;
+    }
+}
+
+static void memo_unlink(DrMemo *m, size_t i) {
+    DrMemoEntry *e = &m->slots[i];
+    if (e->prev != DR_MEMO_NONE) m->slots[e->prev].next = e->next;
+    else m->head = e->next;
+    if (e->next != DR_MEMO_NONE) m->slots[e->next].prev = e->prev;
+    else m->tail = e->prev;
+}
+
+static void memo_push_front(DrMemo *m, size_t i) {
+    DrMemoEntry *e = &m->slots[i];
+    e->prev = DR_MEMO_NONE;
+    e->next = m->head;
+    if (m->head != DR_MEMO_NONE) m->slots[m->head].prev = i;
+    m->head = i;
+    if (m->tail == DR_MEMO_NONE) m->tail = i;
+}
+
+static void memo_free_key(DrMemo *m, size_t slot) {
+    DrMemoArg *k = memo_key(m, slot);
+    for (size_t i = 0; i < m->nargs; i++) {
+        if (m->kinds[i] == 's') free((char *)k[i].s);
+    }
+}
+
+// Moves an entry to an empty slot, keeping its neighbours' links valid
+static void memo_move(DrMemo *m, size_t from, size_t to) {
+    m->slots[to] = m->slots[from];
+    memcpy(memo_key(m, to), memo_key(m, from), sizeof(DrMemoArg) * m->nargs);
+    DrMemoEntry *e = &m->slots[to];
+    if (e->prev != DR_MEMO_NONE) m->slots[e->prev].next = to;
+    else m->head = to;
+    if (e->next != DR_MEMO_NONE) m->slots[e->next].prev = to;
+    else m->tail = to;
+}
+
+// Backward-shift deletion keeps every probe chain unbroken without tombstones
+static void memo_remove(DrMemo *m, size_t i) {
+    memo_unlink(m, i);
+    memo_free_key(m, i);
+    for (size_t j = (i + 1) & m->mask; m->slots[j].hash; j = (j + 1) & m->mask) {
+        size_t home = m->slots[j].hash & m->mask;
+        int movable = i <= j ? (home <= i || home > j) : (home <= i && home > j);
+        if (movable) {
+            memo_move(m, j, i);
+            i = j;
+        }
+    }
+    m->slots[i].hash = 0;
+    m->count--;
+}
+
+static void memo_reset(DrMemo *m) {
+    for (size_t i = 0; m->slots && i <= m->mask; i++) {
+        if (m->slots[i].hash) memo_free_key(m, i);
+        m->slots[i].hash = 0;
+    }
+    m->count = 0;
+    m->head = m->tail = DR_MEMO_NONE;
+}
+
+static int memo_alloc(DrMemo *m) {
+    size_t max = m->max_entries ? m->max_entries : 1;
+    size_t cap = 8;
+    while (cap < max * 2) cap <<= 1;
+    m->nargs = strlen(m->kinds);
+    m->slots = calloc(cap, sizeof(DrMemoEntry));
+    m->keys = calloc(cap * (m->nargs ? m->nargs : 1), sizeof(DrMemoArg));
+    if (!m->slots || !m->keys) {
+        free(m->slots);
+        free(m->keys);
+        m->slots = NULL;
+        m->keys = NULL;
+        return 0;
+    }
+    m->mask = cap - 1;
+    m->count = 0;
+    m->head = m->tail = DR_MEMO_NONE;
+    return 1;
+}
+
+int dr_memo_get(DrMemo *m, const DrMemoArg *args, DrMemoValue *out) {
+    memo_lock(m);
+    if (!m->slots) {
+        memo_unlock(m);
+        return 0;
+    }
+    size_t i = memo_find(m, memo_hash(m, args), args);
+    if (i != DR_MEMO_NONE) {
+        *out = m->slots[i].value;
+        if (m->lru && m->head != i) {
+            memo_unlink(m, i);
+            memo_push_front(m, i);
+        }
+    }
+    memo_unlock(m);
+    return i != DR_MEMO_NONE;
+}
+
+void dr_memo_put(DrMemo *m, const DrMemoArg *args, DrMemoValue value) {
+    memo_lock(m);
+    if (!m->slots && !memo_alloc(m)) {
+        memo_unlock(m);
+        return;
+    }
+    size_t hash = memo_hash(m, args);
+    size_t i = memo_find(m, hash, args);
+    if (i != DR_MEMO_NONE) {
+        // Another thread got here first
+        m->slots[i].value = value;
+        memo_unlock(m);
+        return;
+    }
+    if (m->count >= m->max_entries) {
+        if (m->lru && m->tail != DR_MEMO_NONE) memo_remove(m, m->tail);
+        else memo_reset(m);
+    }
+    i = hash & m->mask;
+    while (m->slots[i].hash) i = (i + 1) & m->mask;
+    DrMemoArg *k = memo_key(m, i);
+    for (size_t a = 0; a < m->nargs; a++) {
+        k[a] = args[a];
+        if (m->kinds[a] == 's' && args[a].s) k[a].s = strdup(args[a].s);
+    }
+    m->slots[i].hash = hash;
+    m->slots[i].value = value;
+    memo_push_front(m, i);
+    m->count++;
+    memo_unlock(m);
+}
+
+void dr_memo_clear(DrMemo *m) {
+    memo_lock(m);
+    memo_reset(m);
+    free(m->slots);
+    free(m->keys);
+    m->slots = NULL;
+    m->keys = NULL;
+    m->mask = 0;
+    memo_unlock(m);
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Result caches for memoized functions.
+ *
+ * Each memoized function owns one DrMemo, an open-addressing table keyed by
+ * its arguments. The table is allocated on first use and holds at most
+ * max_entries results: an LRU cache evicts the least recently used entry
+ * when full, any other cache starts over empty. String arguments are copied
+ * into the table, so callers may free theirs after the call.
+ */
+
+#define DR_MEMO_MAX_ARGS 8
+#define DR_MEMO_NONE ((size_t)-1)
+
+typedef union {
+    long long i;
+    double f;
+} DrMemoValue;
+
+/* One argument: 'i' kinds use i, 's' kinds use s. */
+typedef struct {
+    long long i;
+    const char *s;
+} DrMemoArg;
+
+typedef struct {
+    size_t hash;        /* 0 marks an empty slot */
+    DrMemoValue value;
+    size_t prev, next;  /* recency list, most recent first */
+} DrMemoEntry;
+
+typedef struct {
+    const char *kinds;  /* one 'i' or 's' per argument */
+    size_t max_entries;
+    int lru;
+    size_t nargs;
+    DrMemoEntry *slots;
+    DrMemoArg *keys;    /* nargs per slot */
+    size_t mask;
+    size_t count;
+    size_t head, tail;
+    int lock;
+} DrMemo;
+
+#define DR_MEMO_INIT(kinds, max_entries, lru) \
+    { (kinds), (max_entries), (lru), 0, NULL, NULL, 0, 0, DR_MEMO_NONE, DR_MEMO_NONE, 0 }
+
+/* Looks up args; on a hit stores the cached result in out and returns 1. */
+int dr_memo_get(DrMemo *m, const DrMemoArg *args, DrMemoValue *out);
+
+/* Records the result for args, evicting an older entry when full. */
+void dr_memo_put(DrMemo *m, const DrMemoArg *args, DrMemoValue value);
+
+/* Drops every entry and the table itself. */
+void dr_memo_clear(DrMemo *m);
+
+#ifdef __cplusplus
+}
+#endif
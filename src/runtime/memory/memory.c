@@ -1,14 +1,328 @@
 #include "memory.h"
+#include "allocprof.h"
+#include "region.h"
+#include "slab.h"
+#include <stdatomic.h>
+#include <stdio.h>
 #include <stdlib.h>
 
-static DrRef *dr_head = NULL;
+/*
+ * A block holds, in order: a DrLarge if it is too big for the slab, a
+ * DrLink while tracking, a DrStamp while profiling allocations, the
+ * caller's prefix, the DrRef and the object.
+ */
+typedef struct DrLarge {
+    size_t size;
+    size_t pad; /* keeps what follows 16-byte aligned */
+} DrLarge;
+
+typedef struct DrLink {
+    struct DrLink *next;
+    struct DrLink *prev;
+    DrRef *ref;
+} DrLink;
+
+/*
+ * A thread owning objects. Slots are handed to threads as they first
+ * allocate and taken back when they exit; a slot without a thread leaves
+ * the objects of its last one to be merged by whoever needs to. An object
+ * names its owner by slot and generation, so once the slot goes to another
+ * thread the objects of the last one are no longer taken for the new
+ * one's: those are counted as if their owner were gone.
+ */
+typedef struct DrThreadSlot {
+    atomic_flag lock;
+    int live;
+    unsigned short id;      /* owner id of the slot's thread, see owner_id */
+    unsigned gen;           /* times the slot was handed out */
+    _Atomic size_t pending; /* queue length, read by the owner unlocked */
+    DrRef **queue;          /* objects to merge */
+    size_t cap;
+} DrThreadSlot;
+
+#define DR_SLOT_BITS 10
+#define DR_MAX_THREADS (1 << DR_SLOT_BITS)
+
+static DrThreadSlot dr_slots[DR_MAX_THREADS]; /* slot 0 stays unused */
+static atomic_flag dr_slots_lock = ATOMIC_FLAG_INIT;
+static int dr_slot_next = 1; /* where the search for a free slot starts */
+/* This thread's slot: -1 until it allocates, 0 if none was free. */
+static _Thread_local int dr_slot = -1;
+/* This thread's owner id, 0 without a slot. */
+static _Thread_local unsigned short dr_owner = 0;
+
+/* -1 until the first allocation decides, then 0 or 1 for good. */
+static int dr_tracking = -1;
+static DrLink *dr_head = NULL;
+static size_t dr_live = 0;
+static atomic_flag dr_track_lock = ATOMIC_FLAG_INIT;
+
+static DrAllocStats dr_stats; /* of threads that have exited */
+static atomic_flag dr_stats_lock = ATOMIC_FLAG_INIT;
+static _Thread_local DrAllocStats dr_my_stats;
+static DrAllocHook dr_hook = NULL;
+
+static inline void spin_lock(atomic_flag *f) {
+    while (atomic_flag_test_and_set_explicit(f, memory_order_acquire))
+        ;
+}
+
+static inline void spin_unlock(atomic_flag *f) {
+    atomic_flag_clear_explicit(f, memory_order_release);
+}
+
+static inline int rc_count(int shared) {
+    return shared >> 2; /* arithmetic shift keeps the sign */
+}
+
+/* The DrRef owner of objects allocated by the gen-th thread of slot i; the
+ * generation takes the bits the slot leaves. Never 0. */
+static inline unsigned short owner_id(int i, unsigned gen) {
+    return (unsigned short)(i | gen << DR_SLOT_BITS);
+}
+
+/* Takes a free slot for the calling thread, 0 if there is none. The search
+ * goes round from where the last one ended, so a slot is handed out again
+ * only after all the others. */
+static int acquire_slot(void) {
+    spin_lock(&dr_slots_lock);
+    int slot = 0;
+    for (int k = 0; k < DR_MAX_THREADS - 1; k++) {
+        int i = 1 + (dr_slot_next - 1 + k) % (DR_MAX_THREADS - 1);
+        DrThreadSlot *s = &dr_slots[i];
+        spin_lock(&s->lock);
+        int taken = s->live;
+        if (!taken) {
+            s->live = 1;
+            s->id = owner_id(i, ++s->gen);
+            dr_owner = s->id;
+        }
+        spin_unlock(&s->lock);
+        if (!taken) {
+            slot = i;
+            dr_slot_next = i + 1;
+            break;
+        }
+    }
+    spin_unlock(&dr_slots_lock);
+    return slot;
+}
+
+static inline int my_slot(void) {
+    if (dr_slot < 0) dr_slot = acquire_slot();
+    return dr_slot;
+}
+
+void dr_track_allocs(int on) {
+    if (dr_tracking < 0) dr_tracking = on != 0;
+}
+
+static inline int tracking(void) {
+    if (dr_tracking < 0) {
+        const char *env = getenv("DREAM_TRACK_ALLOCS");
+        dr_tracking = env && *env && *env != '0';
+    }
+    return dr_tracking;
+}
+
+static inline void track(DrLink *l, DrRef *r) {
+    spin_lock(&dr_track_lock);
+    l->ref = r;
+    l->prev = NULL;
+    l->next = dr_head;
+    if (dr_head) dr_head->prev = l;
+    dr_head = l;
+    dr_live++;
+    spin_unlock(&dr_track_lock);
+}
+
+static inline void untrack(DrLink *l) {
+    spin_lock(&dr_track_lock);
+    if (l->prev) l->prev->next = l->next;
+    else dr_head = l->next;
+    if (l->next) l->next->prev = l->prev;
+    dr_live--;
+    spin_unlock(&dr_track_lock);
+}
+
+static inline size_t link_size(void) {
+    return dr_tracking > 0 ? sizeof(DrLink) : 0;
+}
+
+static inline size_t stamp_size(DrRef *r) {
+    return r->flags & DR_REF_STAMPED ? sizeof(DrStamp) : 0;
+}
+
+/* The start of r's block, past any DrLarge. */
+static inline char *block_of(DrRef *r) {
+    return (char *)r - r->prefix - stamp_size(r) - link_size();
+}
+
+static inline void count_alloc(char *block, size_t size) {
+    DrAllocStats *s = &dr_my_stats;
+    s->allocs++;
+    s->live_bytes += size;
+    if (s->live_bytes > s->peak_bytes) s->peak_bytes = s->live_bytes;
+    if (dr_hook) dr_hook(block, size);
+}
+
+static void ref_free(DrRef *r) {
+    char *block = block_of(r);
+    DrAllocStats *s = &dr_my_stats;
+    s->frees++;
+    if (r->flags & DR_REF_STAMPED)
+        dr_alloc_profile_died((DrStamp *)((char *)r - r->prefix) - 1, r->site);
+    if (dr_hook) dr_hook(block, 0);
+    if (r->size_class) {
+        s->live_bytes -= dr_slab_class_size(r->size_class);
+        dr_slab_free(r->size_class, block);
+    } else {
+        DrLarge *large = (DrLarge *)block - 1;
+        s->live_bytes -= large->size;
+        free(large);
+    }
+}
+
+static void destroy(DrRef *r) {
+    if (r->flags & DR_REF_DROP) ((DrDrop *)r - 1)->drop(r + 1);
+    if (dr_tracking > 0) untrack((DrLink *)block_of(r));
+    ref_free(r);
+}
+
+/*
+ * Folds the owner's count into the shared one; from then on the object is
+ * counted there alone. Runs on the owner, or once the owner is gone on the
+ * thread that marked r queued, which keeps any other from merging it too.
+ * dequeue is set when r comes off the owner's queue, or was never put on
+ * it; an object still queued keeps its mark and is destroyed only once
+ * drained, since the queue holds on to it until then. Merging a second
+ * time only settles the mark.
+ */
+static void merge(DrRef *r, int dequeue) {
+    int cur = atomic_load_explicit(&r->shared, memory_order_relaxed);
+    int next;
+    do {
+        next = (rc_count(cur) + (int)r->biased) * DR_RC_ONE | DR_RC_MERGED;
+        if (!dequeue) next |= cur & DR_RC_QUEUED;
+    } while (!atomic_compare_exchange_weak_explicit(
+        &r->shared, &cur, next, memory_order_acq_rel, memory_order_relaxed));
+    r->biased = 0;
+    if (rc_count(next) == 0 && !(next & DR_RC_QUEUED)) destroy(r);
+}
+
+/* Takes the slot's queue and merges what was on it. The lock is let go
+ * first, as dropping an object may release others and queue them here. */
+static void drain(DrThreadSlot *slot) {
+    spin_lock(&slot->lock);
+    size_t n = atomic_load_explicit(&slot->pending, memory_order_relaxed);
+    DrRef **queue = slot->queue;
+    size_t cap = slot->cap;
+    slot->queue = NULL;
+    slot->cap = 0;
+    atomic_store_explicit(&slot->pending, 0, memory_order_relaxed);
+    spin_unlock(&slot->lock);
+    for (size_t i = 0; i < n; i++) merge(queue[i], 1);
+    spin_lock(&slot->lock);
+    if (!slot->queue) {
+        slot->queue = queue;
+        slot->cap = cap;
+        queue = NULL;
+    }
+    spin_unlock(&slot->lock);
+    free(queue);
+}
+
+/* Called after a thread other than the owner took the count below zero. */
+static void queue_for_owner(DrRef *r) {
+    DrThreadSlot *slot = &dr_slots[r->owner & (DR_MAX_THREADS - 1)];
+    spin_lock(&slot->lock);
+    int old = atomic_fetch_or_explicit(&r->shared, DR_RC_QUEUED,
+                                       memory_order_acq_rel);
+    if (old & DR_RC_QUEUED) {
+        spin_unlock(&slot->lock);
+        return;
+    }
+    if (old & DR_RC_MERGED) {
+        /* The owner merged it meanwhile; the count is final. */
+        old = atomic_fetch_and_explicit(&r->shared, ~DR_RC_QUEUED,
+                                        memory_order_acq_rel);
+        spin_unlock(&slot->lock);
+        if (rc_count(old) == 0) destroy(r);
+        return;
+    }
+    if (!slot->live || slot->id != r->owner) {
+        /* Its owner is gone; the slot may have gone to another thread. The
+         * mark keeps others from queueing it meanwhile. */
+        spin_unlock(&slot->lock);
+        merge(r, 1);
+        return;
+    }
+    size_t n = atomic_load_explicit(&slot->pending, memory_order_relaxed);
+    if (n == slot->cap) {
+        size_t cap = slot->cap ? slot->cap * 2 : 16;
+        DrRef **queue = realloc(slot->queue, cap * sizeof(DrRef *));
+        if (!queue) {
+            /* Leave the object queued-marked; it is only leaked. */
+            spin_unlock(&slot->lock);
+            return;
+        }
+        slot->queue = queue;
+        slot->cap = cap;
+    }
+    slot->queue[n] = r;
+    atomic_store_explicit(&slot->pending, n + 1, memory_order_relaxed);
+    spin_unlock(&slot->lock);
+}
 
 void *dr_alloc(size_t size) {
-    DrRef *r = calloc(1, sizeof(DrRef) + size);
-    if (!r) return NULL;
-    r->refcount = 1;
-    r->next = dr_head;
-    dr_head = r;
+    return dr_alloc_prefixed(0, size);
+}
+
+void *dr_alloc_prefixed(size_t prefix, size_t size) {
+    if (dr_region_depth()) {
+        char *block = dr_region_alloc(prefix + sizeof(DrRef) + size);
+        if (!block) return NULL;
+        DrRef *r = (DrRef *)(block + prefix);
+        r->prefix = (unsigned short)prefix;
+        r->flags = DR_REF_STATIC | DR_REF_REGION;
+        return (void *)(r + 1);
+    }
+    return dr_alloc_heap_prefixed(prefix, size);
+}
+
+void *dr_alloc_heap_prefixed(size_t prefix, size_t size) {
+    int me = my_slot();
+    if (me && atomic_load_explicit(&dr_slots[me].pending, memory_order_relaxed))
+        drain(&dr_slots[me]);
+    size_t link = tracking() ? sizeof(DrLink) : 0;
+    size_t stamp = dr_alloc_profiling ? sizeof(DrStamp) : 0;
+    size_t head = link + stamp;
+    size_t total = head + prefix + sizeof(DrRef) + size;
+    int cls = dr_slab_class(total);
+    size_t bytes = cls ? dr_slab_class_size(cls) : total;
+    char *block;
+    if (cls) {
+        block = dr_slab_alloc(cls, total);
+        if (!block) return NULL;
+    } else {
+        DrLarge *large = calloc(1, sizeof(DrLarge) + total);
+        if (!large) return NULL;
+        large->size = total;
+        block = (char *)(large + 1);
+        dr_my_stats.large_allocs++;
+    }
+    count_alloc(block, bytes);
+    DrRef *r = (DrRef *)(block + head + prefix);
+    r->prefix = (unsigned short)prefix;
+    if (stamp) {
+        r->flags = DR_REF_STAMPED;
+        dr_alloc_profile_born((DrStamp *)(block + link), bytes);
+    }
+    r->size_class = (unsigned char)cls;
+    r->owner = me ? dr_owner : 0;
+    if (me) r->biased = 1;
+    else atomic_init(&r->shared, DR_RC_ONE | DR_RC_MERGED);
+    if (link) track((DrLink *)block, r);
     return (void *)(r + 1);
 }
 
@@ -16,28 +330,134 @@ static inline DrRef *to_ref(void *ptr) {
     return ((DrRef *)ptr) - 1;
 }
 
+void *dr_alloc_dropping(size_t size, DrDropFn drop) {
+    void *obj = dr_alloc_prefixed(sizeof(DrDrop), size);
+    if (!obj) return NULL;
+    DrRef *r = to_ref(obj);
+    if (!(r->flags & DR_REF_REGION)) {
+        ((DrDrop *)r - 1)->drop = drop;
+        r->flags |= DR_REF_DROP;
+    }
+    return obj;
+}
+
+void dr_slot_end(void *slot) {
+    DrDrop *d = (DrDrop *)slot;
+    d->drop((DrRef *)(d + 1) + 1);
+}
+
+/* Nonzero if the calling thread counts r in biased. */
+static inline int owns(DrRef *r) {
+    return my_slot() && r->owner == dr_owner &&
+           !(atomic_load_explicit(&r->shared, memory_order_relaxed) &
+             DR_RC_MERGED);
+}
+
 void dr_retain(void *ptr) {
     if (!ptr) return;
-    to_ref(ptr)->refcount++;
+    DrRef *r = to_ref(ptr);
+    if (r->flags & DR_REF_STATIC) return;
+    if (owns(r)) r->biased++;
+    else atomic_fetch_add_explicit(&r->shared, DR_RC_ONE, memory_order_relaxed);
+}
+
+void *dr_retained(void *ptr) {
+    dr_retain(ptr);
+    return ptr;
 }
 
 void dr_release(void *ptr) {
     if (!ptr) return;
     DrRef *r = to_ref(ptr);
-    if (r->refcount > 0 && --r->refcount == 0) {
-        DrRef **cur = &dr_head;
-        while (*cur && *cur != r) cur = &(*cur)->next;
-        if (*cur) *cur = r->next;
-        free(r);
+    if (r->flags & DR_REF_STATIC) return;
+    if (owns(r)) {
+        if (--r->biased == 0) merge(r, 0);
+        return;
+    }
+    int now = atomic_fetch_sub_explicit(&r->shared, DR_RC_ONE,
+                                        memory_order_acq_rel) - DR_RC_ONE;
+    if (now & DR_RC_QUEUED) return; /* its owner settles it */
+    if (now & DR_RC_MERGED) {
+        if (rc_count(now) == 0) destroy(r);
+    } else if (rc_count(now) < 0) {
+        queue_for_owner(r);
+    }
+}
+
+void dr_memory_thread_exit(void) {
+    if (dr_slot > 0) {
+        DrThreadSlot *slot = &dr_slots[dr_slot];
+        for (;;) {
+            drain(slot);
+            spin_lock(&slot->lock);
+            if (!atomic_load_explicit(&slot->pending, memory_order_relaxed))
+                break;
+            spin_unlock(&slot->lock);
+        }
+        /* Objects queued for the slot from now on merge at once. */
+        slot->live = 0;
+        slot->id = 0;
+        spin_unlock(&slot->lock);
     }
+    dr_slot = -1;
+    dr_owner = 0;
+    dr_slab_thread_exit();
+    dr_region_thread_exit();
+    DrAllocStats *s = &dr_my_stats;
+    spin_lock(&dr_stats_lock);
+    dr_stats.allocs += s->allocs;
+    dr_stats.frees += s->frees;
+    dr_stats.live_bytes += s->live_bytes;
+    if (s->peak_bytes > dr_stats.peak_bytes) dr_stats.peak_bytes = s->peak_bytes;
+    dr_stats.large_allocs += s->large_allocs;
+    spin_unlock(&dr_stats_lock);
+    *s = (DrAllocStats){0};
+}
+
+void dr_memory_thread_idle(void) {
+    if (dr_slot > 0 &&
+        atomic_load_explicit(&dr_slots[dr_slot].pending, memory_order_relaxed))
+        drain(&dr_slots[dr_slot]);
+}
+
+void dr_alloc_stats(DrAllocStats *out) {
+    const DrAllocStats *s = &dr_my_stats;
+    spin_lock(&dr_stats_lock);
+    *out = dr_stats;
+    spin_unlock(&dr_stats_lock);
+    out->allocs += s->allocs;
+    out->frees += s->frees;
+    out->live_bytes += s->live_bytes;
+    if (s->peak_bytes > out->peak_bytes) out->peak_bytes = s->peak_bytes;
+    out->large_allocs += s->large_allocs;
+    out->slab_pages = dr_slab_pages();
+}
+
+void dr_set_alloc_hook(DrAllocHook hook) {
+    dr_hook = hook;
+}
+
+size_t dr_live_count(void) {
+    spin_lock(&dr_track_lock);
+    size_t n = dr_live;
+    spin_unlock(&dr_track_lock);
+    return n;
 }
 
 void dr_release_all(void) {
-    DrRef *cur = dr_head;
+    if (dr_tracking <= 0) return;
+    spin_lock(&dr_track_lock);
+    DrLink *cur = dr_head;
+    size_t live = dr_live;
+    dr_head = NULL;
+    dr_live = 0;
+    spin_unlock(&dr_track_lock);
+    if (live)
+        fprintf(stderr, "dream: %zu object%s still alive at exit\n", live,
+                live == 1 ? "" : "s");
     while (cur) {
-        DrRef *next = cur->next;
-        free(cur);
+        DrLink *next = cur->next;
+        ref_free(cur->ref);
         cur = next;
     }
-    dr_head = NULL;
 }
@@ -5,14 +5,107 @@
 extern "C" {
 #endif
 
+/*
+ * Reference counts are biased towards the thread that allocated an
+ * object, its owner. The owner counts its references in `biased` with
+ * plain arithmetic; other threads count theirs in `shared` with atomic
+ * operations. When the owner lets go of its last reference the two are
+ * merged and the object is counted atomically from then on. A thread that
+ * takes the shared count below zero, by releasing a reference the owner
+ * handed over, queues the object for its owner to merge.
+ */
 typedef struct DrRef {
-    struct DrRef *next;
-    size_t refcount;
+    unsigned biased;       /* the owner thread's references */
+    _Atomic int shared;    /* other references times DR_RC_ONE, DR_RC_ bits */
+    unsigned short owner;  /* owner thread's slot and its generation, 0 for none */
+    unsigned short prefix; /* bytes of header ahead of this one, freed with it */
+    unsigned char size_class; /* slab class of the block, 0 if it has its own */
+    unsigned char flags;
+    unsigned short site;   /* allocation site under --profile-alloc, see allocprof.h */
 } DrRef;
 
+#define DR_RC_MERGED 1 /* counted in shared alone */
+#define DR_RC_QUEUED 2 /* waiting for its owner to merge it */
+#define DR_RC_ONE 4
+
+/* Flag of static objects, which retain and release leave alone. */
+#define DR_REF_STATIC 1u
+/* Flag of objects in a region (see region.h); they are static as well. */
+#define DR_REF_REGION 2u
+/* Flag of blocks carrying a DrStamp for the allocation profiler. */
+#define DR_REF_STAMPED 4u
+/* Flag of objects with a DrDrop right ahead of their DrRef. */
+#define DR_REF_DROP 8u
+
+/* Releases what an object holds; run once it dies, before it is freed. */
+typedef void (*DrDropFn)(void *obj);
+
+/* Header of an object that holds references of its own. */
+typedef struct DrDrop {
+    DrDropFn drop;
+    void *pad; /* keeps the DrRef 16-byte aligned */
+} DrDrop;
+
+/* Initializer of the DrRef of a static object. */
+#define DR_REF_STATIC_INIT {0, 0, 0, 0, 0, DR_REF_STATIC, 0}
+
 void *dr_alloc(size_t size);
+/* Like dr_alloc, with prefix bytes of zeroed header ahead of the DrRef;
+ * prefix must keep the DrRef aligned. */
+void *dr_alloc_prefixed(size_t prefix, size_t size);
+/* Like dr_alloc_prefixed, on the heap even while a region is open. */
+void *dr_alloc_heap_prefixed(size_t prefix, size_t size);
+/* Like dr_alloc, for an object drop has to let go of what it holds once it
+ * dies. Objects in a region are freed with it and not dropped. */
+void *dr_alloc_dropping(size_t size, DrDropFn drop);
+/* Cleanup handler of a stack slot laid out as a DrDrop, a DrRef and the
+ * object: drops the object as it goes out of scope. */
+void dr_slot_end(void *slot);
 void dr_retain(void *ptr);
+/* Retains ptr and returns it, for storing a borrowed reference. */
+void *dr_retained(void *ptr);
 void dr_release(void *ptr);
+
+/* Called by a thread the runtime started when it is done: merges the
+ * objects queued for it and hands its allocation cache back. */
+void dr_memory_thread_exit(void);
+
+/* Called by a runtime thread about to sleep: merges the objects queued for
+ * it, which would otherwise wait for its next allocation. */
+void dr_memory_thread_idle(void);
+
+/*
+ * Allocation statistics. Blocks are counted at their allocated size, the
+ * size class for small ones. Threads count their own allocations and fold
+ * them in when they exit, so the figures cover the calling thread and the
+ * threads that have finished; peak_bytes is the highest any one of them
+ * reached. A hook, when set, sees every block as it is allocated
+ * (size > 0) and freed (size 0), on the thread doing so.
+ */
+typedef struct DrAllocStats {
+    size_t allocs;
+    size_t frees;
+    size_t live_bytes;
+    size_t peak_bytes;
+    size_t large_allocs; /* blocks too big for a size class */
+    size_t slab_pages;
+} DrAllocStats;
+
+typedef void (*DrAllocHook)(void *ptr, size_t size);
+
+void dr_alloc_stats(DrAllocStats *out);
+void dr_set_alloc_hook(DrAllocHook hook);
+
+/*
+ * Leak tracking, for debugging. Objects are freed by dr_release alone and
+ * the runtime keeps no list of them, unless tracking is on: setting
+ * DREAM_TRACK_ALLOCS in the environment, or calling dr_track_allocs(1)
+ * before the first allocation, links every live object into a list.
+ * dr_release_all then reports the objects still alive on stderr and frees
+ * them; without tracking it does nothing.
+ */
+void dr_track_allocs(int on);
+size_t dr_live_count(void);
 void dr_release_all(void);
 
 #ifdef __cplusplus
@@ -0,0 +1,119 @@
+#include "region.h"
+#include "drstring.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define DR_REGION_CHUNK (64 * 1024)
+#define DR_REGION_MAX_CHUNK (1024 * 1024)
+/* Regions nested deeper than this share the innermost mark. */
+#define DR_REGION_MAX_DEPTH 64
+
+typedef struct DrChunk {
+    struct DrChunk *prev;
+    size_t size; /* bytes of data after the header */
+    size_t used;
+    size_t pad; /* keeps the data 16-byte aligned */
+} DrChunk;
+
+/* Where a region started: the chunk in use and how much of it was. */
+typedef struct {
+    DrChunk *chunk;
+    size_t used;
+} DrMark;
+
+static _Thread_local DrChunk *dr_chunk; /* being carved, newest first */
+static _Thread_local DrChunk *dr_spare; /* kept for the next region */
+static _Thread_local int dr_depth;
+static _Thread_local DrMark dr_marks[DR_REGION_MAX_DEPTH];
+
+int dr_region_depth(void) {
+    return dr_depth;
+}
+
+int dr_region_begin(void) {
+    if (dr_depth < DR_REGION_MAX_DEPTH)
+        dr_marks[dr_depth] = (DrMark){dr_chunk, dr_chunk ? dr_chunk->used : 0};
+    return dr_depth++;
+}
+
+/* Frees the chunks taken since mark and rewinds the one it was in. */
+static void rewind_to(DrMark mark) {
+    while (dr_chunk != mark.chunk) {
+        DrChunk *prev = dr_chunk->prev;
+        if (!dr_spare || dr_chunk->size > dr_spare->size) {
+            free(dr_spare);
+            dr_spare = dr_chunk;
+        } else {
+            free(dr_chunk);
+        }
+        dr_chunk = prev;
+    }
+    if (dr_chunk) dr_chunk->used = mark.used;
+}
+
+void dr_region_unwind(int depth) {
+    if (depth < 0) depth = 0;
+    if (dr_depth <= depth) return;
+    if (depth < DR_REGION_MAX_DEPTH) rewind_to(dr_marks[depth]);
+    dr_depth = depth;
+}
+
+void dr_region_end(void) {
+    dr_region_unwind(dr_depth - 1);
+}
+
+void dr_region_exit(int *depth) {
+    dr_region_unwind(*depth);
+}
+
+void dr_region_thread_exit(void) {
+    dr_region_unwind(0);
+    free(dr_spare);
+    dr_spare = NULL;
+}
+
+static DrChunk *grow(size_t size) {
+    DrChunk *c;
+    if (dr_spare && dr_spare->size >= size) {
+        c = dr_spare;
+        dr_spare = NULL;
+    } else {
+        size_t want = dr_chunk ? dr_chunk->size * 2 : DR_REGION_CHUNK;
+        if (want > DR_REGION_MAX_CHUNK) want = DR_REGION_MAX_CHUNK;
+        if (want < size) want = size;
+        c = malloc(sizeof(DrChunk) + want);
+        if (!c) return NULL;
+        c->size = want;
+    }
+    c->used = 0;
+    c->prev = dr_chunk;
+    dr_chunk = c;
+    return c;
+}
+
+void *dr_region_alloc(size_t size) {
+    size = (size + 15) & ~(size_t)15;
+    DrChunk *c = dr_chunk;
+    if (!c || c->size - c->used < size) {
+        c = grow(size);
+        if (!c) return NULL;
+    }
+    char *p = (char *)(c + 1) + c->used;
+    c->used += size;
+    memset(p, 0, size);
+    return p;
+}
+
+const char *dr_str_promote(const char *s) {
+    if (!dr_in_region(s)) return s;
+    size_t len = dr_str_len(s);
+    char *copy = dr_alloc_heap_prefixed(sizeof(DrString) - sizeof(DrRef),
+                                        len + 1);
+    if (!copy) return NULL;
+    DrString *h = dr_str_header(copy);
+    h->len = len;
+    h->cap = len;
+    h->hash = dr_str_header(s)->hash;
+    memcpy(copy, s, len + 1);
+    return copy;
+}
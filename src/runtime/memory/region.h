@@ -0,0 +1,57 @@
+#pragma once
+#include <stddef.h>
+#include "memory.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Regions, for objects that die together.
+ *
+ * While a region is open on a thread, dr_alloc on that thread carves
+ * objects out of the region's chunks with a bump pointer instead of the
+ * slab. Their DrRef is flagged DR_REF_STATIC | DR_REF_REGION, so retain and
+ * release leave them alone, and closing the region frees them all at once
+ * by moving the bump pointer back and handing back the chunks taken since
+ * it opened. Regions nest; one chunk is kept per thread for the next one.
+ *
+ * A value that must outlive the region has to be copied out of it first;
+ * dr_str_promote does so for strings. The compiler opens a region for a
+ * `using region { ... }` block and closes it however the block is left.
+ */
+
+/* Nesting depth of the calling thread's regions, 0 with none open. */
+int dr_region_depth(void);
+
+/* Opens a region; returns the depth before it, to close it with. */
+int dr_region_begin(void);
+
+/* Closes the innermost region. */
+void dr_region_end(void);
+
+/* Closes regions until depth are left open; does nothing if no more are
+ * open already. */
+void dr_region_unwind(int depth);
+
+/* Cleanup handler for a variable holding the result of dr_region_begin. */
+void dr_region_exit(int *depth);
+
+/* Size bytes of zeroed, 16-byte aligned memory in the innermost region;
+ * NULL if out of memory. Used by dr_alloc. */
+void *dr_region_alloc(size_t size);
+
+/* Nonzero if ptr, returned by dr_alloc, lives in a region. */
+static inline int dr_in_region(const void *ptr) {
+    return ptr && (((const DrRef *)ptr - 1)->flags & DR_REF_REGION);
+}
+
+/* Closes the calling thread's regions and frees its spare chunk. */
+void dr_region_thread_exit(void);
+
+/* s itself, or a copy on the heap if it lives in a region. */
+const char *dr_str_promote(const char *s);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,153 @@
+#include "slab.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DR_SLAB_PAGE (64 * 1024)
+/* Blocks a thread takes from or gives back to the shared pages at once. */
+#define DR_SLAB_BATCH 32
+
+typedef struct {
+    void *free;  /* freed blocks, linked through their first word */
+    char *bump;  /* next unused block of the current page */
+    char *end;
+} DrSlabClass;
+
+typedef struct {
+    DrSlabClass cls[DR_SLAB_CLASSES + 1];
+    unsigned nfree[DR_SLAB_CLASSES + 1];
+} DrSlabCache;
+
+static const unsigned short class_size[DR_SLAB_CLASSES + 1] = {
+    0,   16,  32,  48,  64,  80,  96,  112, 128, 160, 192,
+    224, 256, 320, 384, 448, 512, 640, 768, 896, 1024};
+
+/* Class of each size in 16-byte steps, indexed by (size + 15) / 16. */
+static const unsigned char class_of[DR_SLAB_MAX / 16 + 1] = {
+    1,  1,  2,  3,  4,  5,  6,  7,  8,  9,  9,  10, 10, 11, 11, 12, 12,
+    13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 15, 16, 16, 16, 16, 17,
+    17, 17, 17, 17, 17, 17, 17, 18, 18, 18, 18, 18, 18, 18, 18, 19, 19,
+    19, 19, 19, 19, 19, 19, 20, 20, 20, 20, 20, 20, 20, 20};
+
+/* The shared pages, under lock. */
+static DrSlabClass classes[DR_SLAB_CLASSES + 1];
+static size_t pages;
+static atomic_flag lock = ATOMIC_FLAG_INIT;
+
+static _Thread_local DrSlabCache cache;
+
+static inline void slab_lock(void) {
+    while (atomic_flag_test_and_set_explicit(&lock, memory_order_acquire))
+        ;
+}
+
+static inline void slab_unlock(void) {
+    atomic_flag_clear_explicit(&lock, memory_order_release);
+}
+
+int dr_slab_class(size_t size) {
+    return size <= DR_SLAB_MAX ? class_of[(size + 15) / 16] : 0;
+}
+
+size_t dr_slab_class_size(int cls) {
+    return class_size[cls];
+}
+
+/* Gives the cache of class cls a batch of free blocks or a bump range. */
+static int refill(int cls) {
+    DrSlabClass *c = &classes[cls], *mine = &cache.cls[cls];
+    size_t size = class_size[cls], want = DR_SLAB_BATCH * size;
+    slab_lock();
+    if (c->free) {
+        unsigned n = 0;
+        void *last = c->free;
+        while (++n < DR_SLAB_BATCH && *(void **)last) last = *(void **)last;
+        mine->free = c->free;
+        c->free = *(void **)last;
+        *(void **)last = NULL;
+        cache.nfree[cls] = n;
+        slab_unlock();
+        return 1;
+    }
+    if ((size_t)(c->end - c->bump) < size) {
+        char *page = calloc(1, DR_SLAB_PAGE);
+        if (!page) {
+            slab_unlock();
+            return 0;
+        }
+        c->bump = page;
+        c->end = page + DR_SLAB_PAGE;
+        pages++;
+    }
+    size_t avail = (size_t)(c->end - c->bump) / size * size;
+    if (want > avail) want = avail;
+    mine->bump = c->bump;
+    mine->end = c->bump + want;
+    c->bump += want;
+    slab_unlock();
+    return 1;
+}
+
+/* Moves n blocks from the cache's free list of class cls to the pages. */
+static void flush(int cls, unsigned n) {
+    DrSlabClass *mine = &cache.cls[cls];
+    if (!n) return;
+    void *first = mine->free, *last = first;
+    for (unsigned i = 1; i < n; i++) last = *(void **)last;
+    mine->free = *(void **)last;
+    cache.nfree[cls] -= n;
+    slab_lock();
+    *(void **)last = classes[cls].free;
+    classes[cls].free = first;
+    slab_unlock();
+}
+
+void *dr_slab_alloc(int cls, size_t zero) {
+    DrSlabClass *c = &cache.cls[cls];
+    size_t size = class_size[cls];
+    for (;;) {
+        void *block = c->free;
+        if (block) {
+            c->free = *(void **)block;
+            cache.nfree[cls]--;
+            memset(block, 0, zero);
+            return block;
+        }
+        if ((size_t)(c->end - c->bump) >= size) {
+            block = c->bump;
+            c->bump += size;
+            return block;
+        }
+        if (!refill(cls)) return NULL;
+    }
+}
+
+void dr_slab_free(int cls, void *block) {
+    DrSlabClass *c = &cache.cls[cls];
+    *(void **)block = c->free;
+    c->free = block;
+    if (++cache.nfree[cls] > 2 * DR_SLAB_BATCH) flush(cls, DR_SLAB_BATCH);
+}
+
+void dr_slab_thread_exit(void) {
+    for (int cls = 1; cls <= DR_SLAB_CLASSES; cls++) {
+        DrSlabClass *c = &cache.cls[cls];
+        size_t size = class_size[cls];
+        /* The rest of the bump range goes back as free blocks. */
+        while ((size_t)(c->end - c->bump) >= size) {
+            void *block = c->bump;
+            c->bump += size;
+            *(void **)block = c->free;
+            c->free = block;
+            cache.nfree[cls]++;
+        }
+        flush(cls, cache.nfree[cls]);
+    }
+}
+
+size_t dr_slab_pages(void) {
+    slab_lock();
+    size_t n = pages;
+    slab_unlock();
+    return n;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Size-class allocator behind dr_alloc.
+ *
+ * Blocks of up to DR_SLAB_MAX bytes are rounded up to one of
+ * DR_SLAB_CLASSES size classes. Each class carves blocks out of 64 KiB
+ * pages with a bump pointer and keeps the blocks freed since on a free
+ * list, which later allocations of the class take first. Pages come zeroed
+ * from the system and are never given back, so only a recycled block is
+ * cleared, and only as far as its new owner asked for.
+ *
+ * Every thread allocates from a cache of its own: a free list and a bump
+ * range per class, refilled from and flushed to the shared pages in
+ * batches under a lock. A block may be freed on any thread; it joins that
+ * thread's cache. Threads the runtime starts hand their cache back with
+ * dr_slab_thread_exit.
+ */
+
+#define DR_SLAB_CLASSES 20
+#define DR_SLAB_MAX 1024
+
+/* The class of a size-byte block, 1-based; 0 if it is too large. */
+int dr_slab_class(size_t size);
+
+/* Size of the blocks in class cls. */
+size_t dr_slab_class_size(int cls);
+
+/* A block of class cls whose first zero bytes are zero; NULL if out of
+ * memory. */
+void *dr_slab_alloc(int cls, size_t zero);
+
+void dr_slab_free(int cls, void *block);
+
+/* Returns the calling thread's cached blocks to the shared pages. */
+void dr_slab_thread_exit(void);
+
+/* Pages taken from the system so far. */
+size_t dr_slab_pages(void);
+
+#ifdef __cplusplus
+}
+#endif
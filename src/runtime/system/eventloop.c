@@ -0,0 +1,613 @@
+#include "eventloop.h"
+#include "../memory/drstring.h"
+#include "../memory/memory.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <windows.h>
+#define io_read(fd, buf, n) _read(fd, buf, (unsigned)(n))
+#define io_write(fd, buf, n) _write(fd, buf, (unsigned)(n))
+#define io_close _close
+#else
+#include <unistd.h>
+#define io_read read
+#define io_write write
+#define io_close close
+#endif
+
+enum { OP_READ, OP_WRITE, OP_DELAY };
+
+/* An operation and the task it completes. The bytes to write, or the room
+ * for those read, follow it in the same block. */
+typedef struct DrIoOp {
+    Task* task;
+    struct DrIoOp* next;
+    int kind;
+    int fd;
+    int err;                     /* errno once it has failed */
+    size_t len;
+    size_t done;                 /* bytes moved so far */
+    unsigned long long deadline; /* OP_DELAY, CLOCK_MONOTONIC ns */
+    char buf[];
+} DrIoOp;
+
+static DrIoOp* new_op(int kind, int fd, size_t len) {
+    DrIoOp* op = (DrIoOp*)dr_alloc_heap_prefixed(0, sizeof(DrIoOp) + len);
+    if (!op) {
+        return NULL;
+    }
+    memset(op, 0, sizeof(DrIoOp));
+    op->task = dr_task_create_pending();
+    if (!op->task) {
+        dr_release(op);
+        return NULL;
+    }
+    op->kind = kind;
+    op->fd = fd;
+    op->len = len;
+    return op;
+}
+
+/* Sets the task's result and completes it, dropping the operation. */
+static void complete(DrIoOp* op) {
+    Task* task = op->task;
+    if (op->err) {
+        dr_task_set_error(task, strerror(op->err));
+    }
+    if (op->kind == OP_READ) {
+        task->result.string_val =
+            (char*)dr_str_from(op->buf, op->err ? 0 : op->done);
+    } else if (op->kind == OP_WRITE) {
+        task->result.int_val = op->err ? -1 : (int)op->done;
+    } else {
+        task->result.int_val = 0;
+    }
+    task->has_result = 1;
+    dr_task_complete(task);
+    dr_release(task);
+    dr_release(op);
+}
+
+static long transfer(DrIoOp* op, int sock);
+
+/* Moves bytes for op, on a socket if sock is set: nonzero once it is done
+ * or has failed, 0 while fd is not ready. A read takes what is there; a
+ * write goes on until all of it is written. */
+static int attempt(DrIoOp* op, int sock) {
+    for (;;) {
+        long n = transfer(op, sock);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            }
+            op->err = errno;
+            return 1;
+        }
+        op->done += (size_t)n;
+        if (op->kind == OP_READ || op->done == op->len) {
+            return 1;
+        }
+    }
+}
+
+static Task* start_io(DrIoOp* op);
+static Task* start_delay(DrIoOp* op, int ms);
+
+Task* dr_io_read(int fd, int max) {
+    DrIoOp* op = new_op(OP_READ, fd, max > 0 ? (size_t)max : 0);
+    return op ? start_io(op) : NULL;
+}
+
+Task* dr_io_write(int fd, const char* text) {
+    size_t len = dr_str_len(text);
+    DrIoOp* op = new_op(OP_WRITE, fd, len);
+    if (!op) {
+        return NULL;
+    }
+    if (len) {
+        memcpy(op->buf, text, len);
+    }
+    return start_io(op);
+}
+
+Task* dr_io_delay(int ms) {
+    DrIoOp* op = new_op(OP_DELAY, -1, 0);
+    return op ? start_delay(op, ms) : NULL;
+}
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <time.h>
+
+#define LOOP_EVENTS 64
+
+typedef struct {
+    DrIoOp* head;
+    DrIoOp* tail;
+} DrIoList;
+
+/* The operations waiting on a descriptor, reads first and writes second. */
+typedef struct {
+    DrIoList ops[2];
+    int added;    /* registered with the epoll instance */
+    int prepared; /* checked for being a socket */
+    int socket;   /* moved with recv and send */
+} DrIoFd;
+
+/* Guards the descriptor table and the timers. */
+static pthread_mutex_t io_lock = PTHREAD_MUTEX_INITIALIZER;
+static DrIoFd* io_fds;
+static size_t io_nfds;
+static DrIoOp** timers; /* min-heap on deadline */
+static size_t ntimers, timers_cap;
+
+static int loop_epoll = -1;
+static int loop_timer = -1;
+/* 0 not started, 1 starting, 2 running, 3 failed with loop_error */
+static atomic_int loop_state;
+static int loop_error;
+
+static void push(DrIoList* list, DrIoOp* op) {
+    op->next = NULL;
+    if (list->tail) {
+        list->tail->next = op;
+    } else {
+        list->head = op;
+    }
+    list->tail = op;
+}
+
+static DrIoOp* pop(DrIoList* list) {
+    DrIoOp* op = list->head;
+    if (op) {
+        list->head = op->next;
+        if (!list->head) {
+            list->tail = NULL;
+        }
+    }
+    return op;
+}
+
+static void complete_all(DrIoList* list) {
+    DrIoOp* op;
+    while ((op = pop(list))) {
+        complete(op);
+    }
+}
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull +
+           (unsigned long long)ts.tv_nsec;
+}
+
+static void* loop_main(void* arg);
+
+/* Starts the loop thread if need be: 0 once it runs, else an errno. */
+static int start_loop(void) {
+    int state = atomic_load_explicit(&loop_state, memory_order_acquire);
+    if (state == 2) {
+        return 0;
+    }
+    int expected = 0;
+    if (state != 0 ||
+        !atomic_compare_exchange_strong(&loop_state, &expected, 1)) {
+        while ((state = atomic_load_explicit(&loop_state,
+                                             memory_order_acquire)) == 1) {
+            sched_yield();
+        }
+        return state == 2 ? 0 : loop_error;
+    }
+    int err = 0;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof ev);
+    loop_epoll = epoll_create1(EPOLL_CLOEXEC);
+    loop_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    ev.events = EPOLLIN;
+    ev.data.fd = loop_timer;
+    if (loop_epoll < 0 || loop_timer < 0 ||
+        epoll_ctl(loop_epoll, EPOLL_CTL_ADD, loop_timer, &ev) != 0) {
+        err = errno;
+    } else {
+        pthread_t thread;
+        err = pthread_create(&thread, NULL, loop_main, NULL);
+        if (!err) {
+            pthread_detach(thread);
+        }
+    }
+    loop_error = err;
+    atomic_store_explicit(&loop_state, err ? 3 : 2, memory_order_release);
+    return err;
+}
+
+static DrIoFd* fd_slot(int fd) {
+    if ((size_t)fd >= io_nfds) {
+        size_t n = io_nfds ? io_nfds : 64;
+        while (n <= (size_t)fd) {
+            n *= 2;
+        }
+        DrIoFd* grown = (DrIoFd*)realloc(io_fds, n * sizeof(DrIoFd));
+        if (!grown) {
+            return NULL;
+        }
+        memset(grown + io_nfds, 0, (n - io_nfds) * sizeof(DrIoFd));
+        io_fds = grown;
+        io_nfds = n;
+    }
+    return &io_fds[fd];
+}
+
+static void prepare(int fd, DrIoFd* f) {
+    struct stat st;
+    f->socket = fstat(fd, &st) == 0 && S_ISSOCK(st.st_mode);
+    f->prepared = 1;
+}
+
+/* A write that fails with EPIPE instead of raising SIGPIPE: the signal is
+ * held back around it, and one it raised is taken again unless it was
+ * pending already. */
+static long write_quiet(int fd, const char* buf, size_t len) {
+    sigset_t pipe_set, old, pending;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set, &old);
+    sigpending(&pending);
+    int was_pending = sigismember(&pending, SIGPIPE);
+    long n = (long)write(fd, buf, len);
+    int err = errno;
+    if (n < 0 && err == EPIPE && !was_pending) {
+        struct timespec zero = {0, 0};
+        sigtimedwait(&pipe_set, NULL, &zero);
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    errno = err;
+    return n;
+}
+
+/*
+ * Reads or writes once for op without blocking. The descriptor's own mode
+ * is left as it is, since other code, or another process as with a
+ * terminal, may share it: sockets take per-call flags, and any other
+ * descriptor in blocking mode is switched out of it for the call only.
+ */
+static long transfer(DrIoOp* op, int sock) {
+    char* at = op->buf + op->done;
+    size_t left = op->len - op->done;
+    if (sock) {
+        return op->kind == OP_READ
+                   ? (long)recv(op->fd, at, left, MSG_DONTWAIT)
+                   : (long)send(op->fd, at, left, MSG_DONTWAIT | MSG_NOSIGNAL);
+    }
+    int flags = fcntl(op->fd, F_GETFL);
+    int borrowed = flags >= 0 && !(flags & O_NONBLOCK);
+    if (borrowed) {
+        fcntl(op->fd, F_SETFL, flags | O_NONBLOCK);
+    }
+    long n = op->kind == OP_READ ? (long)read(op->fd, at, left)
+                                 : write_quiet(op->fd, at, left);
+    if (borrowed) {
+        int err = errno;
+        fcntl(op->fd, F_SETFL, flags);
+        errno = err;
+    }
+    return n;
+}
+
+/* Has epoll report once when fd is ready for what its operations wait
+ * for: 0 or an errno. */
+static int arm(int fd, DrIoFd* f) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof ev);
+    ev.events = (f->ops[0].head ? EPOLLIN : 0) |
+                (f->ops[1].head ? EPOLLOUT : 0);
+    if (!ev.events) {
+        return 0;
+    }
+    ev.events |= EPOLLONESHOT;
+    ev.data.fd = fd;
+    int how = f->added ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(loop_epoll, how, fd, &ev) != 0) {
+        /* The descriptor was closed elsewhere and its number reused. */
+        if (errno == ENOENT) {
+            how = EPOLL_CTL_ADD;
+        } else if (errno == EEXIST) {
+            how = EPOLL_CTL_MOD;
+        } else {
+            return errno;
+        }
+        if (epoll_ctl(loop_epoll, how, fd, &ev) != 0) {
+            return errno;
+        }
+    }
+    f->added = 1;
+    return 0;
+}
+
+static void fail_waiting(DrIoFd* f, int err, DrIoList* done) {
+    for (int k = 0; k < 2; k++) {
+        DrIoOp* op;
+        while ((op = pop(&f->ops[k]))) {
+            op->err = err;
+            push(done, op);
+        }
+    }
+}
+
+/* Runs what is waiting on fd as far as it goes, and watches it again. */
+static void service(int fd, DrIoList* done) {
+    if ((size_t)fd >= io_nfds) {
+        return;
+    }
+    DrIoFd* f = &io_fds[fd];
+    for (int k = 0; k < 2; k++) {
+        while (f->ops[k].head && attempt(f->ops[k].head, f->socket)) {
+            push(done, pop(&f->ops[k]));
+        }
+    }
+    int err = arm(fd, f);
+    if (err) {
+        fail_waiting(f, err, done);
+    }
+}
+
+static Task* start_io(DrIoOp* op) {
+    Task* task = op->task;
+    dr_retain(task);
+    int k = op->kind == OP_WRITE;
+    int err = op->fd < 0 ? EBADF : start_loop();
+    if (err) {
+        op->err = err;
+        complete(op);
+        return task;
+    }
+    pthread_mutex_lock(&io_lock);
+    DrIoFd* f = fd_slot(op->fd);
+    int waiting = 0;
+    if (!f) {
+        op->err = ENOMEM;
+    } else {
+        if (!f->prepared) {
+            prepare(op->fd, f);
+        }
+        /* Behind others waiting, or not ready: wait for epoll. */
+        if (f->ops[k].head || !attempt(op, f->socket)) {
+            push(&f->ops[k], op);
+            waiting = 1;
+            if (f->ops[k].head == op && (err = arm(op->fd, f)) != 0) {
+                pop(&f->ops[k]);
+                op->err = err;
+                waiting = 0;
+            }
+        }
+    }
+    pthread_mutex_unlock(&io_lock);
+    if (!waiting) {
+        complete(op);
+    }
+    return task;
+}
+
+static void arm_timer(void) {
+    struct itimerspec its;
+    memset(&its, 0, sizeof its);
+    if (ntimers) {
+        its.it_value.tv_sec = (time_t)(timers[0]->deadline / 1000000000ull);
+        its.it_value.tv_nsec = (long)(timers[0]->deadline % 1000000000ull);
+    }
+    timerfd_settime(loop_timer, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+static int timer_push(DrIoOp* op) {
+    if (ntimers == timers_cap) {
+        size_t cap = timers_cap ? timers_cap * 2 : 64;
+        DrIoOp** grown = (DrIoOp**)realloc(timers, cap * sizeof(DrIoOp*));
+        if (!grown) {
+            return 0;
+        }
+        timers = grown;
+        timers_cap = cap;
+    }
+    size_t i = ntimers++;
+    while (i && timers[(i - 1) / 2]->deadline > op->deadline) {
+        timers[i] = timers[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    timers[i] = op;
+    return 1;
+}
+
+static DrIoOp* timer_pop(void) {
+    DrIoOp* top = timers[0];
+    DrIoOp* last = timers[--ntimers];
+    size_t i = 0;
+    for (;;) {
+        size_t c = 2 * i + 1;
+        if (c >= ntimers) {
+            break;
+        }
+        if (c + 1 < ntimers && timers[c + 1]->deadline < timers[c]->deadline) {
+            c++;
+        }
+        if (last->deadline <= timers[c]->deadline) {
+            break;
+        }
+        timers[i] = timers[c];
+        i = c;
+    }
+    if (ntimers) {
+        timers[i] = last;
+    }
+    return top;
+}
+
+static void expire(DrIoList* done) {
+    uint64_t ticks;
+    while (read(loop_timer, &ticks, sizeof ticks) > 0) {
+    }
+    unsigned long long now = now_ns();
+    while (ntimers && timers[0]->deadline <= now) {
+        push(done, timer_pop());
+    }
+    arm_timer();
+}
+
+static Task* start_delay(DrIoOp* op, int ms) {
+    Task* task = op->task;
+    dr_retain(task);
+    int err = ms > 0 ? start_loop() : 0;
+    if (ms <= 0 || err) {
+        op->err = err;
+        complete(op);
+        return task;
+    }
+    op->deadline = now_ns() + (unsigned long long)ms * 1000000ull;
+    pthread_mutex_lock(&io_lock);
+    int queued = timer_push(op);
+    if (queued && timers[0] == op) {
+        arm_timer();
+    }
+    pthread_mutex_unlock(&io_lock);
+    if (!queued) {
+        op->err = ENOMEM;
+        complete(op);
+    }
+    return task;
+}
+
+/* Completes the tasks outside the lock: their continuations may start
+ * more I/O. */
+static void* loop_main(void* arg) {
+    (void)arg;
+    struct epoll_event events[LOOP_EVENTS];
+    for (;;) {
+        int n = epoll_wait(loop_epoll, events, LOOP_EVENTS, -1);
+        if (n <= 0) {
+            continue;
+        }
+        DrIoList done = {NULL, NULL};
+        pthread_mutex_lock(&io_lock);
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.fd == loop_timer) {
+                expire(&done);
+            } else {
+                service(events[i].data.fd, &done);
+            }
+        }
+        pthread_mutex_unlock(&io_lock);
+        complete_all(&done);
+    }
+    return NULL;
+}
+
+int dr_io_pipe(int* fds) {
+    return pipe2(fds, O_NONBLOCK | O_CLOEXEC) == 0 ? 0 : -1;
+}
+
+int dr_io_socketpair(int* fds) {
+    return socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+                      fds) == 0
+               ? 0
+               : -1;
+}
+
+int dr_io_close(int fd) {
+    DrIoList done = {NULL, NULL};
+    /* Closed under the lock, so the number is not reused before the slot
+     * is cleared. */
+    pthread_mutex_lock(&io_lock);
+    if (fd >= 0 && (size_t)fd < io_nfds) {
+        DrIoFd* f = &io_fds[fd];
+        if (f->added) {
+            epoll_ctl(loop_epoll, EPOLL_CTL_DEL, fd, NULL);
+        }
+        fail_waiting(f, ECANCELED, &done);
+        memset(f, 0, sizeof(DrIoFd));
+    }
+    int rc = io_close(fd);
+    pthread_mutex_unlock(&io_lock);
+    complete_all(&done);
+    return rc == 0 ? 0 : -1;
+}
+
+#else /* no epoll: each operation runs to the end on the calling thread */
+#ifndef _WIN32
+#include <sys/socket.h>
+#endif
+
+static long transfer(DrIoOp* op, int sock) {
+    (void)sock;
+    return op->kind == OP_READ
+               ? (long)io_read(op->fd, op->buf, op->len)
+               : (long)io_write(op->fd, op->buf + op->done,
+                                op->len - op->done);
+}
+
+static Task* start_io(DrIoOp* op) {
+    Task* task = op->task;
+    dr_retain(task);
+    if (!attempt(op, 0)) {
+        op->err = EAGAIN;
+    }
+    complete(op);
+    return task;
+}
+
+static void* sleep_ms(void* arg) {
+    int ms = (int)(intptr_t)arg;
+#ifdef _WIN32
+    Sleep((DWORD)ms);
+#else
+    usleep((useconds_t)ms * 1000);
+#endif
+    return NULL;
+}
+
+static Task* start_delay(DrIoOp* op, int ms) {
+    dr_release(op->task);
+    dr_release(op);
+    if (ms <= 0) {
+        ms = 0;
+    }
+    return dr_task_create(sleep_ms, (void*)(intptr_t)ms);
+}
+
+int dr_io_pipe(int* fds) {
+#ifdef _WIN32
+    return _pipe(fds, 65536, _O_BINARY) == 0 ? 0 : -1;
+#else
+    return pipe(fds) == 0 ? 0 : -1;
+#endif
+}
+
+int dr_io_socketpair(int* fds) {
+#ifdef _WIN32
+    (void)fds;
+    errno = ENOSYS;
+    return -1;
+#else
+    return socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0 ? 0 : -1;
+#endif
+}
+
+int dr_io_close(int fd) {
+    return io_close(fd) == 0 ? 0 : -1;
+}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef DR_EVENTLOOP_H
+#define DR_EVENTLOOP_H
+
+#include "task.h"
+
+/*
+ * Event loop for asynchronous I/O and timers.
+ *
+ * Reads, writes and delays return a task, completed once the operation is
+ * done; awaiting it from a coroutine holds no thread meanwhile. An
+ * operation is tried right away and only waits if the descriptor is not
+ * ready. The waiting ones are watched by a single loop thread, started by
+ * the first of them, through epoll, with the delays on one timerfd; it
+ * performs each operation once its descriptor is ready and completes its
+ * task, which queues the coroutines awaiting it on the worker pool.
+ *
+ * A descriptor keeps its mode, so a terminal shared with other code reads
+ * as before: a blocking one is switched to non-blocking mode for each try
+ * only, and sockets are not switched at all. A write to a pipe or socket
+ * nobody reads fails with EPIPE rather than raising SIGPIPE. Operations on
+ * one descriptor complete in the order they were started, reads and writes
+ * separately. Where epoll is not available the operations complete
+ * synchronously.
+ */
+
+/**
+ * @brief Reads up to max bytes from fd.
+ *
+ * @return A task whose string result holds the bytes read, empty at end of
+ * file, or NULL if out of memory. It fails if the read fails.
+ */
+Task* dr_io_read(int fd, int max);
+
+/**
+ * @brief Writes all of text to fd.
+ *
+ * @param text The bytes to write; copied, so it may go once this returns.
+ * @return A task whose int result is the number of bytes written, or NULL
+ * if out of memory. It fails, with result -1, if the write fails.
+ */
+Task* dr_io_write(int fd, const char* text);
+
+/**
+ * @brief A task completing after ms milliseconds, with int result 0.
+ */
+Task* dr_io_delay(int ms);
+
+/**
+ * @brief Opens a non-blocking pipe: fds[0] reads what fds[1] writes.
+ * @return 0 on success, -1 on error.
+ */
+int dr_io_pipe(int* fds);
+
+/**
+ * @brief Opens a connected pair of non-blocking Unix stream sockets.
+ * @return 0 on success, -1 on error.
+ */
+int dr_io_socketpair(int* fds);
+
+/**
+ * @brief Closes fd, failing the operations still waiting on it.
+ * @return 0 on success, -1 on error.
+ */
+int dr_io_close(int fd);
+
+#endif /* DR_EVENTLOOP_H */
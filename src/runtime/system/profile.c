@@ -0,0 +1,55 @@
+#include "profile.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static const DrProfSite *prof_sites;
+static const unsigned long long *prof_counts;
+static size_t prof_nsites;
+static const char *prof_path;
+
+static void dr_profile_atexit(void) {
+    dr_profile_dump();
+}
+
+void dr_profile_start(const DrProfSite *sites, const unsigned long long *counts,
+                      size_t n, const char *path) {
+    int registered = prof_path != NULL;
+    prof_sites = sites;
+    prof_counts = counts;
+    prof_nsites = n;
+    prof_path = path;
+    if (!registered)
+        atexit(dr_profile_atexit);
+}
+
+int dr_profile_dump(void) {
+    if (!prof_path)
+        return -1;
+    FILE *f = fopen(prof_path, "w");
+    if (!f) {
+        fprintf(stderr, "dream: cannot write profile %s\n", prof_path);
+        return -1;
+    }
+    fprintf(f, "drprof 1\n");
+    size_t slot = 0;
+    for (size_t i = 0; i < prof_nsites; i++) {
+        const DrProfSite *s = &prof_sites[i];
+        switch (s->kind) {
+        case 'f':
+            fprintf(f, "func %s %llu\n", s->func, prof_counts[slot++]);
+            break;
+        case 'c':
+            fprintf(f, "call %s %u %u %s %llu\n", s->func, s->line, s->column,
+                    s->callee, prof_counts[slot++]);
+            break;
+        case 'b':
+            fprintf(f, "branch %s %u %u %llu %llu\n", s->func, s->line, s->column,
+                    prof_counts[slot], prof_counts[slot + 1]);
+            slot += 2;
+            break;
+        default:
+            break;
+        }
+    }
+    return fclose(f) == 0 ? 0 : -1;
+}
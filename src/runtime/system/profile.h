@@ -0,0 +1,40 @@
+#ifndef DR_PROFILE_H
+#define DR_PROFILE_H
+
+#include <stddef.h>
+
+/*
+ * Counters of --profile-generate builds.
+ *
+ * The generated program defines one DrProfSite per counter site and an
+ * array of counters it increments in place: one slot per function or call
+ * site, two (taken, not taken) per branch. dr_profile_start() arranges for
+ * the counts to be written as a `.drprof` file, the format read back by
+ * --profile-use, when the program exits.
+ */
+
+typedef struct {
+    char kind;          /**< 'f' function entry, 'c' call site, 'b' branch. */
+    const char *func;   /**< Function containing the site. */
+    unsigned line;      /**< Source line, 0 for functions. */
+    unsigned column;    /**< Branch column or call ordinal within the line. */
+    const char *callee; /**< Called function for call sites, else NULL. */
+} DrProfSite;
+
+/**
+ * @brief Registers the counters to write to path at exit.
+ * @param sites Counter sites.
+ * @param counts Counter slots, two per branch site.
+ * @param n Number of sites.
+ * @param path Output file; an existing profile is overwritten.
+ */
+void dr_profile_start(const DrProfSite *sites, const unsigned long long *counts,
+                      size_t n, const char *path);
+
+/**
+ * @brief Writes the registered counters now.
+ * @return 0 on success, -1 if nothing is registered or the file cannot be written.
+ */
+int dr_profile_dump(void);
+
+#endif
@@ -0,0 +1,348 @@
+#include "scheduler.h"
+#include "../memory/memory.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+typedef CRITICAL_SECTION dr_mutex_t;
+typedef CONDITION_VARIABLE dr_cond_t;
+#define mutex_init(m) InitializeCriticalSection(m)
+#define mutex_lock(m) EnterCriticalSection(m)
+#define mutex_unlock(m) LeaveCriticalSection(m)
+#define cond_init(c) InitializeConditionVariable(c)
+#define cond_wait(c, m) SleepConditionVariableCS(c, m, INFINITE)
+#define cond_broadcast(c) WakeAllConditionVariable(c)
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+typedef pthread_mutex_t dr_mutex_t;
+typedef pthread_cond_t dr_cond_t;
+#define mutex_init(m) pthread_mutex_init(m, NULL)
+#define mutex_lock(m) pthread_mutex_lock(m)
+#define mutex_unlock(m) pthread_mutex_unlock(m)
+#define cond_init(c) pthread_cond_init(c, NULL)
+#define cond_wait(c, m) pthread_cond_wait(c, m)
+#define cond_broadcast(c) pthread_cond_broadcast(c)
+#endif
+
+#define DR_MAX_WORKERS 64
+#define DR_DEQUE_MIN 64
+
+/* A deque's storage; grown by its owner, which keeps the old ring for
+ * thieves that may still be reading it. */
+typedef struct DrRing {
+    long size; /* a power of two */
+    struct DrRing *old;
+    _Atomic(DrJob *) jobs[];
+} DrRing;
+
+/* Chase-Lev deque: the owner works the bottom, thieves the top. */
+typedef struct {
+    _Alignas(64) _Atomic long top;
+    _Alignas(64) _Atomic long bottom;
+    _Atomic(DrRing *) ring;
+} DrDeque;
+
+static DrDeque deques[DR_MAX_WORKERS];
+static int nworkers;
+/* 0 until the first use, 1 while starting the workers, then 2. */
+static _Atomic int sched_state;
+
+/* Jobs submitted by threads that are not workers. */
+static dr_mutex_t shared_lock;
+static DrJob *shared_head, *shared_tail;
+static _Atomic size_t shared_len;
+
+/* Sleepers wait for epoch to move; it does on every submission and
+ * notification. */
+static dr_mutex_t sleep_lock;
+static dr_cond_t sleep_cond;
+static _Atomic unsigned long epoch;
+static _Atomic int sleepers;
+
+/* Index of the calling worker, -1 on other threads. */
+static _Thread_local int dr_worker = -1;
+/* Jobs the calling thread runs inside dr_sched_wait, nested. */
+static _Thread_local int dr_depth;
+static _Thread_local unsigned dr_seed;
+
+static DrRing *ring_new(long size) {
+    DrRing *r = calloc(1, sizeof(DrRing) + (size_t)size * sizeof(DrJob *));
+    if (r) r->size = size;
+    return r;
+}
+
+static DrRing *ring_grow(DrRing *r, long top, long bottom) {
+    DrRing *bigger = ring_new(r->size * 2);
+    if (!bigger) return NULL;
+    for (long i = top; i < bottom; i++)
+        atomic_store_explicit(
+            &bigger->jobs[i & (bigger->size - 1)],
+            atomic_load_explicit(&r->jobs[i & (r->size - 1)],
+                                 memory_order_relaxed),
+            memory_order_relaxed);
+    bigger->old = r;
+    return bigger;
+}
+
+/* Owner only; 0 if the deque could not grow. */
+static int deque_push(DrDeque *d, DrJob *job) {
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    DrRing *r = atomic_load_explicit(&d->ring, memory_order_relaxed);
+    if (b - t > r->size - 1) {
+        r = ring_grow(r, t, b);
+        if (!r) return 0;
+        atomic_store_explicit(&d->ring, r, memory_order_release);
+    }
+    atomic_store_explicit(&r->jobs[b & (r->size - 1)], job,
+                          memory_order_relaxed);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_release);
+    return 1;
+}
+
+/* Owner only: the newest job, or NULL. */
+static DrJob *deque_take(DrDeque *d) {
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    DrRing *r = atomic_load_explicit(&d->ring, memory_order_relaxed);
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&d->top, memory_order_relaxed);
+    DrJob *job = NULL;
+    if (t <= b) {
+        job = atomic_load_explicit(&r->jobs[b & (r->size - 1)],
+                                   memory_order_relaxed);
+        if (t == b) {
+            /* The last one; a thief may be after it too. */
+            if (!atomic_compare_exchange_strong_explicit(
+                    &d->top, &t, t + 1, memory_order_seq_cst,
+                    memory_order_relaxed))
+                job = NULL;
+            atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        }
+    } else {
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+    return job;
+}
+
+/* Any thread: the oldest job, or NULL; sets *lost if another thread took
+ * it first. */
+static DrJob *deque_steal(DrDeque *d, int *lost) {
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    if (t >= b) return NULL;
+    DrRing *r = atomic_load_explicit(&d->ring, memory_order_acquire);
+    DrJob *job = atomic_load_explicit(&r->jobs[t & (r->size - 1)],
+                                      memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                                 memory_order_seq_cst,
+                                                 memory_order_relaxed)) {
+        *lost = 1;
+        return NULL;
+    }
+    return job;
+}
+
+static void shared_push(DrJob *job) {
+    job->next = NULL;
+    mutex_lock(&shared_lock);
+    if (shared_tail) shared_tail->next = job;
+    else shared_head = job;
+    shared_tail = job;
+    atomic_fetch_add_explicit(&shared_len, 1, memory_order_relaxed);
+    mutex_unlock(&shared_lock);
+}
+
+static DrJob *shared_pop(void) {
+    if (!atomic_load_explicit(&shared_len, memory_order_relaxed)) return NULL;
+    mutex_lock(&shared_lock);
+    DrJob *job = shared_head;
+    if (job) {
+        shared_head = job->next;
+        if (!shared_head) shared_tail = NULL;
+        atomic_fetch_sub_explicit(&shared_len, 1, memory_order_relaxed);
+    }
+    mutex_unlock(&shared_lock);
+    return job;
+}
+
+static unsigned next_random(void) {
+    if (!dr_seed) dr_seed = (unsigned)(uintptr_t)&dr_seed | 1u;
+    dr_seed ^= dr_seed << 13;
+    dr_seed ^= dr_seed >> 17;
+    dr_seed ^= dr_seed << 5;
+    return dr_seed;
+}
+
+/* Own jobs first, then submitted ones, then those of a random victim. */
+static DrJob *find_work(int *lost) {
+    DrJob *job;
+    if (dr_worker >= 0 && (job = deque_take(&deques[dr_worker]))) return job;
+    if ((job = shared_pop())) return job;
+    int n = nworkers;
+    if (!n) return NULL;
+    int start = (int)(next_random() % (unsigned)n);
+    for (int i = 0; i < n; i++) {
+        int victim = (start + i) % n;
+        if (victim != dr_worker && (job = deque_steal(&deques[victim], lost)))
+            return job;
+    }
+    return NULL;
+}
+
+static void wake(void) {
+    atomic_fetch_add_explicit(&epoch, 1, memory_order_seq_cst);
+    if (atomic_load_explicit(&sleepers, memory_order_seq_cst)) {
+        mutex_lock(&sleep_lock);
+        cond_broadcast(&sleep_cond);
+        mutex_unlock(&sleep_lock);
+    }
+}
+
+static void sleep_until_changed(unsigned long seen) {
+    mutex_lock(&sleep_lock);
+    atomic_fetch_add_explicit(&sleepers, 1, memory_order_seq_cst);
+    if (atomic_load_explicit(&epoch, memory_order_seq_cst) == seen)
+        cond_wait(&sleep_cond, &sleep_lock);
+    atomic_fetch_sub_explicit(&sleepers, 1, memory_order_seq_cst);
+    mutex_unlock(&sleep_lock);
+}
+
+/*
+ * Runs a job if there is one; otherwise sleeps until something changes,
+ * unless ready says the caller need not wait any more. Returns 0 only when
+ * ready did.
+ */
+static int work_or_sleep(int (*ready)(void *), void *arg) {
+    int lost = 0;
+    int helping = ready != NULL;
+    DrJob *job = helping && dr_depth >= DR_SCHED_HELP_DEPTH ? NULL
+                                                             : find_work(&lost);
+    if (!job && !lost) {
+        /* Look again after noting the epoch, so a submission in between
+         * is either seen or keeps us awake. */
+        unsigned long seen = atomic_load_explicit(&epoch, memory_order_seq_cst);
+        if (ready && ready(arg)) return 0;
+        if (!helping || dr_depth < DR_SCHED_HELP_DEPTH) job = find_work(&lost);
+        if (!job && !lost) {
+            if (dr_worker >= 0) dr_memory_thread_idle();
+            sleep_until_changed(seen);
+        }
+    }
+    if (job) {
+        dr_depth += helping;
+        job->run(job);
+        dr_depth -= helping;
+    }
+    return 1;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI worker_main(LPVOID param) {
+#else
+static void *worker_main(void *param) {
+#endif
+    dr_worker = (int)(intptr_t)param;
+    for (;;)
+        work_or_sleep(NULL, NULL);
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+static int worker_count(void) {
+    const char *env = getenv("DREAM_WORKERS");
+    long n = env && *env ? strtol(env, NULL, 10) : 0;
+    if (n <= 0) {
+#ifdef _WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        n = (long)info.dwNumberOfProcessors;
+#else
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    }
+    if (n < 1) n = 1;
+    if (n > DR_MAX_WORKERS) n = DR_MAX_WORKERS;
+    return (int)n;
+}
+
+static void start_workers(void) {
+    if (atomic_load_explicit(&sched_state, memory_order_acquire) == 2) return;
+    int expected = 0;
+    if (!atomic_compare_exchange_strong(&sched_state, &expected, 1)) {
+        while (atomic_load_explicit(&sched_state, memory_order_acquire) != 2) {
+#ifdef _WIN32
+            SwitchToThread();
+#else
+            sched_yield();
+#endif
+        }
+        return;
+    }
+    mutex_init(&shared_lock);
+    mutex_init(&sleep_lock);
+    cond_init(&sleep_cond);
+    int n = worker_count();
+    for (int i = 0; i < n; i++) {
+        DrRing *r = ring_new(DR_DEQUE_MIN);
+        if (!r) {
+            n = i;
+            break;
+        }
+        atomic_store_explicit(&deques[i].ring, r, memory_order_relaxed);
+    }
+    nworkers = n;
+    /* A worker that fails to start leaves an empty deque; waiting threads
+     * run the jobs then. */
+    for (int i = 0; i < n; i++) {
+#ifdef _WIN32
+        HANDLE h = CreateThread(NULL, 0, worker_main, (LPVOID)(intptr_t)i, 0,
+                                NULL);
+        if (h) CloseHandle(h);
+#else
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, worker_main, (void *)(intptr_t)i) == 0)
+            pthread_detach(thread);
+#endif
+    }
+    atomic_store_explicit(&sched_state, 2, memory_order_release);
+}
+
+void dr_sched_submit(DrJob *job) {
+    start_workers();
+    if (dr_worker < 0 || !deque_push(&deques[dr_worker], job))
+        shared_push(job);
+    wake();
+}
+
+int dr_sched_help(void) {
+    start_workers();
+    int lost = 0;
+    DrJob *job = find_work(&lost);
+    if (!job) return 0;
+    job->run(job);
+    return 1;
+}
+
+void dr_sched_wait(int (*ready)(void *), void *arg) {
+    start_workers();
+    while (!ready(arg) && work_or_sleep(ready, arg))
+        ;
+}
+
+void dr_sched_notify(void) {
+    wake();
+}
+
+int dr_sched_workers(void) {
+    start_workers();
+    return nworkers;
+}
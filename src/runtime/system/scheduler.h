@@ -0,0 +1,55 @@
+#ifndef DR_SCHEDULER_H
+#define DR_SCHEDULER_H
+
+/*
+ * Worker pool running the jobs of async tasks.
+ *
+ * A fixed set of worker threads, one per CPU unless DREAM_WORKERS says
+ * otherwise, is started by the first submission. Each worker keeps its
+ * jobs in a Chase-Lev deque: it pushes and takes at the bottom, newest
+ * first, while idle workers steal the oldest from the top. Jobs submitted
+ * by other threads go to a shared queue. A thread waiting for something
+ * runs pending jobs meanwhile and only sleeps once there are none, or once
+ * it is nested DR_SCHED_HELP_DEPTH jobs deep in such waits; what it waits
+ * for must then be making progress elsewhere.
+ */
+
+#define DR_SCHED_HELP_DEPTH 32
+
+/**
+ * @brief A unit of work; embedded at the start of what it runs.
+ */
+typedef struct DrJob {
+    void (*run)(struct DrJob *job); /**< Called once, on any thread. */
+    struct DrJob *next;             /**< Link in the shared queue. */
+} DrJob;
+
+/**
+ * @brief Queues job to run on a worker; from a worker it goes to that
+ * worker's own deque.
+ */
+void dr_sched_submit(DrJob *job);
+
+/**
+ * @brief Runs one pending job on the calling thread.
+ * @return 1 if a job ran, 0 if none was pending.
+ */
+int dr_sched_help(void);
+
+/**
+ * @brief Returns once ready(arg) is nonzero, running pending jobs until
+ * then. Whatever makes ready true must call dr_sched_notify() afterwards.
+ */
+void dr_sched_wait(int (*ready)(void *), void *arg);
+
+/**
+ * @brief Wakes the threads sleeping in dr_sched_wait to check again.
+ */
+void dr_sched_notify(void);
+
+/**
+ * @brief Number of worker threads, starting them if need be.
+ */
+int dr_sched_workers(void);
+
+#endif /* DR_SCHEDULER_H */
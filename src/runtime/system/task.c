@@ -1,143 +1,356 @@
 #include "task.h"
+#include "../memory/drstring.h"
 #include "../memory/memory.h"
-#include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 
-#ifdef _WIN32
-static DWORD WINAPI thread_wrapper(LPVOID param) {
-    ThreadContext* ctx = (ThreadContext*)param;
-    void* result = ctx->func(ctx->arg);
-    
-    // Update task state
-    ctx->task->state = TASK_COMPLETED;
-    if (result) {
-        ctx->task->result.ptr_val = result;
-        ctx->task->has_result = 1;
-    }
-    
-    free(ctx);
-    return 0;
+/* Left as a task's continuation list once it has completed. */
+#define CONTINUATIONS_DONE ((DrContinuation*)1)
+
+static _Thread_local Task* current_task = NULL;
+/* Awaited tasks dr_task_suspend is running inline on this thread. */
+static _Thread_local int inline_depth = 0;
+
+static TaskState load_state(Task* task) {
+    return __atomic_load_n(&task->state, __ATOMIC_ACQUIRE);
+}
+
+/* Nonzero for the one thread that gets to run the task. */
+static int claim(Task* task) {
+    return !__atomic_exchange_n(&task->claimed, 1, __ATOMIC_ACQ_REL);
 }
-#else
-static void* thread_wrapper(void* param) {
-    ThreadContext* ctx = (ThreadContext*)param;
-    void* result = ctx->func(ctx->arg);
-    
-    // Update task state
-    ctx->task->state = TASK_COMPLETED;
-    if (result) {
-        ctx->task->result.ptr_val = result;
-        ctx->task->has_result = 1;
+
+static void finish(Task* task) {
+    __atomic_store_n(&task->state,
+                     task->error_msg ? TASK_FAILED : TASK_COMPLETED,
+                     __ATOMIC_RELEASE);
+    DrContinuation* list = __atomic_exchange_n(
+        &task->continuations, CONTINUATIONS_DONE, __ATOMIC_ACQ_REL);
+    /* Added newest first; they run oldest first. */
+    DrContinuation* order = NULL;
+    while (list) {
+        DrContinuation* next = list->next;
+        list->next = order;
+        order = list;
+        list = next;
     }
-    
-    free(ctx);
-    return NULL;
+    while (order) {
+        DrContinuation* next = order->next;
+        order->run(order, task);
+        order = next;
+    }
+    dr_sched_notify();
 }
-#endif
 
-Task* dr_task_create(void* (*func)(void*), void* arg) {
-    Task* task = (Task*)dr_alloc(sizeof(Task));
+/* Runs the task, or the coroutine up to its next suspension point. Once a
+ * coroutine has suspended, the task may be running elsewhere already. */
+static void execute(Task* task) {
+    Task* outer = current_task;
+    current_task = task;
+    if (task->resume) {
+        int suspended = task->resume(task);
+        current_task = outer;
+        if (suspended) {
+            return;
+        }
+    } else {
+        void* result = task->func(task->arg);
+        current_task = outer;
+        if (result && !task->has_result) {
+            task->result.ptr_val = result;
+            task->has_result = 1;
+        }
+    }
+    finish(task);
+}
+
+static void run_task(DrJob* job) {
+    Task* task = (Task*)job;
+    if (claim(task)) {
+        execute(task);
+    }
+    /* The pool's reference, taken in dr_task_create. */
+    dr_release(task);
+}
+
+static void wake_task(DrJob* job) {
+    Task* task = (Task*)((char*)job - offsetof(Task, wake));
+    execute(task);
+    /* The reference dr_task_suspend took. */
+    dr_release(task);
+}
+
+static void resume_later(DrContinuation* cont, Task* awaited) {
+    (void)awaited;
+    Task* task = (Task*)((char*)cont - offsetof(Task, resume_cont));
+    /* Hands over the reference dr_task_suspend took. */
+    dr_sched_submit(&task->wake);
+}
+
+static Task* new_task(size_t frame_size) {
+    /* Tasks outlive any region the caller has open. */
+    Task* task = (Task*)dr_alloc_heap_prefixed(0, sizeof(Task) + frame_size);
     if (!task) {
         return NULL;
     }
-    
+    memset(task, 0, sizeof(Task) + frame_size);
+    task->job.run = run_task;
+    task->wake.run = wake_task;
+    task->resume_cont.run = resume_later;
     task->state = TASK_PENDING;
-    task->has_result = 0;
-    task->error_msg = NULL;
-    memset(&task->result, 0, sizeof(TaskResult));
-    
-    ThreadContext* ctx = (ThreadContext*)malloc(sizeof(ThreadContext));
-    if (!ctx) {
-        dr_release(task);
-        return NULL;
-    }
-    
-    ctx->func = func;
-    ctx->arg = arg;
-    ctx->task = task;
-    
-#ifdef _WIN32
-    task->thread = CreateThread(NULL, 0, thread_wrapper, ctx, 0, NULL);
-    if (task->thread == NULL) {
-        free(ctx);
-        dr_release(task);
+    return task;
+}
+
+Task* dr_task_create(void* (*func)(void*), void* arg) {
+    Task* task = new_task(0);
+    if (!task) {
         return NULL;
     }
-#else
-    int result = pthread_create(&task->thread, NULL, thread_wrapper, ctx);
-    if (result != 0) {
-        free(ctx);
-        dr_release(task);
+    task->func = func;
+    task->arg = arg;
+    dr_task_start(task);
+    return task;
+}
+
+Task* dr_task_create_coroutine(DrResume resume, size_t frame_size) {
+    Task* task = new_task(frame_size);
+    if (!task) {
         return NULL;
     }
-#endif
+    task->resume = resume;
+    task->arg = task + 1;
+    return task;
+}
 
+void dr_task_start(Task* task) {
+    dr_retain(task);
+    dr_sched_submit(&task->job);
+}
+
+Task* dr_task_create_pending(void) {
+    Task* task = new_task(0);
+    if (task) {
+        task->claimed = 1;
+    }
     return task;
 }
 
+void dr_task_complete(Task* task) {
+    finish(task);
+}
+
+static int task_done(void* task) {
+    return load_state((Task*)task) != TASK_PENDING;
+}
+
 TaskResult dr_task_await(Task* task) {
     if (!task) {
         TaskResult empty = {0};
         return empty;
     }
-    
-    if (task->state == TASK_PENDING) {
-#ifdef _WIN32
-        WaitForSingleObject(task->thread, INFINITE);
-#else
-        pthread_join(task->thread, NULL);
-#endif
-        task->state = TASK_COMPLETED;
+
+    /* A task nobody has started yet runs right here; a coroutine may
+     * suspend on the way. */
+    if (load_state(task) == TASK_PENDING && claim(task)) {
+        execute(task);
+    }
+    if (load_state(task) == TASK_PENDING) {
+        dr_sched_wait(task_done, task);
     }
-    
+
     return task->result;
 }
 
-int dr_task_is_complete(Task* task) {
-    if (!task) {
-        return 1;
+int dr_task_suspend(Task* task, Task* awaited) {
+    if (!awaited || load_state(awaited) != TASK_PENDING) {
+        return 0;
     }
-    
-    if (task->state != TASK_PENDING) {
-        return 1;
+    if (inline_depth < DR_SCHED_HELP_DEPTH && claim(awaited)) {
+        inline_depth++;
+        execute(awaited);
+        inline_depth--;
+        if (load_state(awaited) != TASK_PENDING) {
+            return 0;
+        }
     }
-    
-#ifdef _WIN32
-    DWORD result = WaitForSingleObject(task->thread, 0);
-    if (result == WAIT_OBJECT_0) {
-        task->state = TASK_COMPLETED;
+
+    dr_retain(task);
+    if (dr_task_add_continuation(awaited, &task->resume_cont)) {
         return 1;
     }
-#else
-    // On POSIX, we can't check without blocking, so we'll use a different approach
-    // For now, just return the current state
-#endif
-    
+    dr_release(task);
+    return 0;
+}
+
+int dr_task_add_continuation(Task* task, DrContinuation* cont) {
+    DrContinuation* head = __atomic_load_n(&task->continuations,
+                                           __ATOMIC_ACQUIRE);
+    do {
+        if (head == CONTINUATIONS_DONE) {
+            return 0;
+        }
+        cont->next = head;
+    } while (!__atomic_compare_exchange_n(&task->continuations, &head, cont,
+                                          1, __ATOMIC_ACQ_REL,
+                                          __ATOMIC_ACQUIRE));
+    return 1;
+}
+
+typedef struct {
+    DrContinuation cont;
+    DrTaskCallback callback;
+    void* arg;
+} DrCallback;
+
+static void run_callback(DrContinuation* cont, Task* task) {
+    DrCallback* cb = (DrCallback*)cont;
+    cb->callback(task, cb->arg);
+    dr_release(cb);
+}
+
+int dr_task_continue_with(Task* task, DrTaskCallback callback, void* arg) {
+    DrCallback* cb = (DrCallback*)dr_alloc_heap_prefixed(0, sizeof(DrCallback));
+    if (!cb) {
+        return -1;
+    }
+    cb->cont.run = run_callback;
+    cb->callback = callback;
+    cb->arg = arg;
+    if (!dr_task_add_continuation(task, &cb->cont)) {
+        run_callback(&cb->cont, task);
+    }
     return 0;
 }
 
+/*
+ * WhenAll and WhenAny: a task nothing runs, completed by the continuations
+ * linking it to the tasks it combines.
+ */
+struct DrWhen;
+
+typedef struct {
+    DrContinuation cont;
+    struct DrWhen* when;
+    int index;
+} DrWhenLink;
+
+typedef struct DrWhen {
+    Task* task;
+    size_t pending; /* links yet to run, plus one while linking */
+    int any;
+    int decided;    /* WhenAny: a task has completed */
+    int failed;     /* WhenAll: a task has failed */
+    int n;
+    DrWhenLink links[];
+} DrWhen;
+
+static void when_release(DrWhen* when) {
+    if (__atomic_sub_fetch(&when->pending, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+    Task* task = when->task;
+    if (!when->any) {
+        task->result.int_val = when->n;
+        task->has_result = 1;
+        if (__atomic_load_n(&when->failed, __ATOMIC_ACQUIRE)) {
+            dr_task_set_error(task, "one or more tasks failed");
+        }
+        finish(task);
+    } else if (!when->n) {
+        task->result.int_val = -1;
+        task->has_result = 1;
+        finish(task);
+    }
+    dr_release(task);
+    dr_release(when);
+}
+
+static void when_link_run(DrContinuation* cont, Task* done) {
+    DrWhenLink* link = (DrWhenLink*)cont;
+    DrWhen* when = link->when;
+    if (when->any) {
+        if (!__atomic_exchange_n(&when->decided, 1, __ATOMIC_ACQ_REL)) {
+            when->task->result.int_val = link->index;
+            when->task->has_result = 1;
+            finish(when->task);
+        }
+    } else if (load_state(done) == TASK_FAILED) {
+        __atomic_store_n(&when->failed, 1, __ATOMIC_RELEASE);
+    }
+    when_release(when);
+}
+
+static Task* when(Task** tasks, size_t n, int any) {
+    Task* task = dr_task_create_pending();
+    if (!task) {
+        return NULL;
+    }
+    DrWhen* w = (DrWhen*)dr_alloc_heap_prefixed(
+        0, sizeof(DrWhen) + n * sizeof(DrWhenLink));
+    if (!w) {
+        dr_release(task);
+        return NULL;
+    }
+    /* The combined task is completed from the links. */
+    dr_retain(task);
+    w->task = task;
+    w->pending = n + 1;
+    w->any = any;
+    w->decided = 0;
+    w->failed = 0;
+    w->n = (int)n;
+    for (size_t i = 0; i < n; i++) {
+        DrWhenLink* link = &w->links[i];
+        link->cont.run = when_link_run;
+        link->when = w;
+        link->index = (int)i;
+        if (!tasks[i] || !dr_task_add_continuation(tasks[i], &link->cont)) {
+            when_link_run(&link->cont, tasks[i] ? tasks[i] : task);
+        }
+    }
+    when_release(w);
+    return task;
+}
+
+Task* dr_task_when_all(Task** tasks, size_t n) {
+    return when(tasks, n, 0);
+}
+
+Task* dr_task_when_any(Task** tasks, size_t n) {
+    return when(tasks, n, 1);
+}
+
+TaskResult dr_task_take(Task* task) {
+    TaskResult result = dr_task_await(task);
+    dr_task_cleanup(task);
+    return result;
+}
+
+Task* dr_task_current(void) {
+    return current_task;
+}
+
+int dr_task_is_complete(Task* task) {
+    if (!task) {
+        return 1;
+    }
+    return task_done(task);
+}
+
 void dr_task_cleanup(Task* task) {
     if (!task) {
         return;
     }
-    
+
     // Make sure the task is complete before cleaning up
-    if (task->state == TASK_PENDING) {
+    if (load_state(task) == TASK_PENDING) {
         dr_task_await(task);
     }
-    
-#ifdef _WIN32
-    if (task->thread) {
-        CloseHandle(task->thread);
-    }
-#else
-    // pthread_t doesn't need explicit cleanup
-#endif
-    
+
     if (task->error_msg) {
         dr_release(task->error_msg);
     }
-    
+
     dr_release(task);
 }
 
@@ -145,7 +358,6 @@ void dr_task_set_int_result(Task* task, int value) {
     if (task) {
         task->result.int_val = value;
         task->has_result = 1;
-        task->state = TASK_COMPLETED;
     }
 }
 
@@ -153,19 +365,15 @@ void dr_task_set_float_result(Task* task, float value) {
     if (task) {
         task->result.float_val = value;
         task->has_result = 1;
-        task->state = TASK_COMPLETED;
     }
 }
 
 void dr_task_set_string_result(Task* task, const char* value) {
     if (task && value) {
-        size_t len = strlen(value);
-        char* copy = (char*)dr_alloc(len + 1);
+        char* copy = (char*)dr_str_from(value, dr_str_len(value));
         if (copy) {
-            strcpy(copy, value);
             task->result.string_val = copy;
             task->has_result = 1;
-            task->state = TASK_COMPLETED;
         }
     }
 }
@@ -174,18 +382,18 @@ void dr_task_set_ptr_result(Task* task, void* value) {
     if (task) {
         task->result.ptr_val = value;
         task->has_result = 1;
-        task->state = TASK_COMPLETED;
     }
 }
 
 void dr_task_set_error(Task* task, const char* error_msg) {
     if (task && error_msg) {
         size_t len = strlen(error_msg);
-        char* copy = (char*)dr_alloc(len + 1);
+        char* copy = (char*)dr_alloc_heap_prefixed(0, len + 1);
         if (copy) {
             strcpy(copy, error_msg);
+            /* A later error replaces an earlier one. */
+            dr_release(task->error_msg);
             task->error_msg = copy;
-            task->state = TASK_FAILED;
         }
     }
-}
\ No newline at end of file
+}
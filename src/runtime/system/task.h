@@ -1,19 +1,9 @@
 #ifndef TASK_H
 #define TASK_H
 
-#include "../../util/platform.h"
+#include "scheduler.h"
 #include <stddef.h>
 
-#ifdef _WIN32
-#include <windows.h>
-typedef HANDLE dr_thread_t;
-typedef DWORD (WINAPI *dr_thread_func_t)(LPVOID);
-#else
-#include <pthread.h>
-typedef pthread_t dr_thread_t;
-typedef void* (*dr_thread_func_t)(void*);
-#endif
-
 /**
  * @brief Represents the state of an async task.
  */
@@ -33,11 +23,57 @@ typedef union {
     void* ptr_val;
 } TaskResult;
 
+struct Task;
+
+/**
+ * @brief Resume function of a coroutine task.
+ *
+ * Runs the coroutine from its saved state up to its next suspension point.
+ *
+ * @return 1 if the coroutine suspended, 0 once it has finished.
+ */
+typedef int (*DrResume)(struct Task* task);
+
+/**
+ * @brief Something to run once a task completes; embedded at the start of
+ * what it belongs to.
+ */
+typedef struct DrContinuation {
+    /** Called once, on the thread that completed task. */
+    void (*run)(struct DrContinuation* cont, struct Task* task);
+    struct DrContinuation* next; /**< Link in the task's list. */
+} DrContinuation;
+
+/**
+ * @brief Callback of dr_task_continue_with().
+ */
+typedef void (*DrTaskCallback)(struct Task* task, void* arg);
+
 /**
  * @brief Represents an asynchronous task.
+ *
+ * Tasks run on the worker pool of scheduler.h. A task is reference
+ * counted like other objects; the pool holds a reference until the task
+ * has run, and its block is recycled through the allocator's per-thread
+ * cache once the last reference goes.
+ *
+ * A task either runs func to the end, or is a coroutine: resume runs it
+ * in steps, with its state kept in a frame allocated along with the task,
+ * and it gives its thread back while it waits for another task.
+ *
+ * state is read and written atomically, so completion can be checked from
+ * any thread without blocking. On completion the task runs the
+ * continuations added to it, in the order they were added.
  */
-typedef struct {
-    dr_thread_t thread;     /**< Platform-specific thread handle. */
+typedef struct Task {
+    DrJob job;              /**< Scheduler entry; must stay first. */
+    void* (*func)(void*);   /**< Function to execute. */
+    void* arg;              /**< Argument to pass to the function; a coroutine's frame. */
+    DrResume resume;        /**< Resume function of a coroutine, or NULL. */
+    DrJob wake;             /**< Scheduler entry resuming a suspended coroutine. */
+    DrContinuation resume_cont; /**< Wakes the coroutine when what it awaits completes. */
+    DrContinuation* continuations; /**< Run on completion, newest first. */
+    int claimed;            /**< Set by the thread that runs the function. */
     TaskState state;        /**< Current state of the task. */
     TaskResult result;      /**< Result value of the task. */
     int has_result;         /**< Whether the task has a return value. */
@@ -45,16 +81,7 @@ typedef struct {
 } Task;
 
 /**
- * @brief Thread function wrapper structure.
- */
-typedef struct {
-    void* (*func)(void*);   /**< Function to execute. */
-    void* arg;              /**< Argument to pass to the function. */
-    Task* task;             /**< Task structure to update. */
-} ThreadContext;
-
-/**
- * @brief Creates a new task and starts it running on a separate thread.
+ * @brief Creates a new task and queues it on the worker pool.
  * 
  * @param func Function to execute asynchronously.
  * @param arg Argument to pass to the function.
@@ -62,14 +89,128 @@ typedef struct {
  */
 Task* dr_task_create(void* (*func)(void*), void* arg);
 
+/**
+ * @brief Creates a coroutine task without starting it.
+ *
+ * The frame, frame_size zeroed bytes, follows the task in the same block
+ * and is passed as its arg. The caller fills it in and starts the task
+ * with dr_task_start().
+ *
+ * @param resume Resume function of the coroutine.
+ * @param frame_size Size of the coroutine's frame.
+ * @return Pointer to the created Task structure.
+ */
+Task* dr_task_create_coroutine(DrResume resume, size_t frame_size);
+
+/**
+ * @brief Queues a task from dr_task_create_coroutine() on the worker pool.
+ *
+ * @param task Pointer to the task to start.
+ */
+void dr_task_start(Task* task);
+
+/**
+ * @brief Creates a task that nothing runs.
+ *
+ * Whoever creates it sets its result or error and then completes it with
+ * dr_task_complete(), on any thread.
+ *
+ * @return Pointer to the created Task structure.
+ */
+Task* dr_task_create_pending(void);
+
+/**
+ * @brief Completes a task from dr_task_create_pending(), running its
+ * continuations.
+ *
+ * @param task Pointer to the task to complete.
+ */
+void dr_task_complete(Task* task);
+
+/**
+ * @brief Suspends the running coroutine until awaited completes.
+ *
+ * A task awaited before anything ran it is run right here, up to a
+ * nesting limit. If awaited is still pending then, task is queued again
+ * once it completes, and its resume function must return 1 at once
+ * without touching its frame: another thread may already be resuming it.
+ *
+ * @param task The running coroutine, with its state saved in its frame.
+ * @param awaited The task to wait for.
+ * @return 1 if task is suspended, 0 if awaited is complete.
+ */
+int dr_task_suspend(Task* task, Task* awaited);
+
+/**
+ * @brief Adds a continuation to run once task completes.
+ *
+ * @param task The task to watch.
+ * @param cont The continuation; it stays in use until it has run.
+ * @return 1 if it was added, 0 if task is complete already and cont was
+ * not added.
+ */
+int dr_task_add_continuation(Task* task, DrContinuation* cont);
+
+/**
+ * @brief Calls callback(task, arg) once task completes.
+ *
+ * The callback runs on the thread completing the task, or right away if
+ * the task is complete already, so it should be short; longer work can be
+ * started as a task of its own.
+ *
+ * @return 0 on success, -1 if out of memory.
+ */
+int dr_task_continue_with(Task* task, DrTaskCallback callback, void* arg);
+
+/**
+ * @brief A task completing once all n tasks have completed.
+ *
+ * Its int result is n. It fails if any of the tasks failed. Awaiting it
+ * waits once for all of them.
+ *
+ * @param tasks The tasks; the array may go once this returns.
+ * @param n Number of tasks.
+ * @return The combined task, or NULL if out of memory.
+ */
+Task* dr_task_when_all(Task** tasks, size_t n);
+
+/**
+ * @brief A task completing as soon as one of n tasks completes.
+ *
+ * Its int result is the index of that task, or -1 if n is 0.
+ *
+ * @param tasks The tasks; the array may go once this returns.
+ * @param n Number of tasks.
+ * @return The combined task, or NULL if out of memory.
+ */
+Task* dr_task_when_any(Task** tasks, size_t n);
+
 /**
  * @brief Waits for a task to complete and returns its result.
+ *
+ * Pending tasks are run on the calling thread while it waits.
  * 
  * @param task Pointer to the task to wait for.
  * @return The result of the task.
  */
 TaskResult dr_task_await(Task* task);
 
+/**
+ * @brief Awaits a task the caller holds the only reference to, then
+ * cleans it up.
+ *
+ * @param task Pointer to the task to wait for.
+ * @return The result of the task.
+ */
+TaskResult dr_task_take(Task* task);
+
+/**
+ * @brief The task whose function is running on the calling thread.
+ *
+ * @return The task, or NULL outside of one.
+ */
+Task* dr_task_current(void);
+
 /**
  * @brief Checks if a task has completed without blocking.
  * 
@@ -87,6 +228,9 @@ void dr_task_cleanup(Task* task);
 
 /**
  * @brief Sets an integer result for a task.
+ *
+ * The result setters record what the task's function produced; the task
+ * completes when that function returns.
  * 
  * @param task Pointer to the task.
  * @param value Integer value to set as the result.
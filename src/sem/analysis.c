@@ -50,12 +50,17 @@ void sem_analyzer_init(SemAnalyzer *s, Arena *a) {
   s->scope = malloc(sizeof(Scope));
   scope_init(s->scope, NULL);
   s->current_ret = TK_KW_VOID;
+  s->region_depth = 0;
+  s->stmt_pos = (Pos){0, 0};
+  s->classes = NULL;
+  s->nclasses = 0;
 }
 
 void sem_analyzer_free(SemAnalyzer *s) {
   scope_free(s->scope);
   free(s->scope);
   free(s->diags.data);
+  free(s->classes);
 }
 
 typedef enum { DECL_VAR, DECL_FUNC } DeclKind;
@@ -67,11 +72,14 @@ struct Decl {
     struct {
       TokenKind type;
       int is_const;
+      Slice type_name;
+      int region; /* region depth it was declared at */
     } var;
     struct {
       TokenKind ret_type;
       TokenKind *param_types;
       size_t param_len;
+      Node *node;
     } func;
   } as;
 };
@@ -81,11 +89,264 @@ static void analyze_stmt(SemAnalyzer *s, Node *n);
 
 static Decl *decl_new(SemAnalyzer *s, DeclKind kind) {
   (void)s;
-  Decl *d = malloc(sizeof(Decl));
+  Decl *d = calloc(1, sizeof(Decl));
   d->kind = kind;
   return d;
 }
 
+static Decl *func_decl_new(SemAnalyzer *s, Node *n) {
+  Decl *d = decl_new(s, DECL_FUNC);
+  // For async functions, the semantic return type is Task*
+  d->as.func.ret_type = n->as.func.is_async ? TK_KW_TASK : n->as.func.ret_type;
+  d->as.func.param_len = n->as.func.param_len;
+  d->as.func.param_types = malloc(sizeof(TokenKind) * d->as.func.param_len);
+  for (size_t i = 0; i < d->as.func.param_len; i++) {
+    Node *param = n->as.func.params[i];
+    d->as.func.param_types[i] = param->as.var_decl.type;
+  }
+  d->as.func.node = n;
+  return d;
+}
+
+static Decl *lookup_var(SemAnalyzer *s, Slice name) {
+  Decl *d = scope_lookup(s->scope, sym_intern(slice_to_cstr(s, name)));
+  return d && d->kind == DECL_VAR ? d : NULL;
+}
+
+static Node *class_decl(SemAnalyzer *s, Slice name) {
+  for (size_t i = 0; i < s->nclasses; i++) {
+    Slice c = s->classes[i]->as.type_decl.name;
+    if (c.len == name.len && strncmp(c.start, name.start, name.len) == 0)
+      return s->classes[i];
+  }
+  return NULL;
+}
+
+static int is_class(SemAnalyzer *s, Slice name) {
+  return class_decl(s, name) != NULL;
+}
+
+/*
+ * The method a call on a local or a class goes to, or NULL: an instance
+ * method for a local, a static one for a class.
+ */
+static Node *method_of(SemAnalyzer *s, Node *callee) {
+  if (callee->kind != ND_FIELD || !callee->as.field.object ||
+      callee->as.field.object->kind != ND_IDENT)
+    return NULL;
+  Slice obj = callee->as.field.object->as.ident;
+  Decl *d = lookup_var(s, obj);
+  int is_static = !d;
+  Node *cls = d ? (d->as.var.type == TK_IDENT
+                       ? class_decl(s, d->as.var.type_name)
+                       : NULL)
+                : class_decl(s, obj);
+  Slice name = callee->as.field.name;
+  for (size_t i = 0; cls && i < cls->as.type_decl.len; i++) {
+    Node *m = cls->as.type_decl.members[i];
+    if (m->kind == ND_FUNC && m->as.func.is_static == is_static &&
+        m->as.func.name.len == name.len &&
+        strncmp(m->as.func.name.start, name.start, name.len) == 0)
+      return m;
+  }
+  return NULL;
+}
+
+/*
+ * Region depth of the class instance e evaluates to when it was allocated
+ * inside a `using region` block, 0 otherwise.
+ */
+static int region_of(SemAnalyzer *s, Node *e) {
+  if (e->kind == ND_NEW)
+    return is_class(s, e->as.new_expr.type_name) ? s->region_depth : 0;
+  if (e->kind != ND_IDENT)
+    return 0;
+  Decl *d = lookup_var(s, e->as.ident);
+  return d && d->as.var.type == TK_IDENT && is_class(s, d->as.var.type_name)
+             ? d->as.var.region
+             : 0;
+}
+
+/* The variable whose field or element lhs is, or lhs itself. */
+static Node *store_root(Node *lhs) {
+  while (lhs->kind == ND_FIELD || lhs->kind == ND_INDEX)
+    lhs = lhs->kind == ND_FIELD ? lhs->as.field.object : lhs->as.index.array;
+  return lhs;
+}
+
+/*
+ * Objects a region allocated die with it and cannot be stored outside; stmt
+ * is an expression statement.
+ */
+static void check_region_store(SemAnalyzer *s, Node *stmt) {
+  Node *n = stmt->as.expr_stmt.expr;
+  if (!s->region_depth || !n || n->kind != ND_BINOP || n->as.bin.op != TK_EQ)
+    return;
+  Node *root = store_root(n->as.bin.lhs);
+  Decl *d = root->kind == ND_IDENT ? lookup_var(s, root->as.ident) : NULL;
+  if (region_of(s, n->as.bin.rhs) <= (d ? d->as.var.region : 0))
+    return;
+  if (root->kind == ND_IDENT)
+    diag_pushf(s, stmt->pos, DIAG_ERROR,
+               "object allocated in a region escapes it through '%s'",
+               slice_to_cstr(s, root->as.ident));
+  else
+    diag_push(s, stmt->pos, DIAG_ERROR,
+              "object allocated in a region escapes it");
+}
+
+/* Calls followed into callees before a parameter is assumed to be kept. */
+#define KEEP_DEPTH 4
+
+static int is_name(Node *n, Slice v) {
+  return n && n->kind == ND_IDENT && n->as.ident.len == v.len &&
+         strncmp(n->as.ident.start, v.start, v.len) == 0;
+}
+
+static int param_kept(SemAnalyzer *s, Node *fn, size_t i, int depth);
+
+/*
+ * Nonzero if n, part of body, may store the variable v in a field or element
+ * or hand it to a callee that does.
+ */
+static int kept(SemAnalyzer *s, Node *body, Node *n, Slice v, int depth) {
+  if (!n)
+    return 0;
+  switch (n->kind) {
+  case ND_UNARY:
+  case ND_POST_UNARY:
+    return kept(s, body, n->as.unary.expr, v, depth);
+  case ND_BINOP:
+    if (n->as.bin.op == TK_EQ && is_name(n->as.bin.rhs, v))
+      return n->as.bin.lhs->kind != ND_IDENT || depth >= KEEP_DEPTH ||
+             kept(s, body, body, n->as.bin.lhs->as.ident, depth + 1);
+    return kept(s, body, n->as.bin.lhs, v, depth) ||
+           kept(s, body, n->as.bin.rhs, v, depth);
+  case ND_COND:
+    return kept(s, body, n->as.cond.cond, v, depth) ||
+           kept(s, body, n->as.cond.then_expr, v, depth) ||
+           kept(s, body, n->as.cond.else_expr, v, depth);
+  case ND_INDEX:
+    return kept(s, body, n->as.index.array, v, depth) ||
+           kept(s, body, n->as.index.index, v, depth);
+  case ND_FIELD:
+    return kept(s, body, n->as.field.object, v, depth);
+  case ND_CONSOLE_CALL:
+    return kept(s, body, n->as.console.arg, v, depth);
+  case ND_CALL: {
+    Node *callee = n->as.call.callee;
+    Decl *d = callee->kind == ND_IDENT
+                  ? scope_lookup(s->scope,
+                                 sym_intern(slice_to_cstr(s, callee->as.ident)))
+                  : NULL;
+    for (size_t i = 0; i < n->as.call.len; i++) {
+      Node *arg = n->as.call.args[i];
+      if (is_name(arg, v)
+              ? !d || d->kind != DECL_FUNC ||
+                    param_kept(s, d->as.func.node, i, depth + 1)
+              : kept(s, body, arg, v, depth))
+        return 1;
+    }
+    return 0;
+  }
+  case ND_NEW:
+    for (size_t i = 0; i < n->as.new_expr.arg_len; i++) {
+      if (is_name(n->as.new_expr.args[i], v) ||
+          kept(s, body, n->as.new_expr.args[i], v, depth))
+        return 1;
+    }
+    return 0;
+  case ND_AWAIT:
+    return kept(s, body, n->as.await_expr.expr, v, depth);
+  case ND_VAR_DECL:
+    if (is_name(n->as.var_decl.init, v))
+      return depth >= KEEP_DEPTH ||
+             kept(s, body, body, n->as.var_decl.name, depth + 1);
+    return kept(s, body, n->as.var_decl.init, v, depth);
+  case ND_EXPR_STMT:
+    return kept(s, body, n->as.expr_stmt.expr, v, depth);
+  case ND_RETURN:
+    return kept(s, body, n->as.ret.expr, v, depth);
+  case ND_THROW:
+    return kept(s, body, n->as.throw_stmt.expr, v, depth);
+  case ND_IF:
+    return kept(s, body, n->as.if_stmt.cond, v, depth) ||
+           kept(s, body, n->as.if_stmt.then_br, v, depth) ||
+           kept(s, body, n->as.if_stmt.else_br, v, depth);
+  case ND_WHILE:
+    return kept(s, body, n->as.while_stmt.cond, v, depth) ||
+           kept(s, body, n->as.while_stmt.body, v, depth);
+  case ND_DO_WHILE:
+    return kept(s, body, n->as.do_while_stmt.body, v, depth) ||
+           kept(s, body, n->as.do_while_stmt.cond, v, depth);
+  case ND_FOR:
+    return kept(s, body, n->as.for_stmt.init, v, depth) ||
+           kept(s, body, n->as.for_stmt.cond, v, depth) ||
+           kept(s, body, n->as.for_stmt.update, v, depth) ||
+           kept(s, body, n->as.for_stmt.body, v, depth);
+  case ND_BLOCK:
+    for (size_t i = 0; i < n->as.block.len; i++) {
+      if (kept(s, body, n->as.block.items[i], v, depth))
+        return 1;
+    }
+    return 0;
+  case ND_REGION:
+    return kept(s, body, n->as.region.body, v, depth);
+  case ND_SWITCH:
+    if (kept(s, body, n->as.switch_stmt.expr, v, depth))
+      return 1;
+    for (size_t i = 0; i < n->as.switch_stmt.len; i++) {
+      if (kept(s, body, n->as.switch_stmt.cases[i].body, v, depth))
+        return 1;
+    }
+    return 0;
+  case ND_TRY:
+    return kept(s, body, n->as.try_stmt.body, v, depth) ||
+           kept(s, body, n->as.try_stmt.catch_body, v, depth) ||
+           kept(s, body, n->as.try_stmt.finally_body, v, depth);
+  default:
+    return 0;
+  }
+}
+
+/*
+ * Nonzero if the function may keep its parameter i past the call: it stores
+ * it, directly or through callees, or it is async and reads it later.
+ */
+static int param_kept(SemAnalyzer *s, Node *fn, size_t i, int depth) {
+  if (!fn || fn->as.func.is_async || depth >= KEEP_DEPTH ||
+      i >= fn->as.func.param_len)
+    return 1;
+  Node *body = fn->as.func.body;
+  return kept(s, body, body, fn->as.func.params[i]->as.var_decl.name, depth);
+}
+
+/*
+ * Objects a region allocated cannot be handed to a callee that keeps them,
+ * nor be the receiver of a method that keeps `this`.
+ */
+static void check_region_call(SemAnalyzer *s, Node *call, Node *fn,
+                              const char *name) {
+  if (!s->region_depth)
+    return;
+  Node *callee = call->as.call.callee;
+  if (fn && !fn->as.func.is_static && callee->kind == ND_FIELD &&
+      region_of(s, callee->as.field.object) &&
+      kept(s, fn->as.func.body, fn->as.func.body, (Slice){"this", 4}, 0))
+    diag_pushf(s, s->stmt_pos, DIAG_ERROR,
+               "object allocated in a region escapes it through a call to "
+               "'%s'",
+               name);
+  for (size_t i = 0; i < call->as.call.len; i++) {
+    Node *arg = call->as.call.args[i];
+    if (region_of(s, arg) && param_kept(s, fn, i, 0))
+      diag_pushf(s, s->stmt_pos, DIAG_ERROR,
+                 "object allocated in a region escapes it through a call to "
+                 "'%s'",
+                 name);
+  }
+}
+
 static TokenKind analyze_ident(SemAnalyzer *s, Node *n) {
   char *name = slice_to_cstr(s, n->as.ident);
   Symbol *sym = sym_intern(name);
@@ -99,9 +360,60 @@ static TokenKind analyze_ident(SemAnalyzer *s, Node *n) {
   return d->as.func.ret_type; /* function as value returns its return type */
 }
 
+/* The Task.X calls: what they return, what awaiting the task gives, and
+ * whether they take tasks. */
+typedef struct {
+  const char *name;
+  TokenKind type;
+  TokenKind awaits;
+  int tasks;
+} TaskBuiltin;
+
+static const TaskBuiltin task_builtins[] = {
+    {"WhenAll", TK_KW_TASK, TK_KW_INT, 1},
+    {"WhenAny", TK_KW_TASK, TK_KW_INT, 1},
+    {"Delay", TK_KW_TASK, TK_KW_INT, 0},
+    {"Read", TK_KW_TASK, TK_KW_STRING, 0},
+    {"Write", TK_KW_TASK, TK_KW_INT, 0},
+    {"Pipe", TK_KW_INT, TK_KW_INT, 0},
+    {"SocketPair", TK_KW_INT, TK_KW_INT, 0},
+    {"Close", TK_KW_INT, TK_KW_INT, 0},
+};
+
+/* The Task.X that n calls, or NULL. */
+static const TaskBuiltin *task_builtin(Node *n) {
+  Node *callee = n->as.call.callee;
+  if (callee->kind != ND_FIELD || !callee->as.field.object ||
+      callee->as.field.object->kind != ND_IDENT)
+    return NULL;
+  Slice obj = callee->as.field.object->as.ident;
+  Slice name = callee->as.field.name;
+  if (obj.len != 4 || strncmp(obj.start, "Task", 4) != 0)
+    return NULL;
+  for (size_t i = 0; i < sizeof task_builtins / sizeof *task_builtins; i++) {
+    if (strlen(task_builtins[i].name) == name.len &&
+        strncmp(task_builtins[i].name, name.start, name.len) == 0)
+      return &task_builtins[i];
+  }
+  return NULL;
+}
+
 static TokenKind analyze_call(SemAnalyzer *s, Node *n) {
-  if (n->as.call.callee->kind != ND_IDENT)
+  const TaskBuiltin *tb = task_builtin(n);
+  if (tb) {
+    for (size_t i = 0; i < n->as.call.len; i++) {
+      if (analyze_expr(s, n->as.call.args[i]) != TK_KW_TASK && tb->tasks)
+        diag_push(s, n->as.call.args[i]->pos, DIAG_ERROR,
+                  "Task.WhenAll and Task.WhenAny take tasks");
+    }
+    return tb->type;
+  }
+  if (n->as.call.callee->kind != ND_IDENT) {
+    if (n->as.call.callee->kind == ND_FIELD)
+      check_region_call(s, n, method_of(s, n->as.call.callee),
+                        slice_to_cstr(s, n->as.call.callee->as.field.name));
     return TK_KW_INT;
+  }
   char *name = slice_to_cstr(s, n->as.call.callee->as.ident);
   Symbol *sym = sym_intern(name);
   Decl *d = scope_lookup(s->scope, sym);
@@ -116,6 +428,7 @@ static TokenKind analyze_call(SemAnalyzer *s, Node *n) {
                "expected %zu arguments but got %zu for function '%s'",
                d->as.func.param_len, n->as.call.len, name);
   }
+  check_region_call(s, n, d->as.func.node, name);
   for (size_t i = 0; i < n->as.call.len; i++)
     analyze_expr(s, n->as.call.args[i]);
   return d->as.func.ret_type;
@@ -172,8 +485,12 @@ static TokenKind analyze_expr(SemAnalyzer *s, Node *n) {
       analyze_expr(s, n->as.new_expr.args[i]);
     return TK_IDENT; /* Custom type - actual type name stored in type_name */
   case ND_AWAIT:
-    /* await expressions return TaskResult type */
+    /* await expressions return TaskResult type; Task.X calls say what
+     * theirs give */
     analyze_expr(s, n->as.await_expr.expr);
+    if (n->as.await_expr.expr->kind == ND_CALL &&
+        task_builtin(n->as.await_expr.expr))
+      return task_builtin(n->as.await_expr.expr)->awaits;
     return TK_KW_TASKRESULT;
   case ND_INDEX:
     /* Array access - return element type */
@@ -192,6 +509,8 @@ static TokenKind analyze_expr(SemAnalyzer *s, Node *n) {
 static void analyze_stmt(SemAnalyzer *s, Node *n) {
   if (!n)
     return;
+  if (n->pos.line)
+    s->stmt_pos = n->pos;
   switch (n->kind) {
   case ND_BLOCK: {
     s->scope = scope_push(s->scope);
@@ -210,6 +529,8 @@ static void analyze_stmt(SemAnalyzer *s, Node *n) {
     Decl *d = decl_new(s, DECL_VAR);
     d->as.var.type = n->as.var_decl.type;
     d->as.var.is_const = n->as.var_decl.is_const;
+    d->as.var.type_name = n->as.var_decl.type_name;
+    d->as.var.region = s->region_depth;
     scope_bind(s->scope, sym, d);
     if (n->as.var_decl.init) {
       TokenKind it = analyze_expr(s, n->as.var_decl.init);
@@ -220,6 +541,7 @@ static void analyze_stmt(SemAnalyzer *s, Node *n) {
     break;
   }
   case ND_EXPR_STMT:
+    check_region_store(s, n);
     analyze_expr(s, n->as.expr_stmt.expr);
     break;
   case ND_IF:
@@ -245,26 +567,30 @@ static void analyze_stmt(SemAnalyzer *s, Node *n) {
     analyze_stmt(s, n->as.for_stmt.body);
     break;
   case ND_RETURN:
-    if (n->as.ret.expr)
+    if (n->as.ret.expr) {
+      if (s->region_depth && region_of(s, n->as.ret.expr))
+        diag_push(s, n->pos, DIAG_ERROR,
+                  "object allocated in a region cannot be returned from it");
       analyze_expr(s, n->as.ret.expr);
+    }
+    break;
+  case ND_REGION:
+    s->region_depth++;
+    analyze_stmt(s, n->as.region.body);
+    s->region_depth--;
     break;
   case ND_FUNC: {
     char *name = slice_to_cstr(s, n->as.func.name);
     Symbol *sym = sym_intern(name);
-    if (scope_lookup(s->scope, sym)) {
+    Decl *prev_decl = scope_lookup(s->scope, sym);
+    // Top-level functions were declared up front by sem_analyze_program
+    if (prev_decl && !(prev_decl->kind == DECL_FUNC &&
+                       prev_decl->as.func.node == n)) {
       diag_pushf(s, n->pos, DIAG_ERROR, "redefinition of function '%s'", name);
       break;
     }
-    Decl *d = decl_new(s, DECL_FUNC);
-    // For async functions, the semantic return type is Task*
-    d->as.func.ret_type = n->as.func.is_async ? TK_KW_TASK : n->as.func.ret_type;
-    d->as.func.param_len = n->as.func.param_len;
-    d->as.func.param_types = malloc(sizeof(TokenKind) * d->as.func.param_len);
-    for (size_t i = 0; i < d->as.func.param_len; i++) {
-      Node *param = n->as.func.params[i];
-      d->as.func.param_types[i] = param->as.var_decl.type;
-    }
-    scope_bind(s->scope, sym, d);
+    if (!prev_decl)
+      scope_bind(s->scope, sym, func_decl_new(s, n));
     s->scope = scope_push(s->scope);
     for (size_t i = 0; i < n->as.func.param_len; i++) {
       Node *param = n->as.func.params[i];
@@ -273,12 +599,17 @@ static void analyze_stmt(SemAnalyzer *s, Node *n) {
       Decl *pd = decl_new(s, DECL_VAR);
       pd->as.var.type = param->as.var_decl.type;
       pd->as.var.is_const = param->as.var_decl.is_const;
+      pd->as.var.type_name = param->as.var_decl.type_name;
+      pd->as.var.region = 0;
       scope_bind(s->scope, ps, pd);
     }
     TokenKind prev = s->current_ret;
+    int prev_region = s->region_depth;
     s->current_ret = n->as.func.ret_type;
+    s->region_depth = 0;
     analyze_stmt(s, n->as.func.body);
     s->current_ret = prev;
+    s->region_depth = prev_region;
     s->scope = scope_pop(s->scope);
     break;
   }
@@ -329,6 +660,23 @@ static void analyze_stmt(SemAnalyzer *s, Node *n) {
 }
 
 void sem_analyze_program(SemAnalyzer *s, Node *root) {
+  for (size_t i = 0; i < root->as.block.len; i++) {
+    Node *it = root->as.block.items[i];
+    if (it->kind != ND_CLASS_DECL)
+      continue;
+    s->classes = realloc(s->classes, (s->nclasses + 1) * sizeof(Node *));
+    s->classes[s->nclasses++] = it;
+  }
+  // Declare top-level functions first so they can call each other in any
+  // order, as mutually recursive functions must
+  for (size_t i = 0; i < root->as.block.len; i++) {
+    Node *it = root->as.block.items[i];
+    if (it->kind != ND_FUNC)
+      continue;
+    Symbol *sym = sym_intern(slice_to_cstr(s, it->as.func.name));
+    if (!scope_lookup(s->scope, sym))
+      scope_bind(s->scope, sym, func_decl_new(s, it));
+  }
   for (size_t i = 0; i < root->as.block.len; i++)
     analyze_stmt(s, root->as.block.items[i]);
 }
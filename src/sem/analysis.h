@@ -8,6 +8,10 @@ typedef struct SemAnalyzer {
   DiagnosticVec diags;
   Scope *scope;
   TokenKind current_ret;
+  int region_depth; /* `using region` blocks around the current statement */
+  Pos stmt_pos;     /* the current statement, for expressions without one */
+  Node **classes;   /* the program's class declarations */
+  size_t nclasses;
 } SemAnalyzer;
 
 void sem_analyzer_init(SemAnalyzer *s, Arena *a);
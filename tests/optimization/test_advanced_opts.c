@@ -4,13 +4,17 @@
  *
  * This file contains unit tests and integration tests for all advanced
  * optimization passes including inlining, interprocedural analysis,
- * loop optimizations, and register allocation preparation.
+ * loop optimizations, value-range propagation, and register allocation
+ * preparation.
  */
 
 #include "../../src/opt/inline.h"
 #include "../../src/opt/interprocedural.h"
 #include "../../src/opt/loop_opt.h"
+#include "../../src/opt/profile.h"
 #include "../../src/opt/regalloc.h"
+#include "../../src/opt/sccp.h"
+#include "../../src/opt/vrp.h"
 #include "../../src/cfg/cfg.h"
 #include "../../src/ir/ir.h"
 #include <assert.h>
@@ -405,6 +409,441 @@ static bool test_ssa_conversion(void) {
     return true;
 }
 
+/**
+ * @brief Appends an instruction to a basic block.
+ */
+static IRInstr *append_instr(BasicBlock *bb, IROp op, int dst, IRValue a, IRValue b) {
+    IRInstr *ins = ir_instr_new(op, (IRValue){.id = dst}, a, b);
+    bb->instrs = realloc(bb->instrs, sizeof(IRInstr*) * (bb->ninstrs + 1));
+    bb->instrs[bb->ninstrs++] = ins;
+    return ins;
+}
+
+/**
+ * @brief Test range analysis and folding on a counted loop.
+ *
+ * Builds `for (i = 0; i < 10; i++) { if (i < 20) ...; x = i % 4; }` and
+ * checks that the inner comparison and branch are proven always true.
+ */
+static bool test_value_range_propagation(void) {
+    CFG *cfg = cfg_new();
+    BasicBlock *entry = cfg_add_block(cfg);
+    BasicBlock *header = cfg_add_block(cfg);
+    BasicBlock *body = cfg_add_block(cfg);
+    BasicBlock *then_bb = cfg_add_block(cfg);
+    BasicBlock *latch = cfg_add_block(cfg);
+    BasicBlock *exit_bb = cfg_add_block(cfg);
+    cfg->entry = entry;
+    
+    // entry: i = 0
+    append_instr(entry, IR_MOV, 0, ir_const(0), (IRValue){0});
+    append_instr(entry, IR_JUMP, -1, (IRValue){0}, (IRValue){0});
+    cfg_add_edge(entry, header);
+    
+    // header: t1 = i < 10; cjump t1
+    append_instr(header, IR_LT, 1, (IRValue){.id = 0}, ir_const(10));
+    append_instr(header, IR_CJUMP, -1, (IRValue){.id = 1}, (IRValue){0});
+    cfg_add_edge(header, body);
+    cfg_add_edge(header, exit_bb);
+    
+    // body: t2 = i < 20; cjump t2
+    IRInstr *inner = append_instr(body, IR_LT, 2, (IRValue){.id = 0}, ir_const(20));
+    IRInstr *branch = append_instr(body, IR_CJUMP, -1, (IRValue){.id = 2}, (IRValue){0});
+    cfg_add_edge(body, then_bb);
+    cfg_add_edge(body, latch);
+    
+    // then: x = i % 4
+    append_instr(then_bb, IR_MOD, 3, (IRValue){.id = 0}, ir_const(4));
+    append_instr(then_bb, IR_JUMP, -1, (IRValue){0}, (IRValue){0});
+    cfg_add_edge(then_bb, latch);
+    
+    // latch: i = i + 1
+    append_instr(latch, IR_ADD, 4, (IRValue){.id = 0}, ir_const(1));
+    append_instr(latch, IR_MOV, 0, (IRValue){.id = 4}, (IRValue){0});
+    append_instr(latch, IR_JUMP, -1, (IRValue){0}, (IRValue){0});
+    cfg_add_edge(latch, header);
+    
+    RangeInfo *info = range_analysis(cfg);
+    ASSERT(info != NULL);
+    
+    ValueRange i_body = range_at(info, body, 0, (IRValue){.id = 0});
+    ASSERT(!i_body.empty);
+    ASSERT(i_body.lo == 0 && i_body.hi == 9);
+    
+    ValueRange x = range_at(info, then_bb, 1, (IRValue){.id = 3});
+    ASSERT(x.lo == 0 && x.hi == 3);
+    
+    ValueRange i_exit = range_at(info, exit_bb, 0, (IRValue){.id = 0});
+    ASSERT(i_exit.lo == 10 && i_exit.hi == 10);
+    range_info_free(info);
+    
+    ASSERT(vrp(cfg) == true);
+    ASSERT(inner->op == IR_MOV);
+    ASSERT(ir_const_value(inner->a) == 1);
+    ASSERT(branch->op == IR_JUMP);
+    ASSERT(body->nsucc == 1 && body->succ[0] == then_bb);
+    ASSERT(latch->npred == 1);
+    
+    return true;
+}
+
+/**
+ * @brief Test inlining a callee into its caller's CFG.
+ *
+ * The callee computes `return p + 1`; the caller computes `r = f(41)` and
+ * returns r. After inlining no call remains and r is assigned the callee's
+ * result on the path to the caller's return.
+ */
+static bool test_inline_call_site(void) {
+    FunctionTable *table = function_table_new();
+    
+    // callee(p): t = p + 1; return t
+    CFG *callee_cfg = cfg_new();
+    BasicBlock *cb = cfg_add_block(callee_cfg);
+    callee_cfg->entry = cb;
+    append_instr(cb, IR_ADD, 1, (IRValue){.id = 0}, ir_const(1));
+    append_instr(cb, IR_RETURN, -1, (IRValue){.id = 1}, (IRValue){0});
+    
+    FunctionInfo callee;
+    memset(&callee, 0, sizeof(callee));
+    callee.name = strdup("f");
+    callee.cfg = callee_cfg;
+    callee.params = malloc(sizeof(IRValue));
+    callee.params[0] = (IRValue){.id = 0};
+    callee.nparam = 1;
+    callee.return_val = (IRValue){.id = -1};
+    int callee_id = function_table_add(table, &callee);
+    
+    // caller: r = f(41); return r
+    CFG *caller_cfg = cfg_new();
+    BasicBlock *entry = cfg_add_block(caller_cfg);
+    caller_cfg->entry = entry;
+    IRInstr *call = append_instr(entry, IR_CALL, 0, (IRValue){0}, (IRValue){0});
+    call->extra.call.func_id = callee_id;
+    call->extra.call.args = malloc(sizeof(IRValue));
+    call->extra.call.args[0] = ir_const(41);
+    call->extra.call.nargs = 1;
+    append_instr(entry, IR_RETURN, -1, (IRValue){.id = 0}, (IRValue){0});
+    
+    FunctionInfo caller;
+    memset(&caller, 0, sizeof(caller));
+    caller.name = strdup("main");
+    caller.cfg = caller_cfg;
+    caller.return_val = (IRValue){.id = -1};
+    function_table_add(table, &caller);
+    
+    InlineConfig config = {
+        .max_inline_cost = 100,
+        .max_inline_depth = 3,
+        .inline_hot_only = false,
+        .hot_threshold = 1
+    };
+    ASSERT(inline_functions(caller_cfg, table, &config) == true);
+    ASSERT(function_table_get(table, 1)->inline_depth == 1);
+    
+    bool has_call = false, assigns_result = false;
+    for (size_t i = 0; i < caller_cfg->nblocks; i++) {
+        BasicBlock *bb = caller_cfg->blocks[i];
+        ASSERT(bb->id == (int)i);
+        for (size_t j = 0; j < bb->ninstrs; j++) {
+            IRInstr *ins = bb->instrs[j];
+            if (ins->op == IR_CALL) has_call = true;
+            if (ins->op == IR_MOV && ins->dst.id == 0) assigns_result = true;
+        }
+    }
+    ASSERT(!has_call);
+    ASSERT(assigns_result);
+    
+    // The caller's return is reached through the inlined body
+    BasicBlock *after = caller_cfg->blocks[caller_cfg->nblocks - 1];
+    ASSERT(after->ninstrs == 1 && after->instrs[0]->op == IR_RETURN);
+    ASSERT(after->npred == 1);
+    ASSERT(entry->nsucc == 1 && entry->succ[0] != after);
+    
+    return true;
+}
+
+/**
+ * @brief Test specializing a call with a constant flag argument.
+ *
+ * The callee computes `if (flag) return 7; return x;`. A call passing
+ * flag = 1 is redirected to a clone in which the branch folds, and the
+ * constant result then replaces the call altogether.
+ */
+static bool test_call_site_specialization(void) {
+    FunctionTable *table = function_table_new();
+    
+    // helper(flag, x): if (flag) return 7; return x
+    CFG *helper_cfg = cfg_new();
+    BasicBlock *entry = cfg_add_block(helper_cfg);
+    BasicBlock *then_bb = cfg_add_block(helper_cfg);
+    BasicBlock *else_bb = cfg_add_block(helper_cfg);
+    append_instr(entry, IR_CJUMP, -1, (IRValue){.id = 0}, (IRValue){0});
+    cfg_add_edge(entry, then_bb);
+    cfg_add_edge(entry, else_bb);
+    append_instr(then_bb, IR_RETURN, -1, ir_const(7), (IRValue){0});
+    append_instr(else_bb, IR_RETURN, -1, (IRValue){.id = 1}, (IRValue){0});
+    cfg_compute_dominators(helper_cfg);
+    
+    FunctionInfo helper;
+    memset(&helper, 0, sizeof(helper));
+    helper.name = strdup("helper");
+    helper.cfg = helper_cfg;
+    helper.params = malloc(2 * sizeof(IRValue));
+    helper.params[0] = (IRValue){.id = 0};
+    helper.params[1] = (IRValue){.id = 1};
+    helper.nparam = 2;
+    helper.return_val = (IRValue){.id = -1};
+    int helper_id = function_table_add(table, &helper);
+    
+    IRValue result;
+    ASSERT(!function_constant_return(function_table_get(table, helper_id), &result));
+    
+    // main: r = helper(1, y); return r
+    CFG *main_cfg = cfg_new();
+    BasicBlock *main_bb = cfg_add_block(main_cfg);
+    IRInstr *call = append_instr(main_bb, IR_CALL, 1, (IRValue){0}, (IRValue){0});
+    call->extra.call.func_id = helper_id;
+    call->extra.call.args = malloc(2 * sizeof(IRValue));
+    call->extra.call.args[0] = ir_const(1);
+    call->extra.call.args[1] = (IRValue){.id = 0};
+    call->extra.call.nargs = 2;
+    append_instr(main_bb, IR_RETURN, -1, (IRValue){.id = 1}, (IRValue){0});
+    
+    FunctionInfo caller;
+    memset(&caller, 0, sizeof(caller));
+    caller.name = strdup("main");
+    caller.cfg = main_cfg;
+    caller.return_val = (IRValue){.id = -1};
+    int main_id = function_table_add(table, &caller);
+    
+    SpecializeConfig config = {
+        .max_clone_cost = 100,
+        .max_clones = 4,
+        .hot_only = false
+    };
+    SpecializationCache cache = {0};
+    ASSERT(specialize_call_sites(table, main_id, &cache, &config) == true);
+    
+    // One clone binding flag = 1, keeping only x as a parameter
+    ASSERT(table->nfunctions == 3);
+    ASSERT(cache.count == 1);
+    FunctionInfo *clone = function_table_get(table, cache.items[0].clone_id);
+    ASSERT(strcmp(clone->name, "helper.spec0") == 0);
+    ASSERT(clone->nparam == 1 && clone->params[0].id == 1);
+    ASSERT(function_constant_return(clone, &result));
+    ASSERT(ir_const_value(result) == 7);
+    
+    // The clone records what it binds, for code generation to match calls
+    ASSERT(clone->origin_id == helper_id && clone->bound);
+    ASSERT(ir_is_const(clone->bound[0]) && ir_const_value(clone->bound[0]) == 1);
+    ASSERT(!ir_is_const(clone->bound[1]));
+    
+    // The call folded to `r = 7`
+    ASSERT(call->op == IR_MOV);
+    ASSERT(call->dst.id == 1 && ir_const_value(call->a) == 7);
+    
+    specialization_cache_free(&cache);
+    return true;
+}
+
+/**
+ * @brief Test that constant propagation leaves operations C would trap on.
+ *
+ * `a = 7 / 0` and `b = 1 << 40` stay as they are; `c = 7 / 2` folds.
+ */
+static bool test_sccp_keeps_traps(void) {
+    CFG *cfg = cfg_new();
+    BasicBlock *bb = cfg_add_block(cfg);
+    IRInstr *div0 = append_instr(bb, IR_DIV, 0, ir_const(7), ir_const(0));
+    IRInstr *shl = append_instr(bb, IR_SHL, 1, ir_const(1), ir_const(40));
+    IRInstr *div = append_instr(bb, IR_DIV, 2, ir_const(7), ir_const(2));
+    append_instr(bb, IR_RETURN, -1, (IRValue){.id = 0}, (IRValue){0});
+    
+    sccp(cfg);
+    ASSERT(div0->op == IR_DIV);
+    ASSERT(shl->op == IR_SHL);
+    ASSERT(div->op == IR_MOV && ir_const_value(div->a) == 3);
+    ASSERT(bb->instrs[3]->a.id == 0);
+    
+    return true;
+}
+
+/**
+ * @brief Tests that a self tail call becomes a jump back to the entry.
+ */
+static bool test_tail_recursion_elimination(void) {
+    FunctionTable *table = function_table_new();
+    
+    // sum(n, acc): if (n) { r = sum(n - 1, acc + n); return r } return acc
+    CFG *cfg = cfg_new();
+    BasicBlock *entry = cfg_add_block(cfg);
+    BasicBlock *rec = cfg_add_block(cfg);
+    BasicBlock *done = cfg_add_block(cfg);
+    append_instr(entry, IR_CJUMP, -1, (IRValue){.id = 0}, (IRValue){0});
+    cfg_add_edge(entry, rec);
+    cfg_add_edge(entry, done);
+    append_instr(rec, IR_SUB, 2, (IRValue){.id = 0}, ir_const(1));
+    append_instr(rec, IR_ADD, 3, (IRValue){.id = 1}, (IRValue){.id = 0});
+    IRInstr *call = append_instr(rec, IR_CALL, 4, (IRValue){0}, (IRValue){0});
+    call->extra.call.func_id = 0;
+    call->extra.call.args = malloc(2 * sizeof(IRValue));
+    call->extra.call.args[0] = (IRValue){.id = 2};
+    call->extra.call.args[1] = (IRValue){.id = 3};
+    call->extra.call.nargs = 2;
+    append_instr(rec, IR_RETURN, -1, (IRValue){.id = 4}, (IRValue){0});
+    append_instr(done, IR_RETURN, -1, (IRValue){.id = 1}, (IRValue){0});
+    cfg_compute_dominators(cfg);
+    
+    FunctionInfo func;
+    memset(&func, 0, sizeof(func));
+    func.name = strdup("sum");
+    func.cfg = cfg;
+    func.params = malloc(2 * sizeof(IRValue));
+    func.params[0] = (IRValue){.id = 0};
+    func.params[1] = (IRValue){.id = 1};
+    func.nparam = 2;
+    func.return_val = (IRValue){.id = -1};
+    int id = function_table_add(table, &func);
+    
+    CallGraph *graph = call_graph_new(table);
+    call_graph_detect_recursion(graph);
+    call_graph_free(graph);
+    FunctionInfo *sum = function_table_get(table, id);
+    ASSERT(sum->is_recursive);
+    ASSERT(eliminate_tail_recursion(sum, id) == true);
+    
+    // A fresh entry jumps to the old one, which the rewritten block loops to
+    ASSERT(cfg->entry != entry && cfg->entry->nsucc == 1);
+    ASSERT(cfg->entry->succ[0] == entry);
+    ASSERT(rec->nsucc == 1 && rec->succ[0] == entry);
+    for (size_t i = 0; i < rec->ninstrs; i++) {
+        ASSERT(rec->instrs[i]->op != IR_CALL && rec->instrs[i]->op != IR_RETURN);
+    }
+    
+    // Arguments reach the parameters through temporaries: n = n - 1 must
+    // not be seen by acc = acc + n
+    IRInstr *last = rec->instrs[rec->ninstrs - 1];
+    ASSERT(last->op == IR_JUMP);
+    IRInstr *set_n = rec->instrs[rec->ninstrs - 3];
+    IRInstr *set_acc = rec->instrs[rec->ninstrs - 2];
+    ASSERT(set_n->op == IR_MOV && set_n->dst.id == 0 && set_n->a.id > 4);
+    ASSERT(set_acc->op == IR_MOV && set_acc->dst.id == 1 && set_acc->a.id > 4);
+    
+    // Nothing left to rewrite
+    ASSERT(eliminate_tail_recursion(sum, id) == false);
+    return true;
+}
+
+/**
+ * @brief Tests that purity follows program variables and calls.
+ */
+static bool test_pure_function_identification(void) {
+    FunctionTable *table = function_table_new();
+    
+    // fib(n): return fib(n - 1) + fib(n - 2)
+    CFG *fib_cfg = cfg_new();
+    BasicBlock *fb = cfg_add_block(fib_cfg);
+    append_instr(fb, IR_SUB, 1, (IRValue){.id = 0}, ir_const(1));
+    IRInstr *c1 = append_instr(fb, IR_CALL, 2, (IRValue){0}, (IRValue){0});
+    c1->extra.call.func_id = 0;
+    c1->extra.call.args = malloc(sizeof(IRValue));
+    c1->extra.call.args[0] = (IRValue){.id = 1};
+    c1->extra.call.nargs = 1;
+    append_instr(fb, IR_SUB, 3, (IRValue){.id = 0}, ir_const(2));
+    IRInstr *c2 = append_instr(fb, IR_CALL, 4, (IRValue){0}, (IRValue){0});
+    c2->extra.call.func_id = 0;
+    c2->extra.call.args = malloc(sizeof(IRValue));
+    c2->extra.call.args[0] = (IRValue){.id = 3};
+    c2->extra.call.nargs = 1;
+    append_instr(fb, IR_ADD, 5, (IRValue){.id = 2}, (IRValue){.id = 4});
+    append_instr(fb, IR_RETURN, -1, (IRValue){.id = 5}, (IRValue){0});
+    
+    // bump(): total = total + 1, with total a program variable
+    CFG *bump_cfg = cfg_new();
+    BasicBlock *bb = cfg_add_block(bump_cfg);
+    append_instr(bb, IR_ADD, 0, (IRValue){.id = 0}, ir_const(1));
+    append_instr(bb, IR_RETURN, -1, ir_const(0), (IRValue){0});
+    
+    // twice(): bump(); return 2
+    CFG *twice_cfg = cfg_new();
+    BasicBlock *tb = cfg_add_block(twice_cfg);
+    IRInstr *c3 = append_instr(tb, IR_CALL, 0, (IRValue){0}, (IRValue){0});
+    c3->extra.call.func_id = 1;
+    append_instr(tb, IR_RETURN, -1, ir_const(2), (IRValue){0});
+    
+    CFG *cfgs[3] = {fib_cfg, bump_cfg, twice_cfg};
+    const char *names[3] = {"fib", "bump", "twice"};
+    for (int i = 0; i < 3; i++) {
+        FunctionInfo func;
+        memset(&func, 0, sizeof(func));
+        func.name = strdup(names[i]);
+        func.cfg = cfgs[i];
+        func.return_val = (IRValue){.id = -1};
+        if (i == 0) {
+            func.params = malloc(sizeof(IRValue));
+            func.params[0] = (IRValue){.id = 0};
+            func.nparam = 1;
+        } else if (i == 1) {
+            func.globals = malloc(sizeof(IRValue));
+            func.globals[0] = (IRValue){.id = 0};
+            func.nglobals = 1;
+        }
+        function_table_add(table, &func);
+    }
+    
+    CallGraph *graph = call_graph_new(table);
+    FunctionSummary *summaries = build_function_summaries(graph);
+    identify_pure_functions(graph, summaries);
+    ASSERT(summaries[0].is_pure && !summaries[0].calls_external);
+    ASSERT(!summaries[1].is_pure && summaries[1].modifies_globals);
+    ASSERT(!summaries[2].is_pure && !summaries[2].modifies_globals);
+    
+    function_summaries_free(summaries, table->nfunctions);
+    call_graph_free(graph);
+    return true;
+}
+
+/**
+ * @brief Tests reading a profile and looking up its sites.
+ */
+static bool test_profile_lookup(void) {
+    const char *path = "test_profile_lookup.drprof";
+    FILE *f = fopen(path, "w");
+    ASSERT(f != NULL);
+    fprintf(f, "drprof 1\n"
+               "func main 1\n"
+               "func Math.square 400\n"
+               "func unused 0\n"
+               "call main 3 0 Math.square 250\n"
+               "call main 7 1 Math.square 150\n"
+               "branch main 5 5 90 10\n"
+               "branch main 5 5 9 1\n"
+               "future record\n");
+    fclose(f);
+    
+    Profile *profile = profile_load(path);
+    remove(path);
+    ASSERT(profile != NULL);
+    ASSERT(profile_calls_to(profile, "Math.square") == 400);
+    ASSERT(profile_calls_to(profile, "unused") == 0);
+    ASSERT(profile_hot_threshold(profile) == 4);
+    
+    const ProfileEntry *e = profile_lookup(profile, PROFILE_FUNC, "unused", 0, 0, NULL);
+    ASSERT(e && e->count[0] == 0);
+    // A site recorded twice is summed
+    e = profile_lookup(profile, PROFILE_BRANCH, "main", 5, 5, NULL);
+    ASSERT(e && e->count[0] == 99 && e->count[1] == 11);
+    e = profile_lookup(profile, PROFILE_CALL, "main", 7, 1, "Math.square");
+    ASSERT(e && e->count[0] == 150);
+    ASSERT(!profile_lookup(profile, PROFILE_CALL, "main", 7, 0, "Math.square"));
+    ASSERT(!profile_lookup(profile, PROFILE_FUNC, "missing", 0, 0, NULL));
+    
+    profile_free(profile);
+    ASSERT(profile_load("missing.drprof") == NULL);
+    return true;
+}
+
 /**
  * @brief Main test runner.
  */
@@ -416,9 +855,15 @@ int main(void) {
     TEST(function_table);
     TEST(inline_cost_calculation);
     TEST(should_inline_decision);
+    TEST(inline_call_site);
     
     // Interprocedural analysis tests
     TEST(call_graph_construction);
+    TEST(call_site_specialization);
+    TEST(sccp_keeps_traps);
+    TEST(tail_recursion_elimination);
+    TEST(pure_function_identification);
+    TEST(profile_lookup);
     
     // Register allocation tests
     TEST(liveness_analysis);
@@ -430,6 +875,9 @@ int main(void) {
     TEST(loop_discovery);
     TEST(induction_variable_analysis);
     
+    // Value-range propagation tests
+    TEST(value_range_propagation);
+    
     printf("Test Results\n");
     printf("============\n");
     printf("Tests run: %d\n", test_count);